@@ -16,8 +16,11 @@
 #include <assert.h>
 #include <ctype.h>
 #include <limits.h>
+#include <pthread.h>
 #include <regex.h>
+#include <stdarg.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/param.h>
 #include <sys/types.h>
@@ -25,7 +28,10 @@
 
 /* libopenarc includes */
 #include "arc-canon.h"
+#include "arc-capture.h"
+#include "arc-hdrcanon.h"
 #include "arc-internal.h"
+#include "arc-sha256.h"
 #include "arc-tables.h"
 #include "arc-types.h"
 #include "arc-util.h"
@@ -53,21 +59,104 @@
 /* prototypes */
 extern void arc_error(ARC_MESSAGE *, const char *, ...);
 
+/* body hashing pool */
+#define ARC_BODYERRLEN 128
+
+/* struct arc_bodyjob -- one body canonicalization given to the pool */
+struct arc_bodyjob
+{
+    ARC_CANON *bj_canon;
+    char       bj_error[ARC_BODYERRLEN]; /* first error, reported later */
+};
+
+/* struct arc_bodyworker -- one body hashing helper thread */
+struct arc_bodyworker
+{
+    unsigned int         bw_slot;
+    pthread_t            bw_thread;
+    struct arc_dstring  *bw_fixbuf;
+    struct arc_bodypool *bw_pool;
+};
+
+/* struct arc_bodypool -- body hashing helper threads for one message */
+struct arc_bodypool
+{
+    bool                   bp_quit;
+    unsigned int           bp_nthreads;
+    unsigned int           bp_ncanons;
+    unsigned int           bp_pending;
+    unsigned long          bp_gen;
+    ARC_STAT               bp_status;
+    size_t                 bp_buflen;
+    const char            *bp_buf;
+    ARC_MESSAGE           *bp_msg;
+    struct arc_bodyjob    *bp_jobs;
+    struct arc_bodyworker *bp_workers;
+    pthread_mutex_t        bp_lock;
+    pthread_cond_t         bp_work;
+    pthread_cond_t         bp_done;
+};
+
 /* ========================= PRIVATE SECTION ========================= */
 
+/*
+**  ARC_CANON_KEEPCTX -- set aside a digest context for reuse
+**
+**  Parameters:
+**  	msg -- ARC message handle
+**  	ctx -- digest context no longer needed by its canonicalization
+**
+**  Return value:
+**  	true iff the context was kept; otherwise the caller must free it.
+*/
+
+static bool
+arc_canon_keepctx(ARC_MESSAGE *msg, EVP_MD_CTX *ctx)
+{
+    if (msg->arc_nhashctxs == msg->arc_hashctxsz)
+    {
+        unsigned int newsz;
+        EVP_MD_CTX **new;
+
+        newsz = msg->arc_hashctxsz == 0 ? 8 : msg->arc_hashctxsz * 2;
+        new = ARC_LREALLOC(ARC_MSGALLOC(msg), msg->arc_hashctxs,
+                           newsz * sizeof *new);
+        if (new == NULL)
+        {
+            return false;
+        }
+
+        msg->arc_hashctxs = new;
+        msg->arc_hashctxsz = newsz;
+    }
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+    if (EVP_MD_CTX_cleanup(ctx) != 1)
+#else
+    if (EVP_MD_CTX_reset(ctx) != 1)
+#endif /* OpenSSL < 1.1.0 */
+    {
+        return false;
+    }
+
+    msg->arc_hashctxs[msg->arc_nhashctxs++] = ctx;
+    return true;
+}
+
 /*
 **  ARC_CANON_FREE -- destroy a canonicalization
 **
 **  Parameters:
 **  	msg -- ARC message handle
 **  	canon -- canonicalization to destroy
+**  	keep -- keep its digest context for the message's next use
 **
 **  Return value:
 **  	None.
 */
 
 static void
-arc_canon_free(ARC_MESSAGE *msg, ARC_CANON *canon)
+arc_canon_free(ARC_MESSAGE *msg, ARC_CANON *canon, bool keep)
 {
     assert(msg != NULL);
     if (canon == NULL)
@@ -77,18 +166,21 @@ arc_canon_free(ARC_MESSAGE *msg, ARC_CANON *canon)
 
     if (canon->canon_hash != NULL)
     {
+        EVP_MD_CTX *ctx = canon->canon_hash->hash_ctx;
+
+        if (ctx != NULL && !(keep && arc_canon_keepctx(msg, ctx)))
+        {
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
-        EVP_MD_CTX_destroy(canon->canon_hash->hash_ctx);
+            EVP_MD_CTX_destroy(ctx);
 #else
-        EVP_MD_CTX_free(canon->canon_hash->hash_ctx);
+            EVP_MD_CTX_free(ctx);
 #endif /* OpenSSL < 1.1.0 */
+        }
         BIO_free(canon->canon_hash->hash_tmpbio);
-        ARC_FREE(canon->canon_hash);
     }
 
-    ARC_FREE(canon->canon_hashbuf);
+    /* the canon, its hash and its buffer belong to the message arena */
     arc_dstring_free(canon->canon_buf);
-    ARC_FREE(canon);
 }
 
 /*
@@ -122,11 +214,23 @@ arc_canon_write(ARC_CANON *canon, const char *buf, size_t buflen)
 
     assert(canon->canon_hash != NULL);
 
-    EVP_DigestUpdate(canon->canon_hash->hash_ctx, buf, buflen);
+    if (canon->canon_hash->hash_builtin)
+    {
+        arc_sha256_update(&canon->canon_hash->hash_sha256, buf, buflen);
+    }
+    else
+    {
+        EVP_DigestUpdate(canon->canon_hash->hash_ctx, buf, buflen);
+    }
     if (canon->canon_hash->hash_tmpbio != NULL)
     {
         BIO_write(canon->canon_hash->hash_tmpbio, buf, buflen);
     }
+    if (canon->canon_capture != NULL)
+    {
+        arc_capture_write(canon->canon_capture, canon->canon_capid, buf,
+                          buflen);
+    }
 
     if (canon->canon_remain != (ssize_t) -1)
     {
@@ -207,17 +311,11 @@ arc_canon_header_string(struct arc_dstring *dstr,
                         size_t              hdrlen,
                         bool                crlf)
 {
-    bool        space;
-    const char *p;
-    char       *tmp;
-    char       *end;
-    char        tmpbuf[BUFRSZ];
+    size_t len;
+
     assert(dstr != NULL);
     assert(hdr != NULL);
 
-    tmp = tmpbuf;
-    end = tmpbuf + sizeof tmpbuf - 1;
-
     switch (canon)
     {
     case ARC_CANON_SIMPLE:
@@ -229,127 +327,16 @@ arc_canon_header_string(struct arc_dstring *dstr,
         break;
 
     case ARC_CANON_RELAXED:
-        /* process header field name (before colon) first */
-        for (p = hdr; p < hdr + hdrlen; p++)
-        {
-            /*
-            **  Discard spaces before the colon or before the end
-            **  of the first word.
-            */
-
-            if (isascii(*p))
-            {
-                /* discard spaces */
-                if (ARC_ISLWSP(*p))
-                {
-                    continue;
-                }
-
-                /* convert to lowercase */
-                if (isupper(*p))
-                {
-                    *tmp++ = tolower(*p);
-                }
-                else
-                {
-                    *tmp++ = *p;
-                }
-            }
-            else
-            {
-                *tmp++ = *p;
-            }
-
-            /* reaching the end of the cache buffer, flush it */
-            if (tmp == end)
-            {
-                *tmp = '\0';
-
-                if (!arc_dstring_catn(dstr, tmpbuf, tmp - tmpbuf))
-                {
-                    return ARC_STAT_NORESOURCE;
-                }
-
-                tmp = tmpbuf;
-            }
-
-            if (*p == ':')
-            {
-                p++;
-                break;
-            }
-        }
-
-        /* skip all spaces before first word */
-        while (*p != '\0' && ARC_ISLWSP(*p))
-        {
-            p++;
-        }
-
-        space = false; /* just saw a space */
-
-        for (; *p != '\0'; p++)
+        /* relaxed output is never longer than its input */
+        if (!arc_dstring_reserve(dstr, hdrlen + 2))
         {
-            if (isascii(*p) && isspace(*p))
-            {
-                /* mark that there was a space and continue */
-                space = true;
-
-                continue;
-            }
-
-            /*
-            **  Any non-space marks the beginning of a word.
-            **  If there's a stored space, use it up.
-            */
-
-            if (space)
-            {
-                *tmp++ = ' ';
-
-                /* flush buffer? */
-                if (tmp == end)
-                {
-                    *tmp = '\0';
-
-                    if (!arc_dstring_catn(dstr, tmpbuf, tmp - tmpbuf))
-                    {
-                        return ARC_STAT_NORESOURCE;
-                    }
-
-                    tmp = tmpbuf;
-                }
-
-                space = false;
-            }
-
-            /* copy the byte */
-            *tmp++ = *p;
-
-            /* flush buffer? */
-            if (tmp == end)
-            {
-                *tmp = '\0';
-
-                if (!arc_dstring_catn(dstr, tmpbuf, tmp - tmpbuf))
-                {
-                    return ARC_STAT_NORESOURCE;
-                }
-
-                tmp = tmpbuf;
-            }
+            return ARC_STAT_NORESOURCE;
         }
 
-        /* flush any cached data */
-        if (tmp != tmpbuf)
-        {
-            *tmp = '\0';
-
-            if (!arc_dstring_catn(dstr, tmpbuf, tmp - tmpbuf))
-            {
-                return ARC_STAT_NORESOURCE;
-            }
-        }
+        len = arc_hdrcanon_relaxed(arc_dstring_get(dstr) +
+                                       arc_dstring_len(dstr),
+                                   hdr, hdrlen);
+        arc_dstring_commit(dstr, len);
 
         if (crlf && !arc_dstring_catn(dstr, CRLF, 2))
         {
@@ -390,7 +377,7 @@ arc_canon_header(ARC_MESSAGE         *msg,
     if (msg->arc_canonbuf == NULL)
     {
         msg->arc_canonbuf = arc_dstring_new(hdr->hdr_textlen, 0, msg,
-                                            &arc_error_cb);
+                                            &arc_error_cb, ARC_MSGALLOC(msg));
         if (msg->arc_canonbuf == NULL)
         {
             return ARC_STAT_NORESOURCE;
@@ -449,75 +436,702 @@ arc_canon_flushblanks(ARC_CANON *canon)
 **  	canon -- canonicalization being handled
 **  	buf -- buffer to be fixed
 **  	buflen -- number of bytes at "buf"
+**  	out -- output buffer; allocated if NULL
 **
 **  Return value:
 **  	A ARC_STAT_* constant.
-**
-**  Side effects:
-**  	msg->arc_canonbuf will be initialized and used.
 */
 
 static ARC_STAT
-arc_canon_fixcrlf(ARC_MESSAGE *msg,
-                  ARC_CANON   *canon,
-                  const char  *buf,
-                  size_t       buflen)
+arc_canon_fixcrlf(ARC_MESSAGE         *msg,
+                  ARC_CANON           *canon,
+                  const char          *buf,
+                  size_t               buflen,
+                  struct arc_dstring **out)
 {
-    char        prev;
-    const char *p;
-    const char *eob;
+    char                prev;
+    const char         *p;
+    const char         *eob;
+    struct arc_dstring *fixed;
 
     assert(msg != NULL);
     assert(canon != NULL);
     assert(buf != NULL);
+    assert(out != NULL);
+
+    if (*out == NULL)
+    {
+        *out = arc_dstring_new(buflen, 0, msg, &arc_error_cb,
+                               ARC_MSGALLOC(msg));
+        if (*out == NULL)
+        {
+            return ARC_STAT_NORESOURCE;
+        }
+    }
+    else
+    {
+        arc_dstring_blank(*out);
+    }
+
+    fixed = *out;
+
+    /* most chunks need no fixing at all */
+    arc_dstring_reserve(fixed, buflen);
+
+    eob = buf + buflen - 1;
+
+    prev = canon->canon_lastchar;
+
+    for (p = buf; p <= eob; p++)
+    {
+        if (*p == '\n' && prev != '\r')
+        {
+            /* fix a solitary LF */
+            arc_dstring_catn(fixed, CRLF, 2);
+        }
+        else if (*p == '\r')
+        {
+            if (p < eob && *(p + 1) != '\n')
+            {
+                /* fix a solitary CR */
+                arc_dstring_catn(fixed, CRLF, 2);
+            }
+            else
+            {
+                /* CR at EOL, or CR followed by a LF */
+                arc_dstring_cat1(fixed, *p);
+            }
+        }
+        else
+        {
+            /* something else; copy up to the next line ending */
+            const char *q;
+
+            for (q = p + 1; q <= eob && *q != '\r' && *q != '\n'; q++)
+            {
+                continue;
+            }
+            arc_dstring_catn(fixed, p, q - p);
+            p = q - 1;
+        }
+
+        prev = *p;
+    }
+
+    return ARC_STAT_OK;
+}
+
+/*
+**  ARC_CANON_BODYCANON -- run a body chunk through one body canonicalization
+**
+**  Parameters:
+**  	msg -- ARC message handle
+**  	cur -- canonicalization to update
+**  	buf -- pointer to bytes to canonicalize
+**  	buflen -- number of bytes to canonicalize
+**  	fixbuf -- scratch buffer for ARC_LIBFLAGS_FIXCRLF
+**
+**  Return value:
+**  	A ARC_STAT_* constant.
+*/
+
+static ARC_STAT
+arc_canon_bodycanon(ARC_MESSAGE         *msg,
+                    ARC_CANON           *cur,
+                    const char          *buf,
+                    size_t               buflen,
+                    struct arc_dstring **fixbuf)
+{
+    bool         fixcrlf;
+    ARC_STAT     status;
+    unsigned int wlen;
+    size_t       plen;
+    const char  *p;
+    const char  *wrote;
+    const char  *eob;
+    const char  *start;
+
+    fixcrlf = (msg->arc_library->arcl_flags & ARC_LIBFLAGS_FIXCRLF);
+
+    start = buf;
+    plen = buflen;
+
+    if (fixcrlf)
+    {
+        status = arc_canon_fixcrlf(msg, cur, buf, buflen, fixbuf);
+        if (status != ARC_STAT_OK)
+        {
+            return status;
+        }
+
+        start = arc_dstring_get(*fixbuf);
+        plen = arc_dstring_len(*fixbuf);
+    }
+
+    eob = start + plen - 1;
+    wrote = start;
+    wlen = 0;
+
+    switch (cur->canon_canon)
+    {
+    case ARC_CANON_SIMPLE:
+        for (p = start; p <= eob; p++)
+        {
+            if (*p == '\n')
+            {
+                if (cur->canon_lastchar == '\r')
+                {
+                    if (cur->canon_blankline)
+                    {
+                        cur->canon_blanks++;
+                    }
+                    else if (wlen == 1 || p == start)
+                    {
+                        arc_canon_buffer(cur, CRLF, 2);
+                    }
+                    else
+                    {
+                        arc_canon_buffer(cur, wrote, wlen + 1);
+                    }
+
+                    wrote = p + 1;
+                    wlen = 0;
+                    cur->canon_blankline = true;
+                }
+            }
+            else
+            {
+                if (p == start && cur->canon_lastchar == '\r')
+                {
+                    if (fixcrlf)
+                    {
+                        arc_canon_buffer(cur, CRLF, 2);
+                        cur->canon_lastchar = '\n';
+                        cur->canon_blankline = true;
+                    }
+                    else
+                    {
+                        arc_canon_buffer(cur, "\r", 1);
+                    }
+                }
+
+                if (*p != '\r')
+                {
+                    if (cur->canon_blanks > 0)
+                    {
+                        arc_canon_flushblanks(cur);
+                    }
+                    cur->canon_blankline = false;
+                }
+
+                wlen++;
+            }
+
+            cur->canon_lastchar = *p;
+        }
+
+        if (wlen > 0 && wrote[wlen - 1] == '\r')
+        {
+            wlen--;
+        }
+
+        arc_canon_buffer(cur, wrote, wlen);
+
+        break;
+
+    case ARC_CANON_RELAXED:
+        for (p = start; p <= eob; p++)
+        {
+            switch (cur->canon_bodystate)
+            {
+            case 0:
+                if (ARC_ISWSP(*p))
+                {
+                    cur->canon_bodystate = 1;
+                }
+                else if (*p == '\r')
+                {
+                    cur->canon_bodystate = 2;
+                }
+                else
+                {
+                    cur->canon_blankline = false;
+                    arc_dstring_cat1(cur->canon_buf, *p);
+                    cur->canon_bodystate = 3;
+                }
+                break;
+
+            case 1:
+                if (ARC_ISWSP(*p))
+                {
+                    break;
+                }
+                else if (*p == '\r')
+                {
+                    cur->canon_bodystate = 2;
+                }
+                else
+                {
+                    arc_canon_flushblanks(cur);
+                    arc_canon_buffer(cur, SP, 1);
+                    cur->canon_blankline = false;
+                    arc_dstring_cat1(cur->canon_buf, *p);
+                    cur->canon_bodystate = 3;
+                }
+                break;
+
+            case 2:
+                if (fixcrlf || *p == '\n')
+                {
+                    if (cur->canon_blankline)
+                    {
+                        cur->canon_blanks++;
+                        cur->canon_bodystate = 0;
+                    }
+                    else
+                    {
+                        arc_canon_flushblanks(cur);
+                        arc_canon_buffer(cur,
+                                         arc_dstring_get(cur->canon_buf),
+                                         arc_dstring_len(cur->canon_buf));
+                        arc_canon_buffer(cur, CRLF, 2);
+                        arc_dstring_blank(cur->canon_buf);
+
+                        if (*p == '\n')
+                        {
+                            cur->canon_blankline = true;
+                            cur->canon_bodystate = 0;
+                        }
+                        else if (*p == '\r')
+                        {
+                            cur->canon_blankline = true;
+                        }
+                        else
+                        {
+                            if (ARC_ISWSP(*p))
+                            {
+                                cur->canon_bodystate = 1;
+                            }
+                            else
+                            {
+                                arc_dstring_cat1(cur->canon_buf, *p);
+                                cur->canon_bodystate = 3;
+                            }
+                        }
+                    }
+                }
+                else if (*p == '\r')
+                {
+                    cur->canon_blankline = false;
+                    arc_dstring_cat1(cur->canon_buf, *p);
+                }
+                else if (ARC_ISWSP(*p))
+                {
+                    arc_canon_flushblanks(cur);
+                    arc_canon_buffer(cur, arc_dstring_get(cur->canon_buf),
+                                     arc_dstring_len(cur->canon_buf));
+                    arc_dstring_blank(cur->canon_buf);
+                    cur->canon_bodystate = 1;
+                }
+                else
+                {
+                    cur->canon_blankline = false;
+                    arc_dstring_cat1(cur->canon_buf, *p);
+                    cur->canon_bodystate = 3;
+                }
+                break;
+
+            case 3:
+                if (ARC_ISWSP(*p))
+                {
+                    arc_canon_flushblanks(cur);
+                    arc_canon_buffer(cur, arc_dstring_get(cur->canon_buf),
+                                     arc_dstring_len(cur->canon_buf));
+                    arc_dstring_blank(cur->canon_buf);
+                    cur->canon_bodystate = 1;
+                }
+                else if (*p == '\r')
+                {
+                    cur->canon_bodystate = 2;
+                }
+                else
+                {
+                    /* take the rest of the word in one go */
+                    const char *q;
+
+                    for (q = p + 1;
+                         q <= eob && !ARC_ISWSP(*q) && *q != '\r'; q++)
+                    {
+                        continue;
+                    }
+                    arc_dstring_catn(cur->canon_buf, p, q - p);
+                    p = q - 1;
+                }
+                break;
+            }
+
+            cur->canon_lastchar = *p;
+        }
+
+        arc_canon_buffer(cur, NULL, 0);
+
+        break;
+
+    default:
+        assert(0);
+        /* NOTREACHED */
+    }
+
+    arc_canon_buffer(cur, NULL, 0);
+
+    return ARC_STAT_OK;
+}
+
+/*
+**  ARC_BODYPOOL_ERROR -- record an error raised while running a pool job
+**
+**  Parameters:
+**  	ctx -- struct arc_bodyjob that hit the error
+**  	format -- format string
+**  	... -- arguments
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Helper threads must not touch the message's error string, so the
+**  	first error is kept in the job and handed to arc_error() by the
+**  	calling thread once the chunk is done.
+*/
+
+static void
+arc_bodypool_error(void *ctx, const char *format, ...)
+{
+    va_list             va;
+    struct arc_bodyjob *job = ctx;
+
+    if (job->bj_error[0] != '\0')
+    {
+        return;
+    }
+
+    va_start(va, format);
+    vsnprintf(job->bj_error, sizeof job->bj_error, format, va);
+    va_end(va);
+}
+
+/*
+**  ARC_BODYPOOL_SLOT -- run the current chunk through one thread's share of
+**                       the body canonicalizations
+**
+**  Parameters:
+**  	pool -- body hashing pool
+**  	slot -- which share to process (0 is the calling thread)
+**  	fixbuf -- scratch buffer for ARC_LIBFLAGS_FIXCRLF
+**
+**  Return value:
+**  	A ARC_STAT_* constant.
+*/
+
+static ARC_STAT
+arc_bodypool_slot(struct arc_bodypool *pool,
+                  unsigned int         slot,
+                  struct arc_dstring **fixbuf)
+{
+    unsigned int c;
+    ARC_STAT     status;
+
+    for (c = slot; c < pool->bp_ncanons; c += pool->bp_nthreads + 1)
+    {
+        /* a helper's scratch buffer reports to the job it is working on */
+        if (slot != 0 && *fixbuf != NULL)
+        {
+            (*fixbuf)->ds_ctx = &pool->bp_jobs[c];
+        }
+
+        status = arc_canon_bodycanon(pool->bp_msg, pool->bp_jobs[c].bj_canon,
+                                     pool->bp_buf, pool->bp_buflen, fixbuf);
+        if (status != ARC_STAT_OK)
+        {
+            return status;
+        }
+    }
+
+    return ARC_STAT_OK;
+}
+
+/*
+**  ARC_BODYPOOL_WORKER -- helper thread hashing body canonicalizations
+**
+**  Parameters:
+**  	arg -- struct arc_bodyworker for this thread
+**
+**  Return value:
+**  	NULL.
+*/
+
+static void *
+arc_bodypool_worker(void *arg)
+{
+    unsigned long          seen = 0;
+    ARC_STAT               status;
+    struct arc_bodyworker *w = arg;
+    struct arc_bodypool   *pool = w->bw_pool;
+
+    pthread_mutex_lock(&pool->bp_lock);
+
+    for (;;)
+    {
+        while (!pool->bp_quit && pool->bp_gen == seen)
+        {
+            pthread_cond_wait(&pool->bp_work, &pool->bp_lock);
+        }
+
+        if (pool->bp_quit)
+        {
+            break;
+        }
+
+        seen = pool->bp_gen;
+        pthread_mutex_unlock(&pool->bp_lock);
+
+        status = arc_bodypool_slot(pool, w->bw_slot, &w->bw_fixbuf);
+
+        pthread_mutex_lock(&pool->bp_lock);
+        if (status != ARC_STAT_OK)
+        {
+            pool->bp_status = status;
+        }
+        pool->bp_pending--;
+        if (pool->bp_pending == 0)
+        {
+            pthread_cond_signal(&pool->bp_done);
+        }
+    }
+
+    pthread_mutex_unlock(&pool->bp_lock);
+
+    return NULL;
+}
+
+/*
+**  ARC_BODYPOOL_STOP -- shut down body hashing helper threads
+**
+**  Parameters:
+**  	msg -- ARC message handle
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+arc_bodypool_stop(ARC_MESSAGE *msg)
+{
+    unsigned int         c;
+    struct arc_bodypool *pool;
+
+    assert(msg != NULL);
+
+    pool = msg->arc_bodypool;
+    if (pool == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->bp_lock);
+    pool->bp_quit = true;
+    pthread_cond_broadcast(&pool->bp_work);
+    pthread_mutex_unlock(&pool->bp_lock);
+
+    for (c = 0; c < pool->bp_nthreads; c++)
+    {
+        pthread_join(pool->bp_workers[c].bw_thread, NULL);
+        arc_dstring_free(pool->bp_workers[c].bw_fixbuf);
+    }
+
+    /* the rest of the body is hashed on the calling thread again */
+    for (c = 0; c < pool->bp_ncanons; c++)
+    {
+        pool->bp_jobs[c].bj_canon->canon_buf->ds_ctx = msg;
+        pool->bp_jobs[c].bj_canon->canon_buf->ds_cb = &arc_error_cb;
+    }
+
+    pthread_cond_destroy(&pool->bp_done);
+    pthread_cond_destroy(&pool->bp_work);
+    pthread_mutex_destroy(&pool->bp_lock);
+    ARC_LFREE(ARC_MSGALLOC(msg), pool->bp_workers);
+    ARC_LFREE(ARC_MSGALLOC(msg), pool->bp_jobs);
+    ARC_LFREE(ARC_MSGALLOC(msg), pool);
+
+    msg->arc_bodypool = NULL;
+}
+
+/*
+**  ARC_BODYPOOL_START -- start helper threads for body hashing
+**
+**  Parameters:
+**  	msg -- ARC message handle
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Nothing is started unless there are at least two body
+**  	canonicalizations to spread around.  Failure isn't fatal; hashing
+**  	just stays on the calling thread.
+*/
+
+static void
+arc_bodypool_start(ARC_MESSAGE *msg)
+{
+    unsigned int         c;
+    unsigned int         ncanons = 0;
+    ARC_CANON           *cur;
+    struct arc_bodyjob  *job;
+    struct arc_bodypool *pool;
+
+    assert(msg != NULL);
+
+    for (cur = msg->arc_canonhead; cur != NULL; cur = cur->canon_next)
+    {
+        if (!cur->canon_done && cur->canon_type == ARC_CANONTYPE_BODY)
+        {
+            ncanons++;
+        }
+    }
+
+    if (ncanons < 2)
+    {
+        return;
+    }
+
+    pool = ARC_LCALLOC(ARC_MSGALLOC(msg), 1, sizeof *pool);
+    if (pool == NULL)
+    {
+        return;
+    }
+
+    pool->bp_msg = msg;
+    pool->bp_status = ARC_STAT_OK;
+    pool->bp_jobs = ARC_LCALLOC(ARC_MSGALLOC(msg), ncanons,
+                                sizeof(struct arc_bodyjob));
+    pool->bp_workers = ARC_LCALLOC(
+        ARC_MSGALLOC(msg), MIN(ncanons - 1, msg->arc_library->arcl_bodythreads),
+        sizeof(struct arc_bodyworker));
+    if (pool->bp_jobs == NULL || pool->bp_workers == NULL)
+    {
+        ARC_LFREE(ARC_MSGALLOC(msg), pool->bp_jobs);
+        ARC_LFREE(ARC_MSGALLOC(msg), pool->bp_workers);
+        ARC_LFREE(ARC_MSGALLOC(msg), pool);
+        return;
+    }
+
+    /* fix the assignment up front so threads never walk the shared list */
+    for (cur = msg->arc_canonhead; cur != NULL; cur = cur->canon_next)
+    {
+        if (!cur->canon_done && cur->canon_type == ARC_CANONTYPE_BODY)
+        {
+            job = &pool->bp_jobs[pool->bp_ncanons++];
+            job->bj_canon = cur;
+            cur->canon_buf->ds_ctx = job;
+            cur->canon_buf->ds_cb = &arc_bodypool_error;
+        }
+    }
+
+    pthread_mutex_init(&pool->bp_lock, NULL);
+    pthread_cond_init(&pool->bp_work, NULL);
+    pthread_cond_init(&pool->bp_done, NULL);
+
+    msg->arc_bodypool = pool;
+
+    for (c = 0; c < MIN(ncanons - 1, msg->arc_library->arcl_bodythreads); c++)
+    {
+        pool->bp_workers[c].bw_pool = pool;
+        pool->bp_workers[c].bw_slot = c + 1;
+
+        /* made here so arc_canon_fixcrlf() never reports via the message */
+        if (msg->arc_library->arcl_flags & ARC_LIBFLAGS_FIXCRLF)
+        {
+            pool->bp_workers[c].bw_fixbuf = arc_dstring_new(
+                BUFRSZ, 0, NULL, &arc_bodypool_error, ARC_MSGALLOC(msg));
+            if (pool->bp_workers[c].bw_fixbuf == NULL)
+            {
+                break;
+            }
+        }
+
+        if (pthread_create(&pool->bp_workers[c].bw_thread, NULL,
+                           arc_bodypool_worker, &pool->bp_workers[c]) != 0)
+        {
+            arc_dstring_free(pool->bp_workers[c].bw_fixbuf);
+            break;
+        }
+
+        pool->bp_nthreads++;
+    }
+
+    if (pool->bp_nthreads == 0)
+    {
+        arc_bodypool_stop(msg);
+    }
+}
+
+/*
+**  ARC_BODYPOOL_RUN -- hash a body chunk using the helper threads
+**
+**  Parameters:
+**  	msg -- ARC message handle
+**  	buf -- pointer to bytes to canonicalize
+**  	buflen -- number of bytes to canonicalize
+**
+**  Return value:
+**  	A ARC_STAT_* constant.
+**
+**  Notes:
+**  	The calling thread takes its own share of the canonicalizations
+**  	and then waits for the helpers, so "buf" need not outlive the call.
+*/
+
+static ARC_STAT
+arc_bodypool_run(ARC_MESSAGE *msg, const char *buf, size_t buflen)
+{
+    unsigned int         c;
+    ARC_STAT             status;
+    struct arc_bodypool *pool;
+
+    pool = msg->arc_bodypool;
 
-    if (msg->arc_canonbuf == NULL)
+    pthread_mutex_lock(&pool->bp_lock);
+    pool->bp_buf = buf;
+    pool->bp_buflen = buflen;
+    pool->bp_pending = pool->bp_nthreads;
+    pool->bp_gen++;
+    pthread_cond_broadcast(&pool->bp_work);
+    pthread_mutex_unlock(&pool->bp_lock);
+
+    status = arc_bodypool_slot(pool, 0, &msg->arc_canonbuf);
+
+    pthread_mutex_lock(&pool->bp_lock);
+    while (pool->bp_pending > 0)
     {
-        msg->arc_canonbuf = arc_dstring_new(buflen, 0, msg, &arc_error_cb);
-        if (msg->arc_canonbuf == NULL)
-        {
-            return ARC_STAT_NORESOURCE;
-        }
+        pthread_cond_wait(&pool->bp_done, &pool->bp_lock);
     }
-    else
+    if (status == ARC_STAT_OK)
     {
-        arc_dstring_blank(msg->arc_canonbuf);
+        status = pool->bp_status;
     }
+    pthread_mutex_unlock(&pool->bp_lock);
 
-    eob = buf + buflen - 1;
-
-    prev = canon->canon_lastchar;
-
-    for (p = buf; p <= eob; p++)
+    for (c = 0; c < pool->bp_ncanons; c++)
     {
-        if (*p == '\n' && prev != '\r')
-        {
-            /* fix a solitary LF */
-            arc_dstring_catn(msg->arc_canonbuf, CRLF, 2);
-        }
-        else if (*p == '\r')
-        {
-            if (p < eob && *(p + 1) != '\n')
-            {
-                /* fix a solitary CR */
-                arc_dstring_catn(msg->arc_canonbuf, CRLF, 2);
-            }
-            else
-            {
-                /* CR at EOL, or CR followed by a LF */
-                arc_dstring_cat1(msg->arc_canonbuf, *p);
-            }
-        }
-        else
+        if (pool->bp_jobs[c].bj_error[0] != '\0')
         {
-            /* something else */
-            arc_dstring_cat1(msg->arc_canonbuf, *p);
+            arc_error(msg, "%s", pool->bp_jobs[c].bj_error);
+            pool->bp_jobs[c].bj_error[0] = '\0';
         }
-
-        prev = *p;
     }
 
-    return ARC_STAT_OK;
+    return status;
 }
 
 /* ========================= PUBLIC SECTION ========================= */
@@ -551,7 +1165,7 @@ arc_canon_init(ARC_MESSAGE *msg, bool tmp, bool keep)
             /* already initialized, nothing to do */
             continue;
         }
-        cur->canon_hashbuf = ARC_MALLOC(ARC_HASHBUFSIZE);
+        cur->canon_hashbuf = ARC_AMALLOC(msg->arc_arena, ARC_HASHBUFSIZE);
         if (cur->canon_hashbuf == NULL)
         {
             arc_error(msg, "unable to allocate %d byte(s)", ARC_HASHBUFSIZE);
@@ -559,13 +1173,17 @@ arc_canon_init(ARC_MESSAGE *msg, bool tmp, bool keep)
         }
         cur->canon_hashbufsize = ARC_HASHBUFSIZE;
         cur->canon_hashbuflen = 0;
-        cur->canon_buf = arc_dstring_new(BUFRSZ, BUFRSZ, msg, &arc_error_cb);
+        /* appended to from the body pool's threads, so not in the arena;
+         * most words fit in the inline buffer anyway */
+        cur->canon_buf = arc_dstring_new(BUFRSZ, 0, msg, &arc_error_cb,
+                                         ARC_MSGALLOC(msg));
         if (cur->canon_buf == NULL)
         {
             return ARC_STAT_NORESOURCE;
         }
 
-        cur->canon_hash = ARC_CALLOC(1, sizeof(struct arc_hash));
+        cur->canon_hash = ARC_ACALLOC(msg->arc_arena, 1,
+                                      sizeof(struct arc_hash));
         if (cur->canon_hash == NULL)
         {
             arc_error(msg, "unable to allocate %d bytes",
@@ -573,35 +1191,62 @@ arc_canon_init(ARC_MESSAGE *msg, bool tmp, bool keep)
             return ARC_STAT_NORESOURCE;
         }
 
-#if OPENSSL_VERSION_NUMBER < 0x10100000L
-        cur->canon_hash->hash_ctx = EVP_MD_CTX_create();
-#else
-        cur->canon_hash->hash_ctx = EVP_MD_CTX_new();
-#endif /* OpenSSL < 1.1.0 */
-        if (cur->canon_hash->hash_ctx == NULL)
+        if (cur->canon_hashtype == ARC_HASHTYPE_SHA256 &&
+            (msg->arc_library->arcl_flags & ARC_LIBFLAGS_BUILTINSHA) != 0 &&
+            msg->arc_library->arcl_sha256_block != NULL)
         {
-            arc_error(msg, "EVP_MD_CTX_new() failed");
-            return ARC_STAT_NORESOURCE;
-        }
-        if (cur->canon_hashtype == ARC_HASHTYPE_SHA1)
-        {
-            rc = EVP_DigestInit_ex(cur->canon_hash->hash_ctx, EVP_sha1(), NULL);
+            /* skip EVP dispatch for the many small writes canons make */
+            cur->canon_hash->hash_builtin = true;
+            arc_sha256_init(&cur->canon_hash->hash_sha256,
+                            msg->arc_library->arcl_sha256_block);
         }
         else
         {
-            rc = EVP_DigestInit_ex(cur->canon_hash->hash_ctx, EVP_sha256(),
-                                   NULL);
+            if (msg->arc_nhashctxs > 0)
+            {
+                /* left over from before arc_message_reset() */
+                cur->canon_hash->hash_ctx =
+                    msg->arc_hashctxs[--msg->arc_nhashctxs];
+            }
+            else
+            {
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+                cur->canon_hash->hash_ctx = EVP_MD_CTX_create();
+#else
+                cur->canon_hash->hash_ctx = EVP_MD_CTX_new();
+#endif /* OpenSSL < 1.1.0 */
+            }
+            if (cur->canon_hash->hash_ctx == NULL)
+            {
+                arc_error(msg, "EVP_MD_CTX_new() failed");
+                return ARC_STAT_NORESOURCE;
+            }
+            if (cur->canon_hashtype == ARC_HASHTYPE_SHA1)
+            {
+                rc = EVP_DigestInit_ex(cur->canon_hash->hash_ctx, EVP_sha1(),
+                                       NULL);
+            }
+            else
+            {
+                rc = EVP_DigestInit_ex(cur->canon_hash->hash_ctx, EVP_sha256(),
+                                       NULL);
+            }
+
+            if (rc <= 0)
+            {
+                arc_error(msg, "EVP_DigestInit_ex() failed");
+                return ARC_STAT_INTERNAL;
+            }
         }
 
-        if (rc <= 0)
+        /* one capture file per message beats a temporary file per canon */
+        if (msg->arc_capture != NULL)
         {
-            arc_error(msg, "EVP_DigestInit_ex() failed");
-            return ARC_STAT_INTERNAL;
+            arc_capture_attach(msg, cur);
         }
-
-        if (tmp)
+        else if (tmp)
         {
-            status = arc_tmpfile(msg, &fd, keep);
+            status = arc_tmpfile(msg, &fd, keep, NULL, 0);
             if (status != ARC_STAT_OK)
             {
                 return status;
@@ -633,21 +1278,70 @@ arc_canon_cleanup(ARC_MESSAGE *msg)
 
     assert(msg != NULL);
 
+    arc_bodypool_stop(msg);
+    arc_capture_close(msg);
+
     cur = msg->arc_canonhead;
     while (cur != NULL)
     {
         next = cur->canon_next;
 
-        arc_canon_free(msg, cur);
+        arc_canon_free(msg, cur, false);
 
         cur = next;
     }
 
+    while (msg->arc_nhashctxs > 0)
+    {
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+        EVP_MD_CTX_destroy(msg->arc_hashctxs[--msg->arc_nhashctxs]);
+#else
+        EVP_MD_CTX_free(msg->arc_hashctxs[--msg->arc_nhashctxs]);
+#endif /* OpenSSL < 1.1.0 */
+    }
+    ARC_LFREE(ARC_MSGALLOC(msg), msg->arc_hashctxs);
+    msg->arc_hashctxs = NULL;
+    msg->arc_hashctxsz = 0;
+
     msg->arc_canonhead = NULL;
     arc_dstring_free(msg->arc_canonbuf);
     msg->arc_canonbuf = NULL;
 }
 
+/*
+**  ARC_CANON_RESET -- discard canonicalizations but keep what can be reused
+**
+**  Parameters:
+**  	msg -- ARC message handle
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Digest contexts are set aside for arc_canon_init() to pick up again.
+**  	The canonicalizations themselves live in the message arena and must
+**  	not be used after this.
+*/
+
+void
+arc_canon_reset(ARC_MESSAGE *msg)
+{
+    ARC_CANON *cur;
+
+    assert(msg != NULL);
+
+    arc_bodypool_stop(msg);
+    arc_capture_close(msg);
+
+    for (cur = msg->arc_canonhead; cur != NULL; cur = cur->canon_next)
+    {
+        arc_canon_free(msg, cur, true);
+    }
+
+    msg->arc_canonhead = NULL;
+    msg->arc_canontail = NULL;
+}
+
 /*
 **  ARC_ADD_CANON -- add a new canonicalization handle if needed
 **
@@ -706,7 +1400,7 @@ arc_add_canon(ARC_MESSAGE         *msg,
         }
     }
 
-    new = ARC_MALLOC(sizeof *new);
+    new = ARC_AMALLOC(msg->arc_arena, sizeof *new);
     if (new == NULL)
     {
         arc_error(msg, "unable to allocate %d byte(s)", sizeof *new);
@@ -731,6 +1425,8 @@ arc_add_canon(ARC_MESSAGE         *msg,
     }
     new->canon_sigheader = sighdr;
     new->canon_hdrlist = hdrlist;
+    new->canon_capture = NULL;
+    new->canon_capid = 0;
     new->canon_buf = NULL;
     new->canon_next = NULL;
     new->canon_blankline = true;
@@ -825,7 +1521,7 @@ arc_canon_selecthdrs(ARC_MESSAGE          *msg,
 
     if (msg->arc_hdrlist == NULL)
     {
-        msg->arc_hdrlist = ARC_MALLOC(ARC_MAXHEADER);
+        msg->arc_hdrlist = ARC_AMALLOC(msg->arc_arena, ARC_MAXHEADER);
         if (msg->arc_hdrlist == NULL)
         {
             arc_error(msg, "unable to allocate %d bytes(s)", ARC_MAXHEADER);
@@ -841,7 +1537,8 @@ arc_canon_selecthdrs(ARC_MESSAGE          *msg,
         hdr->hdr_flags &= ~ARC_HDR_SIGNED;
     }
 
-    lhdrs = ARC_CALLOC(msg->arc_hdrcnt, sizeof(struct arc_hdrfield *));
+    lhdrs = ARC_LCALLOC(ARC_MSGALLOC(msg), msg->arc_hdrcnt,
+                        sizeof(struct arc_hdrfield *));
     if (lhdrs == NULL)
     {
         return -1;
@@ -855,10 +1552,10 @@ arc_canon_selecthdrs(ARC_MESSAGE          *msg,
             shcnt++;
         }
     }
-    hdrs = ARC_CALLOC(shcnt, sizeof(char *));
+    hdrs = ARC_LCALLOC(ARC_MSGALLOC(msg), shcnt, sizeof(char *));
     if (hdrs == NULL)
     {
-        ARC_FREE(lhdrs);
+        ARC_LFREE(ARC_MSGALLOC(msg), lhdrs);
         return -1;
     }
 
@@ -910,8 +1607,8 @@ arc_canon_selecthdrs(ARC_MESSAGE          *msg,
     {
         arc_error(msg, "too many headers (found %d, max %d)", shcnt, nptrs);
 
-        ARC_FREE(lhdrs);
-        ARC_FREE(hdrs);
+        ARC_LFREE(ARC_MSGALLOC(msg), lhdrs);
+        ARC_LFREE(ARC_MSGALLOC(msg), hdrs);
 
         return -1;
     }
@@ -927,8 +1624,8 @@ arc_canon_selecthdrs(ARC_MESSAGE          *msg,
         }
     }
 
-    ARC_FREE(lhdrs);
-    ARC_FREE(hdrs);
+    ARC_LFREE(ARC_MSGALLOC(msg), lhdrs);
+    ARC_LFREE(ARC_MSGALLOC(msg), hdrs);
 
     return m;
 }
@@ -948,14 +1645,14 @@ arc_canon_selecthdrs(ARC_MESSAGE          *msg,
 */
 
 static ARC_STAT
-arc_canon_strip_b(ARC_MESSAGE *msg, char *text)
+arc_canon_strip_b(ARC_MESSAGE *msg, const char *text)
 {
-    char  in = '\0';
-    char  last = '\0';
-    char *p;
-    char *tmp;
-    char *end;
-    char  tmpbuf[BUFRSZ];
+    char        in = '\0';
+    char        last = '\0';
+    const char *p;
+    char       *tmp;
+    char       *end;
+    char        tmpbuf[BUFRSZ];
 
     assert(msg != NULL);
     assert(text != NULL);
@@ -1041,8 +1738,18 @@ arc_canon_finalize(ARC_CANON *canon)
 {
     assert(canon != NULL);
 
-    EVP_DigestFinal(canon->canon_hash->hash_ctx, canon->canon_hash->hash_out,
-                    &canon->canon_hash->hash_outlen);
+    if (canon->canon_hash->hash_builtin)
+    {
+        arc_sha256_final(&canon->canon_hash->hash_sha256,
+                         canon->canon_hash->hash_out);
+        canon->canon_hash->hash_outlen = ARC_SHA256_DIGESTSIZE;
+    }
+    else
+    {
+        EVP_DigestFinal(canon->canon_hash->hash_ctx,
+                        canon->canon_hash->hash_out,
+                        &canon->canon_hash->hash_outlen);
+    }
 
     if (canon->canon_hash->hash_tmpbio != NULL)
     {
@@ -1181,7 +1888,6 @@ ARC_STAT
 arc_canon_runheaders(ARC_MESSAGE *msg)
 {
     bool                  signing;
-    unsigned char         savechar;
     int                   c;
     size_t                n;
     int                   nhdrs = 0;
@@ -1190,6 +1896,7 @@ arc_canon_runheaders(ARC_MESSAGE *msg)
     struct arc_hdrfield  *hdr;
     struct arc_hdrfield **hdrset;
     struct arc_hdrfield   tmphdr;
+    char                  hname[ARC_MAXHDRNAMELEN + 1];
 
     assert(msg != NULL);
 
@@ -1199,7 +1906,8 @@ arc_canon_runheaders(ARC_MESSAGE *msg)
     }
 
     n = msg->arc_hdrcnt * sizeof(struct arc_hdrfield *);
-    hdrset = ARC_CALLOC(msg->arc_hdrcnt, sizeof(struct arc_hdrfield *));
+    hdrset = ARC_LCALLOC(ARC_MSGALLOC(msg), msg->arc_hdrcnt,
+                         sizeof(struct arc_hdrfield *));
     if (hdrset == NULL)
     {
         return ARC_STAT_NORESOURCE;
@@ -1207,10 +1915,11 @@ arc_canon_runheaders(ARC_MESSAGE *msg)
 
     if (msg->arc_hdrbuf == NULL)
     {
-        msg->arc_hdrbuf = arc_dstring_new(ARC_MAXHEADER, 0, msg, &arc_error_cb);
+        msg->arc_hdrbuf = arc_dstring_new(ARC_MAXHEADER, 0, msg, &arc_error_cb,
+                                          ARC_MSGALLOC(msg));
         if (msg->arc_hdrbuf == NULL)
         {
-            ARC_FREE(hdrset);
+            ARC_LFREE(ARC_MSGALLOC(msg), hdrset);
             return ARC_STAT_NORESOURCE;
         }
     }
@@ -1260,7 +1969,7 @@ arc_canon_runheaders(ARC_MESSAGE *msg)
                     arc_error(
                         msg,
                         "arc_canon_selecthdrs() failed during canonicalization");
-                    ARC_FREE(hdrset);
+                    ARC_LFREE(ARC_MSGALLOC(msg), hdrset);
                     return ARC_STAT_INTERNAL;
                 }
             }
@@ -1314,7 +2023,7 @@ arc_canon_runheaders(ARC_MESSAGE *msg)
                     {
                         if (!arc_dstring_cat1(msg->arc_hdrbuf, ':'))
                         {
-                            ARC_FREE(hdrset);
+                            ARC_LFREE(ARC_MSGALLOC(msg), hdrset);
                             return ARC_STAT_NORESOURCE;
                         }
                     }
@@ -1322,7 +2031,7 @@ arc_canon_runheaders(ARC_MESSAGE *msg)
                     if (!arc_dstring_catn(msg->arc_hdrbuf, hdr->hdr_text,
                                           hdr->hdr_namelen))
                     {
-                        ARC_FREE(hdrset);
+                        ARC_LFREE(ARC_MSGALLOC(msg), hdrset);
                         return ARC_STAT_NORESOURCE;
                     }
                     continue;
@@ -1333,15 +2042,11 @@ arc_canon_runheaders(ARC_MESSAGE *msg)
                 **  given, so just do those.
                 */
 
-                /* could be space, could be colon ... */
-                savechar = hdr->hdr_text[hdr->hdr_namelen];
-
-                /* terminate the header field name and test */
-                hdr->hdr_text[hdr->hdr_namelen] = '\0';
-                status = regexec(hdrtest, hdr->hdr_text, 0, NULL, 0);
-
-                /* restore the character */
-                hdr->hdr_text[hdr->hdr_namelen] = savechar;
+                /* the text may belong to the caller, so test a copy of
+                 * the name */
+                memcpy(hname, hdr->hdr_text, hdr->hdr_namelen);
+                hname[hdr->hdr_namelen] = '\0';
+                status = regexec(hdrtest, hname, 0, NULL, 0);
 
                 if (status == 0)
                 {
@@ -1349,7 +2054,7 @@ arc_canon_runheaders(ARC_MESSAGE *msg)
                     {
                         if (!arc_dstring_cat1(msg->arc_hdrbuf, ':'))
                         {
-                            ARC_FREE(hdrset);
+                            ARC_LFREE(ARC_MSGALLOC(msg), hdrset);
                             return ARC_STAT_NORESOURCE;
                         }
                     }
@@ -1357,7 +2062,7 @@ arc_canon_runheaders(ARC_MESSAGE *msg)
                     if (!arc_dstring_catn(msg->arc_hdrbuf, hdr->hdr_text,
                                           hdr->hdr_namelen))
                     {
-                        ARC_FREE(hdrset);
+                        ARC_LFREE(ARC_MSGALLOC(msg), hdrset);
                         return ARC_STAT_NORESOURCE;
                     }
                 }
@@ -1378,7 +2083,7 @@ arc_canon_runheaders(ARC_MESSAGE *msg)
                 arc_error(
                     msg,
                     "arc_canon_selecthdrs() failed during canonicalization");
-                ARC_FREE(hdrset);
+                ARC_LFREE(ARC_MSGALLOC(msg), hdrset);
                 return ARC_STAT_INTERNAL;
             }
         }
@@ -1392,7 +2097,7 @@ arc_canon_runheaders(ARC_MESSAGE *msg)
                 status = arc_canon_header(msg, cur, hdrset[c], true);
                 if (status != ARC_STAT_OK)
                 {
-                    ARC_FREE(hdrset);
+                    ARC_LFREE(ARC_MSGALLOC(msg), hdrset);
                     return status;
                 }
             }
@@ -1414,7 +2119,7 @@ arc_canon_runheaders(ARC_MESSAGE *msg)
         status = arc_canon_strip_b(msg, cur->canon_sigheader->hdr_text);
         if (status != ARC_STAT_OK)
         {
-            ARC_FREE(hdrset);
+            ARC_LFREE(ARC_MSGALLOC(msg), hdrset);
             return status;
         }
 
@@ -1434,7 +2139,7 @@ arc_canon_runheaders(ARC_MESSAGE *msg)
         cur->canon_done = true;
     }
 
-    ARC_FREE(hdrset);
+    ARC_LFREE(ARC_MSGALLOC(msg), hdrset);
 
     return ARC_STAT_OK;
 }
@@ -1466,7 +2171,8 @@ arc_canon_signature(ARC_MESSAGE *msg, struct arc_hdrfield *hdr, int type)
 
     if (msg->arc_hdrbuf == NULL)
     {
-        msg->arc_hdrbuf = arc_dstring_new(ARC_MAXHEADER, 0, msg, &arc_error_cb);
+        msg->arc_hdrbuf = arc_dstring_new(ARC_MAXHEADER, 0, msg, &arc_error_cb,
+                                          ARC_MSGALLOC(msg));
         if (msg->arc_hdrbuf == NULL)
         {
             return ARC_STAT_NORESOURCE;
@@ -1570,26 +2276,36 @@ arc_canon_minbody(ARC_MESSAGE *msg)
 **
 **  Return value:
 **  	A ARC_STAT_* constant.
+**
+**  Notes:
+**  	Once the body grows past the library's threshold, messages with
+**  	more than one body canonicalization hand some of them to helper
+**  	threads.
 */
 
 ARC_STAT
 arc_canon_bodychunk(ARC_MESSAGE *msg, const char *buf, size_t buflen)
 {
-    bool         fixcrlf;
-    ARC_STAT     status;
-    unsigned int wlen;
-    ARC_CANON   *cur;
-    size_t       plen;
-    const char  *p;
-    const char  *wrote;
-    const char  *eob;
-    const char  *start;
+    ARC_STAT   status;
+    ARC_LIB   *lib;
+    ARC_CANON *cur;
 
     assert(msg != NULL);
 
+    lib = msg->arc_library;
+
     msg->arc_bodylen += buflen;
 
-    fixcrlf = (msg->arc_library->arcl_flags & ARC_LIBFLAGS_FIXCRLF);
+    if (msg->arc_bodypool == NULL && lib->arcl_bodythreads > 0 &&
+        msg->arc_bodylen >= lib->arcl_bodythreshold)
+    {
+        arc_bodypool_start(msg);
+    }
+
+    if (msg->arc_bodypool != NULL)
+    {
+        return arc_bodypool_run(msg, buf, buflen);
+    }
 
     for (cur = msg->arc_canonhead; cur != NULL; cur = cur->canon_next)
     {
@@ -1599,227 +2315,12 @@ arc_canon_bodychunk(ARC_MESSAGE *msg, const char *buf, size_t buflen)
             continue;
         }
 
-        start = buf;
-        plen = buflen;
-
-        if (fixcrlf)
-        {
-            status = arc_canon_fixcrlf(msg, cur, buf, buflen);
-            if (status != ARC_STAT_OK)
-            {
-                return status;
-            }
-
-            start = arc_dstring_get(msg->arc_canonbuf);
-            plen = arc_dstring_len(msg->arc_canonbuf);
-        }
-
-        eob = start + plen - 1;
-        wrote = start;
-        wlen = 0;
-
-        switch (cur->canon_canon)
+        status = arc_canon_bodycanon(msg, cur, buf, buflen,
+                                     &msg->arc_canonbuf);
+        if (status != ARC_STAT_OK)
         {
-        case ARC_CANON_SIMPLE:
-            for (p = start; p <= eob; p++)
-            {
-                if (*p == '\n')
-                {
-                    if (cur->canon_lastchar == '\r')
-                    {
-                        if (cur->canon_blankline)
-                        {
-                            cur->canon_blanks++;
-                        }
-                        else if (wlen == 1 || p == start)
-                        {
-                            arc_canon_buffer(cur, CRLF, 2);
-                        }
-                        else
-                        {
-                            arc_canon_buffer(cur, wrote, wlen + 1);
-                        }
-
-                        wrote = p + 1;
-                        wlen = 0;
-                        cur->canon_blankline = true;
-                    }
-                }
-                else
-                {
-                    if (p == start && cur->canon_lastchar == '\r')
-                    {
-                        if (fixcrlf)
-                        {
-                            arc_canon_buffer(cur, CRLF, 2);
-                            cur->canon_lastchar = '\n';
-                            cur->canon_blankline = true;
-                        }
-                        else
-                        {
-                            arc_canon_buffer(cur, "\r", 1);
-                        }
-                    }
-
-                    if (*p != '\r')
-                    {
-                        if (cur->canon_blanks > 0)
-                        {
-                            arc_canon_flushblanks(cur);
-                        }
-                        cur->canon_blankline = false;
-                    }
-
-                    wlen++;
-                }
-
-                cur->canon_lastchar = *p;
-            }
-
-            if (wlen > 0 && wrote[wlen - 1] == '\r')
-            {
-                wlen--;
-            }
-
-            arc_canon_buffer(cur, wrote, wlen);
-
-            break;
-
-        case ARC_CANON_RELAXED:
-            for (p = start; p <= eob; p++)
-            {
-                switch (cur->canon_bodystate)
-                {
-                case 0:
-                    if (ARC_ISWSP(*p))
-                    {
-                        cur->canon_bodystate = 1;
-                    }
-                    else if (*p == '\r')
-                    {
-                        cur->canon_bodystate = 2;
-                    }
-                    else
-                    {
-                        cur->canon_blankline = false;
-                        arc_dstring_cat1(cur->canon_buf, *p);
-                        cur->canon_bodystate = 3;
-                    }
-                    break;
-
-                case 1:
-                    if (ARC_ISWSP(*p))
-                    {
-                        break;
-                    }
-                    else if (*p == '\r')
-                    {
-                        cur->canon_bodystate = 2;
-                    }
-                    else
-                    {
-                        arc_canon_flushblanks(cur);
-                        arc_canon_buffer(cur, SP, 1);
-                        cur->canon_blankline = false;
-                        arc_dstring_cat1(cur->canon_buf, *p);
-                        cur->canon_bodystate = 3;
-                    }
-                    break;
-
-                case 2:
-                    if (fixcrlf || *p == '\n')
-                    {
-                        if (cur->canon_blankline)
-                        {
-                            cur->canon_blanks++;
-                            cur->canon_bodystate = 0;
-                        }
-                        else
-                        {
-                            arc_canon_flushblanks(cur);
-                            arc_canon_buffer(cur,
-                                             arc_dstring_get(cur->canon_buf),
-                                             arc_dstring_len(cur->canon_buf));
-                            arc_canon_buffer(cur, CRLF, 2);
-                            arc_dstring_blank(cur->canon_buf);
-
-                            if (*p == '\n')
-                            {
-                                cur->canon_blankline = true;
-                                cur->canon_bodystate = 0;
-                            }
-                            else if (*p == '\r')
-                            {
-                                cur->canon_blankline = true;
-                            }
-                            else
-                            {
-                                if (ARC_ISWSP(*p))
-                                {
-                                    cur->canon_bodystate = 1;
-                                }
-                                else
-                                {
-                                    arc_dstring_cat1(cur->canon_buf, *p);
-                                    cur->canon_bodystate = 3;
-                                }
-                            }
-                        }
-                    }
-                    else if (*p == '\r')
-                    {
-                        cur->canon_blankline = false;
-                        arc_dstring_cat1(cur->canon_buf, *p);
-                    }
-                    else if (ARC_ISWSP(*p))
-                    {
-                        arc_canon_flushblanks(cur);
-                        arc_canon_buffer(cur, arc_dstring_get(cur->canon_buf),
-                                         arc_dstring_len(cur->canon_buf));
-                        arc_dstring_blank(cur->canon_buf);
-                        cur->canon_bodystate = 1;
-                    }
-                    else
-                    {
-                        cur->canon_blankline = false;
-                        arc_dstring_cat1(cur->canon_buf, *p);
-                        cur->canon_bodystate = 3;
-                    }
-                    break;
-
-                case 3:
-                    if (ARC_ISWSP(*p))
-                    {
-                        arc_canon_flushblanks(cur);
-                        arc_canon_buffer(cur, arc_dstring_get(cur->canon_buf),
-                                         arc_dstring_len(cur->canon_buf));
-                        arc_dstring_blank(cur->canon_buf);
-                        cur->canon_bodystate = 1;
-                    }
-                    else if (*p == '\r')
-                    {
-                        cur->canon_bodystate = 2;
-                    }
-                    else
-                    {
-                        arc_dstring_cat1(cur->canon_buf, *p);
-                    }
-                    break;
-                }
-
-                cur->canon_lastchar = *p;
-            }
-
-            arc_canon_buffer(cur, NULL, 0);
-
-            break;
-
-        default:
-            assert(0);
-            /* NOTREACHED */
+            return status;
         }
-
-        arc_canon_buffer(cur, NULL, 0);
     }
 
     return ARC_STAT_OK;
@@ -1842,6 +2343,9 @@ arc_canon_closebody(ARC_MESSAGE *msg)
 
     assert(msg != NULL);
 
+    /* the whole body has been seen, so the helpers are done */
+    arc_bodypool_stop(msg);
+
     for (cur = msg->arc_canonhead; cur != NULL; cur = cur->canon_next)
     {
         /* skip done hashes or header canonicalizations */
@@ -1957,9 +2461,9 @@ arc_canon_getsealhash(ARC_MESSAGE *msg, int setnum, void **sh, size_t *shlen)
 **  Parameters:
 **  	msg -- ARC message from which to get completed hashes
 **      setnum -- which seal's hashes to get
-**  	hh -- pointer to header hash buffer (returned)
+**  	hh -- pointer to header hash buffer (returned), or NULL
 **  	hhlen -- bytes used at hh (returned)
-**  	bh -- pointer to body hash buffer (returned)
+**  	bh -- pointer to body hash buffer (returned), or NULL
 **  	bhlen -- bytes used at bh (returned)
 **
 **  Return value:
@@ -1986,21 +2490,27 @@ arc_canon_gethashes(ARC_MESSAGE *msg,
     hdc = msg->arc_hdrcanons[setnum - 1];
     bdc = msg->arc_bodycanons[setnum - 1];
 
-    status = arc_canon_getfinal(hdc, &hd, &hdlen);
-    if (status != ARC_STAT_OK)
+    if (hh != NULL)
     {
-        return status;
+        status = arc_canon_getfinal(hdc, &hd, &hdlen);
+        if (status != ARC_STAT_OK)
+        {
+            return status;
+        }
+        *hh = hd;
+        *hhlen = hdlen;
     }
-    *hh = hd;
-    *hhlen = hdlen;
 
-    status = arc_canon_getfinal(bdc, &bd, &bdlen);
-    if (status != ARC_STAT_OK)
+    if (bh != NULL)
     {
-        return status;
+        status = arc_canon_getfinal(bdc, &bd, &bdlen);
+        if (status != ARC_STAT_OK)
+        {
+            return status;
+        }
+        *bh = bd;
+        *bhlen = bdlen;
     }
-    *bh = bd;
-    *bhlen = bdlen;
 
     return ARC_STAT_OK;
 }
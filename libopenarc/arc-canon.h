@@ -47,6 +47,7 @@ extern ARC_STAT arc_canon_header_string(
     struct arc_dstring *, arc_canon_t, const char *, size_t, bool);
 extern ARC_STAT      arc_canon_init(ARC_MESSAGE *, bool, bool);
 extern unsigned long arc_canon_minbody(ARC_MESSAGE *);
+extern void          arc_canon_reset(ARC_MESSAGE *);
 extern ARC_STAT      arc_canon_runheaders(ARC_MESSAGE *);
 extern ARC_STAT      arc_canon_runheaders_seal(ARC_MESSAGE *);
 extern int           arc_canon_selecthdrs(ARC_MESSAGE *,
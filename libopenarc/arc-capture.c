@@ -0,0 +1,366 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#include "build-config.h"
+
+/* system includes */
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/* libopenarc includes */
+#include "arc-canon.h"
+#include "arc-capture.h"
+#include "arc-internal.h"
+#include "arc-types.h"
+#include "arc-util.h"
+
+#include "arc-malloc.h"
+
+/* struct arc_capture -- one message's capture file */
+struct arc_capture
+{
+    bool            cap_failed;
+    int             cap_fd;
+    unsigned int    cap_nstreams;
+    size_t          cap_len;
+    off_t           cap_offset;
+    pthread_mutex_t cap_lock;
+    char            cap_path[MAXPATHLEN + 1];
+    unsigned char   cap_buf[ARC_CAPTURE_BUFSZ];
+};
+
+/**
+ *  Write out data, giving up on the capture if that fails.
+ *
+ *  Parameters:
+ *      cap: capture
+ *      buf: data to write
+ *      len: bytes at "buf"
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+static void
+arc_capture_put(struct arc_capture *cap, const void *buf, size_t len)
+{
+    ssize_t              n;
+    const unsigned char *p = buf;
+
+    while (len > 0 && !cap->cap_failed)
+    {
+        n = write(cap->cap_fd, p, len);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            /* a truncated capture is still worth having */
+            cap->cap_failed = true;
+            return;
+        }
+
+        p += n;
+        len -= n;
+        cap->cap_offset += n;
+    }
+}
+
+/**
+ *  Write out whatever is buffered.
+ *
+ *  Parameters:
+ *      cap: capture
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+static void
+arc_capture_flush(struct arc_capture *cap)
+{
+    arc_capture_put(cap, cap->cap_buf, cap->cap_len);
+    cap->cap_len = 0;
+}
+
+/**
+ *  Add data to the buffer, writing it out as it fills.
+ *
+ *  Parameters:
+ *      cap: capture
+ *      buf: data to add
+ *      len: bytes at "buf"
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+static void
+arc_capture_append(struct arc_capture *cap, const void *buf, size_t len)
+{
+    if (cap->cap_len + len > sizeof cap->cap_buf)
+    {
+        arc_capture_flush(cap);
+
+        /* no point copying something that fills the buffer by itself */
+        if (len >= sizeof cap->cap_buf)
+        {
+            arc_capture_put(cap, buf, len);
+            return;
+        }
+    }
+
+    memcpy(cap->cap_buf + cap->cap_len, buf, len);
+    cap->cap_len += len;
+}
+
+/**
+ *  Decide whether the next message should be captured.
+ *
+ *  Parameters:
+ *      lib: library handle
+ *
+ *  Returns:
+ *      true for one message in every ARC_OPTS_CAPTURESAMPLE.
+ */
+
+bool
+arc_capture_sample(ARC_LIB *lib)
+{
+    bool take;
+
+    assert(lib != NULL);
+
+    if (lib->arcl_capsample <= 1)
+    {
+        return true;
+    }
+
+    pthread_mutex_lock(&lib->arcl_caplock);
+    take = lib->arcl_capseq == 0;
+    lib->arcl_capseq = (lib->arcl_capseq + 1) % lib->arcl_capsample;
+    pthread_mutex_unlock(&lib->arcl_caplock);
+
+    return take;
+}
+
+/**
+ *  Start capturing a message's canonicalizations.
+ *
+ *  Parameters:
+ *      msg: message handle
+ *
+ *  Returns:
+ *      An ARC_STAT_* constant.
+ */
+
+ARC_STAT
+arc_capture_open(ARC_MESSAGE *msg)
+{
+    ARC_STAT            status;
+    struct arc_capture *cap;
+    static const char   magic[] = "ARC-CAPTURE 1\n";
+
+    assert(msg != NULL);
+
+    if (msg->arc_capture != NULL)
+    {
+        return ARC_STAT_OK;
+    }
+
+    cap = ARC_LMALLOC(ARC_MSGALLOC(msg), sizeof *cap);
+    if (cap == NULL)
+    {
+        arc_error(msg, "unable to allocate %d byte(s)", sizeof *cap);
+        return ARC_STAT_NORESOURCE;
+    }
+
+    status = arc_tmpfile(msg, &cap->cap_fd, true, cap->cap_path,
+                         sizeof cap->cap_path);
+    if (status != ARC_STAT_OK)
+    {
+        ARC_LFREE(ARC_MSGALLOC(msg), cap);
+        return status;
+    }
+
+    cap->cap_failed = false;
+    cap->cap_nstreams = 0;
+    cap->cap_len = 0;
+    cap->cap_offset = 0;
+    pthread_mutex_init(&cap->cap_lock, NULL);
+
+    arc_capture_append(cap, magic, sizeof magic - 1);
+
+    msg->arc_capture = cap;
+
+    return ARC_STAT_OK;
+}
+
+/**
+ *  Give a canonicalization a stream in the message's capture, if there is
+ *  one.
+ *
+ *  Parameters:
+ *      msg: message handle
+ *      canon: canonicalization
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+void
+arc_capture_attach(ARC_MESSAGE *msg, ARC_CANON *canon)
+{
+    struct arc_capture *cap = msg->arc_capture;
+
+    if (cap == NULL || canon->canon_capture != NULL)
+    {
+        return;
+    }
+
+    /* seal canonicalizations can be set up by the verification thread */
+    pthread_mutex_lock(&cap->cap_lock);
+    canon->canon_capid = ++cap->cap_nstreams;
+    pthread_mutex_unlock(&cap->cap_lock);
+
+    canon->canon_capture = cap;
+}
+
+/**
+ *  Record data written to a canonicalization.
+ *
+ *  Parameters:
+ *      cap: capture
+ *      stream: the canonicalization's stream number
+ *      buf: canonicalized data
+ *      len: bytes at "buf"
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+void
+arc_capture_write(struct arc_capture *cap,
+                  unsigned int        stream,
+                  const char         *buf,
+                  size_t              len)
+{
+    int  n;
+    char hdr[64];
+
+    n = snprintf(hdr, sizeof hdr, "@%u %zu\n", stream, len);
+
+    /* body hashing threads share the file */
+    pthread_mutex_lock(&cap->cap_lock);
+    arc_capture_append(cap, hdr, n);
+    arc_capture_append(cap, buf, len);
+    pthread_mutex_unlock(&cap->cap_lock);
+}
+
+/**
+ *  Write a message's capture index and close the file.
+ *
+ *  Parameters:
+ *      msg: message handle
+ *
+ *  Returns:
+ *      Nothing.
+ *
+ *  Notes:
+ *      Nothing may be writing to the canonicalizations any more.
+ */
+
+void
+arc_capture_close(ARC_MESSAGE *msg)
+{
+    int                 n;
+    off_t               index;
+    struct arc_capture *cap = msg->arc_capture;
+    ARC_CANON          *cur;
+    char                line[128 + 2 * EVP_MAX_MD_SIZE];
+    static const char  *types[] = {"header", "body", "seal", "ams"};
+
+    if (cap == NULL)
+    {
+        return;
+    }
+
+    /* stream data needn't end in a newline, but the index should start one */
+    arc_capture_append(cap, "\n", 1);
+    index = cap->cap_offset + cap->cap_len;
+    arc_capture_append(cap, "#index\n", 7);
+
+    for (cur = msg->arc_canonhead; cur != NULL; cur = cur->canon_next)
+    {
+        if (cur->canon_capture != cap)
+        {
+            continue;
+        }
+
+        n = snprintf(line, sizeof line, "%u %s %s %s %zd %zd ",
+                     cur->canon_capid, types[cur->canon_type],
+                     cur->canon_canon == ARC_CANON_SIMPLE ? "simple"
+                                                          : "relaxed",
+                     cur->canon_hashtype == ARC_HASHTYPE_SHA1 ? "sha1"
+                                                              : "sha256",
+                     cur->canon_length, cur->canon_wrote);
+
+        if (cur->canon_hash == NULL || cur->canon_hash->hash_outlen == 0)
+        {
+            n += snprintf(line + n, sizeof line - n, "-");
+        }
+        for (unsigned int c = 0;
+             cur->canon_hash != NULL && c < cur->canon_hash->hash_outlen; c++)
+        {
+            n += snprintf(line + n, sizeof line - n, "%02x",
+                          cur->canon_hash->hash_out[c]);
+        }
+        line[n++] = '\n';
+
+        arc_capture_append(cap, line, n);
+        cur->canon_capture = NULL;
+    }
+
+    n = snprintf(line, sizeof line, "#end %lld\n", (long long) index);
+    arc_capture_append(cap, line, n);
+    arc_capture_flush(cap);
+
+    close(cap->cap_fd);
+    pthread_mutex_destroy(&cap->cap_lock);
+    ARC_LFREE(ARC_MSGALLOC(msg), cap);
+    msg->arc_capture = NULL;
+}
+
+/* ========================= PUBLIC SECTION ========================= */
+
+/*
+**  ARC_CAPTURE_PATH -- name the file a message's canonicalizations go to
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE object
+**
+**  Return value:
+**  	Path of the capture file, or NULL if the message isn't captured.
+*/
+
+const char *
+arc_capture_path(ARC_MESSAGE *msg)
+{
+    assert(msg != NULL);
+
+    if (msg->arc_capture == NULL)
+    {
+        return NULL;
+    }
+
+    return msg->arc_capture->cap_path;
+}
@@ -0,0 +1,30 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#ifndef ARC_CAPTURE_H
+#define ARC_CAPTURE_H
+
+#include "build-config.h"
+
+/* system includes */
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* libopenarc includes */
+#include "arc-types.h"
+#include "arc.h"
+
+/* how much canonicalized data is gathered before each write(2) */
+#define ARC_CAPTURE_BUFSZ 65536
+
+extern bool     arc_capture_sample(ARC_LIB *);
+extern ARC_STAT arc_capture_open(ARC_MESSAGE *);
+extern void     arc_capture_attach(ARC_MESSAGE *, ARC_CANON *);
+extern void     arc_capture_write(struct arc_capture *,
+                                  unsigned int,
+                                  const char *,
+                                  size_t);
+extern void     arc_capture_close(ARC_MESSAGE *);
+
+#endif /* ARC_CAPTURE_H */
@@ -0,0 +1,231 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "arc-hdrcanon.h"
+
+#ifdef ARC_HDRCANON_SSE2
+#include <emmintrin.h>
+#endif /* ARC_HDRCANON_SSE2 */
+
+/* LWSP as far as the field name is concerned */
+#define ARC_HDRCANON_ISLWSP(c)                                                 \
+    ((c) == '\t' || (c) == '\n' || (c) == '\r' || (c) == ' ')
+
+/* isspace() in the C locale, which is what the value is collapsed on */
+#define ARC_HDRCANON_ISSPACE(c) ((c) == ' ' || ((c) >= '\t' && (c) <= '\r'))
+
+/**
+ *  Canonicalize a header field name and the whitespace after its colon.
+ *
+ *  Parameters:
+ *      out: output pointer, advanced past what was written
+ *      hdr: header field
+ *      end: end of the header field
+ *
+ *  Returns:
+ *      Where the value starts.
+ */
+
+static const char *
+arc_hdrcanon_name(char **out, const char *hdr, const char *end)
+{
+    char         *o = *out;
+    const char   *p;
+    unsigned char c;
+
+    /* drop whitespace anywhere before the colon and lowercase the rest */
+    for (p = hdr; p < end; p++)
+    {
+        c = *p;
+        if (ARC_HDRCANON_ISLWSP(c))
+        {
+            continue;
+        }
+        if (c >= 'A' && c <= 'Z')
+        {
+            c += 'a' - 'A';
+        }
+        *o++ = c;
+
+        if (c == ':')
+        {
+            p++;
+            break;
+        }
+    }
+
+    /* skip all spaces before the first word */
+    while (p < end && *p != '\0' && ARC_HDRCANON_ISLWSP(*p))
+    {
+        p++;
+    }
+
+    *out = o;
+    return p;
+}
+
+/**
+ *  Canonicalize a header field using the "relaxed" algorithm, one byte at
+ *  a time.
+ *
+ *  Parameters:
+ *      out: output buffer, at least "hdrlen" bytes
+ *      hdr: header field, including its name
+ *      hdrlen: bytes at "hdr"; the value also ends at a NUL
+ *
+ *  Returns:
+ *      Number of bytes written to "out", which is not NUL-terminated.
+ */
+
+size_t
+arc_hdrcanon_relaxed_generic(char *out, const char *hdr, size_t hdrlen)
+{
+    bool        space = false;
+    char       *o = out;
+    const char *p;
+    const char *end = hdr + hdrlen;
+
+    for (p = arc_hdrcanon_name(&o, hdr, end); p < end && *p != '\0'; p++)
+    {
+        if (ARC_HDRCANON_ISSPACE(*p))
+        {
+            space = true;
+            continue;
+        }
+
+        /* any non-space starts a word and uses up a stored space */
+        if (space)
+        {
+            *o++ = ' ';
+            space = false;
+        }
+        *o++ = *p;
+    }
+
+    return o - out;
+}
+
+#ifdef ARC_HDRCANON_SSE2
+/**
+ *  Canonicalize a header field using the "relaxed" algorithm, copying
+ *  runs without whitespace sixteen bytes at a time.
+ *
+ *  Parameters:
+ *      out: output buffer, at least "hdrlen" bytes
+ *      hdr: header field, including its name
+ *      hdrlen: bytes at "hdr"; the value also ends at a NUL
+ *
+ *  Returns:
+ *      Number of bytes written to "out", which is not NUL-terminated.
+ *
+ *  Notes:
+ *      Whitespace is never expanded, so "o" never gets ahead of "p" and a
+ *      full sixteen-byte store stays inside the buffer whenever a full
+ *      load does.
+ */
+
+size_t
+arc_hdrcanon_relaxed_sse2(char *out, const char *hdr, size_t hdrlen)
+{
+    bool          space = false;
+    unsigned int  mask;
+    int           run;
+    char         *o = out;
+    const char   *p;
+    const char   *end = hdr + hdrlen;
+    __m128i       v;
+    __m128i       ctl;
+    __m128i       hit;
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i ctlmax = _mm_set1_epi8('\r' - '\t');
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i nul = _mm_setzero_si128();
+
+    p = arc_hdrcanon_name(&o, hdr, end);
+
+    while (end - p >= 16)
+    {
+        /* find whitespace (' ' and '\t' through '\r') and NULs */
+        v = _mm_loadu_si128((const __m128i *) p);
+        ctl = _mm_sub_epi8(v, tab);
+        hit = _mm_cmpeq_epi8(_mm_min_epu8(ctl, ctlmax), ctl);
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, sp));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, nul));
+        mask = _mm_movemask_epi8(hit);
+
+        run = mask == 0 ? 16 : __builtin_ctz(mask);
+        if (run > 0)
+        {
+            if (space)
+            {
+                *o++ = ' ';
+                space = false;
+            }
+            _mm_storeu_si128((__m128i *) o, v);
+            o += run;
+            p += run;
+            if (run == 16)
+            {
+                continue;
+            }
+        }
+
+        if (*p == '\0')
+        {
+            return o - out;
+        }
+
+        /* swallow the rest of this stretch of whitespace */
+        space = true;
+        for (p++; p < end && ARC_HDRCANON_ISSPACE(*p); p++)
+        {
+            continue;
+        }
+    }
+
+    for (; p < end && *p != '\0'; p++)
+    {
+        if (ARC_HDRCANON_ISSPACE(*p))
+        {
+            space = true;
+            continue;
+        }
+
+        if (space)
+        {
+            *o++ = ' ';
+            space = false;
+        }
+        *o++ = *p;
+    }
+
+    return o - out;
+}
+#endif /* ARC_HDRCANON_SSE2 */
+
+/**
+ *  Canonicalize a header field using the "relaxed" algorithm with the best
+ *  implementation available.
+ *
+ *  Parameters:
+ *      out: output buffer, at least "hdrlen" bytes
+ *      hdr: header field, including its name
+ *      hdrlen: bytes at "hdr"; the value also ends at a NUL
+ *
+ *  Returns:
+ *      Number of bytes written to "out", which is not NUL-terminated.
+ */
+
+size_t
+arc_hdrcanon_relaxed(char *out, const char *hdr, size_t hdrlen)
+{
+#ifdef ARC_HDRCANON_SSE2
+    return arc_hdrcanon_relaxed_sse2(out, hdr, hdrlen);
+#else  /* ARC_HDRCANON_SSE2 */
+    return arc_hdrcanon_relaxed_generic(out, hdr, hdrlen);
+#endif /* ARC_HDRCANON_SSE2 */
+}
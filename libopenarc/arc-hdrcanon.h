@@ -0,0 +1,26 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#ifndef ARC_HDRCANON_H
+#define ARC_HDRCANON_H
+
+#include <sys/types.h>
+
+/* SSE2 is part of the x86-64 baseline, so no runtime check is needed */
+#if defined(__SSE2__) && defined(__GNUC__)
+#define ARC_HDRCANON_SSE2 1
+#endif
+
+/* relaxed header canonicalization into a caller-provided buffer; "out" must
+ * have room for at least as many bytes as the input */
+typedef size_t (*arc_hdrcanon_t)(char *, const char *, size_t);
+
+extern size_t arc_hdrcanon_relaxed_generic(char *, const char *, size_t);
+#ifdef ARC_HDRCANON_SSE2
+extern size_t arc_hdrcanon_relaxed_sse2(char *, const char *, size_t);
+#endif /* ARC_HDRCANON_SSE2 */
+
+extern size_t arc_hdrcanon_relaxed(char *, const char *, size_t);
+
+#endif /* ARC_HDRCANON_H */
@@ -35,13 +35,13 @@
 #define MAXBUFRSZ          65536 /* max temp buffer size */
 #define MAXTAGNAME         8     /* biggest tag name */
 
-#define NPRINTABLE         95 /* number of printable characters */
-
 #define ARC_MAXHEADER      4096 /* buffer for caching one header */
 #define ARC_MAXHOSTNAMELEN 256  /* max. FQDN we support */
 
 /* defaults */
-#define DEFTMPDIR          "/tmp" /* default temporary directory */
+#define DEFTMPDIR          "/tmp"            /* default temporary directory */
+#define DEFBODYTHRESHOLD   (4 * 1024 * 1024) /* parallel body hashing */
+#define DEFARENASIZE       (32 * 1024)       /* first message arena chunk */
 
 /*
 **  ARC_KVSETTYPE -- types of key-value sets
@@ -56,6 +56,32 @@ typedef int arc_kvsettype_t;
 #define ARC_KVSETTYPE_AR        3
 #define ARC_KVSETTYPE_MAX       3 /* sentinel value */
 
+/*
+**  ARC_TAG -- tags of interest in ARC header fields and key records, which
+**             get their own slots in an ARC_KVSET
+*/
+
+#define ARC_TAG_A               0
+#define ARC_TAG_B               1
+#define ARC_TAG_BH              2
+#define ARC_TAG_C               3
+#define ARC_TAG_CV              4
+#define ARC_TAG_D               5
+#define ARC_TAG_H               6
+#define ARC_TAG_I               7
+#define ARC_TAG_K               8
+#define ARC_TAG_L               9
+#define ARC_TAG_P               10
+#define ARC_TAG_Q               11
+#define ARC_TAG_S               12
+#define ARC_TAG_T               13
+#define ARC_TAG_V               14
+#define ARC_TAG_X               15
+#define ARC_NTAGS               16 /* number of known tags */
+
+/* arc_amsstatus[] value for a signature that hasn't been checked yet */
+#define ARC_AMS_UNCHECKED       (-1)
+
 /*
 **  ARC_HASHTYPE -- types of hashes
 */
@@ -19,6 +19,7 @@
 #include <string.h>
 #include <sys/param.h>
 #include <sys/types.h>
+#include <time.h>
 
 #include "build-config.h"
 
@@ -56,58 +57,38 @@ extern void arc_error(ARC_MESSAGE *, const char *, ...);
 #endif /* ! T_RRSIG */
 
 /*
-**  ARC_GET_KEY_DNS -- retrieve a key from DNS
+**  ARC_KEY_QNAME -- build the DNS name of a key
 **
 **  Parameters:
 **  	msg -- ARC_MESSAGE handle
-**  	buf -- buffer into which to write the result
-**  	buflen -- bytes available at "buf"
+**  	selector -- selector
+**  	domain -- signing domain
+**  	qname -- buffer into which to write the result
+**  	qnamelen -- bytes available at "qname"
 **
 **  Return value:
 **  	A ARC_STAT_* constant.
 */
 
-ARC_STAT
-arc_get_key_dns(ARC_MESSAGE *msg, char *buf, size_t buflen)
+static ARC_STAT
+arc_key_qname(ARC_MESSAGE *msg,
+              const char  *selector,
+              const char  *domain,
+              char        *qname,
+              size_t       qnamelen)
 {
-    int status;
-    int qdcount;
-    int ancount;
-    int error;
-    int dnssec = ARC_DNSSEC_UNKNOWN;
-    int c;
-    int n = 0;
-    int rdlength = 0;
-    int type = -1;
-    int class = -1;
-    size_t         anslen;
-    void          *q;
-    ARC_LIB       *lib;
-    unsigned char *txtfound = NULL;
-    char          *p;
-    unsigned char *cp;
-    unsigned char *eom;
-    char          *eob;
-    char           qname[ARC_MAXHOSTNAMELEN + 1];
-    unsigned char  ansbuf[MAXPACKET];
-    struct timeval timeout;
-    HEADER         hdr;
-
-    assert(msg != NULL);
-    assert(msg->arc_selector != NULL);
-    assert(msg->arc_domain != NULL);
-
-    lib = msg->arc_library;
+    int   n;
+    int   status;
+    char *qname_idn;
 
-    n = snprintf(qname, sizeof qname - 1, "%s.%s.%s", msg->arc_selector,
-                 ARC_DNSKEYNAME, msg->arc_domain);
-    if (n == -1 || n > sizeof qname - 1)
+    n = snprintf(qname, qnamelen - 1, "%s.%s.%s", selector, ARC_DNSKEYNAME,
+                 domain);
+    if (n == -1 || n > qnamelen - 1)
     {
         arc_error(msg, "key query name too large");
         return ARC_STAT_NORESOURCE;
     }
 
-    char *qname_idn;
     status = idn2_to_ascii_8z(qname, &qname_idn,
                               IDN2_NONTRANSITIONAL | IDN2_NFC_INPUT);
     if (status != IDN2_OK)
@@ -117,7 +98,7 @@ arc_get_key_dns(ARC_MESSAGE *msg, char *buf, size_t buflen)
         return ARC_STAT_KEYFAIL;
     }
 
-    if (strlcpy(qname, qname_idn, sizeof qname) >= sizeof qname)
+    if (strlcpy(qname, qname_idn, qnamelen) >= qnamelen)
     {
         arc_error(msg, "key query name too large");
         idn2_free(qname_idn);
@@ -125,10 +106,25 @@ arc_get_key_dns(ARC_MESSAGE *msg, char *buf, size_t buflen)
     }
     idn2_free(qname_idn);
 
-    anslen = sizeof ansbuf;
+    return ARC_STAT_OK;
+}
+
+/*
+**  ARC_KEY_RESINIT -- make sure the resolver is ready
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE handle
+**
+**  Return value:
+**  	A ARC_STAT_* constant.
+*/
+
+static ARC_STAT
+arc_key_resinit(ARC_MESSAGE *msg)
+{
+    ARC_LIB *lib;
 
-    timeout.tv_sec = msg->arc_timeout;
-    timeout.tv_usec = 0;
+    lib = msg->arc_library;
 
     if (lib->arcl_dns_service == NULL && lib->arcl_dns_init != NULL &&
         lib->arcl_dns_init(&lib->arcl_dns_service) != 0)
@@ -137,8 +133,222 @@ arc_get_key_dns(ARC_MESSAGE *msg, char *buf, size_t buflen)
         return ARC_STAT_KEYFAIL;
     }
 
+    return ARC_STAT_OK;
+}
+
+/*
+**  ARC_KEY_START -- start looking up a key that will be needed later
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE handle
+**  	selector -- selector
+**  	domain -- signing domain
+**
+**  Return value:
+**  	A ARC_STAT_* constant.
+**
+**  Notes:
+**  	A name that has already been started is not asked for again.  A
+**  	query that can't be started is recorded as failed, so that
+**  	arc_get_key_dns() reports it when the key is wanted.
+*/
+
+ARC_STAT
+arc_key_start(ARC_MESSAGE *msg, const char *selector, const char *domain)
+{
+    ARC_STAT             status;
+    ARC_LIB             *lib;
+    struct arc_keyquery *kq;
+    char                 qname[ARC_MAXHOSTNAMELEN + 1];
+
+    assert(msg != NULL);
+    assert(selector != NULL);
+    assert(domain != NULL);
+
+    lib = msg->arc_library;
+
+    status = arc_key_qname(msg, selector, domain, qname, sizeof qname);
+    if (status != ARC_STAT_OK)
+    {
+        return status;
+    }
+
+    for (kq = msg->arc_keyqueries; kq != NULL; kq = kq->kq_next)
+    {
+        if (strcmp(kq->kq_qname, qname) == 0)
+        {
+            return ARC_STAT_OK;
+        }
+    }
+
+    status = arc_key_resinit(msg);
+    if (status != ARC_STAT_OK)
+    {
+        return status;
+    }
+
+    kq = ARC_ACALLOC(msg->arc_arena, 1, sizeof *kq);
+    if (kq == NULL)
+    {
+        arc_error(msg, "unable to allocate %d bytes", sizeof *kq);
+        return ARC_STAT_NORESOURCE;
+    }
+
+    kq->kq_qname = ARC_ASTRNDUP(msg->arc_arena, qname, sizeof qname);
+    kq->kq_ansbuf = ARC_AMALLOC(msg->arc_arena, MAXPACKET);
+    if (kq->kq_qname == NULL || kq->kq_ansbuf == NULL)
+    {
+        arc_error(msg, "unable to allocate %d bytes", MAXPACKET);
+        return ARC_STAT_NORESOURCE;
+    }
+
+    if (msg->arc_timeout != 0)
+    {
+        kq->kq_expire = time(NULL) + msg->arc_timeout;
+    }
+
+    if (lib->arcl_dns_start(lib->arcl_dns_service, T_TXT, kq->kq_qname,
+                            kq->kq_ansbuf, MAXPACKET, &kq->kq_handle) != 0)
+    {
+        kq->kq_handle = NULL;
+        kq->kq_status = ARC_DNS_ERROR;
+        kq->kq_done = true;
+    }
+
+    kq->kq_next = msg->arc_keyqueries;
+    msg->arc_keyqueries = kq;
+
+    return ARC_STAT_OK;
+}
+
+/*
+**  ARC_KEY_POLL -- collect replies to key queries without waiting
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE handle
+**
+**  Return value:
+**  	The number of queries still waiting for a reply.
+*/
+
+unsigned int
+arc_key_poll(ARC_MESSAGE *msg)
+{
+    int                  status;
+    unsigned int         pending = 0;
+    ARC_LIB             *lib;
+    struct arc_keyquery *kq;
+    struct timeval       timeout;
+
+    assert(msg != NULL);
+
+    lib = msg->arc_library;
+
+    for (kq = msg->arc_keyqueries; kq != NULL; kq = kq->kq_next)
+    {
+        if (kq->kq_done)
+        {
+            continue;
+        }
+
+        timeout.tv_sec = 0;
+        timeout.tv_usec = 0;
+
+        kq->kq_anslen = MAXPACKET;
+        status = lib->arcl_dns_waitreply(lib->arcl_dns_service, kq->kq_handle,
+                                         &timeout, &kq->kq_anslen,
+                                         &kq->kq_error, &kq->kq_dnssec);
+
+        /* with a zero timeout, "expired" only means "not yet" */
+        if (status == ARC_DNS_NOREPLY || status == ARC_DNS_EXPIRED)
+        {
+            if (kq->kq_expire == 0 || time(NULL) < kq->kq_expire)
+            {
+                pending++;
+                continue;
+            }
+            status = ARC_DNS_EXPIRED;
+        }
+
+        (void) lib->arcl_dns_cancel(lib->arcl_dns_service, kq->kq_handle);
+        kq->kq_handle = NULL;
+        kq->kq_status = status;
+        kq->kq_done = true;
+    }
+
+    return pending;
+}
+
+/*
+**  ARC_KEY_CANCEL -- abandon any key queries still in flight
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE handle
+**
+**  Return value:
+**  	None.
+*/
+
+void
+arc_key_cancel(ARC_MESSAGE *msg)
+{
+    ARC_LIB             *lib;
+    struct arc_keyquery *kq;
+
+    assert(msg != NULL);
+
+    lib = msg->arc_library;
+
+    for (kq = msg->arc_keyqueries; kq != NULL; kq = kq->kq_next)
+    {
+        if (!kq->kq_done)
+        {
+            (void) lib->arcl_dns_cancel(lib->arcl_dns_service, kq->kq_handle);
+            kq->kq_handle = NULL;
+            kq->kq_done = true;
+        }
+    }
+
+    msg->arc_keyqueries = NULL;
+}
+
+/*
+**  ARC_KEY_QUERY -- look up a key and wait for the reply
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE handle
+**  	qname -- name to look up
+**  	ansbuf -- buffer into which to write the reply
+**  	anslen -- bytes available at "ansbuf"; updated to the reply length
+**  	dnssec -- DNSSEC status of the reply (returned)
+**
+**  Return value:
+**  	A ARC_STAT_* constant.
+*/
+
+static ARC_STAT
+arc_key_query(ARC_MESSAGE   *msg,
+              const char    *qname,
+              unsigned char *ansbuf,
+              size_t        *anslen,
+              int           *dnssec)
+{
+    int            status;
+    int            error;
+    void          *q;
+    ARC_LIB       *lib;
+    struct timeval timeout;
+
+    lib = msg->arc_library;
+
+    status = arc_key_resinit(msg);
+    if (status != ARC_STAT_OK)
+    {
+        return status;
+    }
+
     status = lib->arcl_dns_start(lib->arcl_dns_service, T_TXT, qname, ansbuf,
-                                 anslen, &q);
+                                 *anslen, &q);
 
     if (status != 0)
     {
@@ -153,7 +363,7 @@ arc_get_key_dns(ARC_MESSAGE *msg, char *buf, size_t buflen)
 
         status = lib->arcl_dns_waitreply(
             lib->arcl_dns_service, q, msg->arc_timeout == 0 ? NULL : &timeout,
-            &anslen, &error, &dnssec);
+            anslen, &error, dnssec);
     }
     else
     {
@@ -174,7 +384,7 @@ arc_get_key_dns(ARC_MESSAGE *msg, char *buf, size_t buflen)
             status = lib->arcl_dns_waitreply(lib->arcl_dns_service, q,
                                              msg->arc_timeout == 0 ? NULL
                                                                    : &timeout,
-                                             &anslen, &error, &dnssec);
+                                             anslen, &error, dnssec);
 
             if (wt == &next)
             {
@@ -209,18 +419,107 @@ arc_get_key_dns(ARC_MESSAGE *msg, char *buf, size_t buflen)
 
     (void) lib->arcl_dns_cancel(lib->arcl_dns_service, q);
 
+    return ARC_STAT_OK;
+}
+
+/*
+**  ARC_GET_KEY_DNS -- retrieve a key from DNS
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE handle
+**  	buf -- buffer into which to write the result
+**  	buflen -- bytes available at "buf"
+**
+**  Return value:
+**  	A ARC_STAT_* constant.
+**
+**  Notes:
+**  	A reply already collected by arc_key_poll() is used if there is one.
+*/
+
+ARC_STAT
+arc_get_key_dns(ARC_MESSAGE *msg, char *buf, size_t buflen)
+{
+    int status;
+    int qdcount;
+    int ancount;
+    int dnssec = ARC_DNSSEC_UNKNOWN;
+    int c;
+    int n = 0;
+    int rdlength = 0;
+    int type = -1;
+    int class = -1;
+    size_t               anslen;
+    struct arc_keyquery *kq;
+    unsigned char       *txtfound = NULL;
+    char                *p;
+    unsigned char       *ans;
+    unsigned char       *cp;
+    unsigned char       *eom;
+    char                *eob;
+    char                 qname[ARC_MAXHOSTNAMELEN + 1];
+    unsigned char        ansbuf[MAXPACKET];
+    HEADER               hdr;
+
+    assert(msg != NULL);
+    assert(msg->arc_selector != NULL);
+    assert(msg->arc_domain != NULL);
+
+    status = arc_key_qname(msg, msg->arc_selector, msg->arc_domain, qname,
+                           sizeof qname);
+    if (status != ARC_STAT_OK)
+    {
+        return status;
+    }
+
+    for (kq = msg->arc_keyqueries; kq != NULL; kq = kq->kq_next)
+    {
+        if (kq->kq_done && strcmp(kq->kq_qname, qname) == 0)
+        {
+            break;
+        }
+    }
+
+    if (kq == NULL)
+    {
+        ans = ansbuf;
+        anslen = sizeof ansbuf;
+
+        status = arc_key_query(msg, qname, ans, &anslen, &dnssec);
+        if (status != ARC_STAT_OK)
+        {
+            return status;
+        }
+    }
+    else if (kq->kq_status == ARC_DNS_EXPIRED)
+    {
+        arc_error(msg, "'%s' query timed out", qname);
+        return ARC_STAT_KEYFAIL;
+    }
+    else if (kq->kq_status == ARC_DNS_ERROR)
+    {
+        arc_error(msg, "'%s' query failed", qname);
+        return ARC_STAT_KEYFAIL;
+    }
+    else
+    {
+        ans = kq->kq_ansbuf;
+        anslen = kq->kq_anslen;
+        dnssec = kq->kq_dnssec;
+    }
+
     msg->arc_dnssec_key = dnssec;
 
     /* set up pointers */
-    memcpy(&hdr, ansbuf, sizeof hdr);
-    cp = (unsigned char *) &ansbuf + NS_HFIXEDSZ;
-    eom = (unsigned char *) &ansbuf + anslen;
+    memcpy(&hdr, ans, sizeof hdr);
+    cp = ans + NS_HFIXEDSZ;
+    eom = ans + anslen;
 
     /* skip over the name at the front of the answer */
     for (qdcount = ntohs((unsigned short) hdr.qdcount); qdcount > 0; qdcount--)
     {
         /* copy it first */
-        (void) dn_expand((unsigned char *) &ansbuf, eom, cp, qname,
+        (void) dn_expand(ans, eom, cp, qname,
                          sizeof qname);
 
         if ((n = dn_skipname(cp, eom)) < 0)
@@ -255,7 +554,7 @@ arc_get_key_dns(ARC_MESSAGE *msg, char *buf, size_t buflen)
     }
 
     /* if truncated, we can't do it */
-    if (arc_check_dns_reply(ansbuf, anslen, C_IN, T_TXT) == 1)
+    if (arc_check_dns_reply(ans, anslen, C_IN, T_TXT) == 1)
     {
         arc_error(msg, "'%s' reply truncated", qname);
         return ARC_STAT_KEYFAIL;
@@ -275,7 +574,7 @@ arc_get_key_dns(ARC_MESSAGE *msg, char *buf, size_t buflen)
     while (--ancount >= 0 && cp < eom)
     {
         /* grab the label, even though we know what we asked... */
-        if ((n = dn_expand((unsigned char *) &ansbuf, eom, cp,
+        if ((n = dn_expand(ans, eom, cp,
                            (RES_UNC_T) qname, sizeof qname)) < 0)
         {
             arc_error(msg, "'%s' reply corrupt", qname);
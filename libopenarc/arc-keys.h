@@ -12,7 +12,10 @@
 #include "arc.h"
 
 /* prototypes */
-extern ARC_STAT arc_get_key_dns(ARC_MESSAGE *, char *, size_t);
-extern ARC_STAT arc_get_key_file(ARC_MESSAGE *, char *, size_t);
+extern ARC_STAT     arc_get_key_dns(ARC_MESSAGE *, char *, size_t);
+extern ARC_STAT     arc_get_key_file(ARC_MESSAGE *, char *, size_t);
+extern ARC_STAT     arc_key_start(ARC_MESSAGE *, const char *, const char *);
+extern unsigned int arc_key_poll(ARC_MESSAGE *);
+extern void         arc_key_cancel(ARC_MESSAGE *);
 
 #endif /* ! ARC_ARC_KEYS_H_ */
@@ -0,0 +1,819 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#include "build-config.h"
+
+/* system includes */
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+
+/* openssl includes */
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+
+/* libopenarc includes */
+#include "arc-rsa.h"
+
+#include "arc-malloc.h"
+
+/*
+**  RSA signing and verification for all messages of a library instance run
+**  on a fixed set of threads instead of on whichever thread has the
+**  message, so no more threads than that are ever doing RSA at once.  Each
+**  worker keeps the keys it has seen, with an EVP_PKEY_CTX already set up
+**  for them, so a busy key is initialized once per worker rather than once
+**  per message.  Public keys arrive already decoded, since the caller reads
+**  their size to refuse small ones before queueing anything.
+**
+**  Jobs go through a bounded ring that producers and consumers claim slots
+**  in with compare-and-swap (after Dmitry Vyukov's MPMC queue); the lock
+**  and condition variable are only used to put idle workers to sleep and
+**  to wake them, and the submitting thread sleeps on its own job.
+*/
+
+/* slots in the ring; a power of two */
+#define ARC_RSA_QUEUE  1024
+
+/* keys each worker keeps ready */
+#define ARC_RSA_KEYS   8
+
+#define ARC_RSA_SIGN   0
+#define ARC_RSA_VERIFY 1
+
+/* struct arc_rsajob -- one signature to make or check */
+struct arc_rsajob
+{
+    int                  j_op;
+    bool                 j_done;
+    ARC_STAT             j_status;
+    const EVP_MD        *j_md;
+    const unsigned char *j_key;
+    size_t               j_keylen;
+    EVP_PKEY            *j_pkey; /* already decoded, for verification */
+    const unsigned char *j_digest;
+    size_t               j_diglen;
+    unsigned char       *j_sig;
+    size_t               j_siglen; /* room or length */
+    uint64_t             j_queued;
+    char                *j_err;
+    pthread_mutex_t      j_lock;
+    pthread_cond_t       j_cond;
+};
+
+/* struct arc_rsakey -- a key a worker has set up */
+struct arc_rsakey
+{
+    int            k_op;
+    const EVP_MD  *k_md;
+    unsigned char *k_key; /* copy of the encoded key */
+    size_t         k_keylen;
+    uint64_t       k_used;
+    EVP_PKEY      *k_pkey;
+    EVP_PKEY_CTX  *k_ctx;
+};
+
+/* struct arc_rsaslot -- a place in the ring */
+struct arc_rsaslot
+{
+    atomic_size_t      s_seq;
+    struct arc_rsajob *s_job;
+};
+
+/* struct arc_rsapool -- the workers of one library instance */
+struct arc_rsapool
+{
+    unsigned int         rp_nthreads;
+    pthread_t           *rp_threads;
+    atomic_size_t        rp_head; /* next slot to fill */
+    atomic_size_t        rp_tail; /* next slot to take */
+    atomic_uint          rp_idle; /* workers asleep or going to sleep */
+    atomic_bool          rp_stop;
+    pthread_mutex_t      rp_lock;
+    pthread_cond_t       rp_wake;
+    atomic_uint          rp_depth;
+    atomic_uint          rp_maxdepth;
+    atomic_uint_fast64_t rp_jobs;
+    atomic_uint_fast64_t rp_waitns;
+    atomic_uint_fast64_t rp_waitmax;
+    atomic_uint_fast64_t rp_runns;
+    struct arc_rsaslot   rp_ring[ARC_RSA_QUEUE];
+};
+
+/**
+ *  Get the time in nanoseconds.
+ *
+ *  Parameters:
+ *      None.
+ *
+ *  Returns:
+ *      A monotonic clock reading.
+ */
+
+static uint64_t
+arc_rsa_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ *  Put a job in the ring.
+ *
+ *  Parameters:
+ *      pool: pool
+ *      job: job
+ *
+ *  Returns:
+ *      false if the ring is full.
+ */
+
+static bool
+arc_rsa_push(struct arc_rsapool *pool, struct arc_rsajob *job)
+{
+    size_t              pos;
+    struct arc_rsaslot *slot;
+
+    pos = atomic_load_explicit(&pool->rp_head, memory_order_relaxed);
+    for (;;)
+    {
+        intptr_t dif;
+
+        slot = &pool->rp_ring[pos & (ARC_RSA_QUEUE - 1)];
+        dif = (intptr_t) atomic_load_explicit(&slot->s_seq,
+                                              memory_order_acquire) -
+              (intptr_t) pos;
+        if (dif == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&pool->rp_head, &pos,
+                                                      pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (dif < 0)
+        {
+            return false;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&pool->rp_head, memory_order_relaxed);
+        }
+    }
+
+    slot->s_job = job;
+    atomic_store_explicit(&slot->s_seq, pos + 1, memory_order_release);
+
+    return true;
+}
+
+/**
+ *  Take a job from the ring.
+ *
+ *  Parameters:
+ *      pool: pool
+ *
+ *  Returns:
+ *      The oldest job, or NULL if there are none.
+ */
+
+static struct arc_rsajob *
+arc_rsa_pop(struct arc_rsapool *pool)
+{
+    size_t              pos;
+    struct arc_rsajob  *job;
+    struct arc_rsaslot *slot;
+
+    pos = atomic_load_explicit(&pool->rp_tail, memory_order_relaxed);
+    for (;;)
+    {
+        intptr_t dif;
+
+        slot = &pool->rp_ring[pos & (ARC_RSA_QUEUE - 1)];
+        dif = (intptr_t) atomic_load_explicit(&slot->s_seq,
+                                              memory_order_acquire) -
+              (intptr_t) (pos + 1);
+        if (dif == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&pool->rp_tail, &pos,
+                                                      pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (dif < 0)
+        {
+            return NULL;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&pool->rp_tail, memory_order_relaxed);
+        }
+    }
+
+    job = slot->s_job;
+    atomic_store_explicit(&slot->s_seq, pos + ARC_RSA_QUEUE,
+                          memory_order_release);
+
+    return job;
+}
+
+/**
+ *  Free a worker's key.
+ *
+ *  Parameters:
+ *      k: key
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+static void
+arc_rsa_dropkey(struct arc_rsakey *k)
+{
+    EVP_PKEY_CTX_free(k->k_ctx);
+    EVP_PKEY_free(k->k_pkey);
+    ARC_FREE(k->k_key);
+    memset(k, '\0', sizeof *k);
+}
+
+/**
+ *  Find or set up the key a job needs.
+ *
+ *  Parameters:
+ *      keys: the worker's keys
+ *      job: job
+ *      tick: use counter, for replacing the least recently used key
+ *
+ *  Returns:
+ *      The key, or NULL after filling in the job's status and error.
+ */
+
+static struct arc_rsakey *
+arc_rsa_getkey(struct arc_rsakey *keys, struct arc_rsajob *job, uint64_t tick)
+{
+    BIO               *bio;
+    struct arc_rsakey *k;
+    struct arc_rsakey *victim = &keys[0];
+    bool               sign = (job->j_op == ARC_RSA_SIGN);
+
+    for (int n = 0; n < ARC_RSA_KEYS; n++)
+    {
+        k = &keys[n];
+        if (k->k_ctx != NULL && k->k_op == job->j_op &&
+            k->k_md == job->j_md && k->k_keylen == job->j_keylen &&
+            memcmp(k->k_key, job->j_key, job->j_keylen) == 0)
+        {
+            k->k_used = tick;
+            return k;
+        }
+        if (k->k_used < victim->k_used)
+        {
+            victim = k;
+        }
+    }
+
+    k = victim;
+    arc_rsa_dropkey(k);
+
+    /* errors here match those of the inline code */
+    job->j_status = sign ? ARC_STAT_NORESOURCE : ARC_STAT_INTERNAL;
+
+    if (!sign)
+    {
+        /* the caller has decoded it already, to check its size */
+        if (EVP_PKEY_up_ref(job->j_pkey) != 1)
+        {
+            snprintf(job->j_err, ARC_RSA_ERRLEN, "EVP_PKEY_up_ref() failed");
+            return NULL;
+        }
+        k->k_pkey = job->j_pkey;
+    }
+    else
+    {
+        bio = BIO_new_mem_buf(job->j_key, job->j_keylen);
+        if (bio == NULL)
+        {
+            snprintf(job->j_err, ARC_RSA_ERRLEN, "BIO_new_mem_buf() failed");
+            return NULL;
+        }
+
+        if (job->j_keylen >= 5 &&
+            strncmp((const char *) job->j_key, "-----", 5) == 0)
+        {
+            k->k_pkey = PEM_read_bio_PrivateKey(bio, NULL, NULL, NULL);
+            if (k->k_pkey == NULL)
+            {
+                snprintf(job->j_err, ARC_RSA_ERRLEN,
+                         "PEM_read_bio_PrivateKey() failed");
+            }
+        }
+        else
+        {
+            k->k_pkey = d2i_PrivateKey_bio(bio, NULL);
+            if (k->k_pkey == NULL)
+            {
+                snprintf(job->j_err, ARC_RSA_ERRLEN,
+                         "d2i_PrivateKey_bio() failed");
+            }
+        }
+        BIO_free(bio);
+        if (k->k_pkey == NULL)
+        {
+            return NULL;
+        }
+    }
+
+    k->k_ctx = EVP_PKEY_CTX_new(k->k_pkey, NULL);
+    if (k->k_ctx == NULL)
+    {
+        snprintf(job->j_err, ARC_RSA_ERRLEN, "EVP_PKEY_CTX_new() failed");
+        arc_rsa_dropkey(k);
+        return NULL;
+    }
+
+    job->j_status = ARC_STAT_INTERNAL;
+    if ((sign ? EVP_PKEY_sign_init(k->k_ctx)
+              : EVP_PKEY_verify_init(k->k_ctx)) <= 0)
+    {
+        snprintf(job->j_err, ARC_RSA_ERRLEN, "%s() failed",
+                 sign ? "EVP_PKEY_sign_init" : "EVP_PKEY_verify_init");
+        arc_rsa_dropkey(k);
+        return NULL;
+    }
+    if (EVP_PKEY_CTX_set_rsa_padding(k->k_ctx, RSA_PKCS1_PADDING) <= 0)
+    {
+        snprintf(job->j_err, ARC_RSA_ERRLEN,
+                 "EVP_PKEY_CTX_set_rsa_padding() failed");
+        arc_rsa_dropkey(k);
+        return NULL;
+    }
+    if (EVP_PKEY_CTX_set_signature_md(k->k_ctx, job->j_md) <= 0)
+    {
+        snprintf(job->j_err, ARC_RSA_ERRLEN,
+                 "EVP_PKEY_CTX_set_signature_md() failed");
+        arc_rsa_dropkey(k);
+        return NULL;
+    }
+
+    k->k_key = ARC_MALLOC(job->j_keylen);
+    if (k->k_key == NULL)
+    {
+        snprintf(job->j_err, ARC_RSA_ERRLEN, "can't allocate %zu bytes",
+                 job->j_keylen);
+        arc_rsa_dropkey(k);
+        return NULL;
+    }
+    memcpy(k->k_key, job->j_key, job->j_keylen);
+    k->k_keylen = job->j_keylen;
+    k->k_op = job->j_op;
+    k->k_md = job->j_md;
+    k->k_used = tick;
+
+    return k;
+}
+
+/**
+ *  Do a job.
+ *
+ *  Parameters:
+ *      keys: the worker's keys
+ *      job: job
+ *      tick: use counter
+ *
+ *  Returns:
+ *      Nothing; the result is in the job.
+ */
+
+static void
+arc_rsa_run(struct arc_rsakey *keys, struct arc_rsajob *job, uint64_t tick)
+{
+    int                rc;
+    size_t             siglen;
+    struct arc_rsakey *k;
+
+    k = arc_rsa_getkey(keys, job, tick);
+    if (k == NULL)
+    {
+        return;
+    }
+
+    if (job->j_op == ARC_RSA_VERIFY)
+    {
+        rc = EVP_PKEY_verify(k->k_ctx, job->j_sig, job->j_siglen,
+                             job->j_digest, job->j_diglen);
+        job->j_status = rc == 1 ? ARC_STAT_OK : ARC_STAT_BADSIG;
+        return;
+    }
+
+    siglen = job->j_siglen;
+    rc = EVP_PKEY_sign(k->k_ctx, NULL, &siglen, job->j_digest, job->j_diglen);
+    if (rc == 1 && siglen > job->j_siglen)
+    {
+        snprintf(job->j_err, ARC_RSA_ERRLEN,
+                 "signature of %zu bytes is too large", siglen);
+        job->j_status = ARC_STAT_INTERNAL;
+        return;
+    }
+
+    siglen = job->j_siglen;
+    rc = EVP_PKEY_sign(k->k_ctx, job->j_sig, &siglen, job->j_digest,
+                       job->j_diglen);
+    if (rc != 1 || siglen == 0)
+    {
+        snprintf(job->j_err, ARC_RSA_ERRLEN,
+                 "EVP_PKEY_sign() failed (status %d, length %zu)", rc, siglen);
+        job->j_status = ARC_STAT_INTERNAL;
+        return;
+    }
+
+    job->j_siglen = siglen;
+    job->j_status = ARC_STAT_OK;
+}
+
+/**
+ *  Worker thread: run jobs until the pool is freed.
+ *
+ *  Parameters:
+ *      arg: the pool
+ *
+ *  Returns:
+ *      NULL.
+ */
+
+static void *
+arc_rsa_worker(void *arg)
+{
+    uint64_t            tick = 0;
+    struct arc_rsapool *pool = arg;
+    struct arc_rsajob  *job;
+    struct arc_rsakey   keys[ARC_RSA_KEYS];
+
+    memset(keys, '\0', sizeof keys);
+
+    for (;;)
+    {
+        uint64_t start;
+        uint64_t wait;
+        uint64_t max;
+
+        job = arc_rsa_pop(pool);
+        if (job == NULL)
+        {
+            /*
+            **  Announce going to sleep before looking again, so that a
+            **  producer either sees us idle or we see its job.
+            */
+
+            pthread_mutex_lock(&pool->rp_lock);
+            atomic_fetch_add(&pool->rp_idle, 1);
+            atomic_thread_fence(memory_order_seq_cst);
+            while ((job = arc_rsa_pop(pool)) == NULL &&
+                   !atomic_load(&pool->rp_stop))
+            {
+                pthread_cond_wait(&pool->rp_wake, &pool->rp_lock);
+            }
+            atomic_fetch_sub(&pool->rp_idle, 1);
+            pthread_mutex_unlock(&pool->rp_lock);
+
+            if (job == NULL)
+            {
+                break;
+            }
+        }
+
+        atomic_fetch_sub(&pool->rp_depth, 1);
+
+        start = arc_rsa_now();
+        wait = start - job->j_queued;
+        arc_rsa_run(keys, job, ++tick);
+
+        atomic_fetch_add(&pool->rp_jobs, 1);
+        atomic_fetch_add(&pool->rp_waitns, wait);
+        atomic_fetch_add(&pool->rp_runns, arc_rsa_now() - start);
+        max = atomic_load(&pool->rp_waitmax);
+        while (wait > max &&
+               !atomic_compare_exchange_weak(&pool->rp_waitmax, &max, wait))
+        {
+            continue;
+        }
+
+        pthread_mutex_lock(&job->j_lock);
+        job->j_done = true;
+        pthread_cond_signal(&job->j_cond);
+        pthread_mutex_unlock(&job->j_lock);
+    }
+
+    for (int n = 0; n < ARC_RSA_KEYS; n++)
+    {
+        arc_rsa_dropkey(&keys[n]);
+    }
+
+    return NULL;
+}
+
+/**
+ *  Hand a job to the workers and wait for it.
+ *
+ *  Parameters:
+ *      pool: pool
+ *      job: job
+ *
+ *  Returns:
+ *      The job's status.
+ */
+
+static ARC_STAT
+arc_rsa_submit(struct arc_rsapool *pool, struct arc_rsajob *job)
+{
+    unsigned int depth;
+    unsigned int max;
+
+    job->j_done = false;
+    job->j_err[0] = '\0';
+    pthread_mutex_init(&job->j_lock, NULL);
+    pthread_cond_init(&job->j_cond, NULL);
+
+    depth = atomic_fetch_add(&pool->rp_depth, 1) + 1;
+    max = atomic_load(&pool->rp_maxdepth);
+    while (depth > max &&
+           !atomic_compare_exchange_weak(&pool->rp_maxdepth, &max, depth))
+    {
+        continue;
+    }
+
+    job->j_queued = arc_rsa_now();
+
+    /* a full ring means more work than the workers can take; wait */
+    while (!arc_rsa_push(pool, job))
+    {
+        sched_yield();
+    }
+
+    /* pairs with the fence in a worker announcing that it's idle */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&pool->rp_idle) > 0)
+    {
+        pthread_mutex_lock(&pool->rp_lock);
+        pthread_cond_signal(&pool->rp_wake);
+        pthread_mutex_unlock(&pool->rp_lock);
+    }
+
+    pthread_mutex_lock(&job->j_lock);
+    while (!job->j_done)
+    {
+        pthread_cond_wait(&job->j_cond, &job->j_lock);
+    }
+    pthread_mutex_unlock(&job->j_lock);
+
+    pthread_cond_destroy(&job->j_cond);
+    pthread_mutex_destroy(&job->j_lock);
+
+    return job->j_status;
+}
+
+/**
+ *  Start a pool of RSA workers.
+ *
+ *  Parameters:
+ *      nthreads: number of workers
+ *      pool: the pool (returned)
+ *
+ *  Returns:
+ *      An ARC_STAT_* constant.
+ */
+
+ARC_STAT
+arc_rsapool_new(unsigned int nthreads, struct arc_rsapool **pool)
+{
+    struct arc_rsapool *new;
+
+    assert(nthreads > 0);
+    assert(pool != NULL);
+
+    new = ARC_CALLOC(1, sizeof *new);
+    if (new == NULL)
+    {
+        return ARC_STAT_NORESOURCE;
+    }
+
+    new->rp_threads = ARC_CALLOC(nthreads, sizeof *new->rp_threads);
+    if (new->rp_threads == NULL)
+    {
+        ARC_FREE(new);
+        return ARC_STAT_NORESOURCE;
+    }
+
+    for (size_t n = 0; n < ARC_RSA_QUEUE; n++)
+    {
+        atomic_init(&new->rp_ring[n].s_seq, n);
+    }
+    pthread_mutex_init(&new->rp_lock, NULL);
+    pthread_cond_init(&new->rp_wake, NULL);
+
+    for (; new->rp_nthreads < nthreads; new->rp_nthreads++)
+    {
+        if (pthread_create(&new->rp_threads[new->rp_nthreads], NULL,
+                           arc_rsa_worker, new) != 0)
+        {
+            arc_rsapool_free(new);
+            return ARC_STAT_NORESOURCE;
+        }
+    }
+
+    *pool = new;
+
+    return ARC_STAT_OK;
+}
+
+/**
+ *  Stop a pool's workers and free it.
+ *
+ *  Parameters:
+ *      pool: pool, with no jobs outstanding
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+void
+arc_rsapool_free(struct arc_rsapool *pool)
+{
+    if (pool == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->rp_lock);
+    atomic_store(&pool->rp_stop, true);
+    pthread_cond_broadcast(&pool->rp_wake);
+    pthread_mutex_unlock(&pool->rp_lock);
+
+    for (unsigned int n = 0; n < pool->rp_nthreads; n++)
+    {
+        pthread_join(pool->rp_threads[n], NULL);
+    }
+
+    pthread_cond_destroy(&pool->rp_wake);
+    pthread_mutex_destroy(&pool->rp_lock);
+    ARC_FREE(pool->rp_threads);
+    ARC_FREE(pool);
+}
+
+/**
+ *  Sign a digest with rsa-sha256 on a worker.
+ *
+ *  Parameters:
+ *      pool: pool
+ *      key: private key, PEM or DER
+ *      keylen: bytes at "key"
+ *      digest: SHA-256 digest
+ *      diglen: bytes at "digest"
+ *      sig: where to put the signature
+ *      siglen: room at "sig"; set to the signature's length
+ *      err: ARC_RSA_ERRLEN bytes for an error message
+ *
+ *  Returns:
+ *      An ARC_STAT_* constant.
+ */
+
+ARC_STAT
+arc_rsapool_sign(struct arc_rsapool  *pool,
+                 const unsigned char *key,
+                 size_t               keylen,
+                 const unsigned char *digest,
+                 size_t               diglen,
+                 unsigned char       *sig,
+                 size_t              *siglen,
+                 char                *err)
+{
+    ARC_STAT          status;
+    struct arc_rsajob job;
+
+    assert(pool != NULL);
+    assert(key != NULL);
+    assert(digest != NULL);
+    assert(sig != NULL);
+    assert(siglen != NULL);
+    assert(err != NULL);
+
+    memset(&job, '\0', sizeof job);
+    job.j_op = ARC_RSA_SIGN;
+    job.j_md = EVP_sha256();
+    job.j_key = key;
+    job.j_keylen = keylen;
+    job.j_digest = digest;
+    job.j_diglen = diglen;
+    job.j_sig = sig;
+    job.j_siglen = *siglen;
+    job.j_err = err;
+
+    status = arc_rsa_submit(pool, &job);
+    if (status == ARC_STAT_OK)
+    {
+        *siglen = job.j_siglen;
+    }
+
+    return status;
+}
+
+/**
+ *  Check a signature on a worker.
+ *
+ *  Parameters:
+ *      pool: pool
+ *      key: public key, DER
+ *      keylen: bytes at "key"
+ *      pkey: "key", decoded
+ *      md: digest the signature was made over
+ *      sig: signature
+ *      siglen: bytes at "sig"
+ *      digest: digest to check against
+ *      diglen: bytes at "digest"
+ *      err: ARC_RSA_ERRLEN bytes for an error message
+ *
+ *  Returns:
+ *      ARC_STAT_OK if the signature is good, ARC_STAT_BADSIG if not, or
+ *      ARC_STAT_INTERNAL with "err" filled in.
+ */
+
+ARC_STAT
+arc_rsapool_verify(struct arc_rsapool  *pool,
+                   const unsigned char *key,
+                   size_t               keylen,
+                   EVP_PKEY            *pkey,
+                   const EVP_MD        *md,
+                   const unsigned char *sig,
+                   size_t               siglen,
+                   const unsigned char *digest,
+                   size_t               diglen,
+                   char                *err)
+{
+    struct arc_rsajob job;
+
+    assert(pool != NULL);
+    assert(key != NULL);
+    assert(pkey != NULL);
+    assert(md != NULL);
+    assert(sig != NULL);
+    assert(digest != NULL);
+    assert(err != NULL);
+
+    memset(&job, '\0', sizeof job);
+    job.j_op = ARC_RSA_VERIFY;
+    job.j_md = md;
+    job.j_key = key;
+    job.j_keylen = keylen;
+    job.j_pkey = pkey;
+    job.j_digest = digest;
+    job.j_diglen = diglen;
+    job.j_sig = (unsigned char *) sig;
+    job.j_siglen = siglen;
+    job.j_err = err;
+
+    return arc_rsa_submit(pool, &job);
+}
+
+/**
+ *  Report how busy a pool has been.
+ *
+ *  Parameters:
+ *      pool: pool
+ *      stats: filled in
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+void
+arc_rsapool_stats(struct arc_rsapool *pool, struct arc_rsastats *stats)
+{
+    assert(pool != NULL);
+    assert(stats != NULL);
+
+    stats->rs_threads = pool->rp_nthreads;
+    stats->rs_depth = atomic_load(&pool->rp_depth);
+    stats->rs_maxdepth = atomic_load(&pool->rp_maxdepth);
+    stats->rs_jobs = atomic_load(&pool->rp_jobs);
+    stats->rs_waitns = atomic_load(&pool->rp_waitns);
+    stats->rs_waitmax = atomic_load(&pool->rp_waitmax);
+    stats->rs_runns = atomic_load(&pool->rp_runns);
+}
@@ -0,0 +1,49 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#ifndef ARC_RSA_H
+#define ARC_RSA_H
+
+#include "build-config.h"
+
+/* system includes */
+#include <sys/types.h>
+
+/* libopenarc includes */
+#include "arc.h"
+
+/* openssl includes */
+#include <openssl/evp.h>
+
+/* largest signature produced, in bytes (an 8192-bit key) */
+#define ARC_RSA_MAXSIG 1024
+
+/* room for a worker's error message */
+#define ARC_RSA_ERRLEN 128
+
+struct arc_rsapool;
+
+extern ARC_STAT arc_rsapool_new(unsigned int, struct arc_rsapool **);
+extern void     arc_rsapool_free(struct arc_rsapool *);
+extern ARC_STAT arc_rsapool_sign(struct arc_rsapool *,
+                                 const unsigned char *,
+                                 size_t,
+                                 const unsigned char *,
+                                 size_t,
+                                 unsigned char *,
+                                 size_t *,
+                                 char *);
+extern ARC_STAT arc_rsapool_verify(struct arc_rsapool *,
+                                   const unsigned char *,
+                                   size_t,
+                                   EVP_PKEY *,
+                                   const EVP_MD *,
+                                   const unsigned char *,
+                                   size_t,
+                                   const unsigned char *,
+                                   size_t,
+                                   char *);
+extern void     arc_rsapool_stats(struct arc_rsapool *, struct arc_rsastats *);
+
+#endif /* ARC_RSA_H */
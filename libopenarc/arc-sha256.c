@@ -0,0 +1,383 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "arc-sha256.h"
+
+#ifdef ARC_SHA256_SHANI
+#include <cpuid.h>
+#include <immintrin.h>
+#endif /* ARC_SHA256_SHANI */
+
+#define ROTR(x, n)   (((x) >> (n)) | ((x) << (32 - (n))))
+#define CH(x, y, z)  (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define BSIG0(x)     (ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define BSIG1(x)     (ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define SSIG0(x)     (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define SSIG1(x)     (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint32_t sha256_h0[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+/**
+ *  Process whole blocks using plain C.
+ *
+ *  Parameters:
+ *      state: hash state to update
+ *      data: input blocks
+ *      nblocks: number of 64-byte blocks at "data"
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+void
+arc_sha256_block_generic(uint32_t *state, const unsigned char *data,
+                         size_t nblocks)
+{
+    int      c;
+    uint32_t a, b, cc, d, e, f, g, h;
+    uint32_t t1;
+    uint32_t t2;
+    uint32_t w[64];
+
+    while (nblocks-- > 0)
+    {
+        for (c = 0; c < 16; c++)
+        {
+            w[c] = ((uint32_t) data[c * 4] << 24) |
+                   ((uint32_t) data[c * 4 + 1] << 16) |
+                   ((uint32_t) data[c * 4 + 2] << 8) |
+                   ((uint32_t) data[c * 4 + 3]);
+        }
+
+        for (c = 16; c < 64; c++)
+        {
+            w[c] = SSIG1(w[c - 2]) + w[c - 7] + SSIG0(w[c - 15]) + w[c - 16];
+        }
+
+        a = state[0];
+        b = state[1];
+        cc = state[2];
+        d = state[3];
+        e = state[4];
+        f = state[5];
+        g = state[6];
+        h = state[7];
+
+        for (c = 0; c < 64; c++)
+        {
+            t1 = h + BSIG1(e) + CH(e, f, g) + sha256_k[c] + w[c];
+            t2 = BSIG0(a) + MAJ(a, b, cc);
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = cc;
+            cc = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += cc;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+
+        data += ARC_SHA256_BLOCKSIZE;
+    }
+}
+
+#ifdef ARC_SHA256_SHANI
+/**
+ *  Process whole blocks using the x86 SHA extensions.
+ *
+ *  Parameters:
+ *      state: hash state to update
+ *      data: input blocks
+ *      nblocks: number of 64-byte blocks at "data"
+ *
+ *  Returns:
+ *      Nothing.
+ *
+ *  Notes:
+ *      Must only be called if arc_sha256_select() reported that the CPU
+ *      supports it.
+ */
+
+__attribute__((target("sha,sse4.1"))) void
+arc_sha256_block_shani(uint32_t *state, const unsigned char *data,
+                       size_t nblocks)
+{
+    int           q;
+    __m128i       abef;
+    __m128i       cdgh;
+    __m128i       abef_save;
+    __m128i       cdgh_save;
+    __m128i       msg;
+    __m128i       tmp;
+    __m128i       m[4];
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                        0x0405060700010203ULL);
+
+    /* rearrange the state into the order the instructions want */
+    tmp = _mm_loadu_si128((const __m128i *) &state[0]);
+    cdgh = _mm_loadu_si128((const __m128i *) &state[4]);
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);
+    cdgh = _mm_shuffle_epi32(cdgh, 0x1B);
+    abef = _mm_alignr_epi8(tmp, cdgh, 8);
+    cdgh = _mm_blend_epi16(cdgh, tmp, 0xF0);
+
+    while (nblocks-- > 0)
+    {
+        abef_save = abef;
+        cdgh_save = cdgh;
+
+        /* four rounds per pass, scheduling the message as we go */
+#pragma GCC unroll 16
+        for (q = 0; q < 16; q++)
+        {
+            if (q < 4)
+            {
+                m[q] = _mm_shuffle_epi8(
+                    _mm_loadu_si128((const __m128i *) (data + q * 16)), mask);
+            }
+
+            msg = _mm_add_epi32(
+                m[q % 4], _mm_loadu_si128((const __m128i *) &sha256_k[q * 4]));
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, msg);
+
+            if (q >= 3 && q <= 14)
+            {
+                tmp = _mm_alignr_epi8(m[q % 4], m[(q + 3) % 4], 4);
+                m[(q + 1) % 4] = _mm_add_epi32(m[(q + 1) % 4], tmp);
+                m[(q + 1) % 4] = _mm_sha256msg2_epu32(m[(q + 1) % 4],
+                                                      m[q % 4]);
+            }
+
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            abef = _mm_sha256rnds2_epu32(abef, cdgh, msg);
+
+            if (q >= 1 && q <= 12)
+            {
+                m[(q + 3) % 4] = _mm_sha256msg1_epu32(m[(q + 3) % 4],
+                                                      m[q % 4]);
+            }
+        }
+
+        abef = _mm_add_epi32(abef, abef_save);
+        cdgh = _mm_add_epi32(cdgh, cdgh_save);
+
+        data += ARC_SHA256_BLOCKSIZE;
+    }
+
+    /* and back again */
+    tmp = _mm_shuffle_epi32(abef, 0x1B);
+    cdgh = _mm_shuffle_epi32(cdgh, 0xB1);
+    abef = _mm_blend_epi16(tmp, cdgh, 0xF0);
+    cdgh = _mm_alignr_epi8(cdgh, tmp, 8);
+
+    _mm_storeu_si128((__m128i *) &state[0], abef);
+    _mm_storeu_si128((__m128i *) &state[4], cdgh);
+}
+#endif /* ARC_SHA256_SHANI */
+
+/**
+ *  Pick the best compression function for this CPU.
+ *
+ *  Parameters:
+ *      accel: set to true if a hardware-accelerated implementation was
+ *             selected (may be NULL)
+ *
+ *  Returns:
+ *      The compression function to use.
+ */
+
+arc_sha256_block_t
+arc_sha256_select(bool *accel)
+{
+#ifdef ARC_SHA256_SHANI
+    unsigned int eax;
+    unsigned int ebx;
+    unsigned int ecx;
+    unsigned int edx;
+
+    /* SHA (leaf 7 EBX bit 29) plus SSSE3 and SSE4.1 (leaf 1 ECX bits 9, 19) */
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) != 0 &&
+        (ecx & (1 << 9)) != 0 && (ecx & (1 << 19)) != 0 &&
+        __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) != 0 &&
+        (ebx & (1 << 29)) != 0)
+    {
+        if (accel != NULL)
+        {
+            *accel = true;
+        }
+        return arc_sha256_block_shani;
+    }
+#endif /* ARC_SHA256_SHANI */
+
+    if (accel != NULL)
+    {
+        *accel = false;
+    }
+    return arc_sha256_block_generic;
+}
+
+/**
+ *  Start a new digest.
+ *
+ *  Parameters:
+ *      ctx: context to initialize
+ *      block: compression function, usually from arc_sha256_select()
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+void
+arc_sha256_init(struct arc_sha256 *ctx, arc_sha256_block_t block)
+{
+    assert(ctx != NULL);
+    assert(block != NULL);
+
+    memcpy(ctx->sha_state, sha256_h0, sizeof ctx->sha_state);
+    ctx->sha_total = 0;
+    ctx->sha_buflen = 0;
+    ctx->sha_block = block;
+}
+
+/**
+ *  Add data to a digest.
+ *
+ *  Parameters:
+ *      ctx: digest context
+ *      buf: input data
+ *      buflen: bytes available at "buf"
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+void
+arc_sha256_update(struct arc_sha256 *ctx, const void *buf, size_t buflen)
+{
+    size_t               n;
+    const unsigned char *p = buf;
+
+    assert(ctx != NULL);
+
+    ctx->sha_total += buflen;
+
+    /* top up a partial block first */
+    if (ctx->sha_buflen > 0)
+    {
+        n = ARC_SHA256_BLOCKSIZE - ctx->sha_buflen;
+        if (n > buflen)
+        {
+            n = buflen;
+        }
+
+        memcpy(&ctx->sha_buf[ctx->sha_buflen], p, n);
+        ctx->sha_buflen += n;
+        p += n;
+        buflen -= n;
+
+        if (ctx->sha_buflen < ARC_SHA256_BLOCKSIZE)
+        {
+            return;
+        }
+
+        ctx->sha_block(ctx->sha_state, ctx->sha_buf, 1);
+        ctx->sha_buflen = 0;
+    }
+
+    /* whole blocks go straight from the caller's buffer */
+    n = buflen / ARC_SHA256_BLOCKSIZE;
+    if (n > 0)
+    {
+        ctx->sha_block(ctx->sha_state, p, n);
+        p += n * ARC_SHA256_BLOCKSIZE;
+        buflen -= n * ARC_SHA256_BLOCKSIZE;
+    }
+
+    if (buflen > 0)
+    {
+        memcpy(ctx->sha_buf, p, buflen);
+        ctx->sha_buflen = buflen;
+    }
+}
+
+/**
+ *  Finish a digest.
+ *
+ *  Parameters:
+ *      ctx: digest context
+ *      out: output buffer, at least ARC_SHA256_DIGESTSIZE bytes
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+void
+arc_sha256_final(struct arc_sha256 *ctx, unsigned char *out)
+{
+    int      c;
+    uint64_t bits;
+
+    assert(ctx != NULL);
+    assert(out != NULL);
+
+    bits = ctx->sha_total * 8;
+
+    ctx->sha_buf[ctx->sha_buflen++] = 0x80;
+    if (ctx->sha_buflen > ARC_SHA256_BLOCKSIZE - 8)
+    {
+        memset(&ctx->sha_buf[ctx->sha_buflen], 0,
+               ARC_SHA256_BLOCKSIZE - ctx->sha_buflen);
+        ctx->sha_block(ctx->sha_state, ctx->sha_buf, 1);
+        ctx->sha_buflen = 0;
+    }
+
+    memset(&ctx->sha_buf[ctx->sha_buflen], 0,
+           ARC_SHA256_BLOCKSIZE - 8 - ctx->sha_buflen);
+    for (c = 0; c < 8; c++)
+    {
+        ctx->sha_buf[ARC_SHA256_BLOCKSIZE - 1 - c] = (bits >> (c * 8)) & 0xff;
+    }
+    ctx->sha_block(ctx->sha_state, ctx->sha_buf, 1);
+
+    for (c = 0; c < 8; c++)
+    {
+        out[c * 4] = (ctx->sha_state[c] >> 24) & 0xff;
+        out[c * 4 + 1] = (ctx->sha_state[c] >> 16) & 0xff;
+        out[c * 4 + 2] = (ctx->sha_state[c] >> 8) & 0xff;
+        out[c * 4 + 3] = ctx->sha_state[c] & 0xff;
+    }
+}
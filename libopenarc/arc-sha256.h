@@ -0,0 +1,43 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#ifndef ARC_SHA256_H
+#define ARC_SHA256_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define ARC_SHA256_BLOCKSIZE  64
+#define ARC_SHA256_DIGESTSIZE 32
+
+/* x86 SHA extensions can be used if the compiler knows how to target them */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define ARC_SHA256_SHANI 1
+#endif
+
+/* compression function; processes "nblocks" consecutive 64-byte blocks */
+typedef void (*arc_sha256_block_t)(uint32_t *, const unsigned char *, size_t);
+
+/* struct arc_sha256 -- built-in SHA-256 context */
+struct arc_sha256
+{
+    uint32_t           sha_state[8];
+    uint64_t           sha_total;
+    size_t             sha_buflen;
+    arc_sha256_block_t sha_block;
+    unsigned char      sha_buf[ARC_SHA256_BLOCKSIZE];
+};
+
+extern void arc_sha256_block_generic(uint32_t *, const unsigned char *, size_t);
+#ifdef ARC_SHA256_SHANI
+extern void arc_sha256_block_shani(uint32_t *, const unsigned char *, size_t);
+#endif /* ARC_SHA256_SHANI */
+
+extern arc_sha256_block_t arc_sha256_select(bool *);
+extern void arc_sha256_init(struct arc_sha256 *, arc_sha256_block_t);
+extern void arc_sha256_update(struct arc_sha256 *, const void *, size_t);
+extern void arc_sha256_final(struct arc_sha256 *, unsigned char *);
+
+#endif /* ARC_SHA256_H */
@@ -0,0 +1,273 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#include "build-config.h"
+
+/* system includes */
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+/* libopenarc includes */
+#include "arc-tasks.h"
+
+#include "arc-malloc.h"
+
+/*
+**  Background work for messages, such as checking signatures while the body
+**  is still arriving, runs on a few threads that live as long as the
+**  library instance instead of on a thread started for each message.
+**
+**  A task that no worker has picked up by the time its message needs the
+**  result is taken back and run by the message's own thread, so a burst of
+**  messages never waits behind a queue longer than doing the work itself
+**  would take.
+*/
+
+#define ARC_TASK_QUEUED  1
+#define ARC_TASK_RUNNING 2
+#define ARC_TASK_DONE    3
+
+/* struct arc_taskpool -- the background workers of one library instance */
+struct arc_taskpool
+{
+    bool             tp_stop;
+    unsigned int     tp_nthreads;
+    pthread_t       *tp_threads;
+    struct arc_task *tp_head;
+    struct arc_task *tp_tail;
+    pthread_mutex_t  tp_lock;
+    pthread_cond_t   tp_work;
+    pthread_cond_t   tp_done;
+};
+
+/**
+ *  Worker thread: run tasks until the pool is freed.
+ *
+ *  Parameters:
+ *      arg: the pool
+ *
+ *  Returns:
+ *      NULL.
+ */
+
+static void *
+arc_task_worker(void *arg)
+{
+    struct arc_task     *task;
+    struct arc_taskpool *pool = arg;
+
+    pthread_mutex_lock(&pool->tp_lock);
+
+    for (;;)
+    {
+        while (pool->tp_head == NULL && !pool->tp_stop)
+        {
+            pthread_cond_wait(&pool->tp_work, &pool->tp_lock);
+        }
+
+        if (pool->tp_head == NULL)
+        {
+            break;
+        }
+
+        task = pool->tp_head;
+        pool->tp_head = task->t_next;
+        if (pool->tp_head == NULL)
+        {
+            pool->tp_tail = NULL;
+        }
+        task->t_state = ARC_TASK_RUNNING;
+        pthread_mutex_unlock(&pool->tp_lock);
+
+        task->t_fn(task->t_arg);
+
+        pthread_mutex_lock(&pool->tp_lock);
+        task->t_state = ARC_TASK_DONE;
+        pthread_cond_broadcast(&pool->tp_done);
+    }
+
+    pthread_mutex_unlock(&pool->tp_lock);
+
+    return NULL;
+}
+
+/**
+ *  Start a pool of background workers.
+ *
+ *  Parameters:
+ *      nthreads: number of workers
+ *      pool: the pool (returned)
+ *
+ *  Returns:
+ *      An ARC_STAT_* constant.
+ */
+
+ARC_STAT
+arc_taskpool_new(unsigned int nthreads, struct arc_taskpool **pool)
+{
+    struct arc_taskpool *new;
+
+    assert(nthreads > 0);
+    assert(pool != NULL);
+
+    new = ARC_CALLOC(1, sizeof *new);
+    if (new == NULL)
+    {
+        return ARC_STAT_NORESOURCE;
+    }
+
+    new->tp_threads = ARC_CALLOC(nthreads, sizeof *new->tp_threads);
+    if (new->tp_threads == NULL)
+    {
+        ARC_FREE(new);
+        return ARC_STAT_NORESOURCE;
+    }
+
+    pthread_mutex_init(&new->tp_lock, NULL);
+    pthread_cond_init(&new->tp_work, NULL);
+    pthread_cond_init(&new->tp_done, NULL);
+
+    for (; new->tp_nthreads < nthreads; new->tp_nthreads++)
+    {
+        if (pthread_create(&new->tp_threads[new->tp_nthreads], NULL,
+                           arc_task_worker, new) != 0)
+        {
+            arc_taskpool_free(new);
+            return ARC_STAT_NORESOURCE;
+        }
+    }
+
+    *pool = new;
+
+    return ARC_STAT_OK;
+}
+
+/**
+ *  Stop a pool's workers and free it.
+ *
+ *  Parameters:
+ *      pool: pool, with no tasks outstanding
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+void
+arc_taskpool_free(struct arc_taskpool *pool)
+{
+    if (pool == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->tp_lock);
+    pool->tp_stop = true;
+    pthread_cond_broadcast(&pool->tp_work);
+    pthread_mutex_unlock(&pool->tp_lock);
+
+    for (unsigned int n = 0; n < pool->tp_nthreads; n++)
+    {
+        pthread_join(pool->tp_threads[n], NULL);
+    }
+
+    pthread_cond_destroy(&pool->tp_done);
+    pthread_cond_destroy(&pool->tp_work);
+    pthread_mutex_destroy(&pool->tp_lock);
+    ARC_FREE(pool->tp_threads);
+    ARC_FREE(pool);
+}
+
+/**
+ *  Queue a task for the workers.
+ *
+ *  Parameters:
+ *      pool: pool
+ *      task: task, which must stay put until arc_taskpool_finish()
+ *      fn: function to run
+ *      arg: argument for "fn"
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+void
+arc_taskpool_start(struct arc_taskpool *pool,
+                   struct arc_task     *task,
+                   void (*fn)(void *),
+                   void *arg)
+{
+    assert(pool != NULL);
+    assert(task != NULL);
+    assert(fn != NULL);
+
+    task->t_fn = fn;
+    task->t_arg = arg;
+    task->t_next = NULL;
+
+    pthread_mutex_lock(&pool->tp_lock);
+    task->t_state = ARC_TASK_QUEUED;
+    if (pool->tp_tail == NULL)
+    {
+        pool->tp_head = task;
+    }
+    else
+    {
+        pool->tp_tail->t_next = task;
+    }
+    pool->tp_tail = task;
+    pthread_cond_signal(&pool->tp_work);
+    pthread_mutex_unlock(&pool->tp_lock);
+}
+
+/**
+ *  Wait for a task, running it here if no worker has started it yet.
+ *
+ *  Parameters:
+ *      pool: pool
+ *      task: task given to arc_taskpool_start()
+ *
+ *  Returns:
+ *      Nothing; the task's function has returned.
+ */
+
+void
+arc_taskpool_finish(struct arc_taskpool *pool, struct arc_task *task)
+{
+    assert(pool != NULL);
+    assert(task != NULL);
+
+    pthread_mutex_lock(&pool->tp_lock);
+
+    if (task->t_state == ARC_TASK_QUEUED)
+    {
+        struct arc_task **prev;
+        struct arc_task  *last = NULL;
+
+        for (prev = &pool->tp_head; *prev != task; prev = &(*prev)->t_next)
+        {
+            last = *prev;
+        }
+        *prev = task->t_next;
+        if (pool->tp_tail == task)
+        {
+            pool->tp_tail = last;
+        }
+        task->t_state = ARC_TASK_RUNNING;
+        pthread_mutex_unlock(&pool->tp_lock);
+
+        task->t_fn(task->t_arg);
+        task->t_state = ARC_TASK_DONE;
+
+        return;
+    }
+
+    while (task->t_state != ARC_TASK_DONE)
+    {
+        pthread_cond_wait(&pool->tp_done, &pool->tp_lock);
+    }
+
+    pthread_mutex_unlock(&pool->tp_lock);
+}
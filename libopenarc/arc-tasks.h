@@ -0,0 +1,32 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#ifndef ARC_TASKS_H
+#define ARC_TASKS_H
+
+#include "build-config.h"
+
+/* libopenarc includes */
+#include "arc.h"
+
+/* struct arc_task -- a function to run in the background */
+struct arc_task
+{
+    int              t_state;
+    void            *t_arg;
+    struct arc_task *t_next;
+    void (*t_fn)(void *);
+};
+
+struct arc_taskpool;
+
+extern ARC_STAT arc_taskpool_new(unsigned int, struct arc_taskpool **);
+extern void     arc_taskpool_free(struct arc_taskpool *);
+extern void     arc_taskpool_start(struct arc_taskpool *,
+                                   struct arc_task *,
+                                   void (*)(void *),
+                                   void *);
+extern void     arc_taskpool_finish(struct arc_taskpool *, struct arc_task *);
+
+#endif /* ARC_TASKS_H */
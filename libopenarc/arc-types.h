@@ -8,6 +8,7 @@
 #include "build-config.h"
 
 /* system includes */
+#include <pthread.h>
 #include <regex.h>
 #include <stdbool.h>
 #include <sys/types.h>
@@ -20,17 +21,25 @@
 #include <openssl/sha.h>
 
 /* libopenarc includes */
+#include "arc-arena.h"
 #include "arc-internal.h"
+#include "arc-sha256.h"
+#include "arc-tasks.h"
 #include "arc.h"
 
+/* struct arc_capture -- where canonicalized data is being recorded */
+struct arc_capture;
+
 /* struct arc_hash -- stuff needed to do a hash */
 struct arc_hash
 {
-    int           hash_tmpfd;
-    BIO          *hash_tmpbio;
-    EVP_MD_CTX   *hash_ctx;
-    unsigned char hash_out[EVP_MAX_MD_SIZE];
-    unsigned int  hash_outlen;
+    bool              hash_builtin;
+    int               hash_tmpfd;
+    BIO              *hash_tmpbio;
+    EVP_MD_CTX       *hash_ctx;
+    struct arc_sha256 hash_sha256;
+    unsigned char     hash_out[EVP_MAX_MD_SIZE];
+    unsigned int      hash_outlen;
 };
 
 /* struct arc_qmethod -- signature query method */
@@ -55,7 +64,7 @@ struct arc_hdrfield
     uint32_t             hdr_flags;
     size_t               hdr_namelen;
     size_t               hdr_textlen;
-    char                *hdr_text;
+    const char          *hdr_text;
     void                *hdr_data;
     struct arc_hdrfield *hdr_next;
 };
@@ -71,6 +80,21 @@ struct arc_set
     struct arc_hdrfield *arcset_as;
 };
 
+/* struct arc_keyquery -- a key lookup started before it was needed */
+struct arc_keyquery
+{
+    bool                 kq_done;
+    int                  kq_status; /* ARC_DNS_* once done */
+    int                  kq_error;
+    int                  kq_dnssec;
+    size_t               kq_anslen;
+    time_t               kq_expire; /* 0 if never */
+    void                *kq_handle;
+    char                *kq_qname;
+    unsigned char       *kq_ansbuf;
+    struct arc_keyquery *kq_next;
+};
+
 /* struct arc_plist -- a parameter/value pair */
 struct arc_plist
 {
@@ -86,7 +110,8 @@ struct arc_kvset
     arc_kvsettype_t   set_type;
     char             *set_data;
     void             *set_udata;
-    struct arc_plist *set_plist[NPRINTABLE];
+    char             *set_tags[ARC_NTAGS]; /* values of known tags */
+    struct arc_plist *set_plist;           /* any other tags */
     struct arc_kvset *set_next;
 };
 
@@ -100,6 +125,7 @@ struct arc_canon
     int                  canon_bodystate;
     unsigned int         canon_hashtype;
     unsigned int         canon_blanks;
+    unsigned int         canon_capid;
     size_t               canon_hashbuflen;
     size_t               canon_hashbufsize;
     ssize_t              canon_remain;
@@ -111,6 +137,7 @@ struct arc_canon
     struct arc_hash     *canon_hash;
     struct arc_dstring  *canon_buf;
     struct arc_hdrfield *canon_sigheader;
+    struct arc_capture  *canon_capture;
     struct arc_canon    *canon_next;
 };
 
@@ -119,11 +146,16 @@ struct arc_msghandle
 {
     bool                 arc_partial;
     bool                 arc_infail;
+    bool                 arc_sealchecked;
+    bool                 arc_cvstop;
+    bool                 arc_bgstarted;
+    bool                 arc_bgdone;
     int                  arc_dnssec_key;
     int                  arc_signalg;
     int                  arc_oldest_pass;
     unsigned int         arc_mode;
     unsigned int         arc_nsets;
+    unsigned int         arc_cvfail;
     unsigned int         arc_margin;
     unsigned int         arc_state;
     unsigned int         arc_hdrcnt;
@@ -164,6 +196,16 @@ struct arc_msghandle
     struct arc_canon    *arc_sign_bodycanon;
     struct arc_canon    *arc_canonhead;
     struct arc_canon    *arc_canontail;
+    struct arc_bodypool *arc_bodypool;
+    struct arc_capture  *arc_capture;
+    struct arc_arena    *arc_arena;
+    size_t               arc_arenakeep;
+    unsigned int         arc_nhashctxs;
+    unsigned int         arc_hashctxsz;
+    EVP_MD_CTX         **arc_hashctxs;
+    ARC_STAT            *arc_amsstatus;
+    struct arc_task      arc_bgtask;
+    pthread_mutex_t      arc_bglock;
     struct arc_hdrfield *arc_hhead;
     struct arc_hdrfield *arc_htail;
     struct arc_hdrfield *arc_sealhead;
@@ -171,6 +213,7 @@ struct arc_msghandle
     struct arc_kvset    *arc_kvsethead;
     struct arc_kvset    *arc_kvsettail;
     struct arc_set      *arc_sets;
+    struct arc_keyquery *arc_keyqueries;
     ARC_LIB             *arc_library;
     const void          *arc_user_context;
 };
@@ -178,17 +221,30 @@ struct arc_msghandle
 /* struct arc_lib -- a ARC library context */
 struct arc_lib
 {
-    bool                arcl_signre;
-    bool                arcl_dnsinit_done;
-    unsigned int        arcl_flsize;
-    unsigned int        arcl_sigttl;
-    uint32_t            arcl_flags;
-    time_t              arcl_fixedtime;
-    unsigned int        arcl_callback_int;
-    unsigned int        arcl_minkeysize;
-    unsigned int       *arcl_flist;
-    struct arc_dstring *arcl_sslerrbuf;
-    char              **arcl_oversignhdrs;
+    bool                 arcl_signre;
+    bool                 arcl_dnsinit_done;
+    unsigned int         arcl_flsize;
+    unsigned int         arcl_sigttl;
+    uint32_t             arcl_flags;
+    time_t               arcl_fixedtime;
+    unsigned int         arcl_callback_int;
+    unsigned int         arcl_minkeysize;
+    unsigned int         arcl_bodythreads;
+    size_t               arcl_bodythreshold;
+    unsigned int         arcl_rsathreads;
+    struct arc_rsapool  *arcl_rsapool;
+    struct arc_taskpool *arcl_taskpool;
+    size_t               arcl_arenasize;
+    size_t               arcl_arenahwm;
+    pthread_mutex_t      arcl_arenalock;
+    unsigned int         arcl_capsample;
+    unsigned int         arcl_capseq;
+    pthread_mutex_t      arcl_caplock;
+    struct arc_allocator arcl_alloc;
+    unsigned int        *arcl_flist;
+    arc_sha256_block_t   arcl_sha256_block; /* NULL without SHA-NI */
+    struct arc_dstring  *arcl_sslerrbuf;
+    char               **arcl_oversignhdrs;
     void (*arcl_dns_callback)(const void *context);
     void *arcl_dns_service;
     int (*arcl_dns_init)(void **srv);
@@ -211,4 +267,7 @@ struct arc_lib
     char    arcl_queryinfo[MAXPATHLEN + 1];
 };
 
+/* allocator that message-related memory is charged to */
+#define ARC_MSGALLOC(msg) (&(msg)->arc_library->arcl_alloc)
+
 #endif /* ARC_ARC_TYPES_H_ */
@@ -151,13 +151,15 @@ arc_hdrlist(char *buf, size_t buflen, char **hdrlist, bool first)
 **  	msg -- ARC_MESSAGE handle
 **  	fp -- descriptor (returned)
 **  	keep -- if false, unlink() the file once created
+**  	name -- buffer to receive the file's path (or NULL)
+**  	namelen -- bytes available at "name"
 **
 **  Return value:
 **  	An ARC_STAT_* constant.
 */
 
 ARC_STAT
-arc_tmpfile(ARC_MESSAGE *msg, int *fp, bool keep)
+arc_tmpfile(ARC_MESSAGE *msg, int *fp, bool keep, char *name, size_t namelen)
 {
     int   fd;
     char *p;
@@ -186,6 +188,11 @@ arc_tmpfile(ARC_MESSAGE *msg, int *fp, bool keep)
 
     *fp = fd;
 
+    if (name != NULL)
+    {
+        strlcpy(name, path, namelen);
+    }
+
     if (!keep)
     {
         (void) unlink(path);
@@ -27,6 +27,6 @@ extern void     arc_min_timeval(struct timeval *,
                                 struct timeval *,
                                 struct timeval **);
 
-extern ARC_STAT arc_tmpfile(ARC_MESSAGE *, int *, bool);
+extern ARC_STAT arc_tmpfile(ARC_MESSAGE *, int *, bool, char *, size_t);
 
 #endif /* _ARC_UTIL_H_ */
@@ -18,12 +18,14 @@
 #include <limits.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <pthread.h>
 #include <resolv.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/param.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #ifdef __STDC__
@@ -42,10 +44,14 @@
 
 /* libopenarc includes */
 #include "arc-canon.h"
+#include "arc-capture.h"
 #include "arc-dns.h"
 #include "arc-internal.h"
 #include "arc-keys.h"
+#include "arc-rsa.h"
+#include "arc-sha256.h"
 #include "arc-tables.h"
+#include "arc-tasks.h"
 #include "arc-types.h"
 #include "arc-util.h"
 #include "arc.h"
@@ -79,11 +85,25 @@ void arc_error(ARC_MESSAGE *, const char *, ...);
 #define BUFRSZ             2048
 #define DEFERRLEN          128
 
+/* background verification threads, at most */
+#define MAXBGTHREADS       16
+
 /* generic array size macro */
 #define NITEMS(array)      ((int) (sizeof(array) / sizeof(array[0])))
 
-/* macros */
-#define ARC_PHASH(x)       ((x) - 32)
+/* names of the ARC_TAG_* tags, in order */
+static const char *arc_tagnames[ARC_NTAGS] = {
+    "a", "b", "bh", "c", "cv", "d", "h", "i",
+    "k", "l", "p",  "q", "s",  "t", "v", "x",
+};
+
+/* single-letter tags, indexed by letter */
+static const int arc_tagletters[26] = {
+    ARC_TAG_A, ARC_TAG_B, ARC_TAG_C, ARC_TAG_D, -1,        -1,        -1,
+    ARC_TAG_H, ARC_TAG_I, -1,        ARC_TAG_K, ARC_TAG_L, -1,        -1,
+    -1,        ARC_TAG_P, ARC_TAG_Q, -1,        ARC_TAG_S, ARC_TAG_T, -1,
+    ARC_TAG_V, -1,        ARC_TAG_X, -1,        -1,
+};
 
 /*
 **  ARC_ERROR -- log an error into a DKIM handle
@@ -111,7 +131,7 @@ arc_verror(ARC_MESSAGE *msg, const char *format, va_list ap)
 
     if (msg->arc_error == NULL)
     {
-        msg->arc_error = ARC_MALLOC(DEFERRLEN);
+        msg->arc_error = ARC_LMALLOC(ARC_MSGALLOC(msg), DEFERRLEN);
         if (msg->arc_error == NULL)
         {
             errno = saverr;
@@ -135,14 +155,14 @@ arc_verror(ARC_MESSAGE *msg, const char *format, va_list ap)
 
         if (flen >= msg->arc_errorlen)
         {
-            new = ARC_MALLOC(flen + 1);
+            new = ARC_LMALLOC(ARC_MSGALLOC(msg), flen + 1);
             if (new == NULL)
             {
                 errno = saverr;
                 return;
             }
 
-            ARC_FREE(msg->arc_error);
+            ARC_LFREE(ARC_MSGALLOC(msg), msg->arc_error);
             msg->arc_error = new;
             msg->arc_errorlen = flen + 1;
         }
@@ -160,19 +180,41 @@ arc_error(ARC_MESSAGE *msg, const char *format, ...)
 {
     va_list va;
 
+    /* the background verification thread may be reporting too */
+    if (msg->arc_bgstarted)
+    {
+        pthread_mutex_lock(&msg->arc_bglock);
+    }
+
     va_start(va, format);
     arc_verror(msg, format, va);
     va_end(va);
+
+    if (msg->arc_bgstarted)
+    {
+        pthread_mutex_unlock(&msg->arc_bglock);
+    }
 }
 
 void
-arc_error_cb(void *msg, const char *format, ...)
+arc_error_cb(void *ctx, const char *format, ...)
 {
-    va_list va;
+    va_list      va;
+    ARC_MESSAGE *msg = ctx;
+
+    if (msg->arc_bgstarted)
+    {
+        pthread_mutex_lock(&msg->arc_bglock);
+    }
 
     va_start(va, format);
     arc_verror(msg, format, va);
     va_end(va);
+
+    if (msg->arc_bgstarted)
+    {
+        pthread_mutex_unlock(&msg->arc_bglock);
+    }
 }
 
 /*
@@ -576,7 +618,8 @@ arc_getamshdr_d(
 
 #define DELIMITER "\001"
 
-    tmpbuf = arc_dstring_new(BUFRSZ, MAXBUFRSZ, msg, &arc_error_cb);
+    tmpbuf = arc_dstring_new_arena(msg->arc_arena, BUFRSZ, MAXBUFRSZ, msg,
+                                   &arc_error_cb);
     if (tmpbuf == NULL)
     {
         arc_error(msg, "failed to allocate dynamic string");
@@ -586,7 +629,7 @@ arc_getamshdr_d(
     if (msg->arc_hdrbuf == NULL)
     {
         msg->arc_hdrbuf = arc_dstring_new(BUFRSZ, MAXBUFRSZ, msg,
-                                          &arc_error_cb);
+                                          &arc_error_cb, ARC_MSGALLOC(msg));
         if (msg->arc_hdrbuf == NULL)
         {
             arc_dstring_free(tmpbuf);
@@ -747,6 +790,7 @@ arc_getamshdr_d(
 ARC_LIB *
 arc_init(void)
 {
+    bool     accel;
     ARC_LIB *lib;
 
     lib = ARC_CALLOC(1, sizeof *lib);
@@ -756,6 +800,9 @@ arc_init(void)
     }
 
     lib->arcl_minkeysize = ARC_DEFAULT_MINKEYSIZE;
+    lib->arcl_bodythreshold = DEFBODYTHRESHOLD;
+    lib->arcl_arenasize = DEFARENASIZE;
+    lib->arcl_capsample = 1;
     lib->arcl_flags = ARC_LIBFLAGS_DEFAULT;
 
 #define FEATURE_INDEX(x)  ((x) / (8 * sizeof(unsigned int)))
@@ -780,9 +827,27 @@ arc_init(void)
     lib->arcl_dns_cancel = arc_res_cancel;
     lib->arcl_dns_waitreply = arc_res_waitreply;
     strlcpy(lib->arcl_tmpdir, DEFTMPDIR, sizeof lib->arcl_tmpdir);
+    pthread_mutex_init(&lib->arcl_arenalock, NULL);
+    pthread_mutex_init(&lib->arcl_caplock, NULL);
+    arc_allocator_init(&lib->arcl_alloc);
 
     FEATURE_ADD(lib, ARC_FEATURE_SHA256);
 
+    /*
+    **  Pick the built-in SHA-256 implementation once, up front.  The
+    **  portable C version is much slower than EVP, so without the SHA
+    **  extensions ARC_LIBFLAGS_BUILTINSHA has no effect.
+    */
+    lib->arcl_sha256_block = arc_sha256_select(&accel);
+    if (accel)
+    {
+        FEATURE_ADD(lib, ARC_FEATURE_SHANI);
+    }
+    else
+    {
+        lib->arcl_sha256_block = NULL;
+    }
+
     return lib;
 }
 
@@ -802,6 +867,15 @@ arc_close(ARC_LIB *lib)
     arc_options(lib, ARC_OP_SETOPT, ARC_OPTS_SIGNHDRS, NULL, sizeof(char **));
     arc_options(lib, ARC_OP_SETOPT, ARC_OPTS_OVERSIGNHDRS, NULL,
                 sizeof(char **));
+    arc_rsapool_free(lib->arcl_rsapool);
+    arc_taskpool_free(lib->arcl_taskpool);
+    if (lib->arcl_dns_service != NULL && lib->arcl_dns_close != NULL)
+    {
+        lib->arcl_dns_close(lib->arcl_dns_service);
+    }
+    pthread_mutex_destroy(&lib->arcl_arenalock);
+    pthread_mutex_destroy(&lib->arcl_caplock);
+    arc_allocator_destroy(&lib->arcl_alloc);
     ARC_FREE(lib->arcl_flist);
     ARC_FREE(lib);
 }
@@ -866,6 +940,21 @@ arc_options(ARC_LIB *lib, int op, int arg, void *val, size_t valsz)
         else
         {
             memcpy(&lib->arcl_flags, val, valsz);
+
+            /* only while no messages are using the old workers */
+            if ((lib->arcl_flags & ARC_LIBFLAGS_BGVERIFY) == 0)
+            {
+                arc_taskpool_free(lib->arcl_taskpool);
+                lib->arcl_taskpool = NULL;
+            }
+            else if (lib->arcl_taskpool == NULL)
+            {
+                long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+                /* without workers arc_eom() does all the checks itself */
+                (void) arc_taskpool_new(ncpu > 0 ? MIN(ncpu, MAXBGTHREADS) : 1,
+                                        &lib->arcl_taskpool);
+            }
         }
 
         return ARC_STAT_OK;
@@ -968,6 +1057,196 @@ arc_options(ARC_LIB *lib, int op, int arg, void *val, size_t valsz)
 
         return ARC_STAT_OK;
 
+    case ARC_OPTS_BODYTHREADS:
+        if (val == NULL)
+        {
+            return ARC_STAT_INVALID;
+        }
+
+        if (valsz != sizeof lib->arcl_bodythreads)
+        {
+            return ARC_STAT_INVALID;
+        }
+
+        if (op == ARC_OP_GETOPT)
+        {
+            memcpy(val, &lib->arcl_bodythreads, valsz);
+        }
+        else
+        {
+            memcpy(&lib->arcl_bodythreads, val, valsz);
+        }
+
+        return ARC_STAT_OK;
+
+    case ARC_OPTS_BODYTHRESHOLD:
+        if (val == NULL)
+        {
+            return ARC_STAT_INVALID;
+        }
+
+        if (valsz != sizeof lib->arcl_bodythreshold)
+        {
+            return ARC_STAT_INVALID;
+        }
+
+        if (op == ARC_OP_GETOPT)
+        {
+            memcpy(val, &lib->arcl_bodythreshold, valsz);
+        }
+        else
+        {
+            memcpy(&lib->arcl_bodythreshold, val, valsz);
+        }
+
+        return ARC_STAT_OK;
+
+    case ARC_OPTS_RSATHREADS:
+        if (val == NULL)
+        {
+            return ARC_STAT_INVALID;
+        }
+
+        if (valsz != sizeof lib->arcl_rsathreads)
+        {
+            return ARC_STAT_INVALID;
+        }
+
+        if (op == ARC_OP_GETOPT)
+        {
+            memcpy(val, &lib->arcl_rsathreads, valsz);
+            return ARC_STAT_OK;
+        }
+
+        /* only while no messages are using the old workers */
+        arc_rsapool_free(lib->arcl_rsapool);
+        lib->arcl_rsapool = NULL;
+        memcpy(&lib->arcl_rsathreads, val, valsz);
+
+        if (lib->arcl_rsathreads > 0 &&
+            arc_rsapool_new(lib->arcl_rsathreads, &lib->arcl_rsapool) !=
+                ARC_STAT_OK)
+        {
+            lib->arcl_rsathreads = 0;
+            return ARC_STAT_NORESOURCE;
+        }
+
+        return ARC_STAT_OK;
+
+    case ARC_OPTS_RSASTATS:
+        if (val == NULL || valsz != sizeof(struct arc_rsastats) ||
+            op != ARC_OP_GETOPT)
+        {
+            return ARC_STAT_INVALID;
+        }
+
+        memset(val, '\0', valsz);
+        if (lib->arcl_rsapool != NULL)
+        {
+            arc_rsapool_stats(lib->arcl_rsapool, val);
+        }
+
+        return ARC_STAT_OK;
+
+    case ARC_OPTS_ARENASIZE:
+        if (val == NULL)
+        {
+            return ARC_STAT_INVALID;
+        }
+
+        if (valsz != sizeof lib->arcl_arenasize)
+        {
+            return ARC_STAT_INVALID;
+        }
+
+        if (op == ARC_OP_GETOPT)
+        {
+            memcpy(val, &lib->arcl_arenasize, valsz);
+        }
+        else
+        {
+            memcpy(&lib->arcl_arenasize, val, valsz);
+        }
+
+        return ARC_STAT_OK;
+
+    case ARC_OPTS_ARENAHWM:
+        if (val == NULL)
+        {
+            return ARC_STAT_INVALID;
+        }
+
+        if (valsz != sizeof lib->arcl_arenahwm)
+        {
+            return ARC_STAT_INVALID;
+        }
+
+        /* messages finishing on other threads update this */
+        pthread_mutex_lock(&lib->arcl_arenalock);
+        if (op == ARC_OP_GETOPT)
+        {
+            memcpy(val, &lib->arcl_arenahwm, valsz);
+        }
+        else
+        {
+            memcpy(&lib->arcl_arenahwm, val, valsz);
+        }
+        pthread_mutex_unlock(&lib->arcl_arenalock);
+
+        return ARC_STAT_OK;
+
+    case ARC_OPTS_CAPTURESAMPLE:
+        if (val == NULL)
+        {
+            return ARC_STAT_INVALID;
+        }
+
+        if (valsz != sizeof lib->arcl_capsample)
+        {
+            return ARC_STAT_INVALID;
+        }
+
+        pthread_mutex_lock(&lib->arcl_caplock);
+        if (op == ARC_OP_GETOPT)
+        {
+            memcpy(val, &lib->arcl_capsample, valsz);
+        }
+        else
+        {
+            memcpy(&lib->arcl_capsample, val, valsz);
+            lib->arcl_capseq = 0;
+        }
+        pthread_mutex_unlock(&lib->arcl_caplock);
+
+        return ARC_STAT_OK;
+
+    case ARC_OPTS_MEMLIVE:
+        if (val == NULL || valsz != sizeof(size_t) || op != ARC_OP_GETOPT)
+        {
+            return ARC_STAT_INVALID;
+        }
+
+        arc_allocator_stats(&lib->arcl_alloc, val, NULL);
+
+        return ARC_STAT_OK;
+
+    case ARC_OPTS_MEMPEAK:
+        if (val == NULL || valsz != sizeof(size_t))
+        {
+            return ARC_STAT_INVALID;
+        }
+
+        if (op == ARC_OP_GETOPT)
+        {
+            arc_allocator_stats(&lib->arcl_alloc, NULL, val);
+        }
+        else
+        {
+            arc_allocator_setpeak(&lib->arcl_alloc, *(size_t *) val);
+        }
+
+        return ARC_STAT_OK;
+
     case ARC_OPTS_SIGNHDRS:
         if (valsz != sizeof(char **) || op == ARC_OP_GETOPT)
         {
@@ -1107,6 +1386,55 @@ arc_set_dns(ARC_LIB *lib,
     return ARC_STAT_OK;
 }
 
+/*
+**  ARC_SET_ALLOCATOR -- override memory allocation
+**
+**  Parameters:
+**  	lib -- library instance
+**  	alloc_fn -- allocation function
+**  	realloc_fn -- reallocation function
+**  	free_fn -- release function
+**  	ctx -- context passed to each of the above
+**
+**  Return value:
+**  	An ARC_STAT_* constant.
+**
+**  Notes:
+**  	Only allowed while nothing is allocated from the library, i.e.
+**  	before the first message handle is created or after the last one
+**  	is destroyed.
+*/
+
+ARC_STAT
+arc_set_allocator(ARC_LIB *lib,
+                  void *(*alloc_fn)(void *ctx, size_t size),
+                  void *(*realloc_fn)(void *ctx, void *ptr, size_t size),
+                  void (*free_fn)(void *ctx, void *ptr),
+                  void *ctx)
+{
+    size_t live;
+
+    assert(lib != NULL);
+
+    if (alloc_fn == NULL || realloc_fn == NULL || free_fn == NULL)
+    {
+        return ARC_STAT_INVALID;
+    }
+
+    arc_allocator_stats(&lib->arcl_alloc, &live, NULL);
+    if (live != 0)
+    {
+        return ARC_STAT_INVALID;
+    }
+
+    lib->arcl_alloc.al_malloc = alloc_fn;
+    lib->arcl_alloc.al_realloc = realloc_fn;
+    lib->arcl_alloc.al_free = free_fn;
+    lib->arcl_alloc.al_ctx = ctx;
+
+    return ARC_STAT_OK;
+}
+
 /*
 **  ARC_GETSSLBUF -- retrieve SSL error buffer
 **
@@ -1172,6 +1500,44 @@ arc_check_uint(char *value, uint64_t *out)
     return true;
 }
 
+/*
+**  ARC_PARAM_TAG -- map a parameter name to one of the known tags
+**
+**  Parameters:
+**  	param -- parameter name
+**
+**  Return value:
+**  	An ARC_TAG_* constant, or -1 if "param" isn't one of them.
+*/
+
+static int
+arc_param_tag(const char *param)
+{
+    if (param[0] < 'a' || param[0] > 'z')
+    {
+        return -1;
+    }
+
+    if (param[1] == '\0')
+    {
+        return arc_tagletters[param[0] - 'a'];
+    }
+
+    if (param[2] == '\0')
+    {
+        if (param[0] == 'b' && param[1] == 'h')
+        {
+            return ARC_TAG_BH;
+        }
+        if (param[0] == 'c' && param[1] == 'v')
+        {
+            return ARC_TAG_CV;
+        }
+    }
+
+    return -1;
+}
+
 /*
 **  ARC_PARAM_GET -- get a parameter from a set
 **
@@ -1186,13 +1552,19 @@ arc_check_uint(char *value, uint64_t *out)
 static char *
 arc_param_get(ARC_KVSET *set, const char *param)
 {
+    int        tag;
     ARC_PLIST *plist;
 
     assert(set != NULL);
     assert(param != NULL);
 
-    for (plist = set->set_plist[ARC_PHASH(param[0])]; plist != NULL;
-         plist = plist->plist_next)
+    tag = arc_param_tag(param);
+    if (tag != -1)
+    {
+        return set->set_tags[tag];
+    }
+
+    for (plist = set->set_plist; plist != NULL; plist = plist->plist_next)
     {
         if (strcmp(plist->plist_param, param) == 0)
         {
@@ -1372,6 +1744,9 @@ arc_add_plist(ARC_MESSAGE *msg,
               bool         force,
               bool         ignore_dups)
 {
+    int        c;
+    int        tag;
+    bool       dup = false;
     ARC_PLIST *plist;
 
     assert(msg != NULL);
@@ -1385,45 +1760,57 @@ arc_add_plist(ARC_MESSAGE *msg,
         return -1;
     }
 
-    /* see if we have one already */
-    for (plist = set->set_plist[ARC_PHASH(param[0])]; plist != NULL;
-         plist = plist->plist_next)
+    /* see if we have one already; names that differ only in the case of
+     * their trailing characters count as the same parameter */
+    tag = arc_param_tag(param);
+    if (tag != -1)
+    {
+        dup = set->set_tags[tag] != NULL;
+    }
+    else
     {
-        if (strcasecmp(plist->plist_param, param) == 0)
+        for (c = 0; c < ARC_NTAGS && !dup; c++)
         {
-            if (ignore_dups)
-            {
-                return 0;
-            }
-
-            arc_error(msg, "duplicate parameter '%s'", param);
-            return -1;
+            dup = set->set_tags[c] != NULL && arc_tagnames[c][0] == param[0] &&
+                  strcasecmp(arc_tagnames[c], param) == 0;
         }
     }
 
-    /* nope; make one and connect it */
-    if (plist == NULL)
+    for (plist = set->set_plist; plist != NULL && !dup;
+         plist = plist->plist_next)
     {
-        int n;
+        dup = plist->plist_param[0] == param[0] &&
+              strcasecmp(plist->plist_param, param) == 0;
+    }
 
-        plist = ARC_MALLOC(sizeof(ARC_PLIST));
-        if (plist == NULL)
+    if (dup)
+    {
+        if (ignore_dups)
         {
-            arc_error(msg, "unable to allocate %d byte(s)", sizeof(ARC_PLIST));
-            return -1;
+            return 0;
         }
-        force = true;
-        n = ARC_PHASH(param[0]);
-        plist->plist_next = set->set_plist[n];
-        set->set_plist[n] = plist;
-        plist->plist_param = param;
+
+        arc_error(msg, "duplicate parameter '%s'", param);
+        return -1;
+    }
+
+    /* nope; store it */
+    if (tag != -1)
+    {
+        set->set_tags[tag] = value;
+        return 0;
     }
 
-    /* set the value if "force" was set (or this was a new entry) */
-    if (force)
+    plist = ARC_AMALLOC(msg->arc_arena, sizeof(ARC_PLIST));
+    if (plist == NULL)
     {
-        plist->plist_value = value;
+        arc_error(msg, "unable to allocate %d byte(s)", sizeof(ARC_PLIST));
+        return -1;
     }
+    plist->plist_next = set->set_plist;
+    set->set_plist = plist;
+    plist->plist_param = param;
+    plist->plist_value = value;
 
     return 0;
 }
@@ -1447,7 +1834,7 @@ arc_add_plist(ARC_MESSAGE *msg,
 static ARC_STAT
 arc_process_set(ARC_MESSAGE    *msg,
                 arc_kvsettype_t type,
-                char           *str,
+                const char     *str,
                 size_t          len,
                 void           *data,
                 ARC_KVSET     **out)
@@ -1476,18 +1863,16 @@ arc_process_set(ARC_MESSAGE    *msg,
     state = 0;
     spaced = false;
 
-    hcopy = ARC_MALLOC(len + 1);
+    hcopy = ARC_ASTRNDUP(msg->arc_arena, str, len);
     if (hcopy == NULL)
     {
         arc_error(msg, "unable to allocate %d byte(s)", len + 1);
         return ARC_STAT_INTERNAL;
     }
-    strlcpy(hcopy, str, len + 1);
 
-    set = ARC_CALLOC(1, sizeof(ARC_KVSET));
+    set = ARC_ACALLOC(msg->arc_arena, 1, sizeof(ARC_KVSET));
     if (set == NULL)
     {
-        ARC_FREE(hcopy);
         arc_error(msg, "unable to allocate %d byte(s)", sizeof(ARC_KVSET));
         return ARC_STAT_INTERNAL;
     }
@@ -1508,7 +1893,6 @@ arc_process_set(ARC_MESSAGE    *msg,
     msg->arc_kvsettail = set;
 
     set->set_next = NULL;
-    memset(&set->set_plist, '\0', sizeof set->set_plist);
     set->set_data = hcopy;
     set->set_bad = false;
 
@@ -1728,7 +2112,7 @@ arc_process_set(ARC_MESSAGE    *msg,
 
         /* make sure nothing got signed that shouldn't be */
         p = arc_param_get(set, "h");
-        hcopy = ARC_STRDUP(p);
+        hcopy = ARC_LSTRDUP(ARC_MSGALLOC(msg), p);
         if (hcopy == NULL)
         {
             len = strlen(p);
@@ -1744,11 +2128,11 @@ arc_process_set(ARC_MESSAGE    *msg,
             {
                 arc_error(msg, "ARC-Message-Signature signs %s", p);
                 set->set_bad = true;
-                ARC_FREE(hcopy);
+                ARC_LFREE(ARC_MSGALLOC(msg), hcopy);
                 return ARC_STAT_INTERNAL;
             }
         }
-        ARC_FREE(hcopy);
+        ARC_LFREE(ARC_MSGALLOC(msg), hcopy);
 
         /* test validity of "l", "t", "x", and "i" */
         p = arc_param_get(set, "l");
@@ -2012,12 +2396,8 @@ arc_get_key(ARC_MESSAGE *msg, bool test)
     }
     msg->arc_b64keylen = strlen(msg->arc_b64key);
 
-    if (msg->arc_key != NULL)
-    {
-        ARC_FREE(msg->arc_key);
-    }
-
-    msg->arc_key = ARC_MALLOC(msg->arc_b64keylen);
+    /* a previous key, if any, stays in the arena until the message is freed */
+    msg->arc_key = ARC_AMALLOC(msg->arc_arena, msg->arc_b64keylen);
     if (msg->arc_key == NULL)
     {
         arc_error(msg, "unable to allocate %d byte(s)", msg->arc_b64keylen);
@@ -2096,7 +2476,7 @@ arc_verify_hash(ARC_MESSAGE *msg, char *b64sig, void *h, size_t hlen)
 
     b64siglen = strlen(b64sig);
 
-    sig = ARC_MALLOC(b64siglen);
+    sig = ARC_LMALLOC(ARC_MSGALLOC(msg), b64siglen);
     if (sig == NULL)
     {
         arc_error(msg, "unable to allocate %d bytes", b64siglen);
@@ -2136,11 +2516,27 @@ arc_verify_hash(ARC_MESSAGE *msg, char *b64sig, void *h, size_t hlen)
         goto error;
     }
 
-    status = ARC_STAT_INTERNAL;
-    ctx = EVP_PKEY_CTX_new(pkey, NULL);
-    if (ctx == NULL)
+    if (msg->arc_library->arcl_rsapool != NULL)
     {
-        arc_error(msg, "EVP_PKEY_CTX_new() failed");
+        char err[ARC_RSA_ERRLEN];
+
+        status = arc_rsapool_verify(
+            msg->arc_library->arcl_rsapool, msg->arc_key, msg->arc_keylen,
+            pkey,
+            msg->arc_hashtype == ARC_HASHTYPE_SHA1 ? EVP_sha1() : EVP_sha256(),
+            sig, siglen, h, hlen, err);
+        if (status == ARC_STAT_INTERNAL)
+        {
+            arc_error(msg, "%s", err);
+        }
+        goto error;
+    }
+
+    status = ARC_STAT_INTERNAL;
+    ctx = EVP_PKEY_CTX_new(pkey, NULL);
+    if (ctx == NULL)
+    {
+        arc_error(msg, "EVP_PKEY_CTX_new() failed");
         goto error;
     }
 
@@ -2183,37 +2579,35 @@ error:
     EVP_PKEY_CTX_free(ctx);
     EVP_PKEY_free(pkey);
     BIO_free(keydata);
-    ARC_FREE(sig);
+    ARC_LFREE(ARC_MSGALLOC(msg), sig);
 
     return status;
 }
 
 /*
-**  ARC_VALIDATE_MSG -- validate a specific ARC-Message-Signature
+**  ARC_VALIDATE_AMS -- verify a specific ARC-Message-Signature over the
+**                      header
 **
 **  Parameters:
 **  	msg -- ARC message handle
-**  	set -- ARC set number whose AMS should be validated (zero-based)
-**  	verify -- verify or sign
+**  	setnum -- ARC set number whose AMS should be verified (one-based)
 **
 **  Return value:
 **  	An ARC_STAT_* constant.
+**
+**  Notes:
+**  	This doesn't need the body, so it can run during arc_body() calls
+**  	on the background verification thread.
 */
 
 static ARC_STAT
-arc_validate_msg(ARC_MESSAGE *msg, unsigned int setnum)
+arc_validate_ams(ARC_MESSAGE *msg, unsigned int setnum)
 {
-    size_t          elen;
     size_t          hhlen;
-    size_t          bhlen;
-    size_t          b64bhlen;
     ARC_STAT        status;
     char           *alg;
     char           *b64sig;
-    unsigned char  *b64bh;
-    char           *b64bhtag;
     void           *hh;
-    void           *bh;
     struct arc_set *set;
     ARC_KVSET      *kvset;
 
@@ -2222,18 +2616,6 @@ arc_validate_msg(ARC_MESSAGE *msg, unsigned int setnum)
     /* pull the (set-1)th ARC Set */
     set = &msg->arc_sets[setnum - 1];
 
-    /*
-    **  Validate the ARC-Message-Signature.
-    */
-
-    /* finalize body canonicalizations */
-    status = arc_canon_closebody(msg);
-    if (status != ARC_STAT_OK)
-    {
-        arc_error(msg, "arc_canon_closebody() failed");
-        return status;
-    }
-
     /*
     **  The stub AMS was generated, canonicalized, and hashed by
     **  arc_canon_runheaders().  It should also have been finalized.
@@ -2252,28 +2634,83 @@ arc_validate_msg(ARC_MESSAGE *msg, unsigned int setnum)
         return status;
     }
 
-    /* extract the header and body hashes from the message */
-    status = arc_canon_gethashes(msg, setnum, &hh, &hhlen, &bh, &bhlen);
+    /* extract the header hash from the message */
+    status = arc_canon_gethashes(msg, setnum, &hh, &hhlen, NULL, NULL);
     if (status != ARC_STAT_OK)
     {
         arc_error(msg, "arc_canon_gethashes() failed");
         return status;
     }
 
-    /* extract the signature and body hash from the message */
+    /* verify the signature against the header hash and the key */
     b64sig = arc_param_get(kvset, "b");
-    b64bhtag = arc_param_get(kvset, "bh");
+    return arc_verify_hash(msg, b64sig, hh, hhlen);
+}
 
-    /* verify the signature against the header hash and the key */
-    status = arc_verify_hash(msg, b64sig, hh, hhlen);
+/*
+**  ARC_VALIDATE_MSG -- validate a specific ARC-Message-Signature
+**
+**  Parameters:
+**  	msg -- ARC message handle
+**  	setnum -- ARC set number whose AMS should be validated (one-based)
+**
+**  Return value:
+**  	An ARC_STAT_* constant.
+*/
+
+static ARC_STAT
+arc_validate_msg(ARC_MESSAGE *msg, unsigned int setnum)
+{
+    size_t         elen;
+    size_t         bhlen;
+    size_t         b64bhlen;
+    ARC_STAT       status;
+    unsigned char *b64bh;
+    char          *b64bhtag;
+    void          *bh;
+
+    assert(msg != NULL);
+
+    /*
+    **  Validate the ARC-Message-Signature.
+    */
+
+    /* finalize body canonicalizations */
+    status = arc_canon_closebody(msg);
     if (status != ARC_STAT_OK)
     {
+        arc_error(msg, "arc_canon_closebody() failed");
+        return status;
+    }
+
+    /* the signature itself may have been checked in the background */
+    if (msg->arc_amsstatus != NULL &&
+        msg->arc_amsstatus[setnum - 1] != ARC_AMS_UNCHECKED)
+    {
+        status = msg->arc_amsstatus[setnum - 1];
+    }
+    else
+    {
+        status = arc_validate_ams(msg, setnum);
+    }
+    if (status != ARC_STAT_OK)
+    {
+        return status;
+    }
+
+    /* extract the body hash from the message */
+    status = arc_canon_gethashes(msg, setnum, NULL, NULL, &bh, &bhlen);
+    if (status != ARC_STAT_OK)
+    {
+        arc_error(msg, "arc_canon_gethashes() failed");
         return status;
     }
 
     /* verify the signature's "bh" against our computed one */
+    b64bhtag = arc_param_get(msg->arc_sets[setnum - 1].arcset_ams->hdr_data,
+                             "bh");
     b64bhlen = BASE64SIZE(bhlen);
-    b64bh = ARC_CALLOC(1, b64bhlen + 1);
+    b64bh = ARC_LCALLOC(ARC_MSGALLOC(msg), 1, b64bhlen + 1);
     if (b64bh == NULL)
     {
         arc_error(msg, "unable to allocate %d bytes", b64bhlen + 1);
@@ -2282,12 +2719,12 @@ arc_validate_msg(ARC_MESSAGE *msg, unsigned int setnum)
     elen = arc_base64_encode(bh, bhlen, b64bh, b64bhlen);
     if (elen != strlen(b64bhtag) || strcmp((char *) b64bh, b64bhtag) != 0)
     {
-        ARC_FREE(b64bh);
+        ARC_LFREE(ARC_MSGALLOC(msg), b64bh);
         arc_error(msg, "body hash mismatch");
         return ARC_STAT_BADSIG;
     }
 
-    ARC_FREE(b64bh);
+    ARC_LFREE(ARC_MSGALLOC(msg), b64bh);
     /* if we got this far, the signature was good */
     return ARC_STAT_OK;
 }
@@ -2367,6 +2804,284 @@ arc_validate_seal(ARC_MESSAGE *msg, unsigned int setnum)
     return status;
 }
 
+/*
+**  ARC_VALIDATE_SEALS -- validate every ARC seal, newest first
+**
+**  Parameters:
+**  	msg -- ARC message handle
+**
+**  Return value:
+**  	An ARC_STAT_* constant.
+**
+**  Side effects:
+**  	Fails the chain on a bad seal, and records that the seals have been
+**  	checked unless an internal error kept that from happening.
+*/
+
+static ARC_STAT
+arc_validate_seals(ARC_MESSAGE *msg)
+{
+    ARC_STAT status;
+
+    for (unsigned int i = msg->arc_nsets; i > 0; i--)
+    {
+        if (i == msg->arc_cvfail)
+        {
+            arc_error(msg, "chain already failed at instance %u", i);
+            msg->arc_cstate = ARC_CHAIN_FAIL;
+            msg->arc_cvstop = true;
+            msg->arc_sealchecked = true;
+            return ARC_STAT_BADSIG;
+        }
+
+        status = arc_validate_seal(msg, i);
+        if (status == ARC_STAT_INTERNAL)
+        {
+            return status;
+        }
+        if (status != ARC_STAT_OK)
+        {
+            msg->arc_cstate = ARC_CHAIN_FAIL;
+            msg->arc_sealchecked = true;
+            return status;
+        }
+    }
+
+    msg->arc_sealchecked = true;
+
+    return ARC_STAT_OK;
+}
+
+/*
+**  ARC_PREFETCH_KEYS -- start looking up every key the chain will need
+**
+**  Parameters:
+**  	msg -- ARC message handle
+**
+**  Return value:
+**  	The number of lookups still waiting for a reply.
+**
+**  Notes:
+**  	Failures here are left for arc_get_key() to find and report when
+**  	the key is actually wanted.
+*/
+
+static unsigned int
+arc_prefetch_keys(ARC_MESSAGE *msg)
+{
+    const char          *selector;
+    const char          *domain;
+    struct arc_hdrfield *hdrs[2];
+
+    if (msg->arc_query != ARC_QUERY_DNS)
+    {
+        return 0;
+    }
+
+    for (unsigned int i = msg->arc_nsets; i > 0; i--)
+    {
+        hdrs[0] = msg->arc_sets[i - 1].arcset_as;
+        hdrs[1] = msg->arc_sets[i - 1].arcset_ams;
+
+        for (int c = 0; c < 2; c++)
+        {
+            if (hdrs[c] == NULL)
+            {
+                continue;
+            }
+
+            selector = arc_param_get(hdrs[c]->hdr_data, "s");
+            domain = arc_param_get(hdrs[c]->hdr_data, "d");
+            if (selector != NULL && domain != NULL)
+            {
+                (void) arc_key_start(msg, selector, domain);
+            }
+        }
+    }
+
+    return arc_key_poll(msg);
+}
+
+/*
+**  ARC_VERIFY_TASK -- check signatures that don't need the body
+**
+**  Parameters:
+**  	arg -- ARC message handle
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	Runs on one of the library's background workers, or on the caller's
+**  	thread if none of them got to it, between the end of arc_eoh() and
+**  	arc_verify_join().  In the meantime the caller only feeds the body,
+**  	which touches nothing this uses except the error buffer, and
+**  	arc_error() serializes that.
+*/
+
+static void
+arc_verify_task(void *arg)
+{
+    ARC_MESSAGE *msg = arg;
+
+    (void) arc_validate_seals(msg);
+
+    /* the newest AMS, then older ones until one fails (for oldest-pass) */
+    for (unsigned int i = msg->arc_nsets;
+         i > 0 && msg->arc_cstate != ARC_CHAIN_FAIL &&
+         msg->arc_hdrcanons[i - 1] != NULL;
+         i--)
+    {
+        msg->arc_amsstatus[i - 1] = arc_validate_ams(msg, i);
+        if (msg->arc_amsstatus[i - 1] != ARC_STAT_OK)
+        {
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&msg->arc_bglock);
+    msg->arc_bgdone = true;
+    pthread_mutex_unlock(&msg->arc_bglock);
+}
+
+/*
+**  ARC_VERIFY_START -- start checking signatures in the background
+**
+**  Parameters:
+**  	msg -- ARC message handle
+**
+**  Return value:
+**  	None.  Without background workers, arc_eom() does all the work as
+**  	usual.
+*/
+
+static void
+arc_verify_start(ARC_MESSAGE *msg)
+{
+    if (msg->arc_library->arcl_taskpool == NULL)
+    {
+        return;
+    }
+
+    msg->arc_amsstatus = ARC_AMALLOC(msg->arc_arena,
+                                     msg->arc_nsets * sizeof(ARC_STAT));
+    if (msg->arc_amsstatus == NULL)
+    {
+        return;
+    }
+
+    for (unsigned int i = 0; i < msg->arc_nsets; i++)
+    {
+        msg->arc_amsstatus[i] = ARC_AMS_UNCHECKED;
+    }
+
+    if (pthread_mutex_init(&msg->arc_bglock, NULL) != 0)
+    {
+        msg->arc_amsstatus = NULL;
+        return;
+    }
+
+    /* set first so the task's arc_error() calls take the lock */
+    msg->arc_bgstarted = true;
+    arc_taskpool_start(msg->arc_library->arcl_taskpool, &msg->arc_bgtask,
+                       arc_verify_task, msg);
+}
+
+/*
+**  ARC_VERIFY_JOIN -- wait for background signature checks to finish
+**
+**  Parameters:
+**  	msg -- ARC message handle
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+arc_verify_join(ARC_MESSAGE *msg)
+{
+    if (!msg->arc_bgstarted)
+    {
+        return;
+    }
+
+    arc_taskpool_finish(msg->arc_library->arcl_taskpool, &msg->arc_bgtask);
+    pthread_mutex_destroy(&msg->arc_bglock);
+    msg->arc_bgstarted = false;
+}
+
+/*
+**  ARC_MESSAGE_SETUP -- set the per-transaction fields of a message handle
+**
+**  Parameters:
+**  	msg -- message handle, otherwise zeroed
+**  	canonhdr -- canonicalization to use for the header
+**  	canonbody -- canonicalization to use for the body
+**  	signalg -- signing algorithm
+**  	mode -- mask of mode bits
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+arc_message_setup(ARC_MESSAGE *msg,
+                  arc_canon_t  canonhdr,
+                  arc_canon_t  canonbody,
+                  arc_alg_t    signalg,
+                  arc_mode_t   mode)
+{
+    ARC_LIB *lib = msg->arc_library;
+
+    if (lib->arcl_fixedtime != 0)
+    {
+        msg->arc_timestamp = lib->arcl_fixedtime;
+    }
+    else
+    {
+        time(&msg->arc_timestamp);
+    }
+
+    msg->arc_sigttl = lib->arcl_sigttl;
+
+    msg->arc_canonhdr = canonhdr;
+    msg->arc_canonbody = canonbody;
+    msg->arc_signalg = signalg;
+    msg->arc_margin = ARC_HDRMARGIN;
+    msg->arc_mode = mode;
+
+    if (strlen(lib->arcl_queryinfo) > 0)
+    {
+        msg->arc_query = ARC_QUERY_FILE;
+    }
+}
+
+/*
+**  ARC_MESSAGE_REPORT -- record a message's arena usage in its library
+**
+**  Parameters:
+**  	msg -- message handle that is finished with its arena contents
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+arc_message_report(ARC_MESSAGE *msg)
+{
+    size_t   used;
+    ARC_LIB *lib = msg->arc_library;
+
+    used = arc_arena_used(msg->arc_arena);
+
+    pthread_mutex_lock(&lib->arcl_arenalock);
+    if (used > lib->arcl_arenahwm)
+    {
+        lib->arcl_arenahwm = used;
+    }
+    pthread_mutex_unlock(&lib->arcl_arenalock);
+}
+
 /*
 **  ARC_MESSAGE -- create a new message handle
 **
@@ -2389,7 +3104,8 @@ arc_message(ARC_LIB     *lib,
             arc_mode_t   mode,
             const char **err)
 {
-    ARC_MESSAGE *msg;
+    ARC_MESSAGE      *msg;
+    struct arc_arena *arena;
 
     if (mode == 0)
     {
@@ -2400,40 +3116,114 @@ arc_message(ARC_LIB     *lib,
         return NULL;
     }
 
-    msg = ARC_CALLOC(1, sizeof *msg);
+    /* the handle itself lives in its arena, so arc_free() is one free() for
+     * messages that fit in the first chunk */
+    arena = arc_arena_new(lib->arcl_arenasize, &lib->arcl_alloc);
+    if (arena == NULL)
+    {
+        if (err != NULL)
+        {
+            *err = strerror(errno);
+        }
+        return NULL;
+    }
+
+    msg = ARC_ACALLOC(arena, 1, sizeof *msg);
     if (msg == NULL)
     {
         if (err != NULL)
         {
             *err = strerror(errno);
         }
+        arc_arena_free(arena);
         return NULL;
     }
 
+    msg->arc_arena = arena;
+    msg->arc_arenakeep = arc_arena_used(arena);
     msg->arc_library = lib;
-    if (lib->arcl_fixedtime != 0)
+
+    arc_message_setup(msg, canonhdr, canonbody, signalg, mode);
+
+    return msg;
+}
+
+/*
+**  ARC_MESSAGE_RESET -- return a message handle to its initial state
+**
+**  Parameters:
+**  	msg -- message handle to recycle
+**  	canonhdr -- canonicalization to use for the header
+**  	canonbody -- canonicalization to use for the body
+**  	signalg -- signing algorithm
+**  	mode -- mask of mode bits
+**  	err -- error string (returned)
+**
+**  Return value:
+**  	An ARC_STAT_* constant (and "err" is updated on failure).
+*/
+
+ARC_STAT
+arc_message_reset(ARC_MESSAGE *msg,
+                  arc_canon_t  canonhdr,
+                  arc_canon_t  canonbody,
+                  arc_alg_t    signalg,
+                  arc_mode_t   mode,
+                  const char **err)
+{
+    ARC_MESSAGE saved;
+
+    assert(msg != NULL);
+
+    if (mode == 0)
     {
-        msg->arc_timestamp = lib->arcl_fixedtime;
+        if (err != NULL)
+        {
+            *err = "no mode(s) selected";
+        }
+        return ARC_STAT_INVALID;
     }
-    else
+
+    arc_verify_join(msg);
+    arc_key_cancel(msg);
+
+    /* hash contexts are kept for the next round of canonicalizations */
+    arc_canon_reset(msg);
+
+    arc_message_report(msg);
+
+    if (msg->arc_error != NULL)
     {
-        time(&msg->arc_timestamp);
+        ARC_LFREE(ARC_MSGALLOC(msg), msg->arc_error);
     }
 
-    msg->arc_sigttl = lib->arcl_sigttl;
-
-    msg->arc_canonhdr = canonhdr;
-    msg->arc_canonbody = canonbody;
-    msg->arc_signalg = signalg;
-    msg->arc_margin = ARC_HDRMARGIN;
-    msg->arc_mode = mode;
+    if (msg->arc_hdrbuf != NULL)
+    {
+        arc_dstring_blank(msg->arc_hdrbuf);
+    }
 
-    if (strlen(lib->arcl_queryinfo) > 0)
+    if (msg->arc_canonbuf != NULL)
     {
-        msg->arc_query = ARC_QUERY_FILE;
+        arc_dstring_blank(msg->arc_canonbuf);
     }
 
-    return msg;
+    /* everything else lived in the arena, after the handle itself */
+    saved = *msg;
+    arc_arena_reset(msg->arc_arena, msg->arc_arenakeep);
+    memset(msg, '\0', sizeof *msg);
+
+    msg->arc_arena = saved.arc_arena;
+    msg->arc_arenakeep = saved.arc_arenakeep;
+    msg->arc_library = saved.arc_library;
+    msg->arc_hdrbuf = saved.arc_hdrbuf;
+    msg->arc_canonbuf = saved.arc_canonbuf;
+    msg->arc_hashctxs = saved.arc_hashctxs;
+    msg->arc_nhashctxs = saved.arc_nhashctxs;
+    msg->arc_hashctxsz = saved.arc_hashctxsz;
+
+    arc_message_setup(msg, canonhdr, canonbody, signalg, mode);
+
+    return ARC_STAT_OK;
 }
 
 /*
@@ -2449,71 +3239,91 @@ arc_message(ARC_LIB     *lib,
 void
 arc_free(ARC_MESSAGE *msg)
 {
-    struct arc_hdrfield *h;
-    struct arc_hdrfield *tmp;
-
     if (msg == NULL)
     {
         return;
     }
 
-    if (msg->arc_error != NULL)
-    {
-        ARC_FREE(msg->arc_error);
-    }
+    arc_verify_join(msg);
+    arc_key_cancel(msg);
 
-    h = msg->arc_hhead;
-    while (h != NULL)
+    if (msg->arc_error != NULL)
     {
-        tmp = h->hdr_next;
-        ARC_FREE(h->hdr_text);
-        ARC_FREE(h);
-        h = tmp;
+        ARC_LFREE(ARC_MSGALLOC(msg), msg->arc_error);
     }
 
-    h = msg->arc_sealhead;
-    while (h != NULL)
-    {
-        tmp = h->hdr_next;
-        ARC_FREE(h->hdr_text);
-        ARC_FREE(h);
-        h = tmp;
-    }
+    arc_dstring_free(msg->arc_hdrbuf);
 
-    if (msg->arc_hdrlist != NULL)
-    {
-        ARC_FREE(msg->arc_hdrlist);
-    }
+    arc_canon_cleanup(msg);
 
-    arc_dstring_free(msg->arc_hdrbuf);
+    /* header fields, parameter sets, canonicalizations and the handle
+     * itself are all in the arena */
+    arc_message_report(msg);
+    arc_arena_free(msg->arc_arena);
+}
 
-    while (msg->arc_kvsethead != NULL)
-    {
-        int        i;
-        ARC_KVSET *set = msg->arc_kvsethead;
+/*
+**  ARC_FIXCRLF -- normalize the line endings of a header field
+**
+**  Parameters:
+**  	in -- text to normalize
+**  	inlen -- bytes to use at "in"
+**  	out -- buffer to receive the result, or NULL to just measure it
+**
+**  Return value:
+**  	Length of the normalized text, not counting the NUL that is
+**  	appended to "out".
+*/
 
-        msg->arc_kvsethead = set->set_next;
-        ARC_FREE(set->set_data);
+static size_t
+arc_fixcrlf(const char *in, size_t inlen, char *out)
+{
+    char   prev = '\0';
+    size_t n = 0;
 
-        for (i = 0; i < NITEMS(set->set_plist); i++)
+    for (const char *p = in, *q = in + inlen; p < q && *p != '\0'; p++)
+    {
+        if (*p == '\n' && prev != '\r') /* bare LF */
         {
-            while (set->set_plist[i] != NULL)
+            if (out != NULL)
             {
-                ARC_PLIST *plist = set->set_plist[i];
-                set->set_plist[i] = plist->plist_next;
-                ARC_FREE(plist);
+                out[n] = '\r';
             }
+            n++;
+        }
+        else if (prev == '\r' && *p != '\n') /* bare CR */
+        {
+            if (out != NULL)
+            {
+                out[n] = '\n';
+            }
+            n++;
+        }
+
+        if (out != NULL)
+        {
+            out[n] = *p;
         }
+        n++;
 
-        ARC_FREE(set);
+        prev = *p;
     }
 
-    arc_canon_cleanup(msg);
+    if (prev == '\r') /* end CR */
+    {
+        if (out != NULL)
+        {
+            out[n] = '\n';
+        }
+        n++;
+    }
+
+    if (out != NULL)
+    {
+        out[n] = '\0';
+    }
 
-    ARC_FREE(msg->arc_sealcanons);
-    ARC_FREE(msg->arc_sets);
-    ARC_FREE(msg->arc_key);
-    ARC_FREE(msg);
+    return n;
 }
 
 /*
@@ -2523,6 +3333,8 @@ arc_free(ARC_MESSAGE *msg)
 **  	msg -- message handle
 **  	hdr -- full text of the header field
 **  	hlen -- bytes to use at hname
+**  	borrow -- if true, "hdr" is NUL-terminated at "hlen" and will
+**  	          outlive the message handle, so it can be used in place
 **  	ret -- (returned) object, if it's good
 **
 **  Return value:
@@ -2533,12 +3345,14 @@ static ARC_STAT
 arc_parse_header_field(ARC_MESSAGE          *msg,
                        const char           *hdr,
                        size_t                hlen,
+                       bool                  borrow,
                        struct arc_hdrfield **ret)
 {
     const char          *colon;
     const char          *semicolon;
     const char          *end = NULL;
     size_t               c;
+    size_t               textlen = hlen;
     struct arc_hdrfield *h;
 
     assert(msg != NULL);
@@ -2607,7 +3421,7 @@ arc_parse_header_field(ARC_MESSAGE          *msg,
         return ARC_STAT_SYNTAX;
     }
 
-    h = ARC_MALLOC(sizeof *h);
+    h = ARC_AMALLOC(msg->arc_arena, sizeof *h);
     if (h == NULL)
     {
         arc_error(msg, "unable to allocate %d byte(s)", sizeof *h);
@@ -2616,57 +3430,36 @@ arc_parse_header_field(ARC_MESSAGE          *msg,
 
     if ((msg->arc_library->arcl_flags & ARC_LIBFLAGS_FIXCRLF) != 0)
     {
-        char                prev = '\0';
-        struct arc_dstring *tmphdr;
-
-        tmphdr = arc_dstring_new(BUFRSZ, MAXBUFRSZ, msg, &arc_error_cb);
-        if (tmphdr == NULL)
-        {
-            ARC_FREE(h);
-            return ARC_STAT_NORESOURCE;
-        }
-
-        for (const char *p = hdr, *q = hdr + hlen; p < q && *p != '\0'; p++)
-        {
-            if (*p == '\n' && prev != '\r') /* bare LF */
-            {
-                arc_dstring_catn(tmphdr, CRLF, 2);
-            }
-            else if (prev == '\r' && *p != '\n') /* bare CR */
-            {
-                arc_dstring_cat1(tmphdr, '\n');
-                arc_dstring_cat1(tmphdr, *p);
-            }
-            else /* other */
-            {
-                arc_dstring_cat1(tmphdr, *p);
-            }
+        textlen = arc_fixcrlf(hdr, hlen, NULL);
+    }
 
-            prev = *p;
-        }
+    if (textlen != hlen)
+    {
+        char *text;
 
-        if (prev == '\r') /* end CR */
+        text = ARC_AMALLOC(msg->arc_arena, textlen + 1);
+        if (text != NULL)
         {
-            arc_dstring_cat1(tmphdr, '\n');
+            arc_fixcrlf(hdr, hlen, text);
         }
-
-        h->hdr_text = strndup(arc_dstring_get(tmphdr), arc_dstring_len(tmphdr));
-
-        arc_dstring_free(tmphdr);
+        h->hdr_text = text;
+    }
+    else if (borrow)
+    {
+        h->hdr_text = hdr;
     }
     else
     {
-        h->hdr_text = strndup(hdr, hlen);
+        h->hdr_text = ARC_ASTRNDUP(msg->arc_arena, hdr, hlen);
     }
 
     if (h->hdr_text == NULL)
     {
-        ARC_FREE(h);
         return ARC_STAT_NORESOURCE;
     }
 
     h->hdr_namelen = end != NULL ? end - hdr : hlen;
-    h->hdr_textlen = hlen;
+    h->hdr_textlen = textlen;
     h->hdr_flags = 0;
     h->hdr_next = NULL;
 
@@ -2676,34 +3469,34 @@ arc_parse_header_field(ARC_MESSAGE          *msg,
 }
 
 /*
-**  ARC_HEADER_FIELD -- consume a header field
+**  ARC_ADD_HEADER_FIELD -- parse a header field and queue it
 **
 **  Parameters:
 **  	msg -- message handle
 **  	hdr -- full text of the header field
 **  	hlen -- bytes to use at hname
+**  	borrow -- use "hdr" in place (see arc_parse_header_field())
 **
 **  Return value:
 **  	An ARC_STAT_* constant.
 */
 
-ARC_STAT
-arc_header_field(ARC_MESSAGE *msg, const char *hdr, size_t hlen)
+static ARC_STAT
+arc_add_header_field(ARC_MESSAGE *msg,
+                     const char  *hdr,
+                     size_t       hlen,
+                     bool         borrow)
 {
     ARC_STAT             status;
     struct arc_hdrfield *h;
 
-    assert(msg != NULL);
-    assert(hdr != NULL);
-    assert(hlen != 0);
-
     if (msg->arc_state > ARC_STATE_HEADER)
     {
         return ARC_STAT_INVALID;
     }
     msg->arc_state = ARC_STATE_HEADER;
 
-    status = arc_parse_header_field(msg, hdr, hlen, &h);
+    status = arc_parse_header_field(msg, hdr, hlen, borrow, &h);
     if (status != ARC_STAT_OK)
     {
         return status;
@@ -2725,6 +3518,124 @@ arc_header_field(ARC_MESSAGE *msg, const char *hdr, size_t hlen)
     return ARC_STAT_OK;
 }
 
+/*
+**  ARC_HEADER_FIELD -- consume a header field
+**
+**  Parameters:
+**  	msg -- message handle
+**  	hdr -- full text of the header field
+**  	hlen -- bytes to use at hname
+**
+**  Return value:
+**  	An ARC_STAT_* constant.
+*/
+
+ARC_STAT
+arc_header_field(ARC_MESSAGE *msg, const char *hdr, size_t hlen)
+{
+    assert(msg != NULL);
+    assert(hdr != NULL);
+    assert(hlen != 0);
+
+    return arc_add_header_field(msg, hdr, hlen, false);
+}
+
+/*
+**  ARC_HEADER_FIELD_REF -- consume a header field without copying it
+**
+**  Parameters:
+**  	msg -- message handle
+**  	hdr -- full text of the header field, NUL-terminated at "hlen"
+**  	hlen -- bytes to use at hname
+**
+**  Return value:
+**  	An ARC_STAT_* constant.
+**
+**  Notes:
+**  	The caller must leave "hdr" intact until the handle is passed to
+**  	arc_free() or arc_message_reset().
+*/
+
+ARC_STAT
+arc_header_field_ref(ARC_MESSAGE *msg, const char *hdr, size_t hlen)
+{
+    assert(msg != NULL);
+    assert(hdr != NULL);
+    assert(hlen != 0);
+
+    if (hdr[hlen] != '\0')
+    {
+        arc_error(msg, "header field is not NUL-terminated");
+        return ARC_STAT_INVALID;
+    }
+
+    return arc_add_header_field(msg, hdr, hlen, true);
+}
+
+/*
+**  ARC_HEADER_FIELD_IOV -- consume a header field supplied in pieces
+**
+**  Parameters:
+**  	msg -- message handle
+**  	iov -- pieces of the header field, in order
+**  	iovcnt -- number of entries at "iov"
+**
+**  Return value:
+**  	An ARC_STAT_* constant.
+**
+**  Notes:
+**  	The pieces are concatenated straight into the message's own storage,
+**  	so each byte is copied once.
+*/
+
+ARC_STAT
+arc_header_field_iov(ARC_MESSAGE *msg, const struct iovec *iov, int iovcnt)
+{
+    int    c;
+    size_t hlen = 0;
+    char  *hdr;
+    char  *p;
+
+    assert(msg != NULL);
+    assert(iov != NULL);
+
+    for (c = 0; c < iovcnt; c++)
+    {
+        if (iov[c].iov_len > SIZE_MAX - 1 - hlen)
+        {
+            return ARC_STAT_INVALID;
+        }
+        hlen += iov[c].iov_len;
+    }
+
+    if (hlen == 0)
+    {
+        return ARC_STAT_INVALID;
+    }
+
+    if (msg->arc_state > ARC_STATE_HEADER)
+    {
+        return ARC_STAT_INVALID;
+    }
+
+    hdr = ARC_AMALLOC(msg->arc_arena, hlen + 1);
+    if (hdr == NULL)
+    {
+        arc_error(msg, "unable to allocate %d byte(s)", hlen + 1);
+        return ARC_STAT_NORESOURCE;
+    }
+
+    p = hdr;
+    for (c = 0; c < iovcnt; c++)
+    {
+        memcpy(p, iov[c].iov_base, iov[c].iov_len);
+        p += iov[c].iov_len;
+    }
+    *p = '\0';
+
+    return arc_add_header_field(msg, hdr, hlen, true);
+}
+
 /*
 **  ARC_EOH_VERIFY -- verifying side of the end-of-header handler
 **
@@ -2764,9 +3675,12 @@ arc_eoh_verify(ARC_MESSAGE *msg)
     */
 
     /* sets already in the chain, validation */
-    msg->arc_sealcanons = ARC_CALLOC(msg->arc_nsets, sizeof(ARC_CANON *));
-    msg->arc_hdrcanons = ARC_CALLOC(msg->arc_nsets, sizeof(ARC_CANON *));
-    msg->arc_bodycanons = ARC_CALLOC(msg->arc_nsets, sizeof(ARC_CANON *));
+    msg->arc_sealcanons = ARC_ACALLOC(msg->arc_arena, msg->arc_nsets,
+                                      sizeof(ARC_CANON *));
+    msg->arc_hdrcanons = ARC_ACALLOC(msg->arc_arena, msg->arc_nsets,
+                                     sizeof(ARC_CANON *));
+    msg->arc_bodycanons = ARC_ACALLOC(msg->arc_arena, msg->arc_nsets,
+                                      sizeof(ARC_CANON *));
 
     if (msg->arc_sealcanons == NULL || msg->arc_hdrcanons == NULL ||
         msg->arc_bodycanons == NULL)
@@ -2797,6 +3711,13 @@ arc_eoh_verify(ARC_MESSAGE *msg)
             return status;
         }
 
+        /* older AMSes are only needed to find the oldest pass */
+        if (n < msg->arc_nsets - 1 &&
+            (msg->arc_library->arcl_flags & ARC_LIBFLAGS_SKIPOLDEST) != 0)
+        {
+            continue;
+        }
+
         /* AMS */
         h = msg->arc_sets[n].arcset_ams;
         htag = arc_param_get(h->hdr_data, "h");
@@ -3006,7 +3927,8 @@ arc_eoh(ARC_MESSAGE *msg)
     /* build up the array of ARC sets, for use later */
     if (nsets > 0)
     {
-        msg->arc_sets = ARC_CALLOC(nsets, sizeof(struct arc_set));
+        msg->arc_sets = ARC_ACALLOC(msg->arc_arena, nsets,
+                                    sizeof(struct arc_set));
         if (msg->arc_sets == NULL)
         {
             return ARC_STAT_NORESOURCE;
@@ -3075,6 +3997,26 @@ arc_eoh(ARC_MESSAGE *msg)
         }
     }
 
+    /*
+    **  The first seal says cv=none and the rest say cv=pass, or the chain
+    **  had already failed before it got here.  Note the newest one that
+    **  doesn't; checking the seals stops there, and whether that's a hard
+    **  failure depends on the signatures newer than it.
+    */
+
+    for (c = nsets; c > 0 && msg->arc_cstate != ARC_CHAIN_FAIL; c--)
+    {
+        char *cv;
+
+        cv = arc_param_get(msg->arc_sets[c - 1].arcset_as->hdr_data, "cv");
+        if (!((c == 1 && strcasecmp(cv, "none") == 0) ||
+              (c != 1 && strcasecmp(cv, "pass") == 0)))
+        {
+            msg->arc_cvfail = c;
+            break;
+        }
+    }
+
     /*
     **  Always call arc_eoh_verify() because the hashes it sets up are
     **  needed in either mode.
@@ -3096,6 +4038,13 @@ arc_eoh(ARC_MESSAGE *msg)
         }
     }
 
+    /* a capture that can't be opened just means this message isn't captured */
+    if ((msg->arc_library->arcl_flags & ARC_LIBFLAGS_CAPTURE) != 0 &&
+        arc_capture_sample(msg->arc_library))
+    {
+        (void) arc_capture_open(msg);
+    }
+
     /* initialize the canonicalizations */
     keep = ((msg->arc_library->arcl_flags & ARC_LIBFLAGS_KEEPFILES) != 0);
     status = arc_canon_init(msg, keep, keep);
@@ -3122,6 +4071,33 @@ arc_eoh(ARC_MESSAGE *msg)
             arc_error(msg, "arc_canon_runheaders_seal() failed");
             return ARC_STAT_SYNTAX;
         }
+
+        /*
+        **  Without blocking, start all the key lookups now and leave the
+        **  checks to arc_eom() unless the replies are already in.
+        */
+
+        if ((msg->arc_library->arcl_flags & ARC_LIBFLAGS_NONBLOCK) != 0 &&
+            arc_prefetch_keys(msg) > 0)
+        {
+            return ARC_STAT_OK;
+        }
+
+        /*
+        **  Check everything that doesn't need the body now, in the
+        **  background if asked to.  When only verifying, a bad seal means
+        **  the body isn't needed.  An internal error here is retried and
+        **  reported by arc_eom().
+        */
+
+        if ((msg->arc_library->arcl_flags & ARC_LIBFLAGS_BGVERIFY) != 0)
+        {
+            arc_verify_start(msg);
+        }
+        else if ((msg->arc_mode & ARC_MODE_SIGN) == 0)
+        {
+            (void) arc_validate_seals(msg);
+        }
     }
 
     return ARC_STAT_OK;
@@ -3151,6 +4127,11 @@ arc_body(ARC_MESSAGE *msg, const unsigned char *buf, size_t len)
     }
     msg->arc_state = ARC_STATE_BODY;
 
+    if (!arc_body_needed(msg))
+    {
+        return ARC_STAT_OK;
+    }
+
     return arc_canon_bodychunk(msg, (const char *) buf, len);
 }
 
@@ -3169,8 +4150,21 @@ arc_eom(ARC_MESSAGE *msg)
 {
     ARC_STAT status;
 
-    /* nothing to do if the chain has been expressly failed */
-    if (msg->arc_cstate == ARC_CHAIN_FAIL)
+    /* come back once every key lookup arc_eoh() started has finished */
+    if (arc_key_poll(msg) > 0)
+    {
+        return ARC_STAT_AGAIN;
+    }
+
+    arc_verify_join(msg);
+
+    /*
+    **  Nothing to do if the chain has been expressly failed, unless it was
+    **  by a seal's cv= value, which is only a hard failure if the newest
+    **  ARC-Message-Signature is good too.
+    */
+
+    if (msg->arc_cstate == ARC_CHAIN_FAIL && !msg->arc_cvstop)
     {
         return ARC_STAT_OK;
     }
@@ -3197,7 +4191,34 @@ arc_eom(ARC_MESSAGE *msg)
         return ARC_STAT_OK;
     }
 
-    /* determine the oldest-pass value */
+    /* validate each ARC-Seal, unless arc_eoh() already did */
+    if (!msg->arc_sealchecked)
+    {
+        status = arc_validate_seals(msg);
+        if (status == ARC_STAT_INTERNAL)
+        {
+            return status;
+        }
+    }
+    if (msg->arc_cstate == ARC_CHAIN_FAIL)
+    {
+        msg->arc_infail = msg->arc_cvstop;
+        return ARC_STAT_OK;
+    }
+    msg->arc_cstate = ARC_CHAIN_PASS;
+
+    /*
+    **  Determine the oldest-pass value. It's only reported for a passing
+    **  chain, so this waits until the seals have been checked.
+    */
+
+    if (msg->arc_nsets > 1 &&
+        (msg->arc_library->arcl_flags & ARC_LIBFLAGS_SKIPOLDEST) != 0)
+    {
+        msg->arc_oldest_pass = -1;
+        return ARC_STAT_OK;
+    }
+
     for (int i = msg->arc_nsets - 1; i > 0; i--)
     {
         if (arc_validate_msg(msg, i) != ARC_STAT_OK)
@@ -3212,45 +4233,141 @@ arc_eom(ARC_MESSAGE *msg)
         }
     }
 
-    /* validate each ARC-Seal */
-    msg->arc_cstate = ARC_CHAIN_PASS;
-    for (int i = msg->arc_nsets; i > 0; i--)
+    return ARC_STAT_OK;
+}
+
+/*
+**  ARC_PROCESS_MESSAGE -- process a whole message held in one buffer
+**
+**  Parameters:
+**  	msg -- message handle, fresh from arc_message() or arc_message_reset()
+**  	buf -- the message: header fields, a blank line, then the body
+**  	len -- bytes at "buf"
+**
+**  Return value:
+**  	An ARC_STAT_* constant, as from whichever step stopped.
+**
+**  Notes:
+**  	The header block is copied once into the message's arena and split
+**  	in place there; the body is canonicalized straight out of "buf".
+**  	Lines in the header block may end in CRLF or a bare LF.  The body is
+**  	hashed as it is, so it should already use CRLF.
+*/
+
+ARC_STAT
+arc_process_message(ARC_MESSAGE *msg, const unsigned char *buf, size_t len)
+{
+    ARC_STAT             status;
+    size_t               hlen = len;
+    size_t               flen;
+    const unsigned char *body = NULL;
+    const unsigned char *nl;
+    char                *hdrs;
+    char                *field;
+    char                *end;
+    char                *p;
+
+    assert(msg != NULL);
+    assert(buf != NULL);
+
+    if (msg->arc_state != ARC_STATE_INIT)
+    {
+        return ARC_STAT_INVALID;
+    }
+
+    /* the header block ends at the first empty line, if there is one */
+    if (len > 0 && buf[0] == '\n')
+    {
+        hlen = 0;
+        body = buf + 1;
+    }
+    else if (len > 1 && buf[0] == '\r' && buf[1] == '\n')
+    {
+        hlen = 0;
+        body = buf + 2;
+    }
+
+    for (nl = buf; body == NULL && nl < buf + len; nl++)
+    {
+        nl = memchr(nl, '\n', buf + len - nl);
+        if (nl == NULL)
+        {
+            break;
+        }
+
+        if (nl + 1 < buf + len && nl[1] == '\n')
+        {
+            hlen = nl + 1 - buf;
+            body = nl + 2;
+        }
+        else if (nl + 2 < buf + len && nl[1] == '\r' && nl[2] == '\n')
+        {
+            hlen = nl + 1 - buf;
+            body = nl + 3;
+        }
+    }
+
+    hdrs = ARC_AMALLOC(msg->arc_arena, hlen + 1);
+    if (hdrs == NULL)
     {
-        char      *cv;
-        ARC_KVSET *kvset;
+        arc_error(msg, "unable to allocate %d byte(s)", hlen + 1);
+        return ARC_STAT_NORESOURCE;
+    }
+    memcpy(hdrs, buf, hlen);
+    hdrs[hlen] = '\0';
 
-        for (kvset = arc_set_first(msg, ARC_KVSETTYPE_SEAL); kvset != NULL;
-             kvset = arc_set_next(kvset, ARC_KVSETTYPE_SEAL))
+    /* each field runs to a line break that isn't followed by folding */
+    end = hdrs + hlen;
+    for (field = hdrs; field < end; field = p + 1)
+    {
+        for (p = field; (p = memchr(p, '\n', end - p)) != NULL; p++)
         {
-            if (atoi(arc_param_get(kvset, "i")) == i)
+            if (p + 1 == end || (p[1] != ' ' && p[1] != '\t'))
             {
                 break;
             }
         }
+        if (p == NULL)
+        {
+            p = end;
+        }
 
-        cv = arc_param_get(kvset, "cv");
-        if (!((i == 1 && strcasecmp(cv, "none") == 0) ||
-              (i != 1 && strcasecmp(cv, "pass") == 0)))
+        flen = p - field;
+        if (flen > 0 && field[flen - 1] == '\r')
         {
-            /* the chain has already failed */
-            msg->arc_cstate = ARC_CHAIN_FAIL;
-            msg->arc_infail = true;
-            return ARC_STAT_OK;
+            flen--;
         }
+        field[flen] = '\0';
 
-        status = arc_validate_seal(msg, i);
-        if (status == ARC_STAT_INTERNAL)
+        if (flen == 0)
+        {
+            continue;
+        }
+
+        status = arc_add_header_field(msg, field, flen, true);
+        if (status != ARC_STAT_OK)
         {
+            arc_error(msg, "error processing header field \"%s\"", field);
             return status;
         }
+    }
+
+    status = arc_eoh(msg);
+    if (status != ARC_STAT_OK)
+    {
+        return status;
+    }
+
+    if (body != NULL && body < buf + len && arc_body_needed(msg))
+    {
+        status = arc_body(msg, body, buf + len - body);
         if (status != ARC_STAT_OK)
         {
-            msg->arc_cstate = ARC_CHAIN_FAIL;
-            return ARC_STAT_OK;
+            return status;
         }
     }
 
-    return ARC_STAT_OK;
+    return arc_eom(msg);
 }
 
 /*
@@ -3289,6 +4406,45 @@ arc_set_cv(ARC_MESSAGE *msg, ARC_CHAIN cv)
     }
 }
 
+/*
+**  ARC_SIGN_POOLED -- sign a digest on the library's RSA workers
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE object
+**  	key -- secret key, printable
+**  	keylen -- key length
+**  	digest -- digest to sign
+**  	diglen -- digest length
+**  	sig -- ARC_RSA_MAXSIG bytes for the signature
+**  	siglen -- signature length (returned)
+**
+**  Return value:
+**  	An ARC_STAT_* constant.
+*/
+
+static ARC_STAT
+arc_sign_pooled(ARC_MESSAGE         *msg,
+                const unsigned char *key,
+                size_t               keylen,
+                const unsigned char *digest,
+                size_t               diglen,
+                unsigned char       *sig,
+                size_t              *siglen)
+{
+    ARC_STAT status;
+    char     err[ARC_RSA_ERRLEN];
+
+    *siglen = ARC_RSA_MAXSIG;
+    status = arc_rsapool_sign(msg->arc_library->arcl_rsapool, key, keylen,
+                              digest, diglen, sig, siglen, err);
+    if (status != ARC_STAT_OK)
+    {
+        arc_error(msg, "%s", err);
+    }
+
+    return status;
+}
+
 /*
 **  ARC_GETSEAL -- get the "seal" to apply to this message
 **
@@ -3388,86 +4544,87 @@ arc_getseal(ARC_MESSAGE         *msg,
     msg->arc_selector = selector;
     msg->arc_authservid = authservid;
 
-    /* load the key */
-    keydata = BIO_new_mem_buf(key, keylen);
-    if (keydata == NULL)
-    {
-        arc_error(msg, "BIO_new_mem_buf() failed");
-        status = ARC_STAT_NORESOURCE;
-        goto error;
-    }
-
-    if (strncmp((const char *) key, "-----", 5) == 0)
+    if (msg->arc_library->arcl_rsapool != NULL)
     {
-        pkey = PEM_read_bio_PrivateKey(keydata, NULL, NULL, NULL);
-        if (pkey == NULL)
+        /* the workers load the key; just make room for what they return */
+        sigout = ARC_LMALLOC(ARC_MSGALLOC(msg), ARC_RSA_MAXSIG);
+        if (sigout == NULL)
         {
-            arc_error(msg, "PEM_read_bio_PrivateKey() failed");
+            arc_error(msg, "can't allocate %d bytes for signature",
+                      ARC_RSA_MAXSIG);
             status = ARC_STAT_NORESOURCE;
             goto error;
         }
     }
     else
     {
-        pkey = d2i_PrivateKey_bio(keydata, NULL);
-        if (pkey == NULL)
+        /* load the key */
+        keydata = BIO_new_mem_buf(key, keylen);
+        if (keydata == NULL)
         {
-            arc_error(msg, "d2i_PrivateKey_bio() failed");
+            arc_error(msg, "BIO_new_mem_buf() failed");
             status = ARC_STAT_NORESOURCE;
             goto error;
         }
-    }
 
-    ctx = EVP_PKEY_CTX_new(pkey, NULL);
-    if (ctx == NULL)
-    {
-        arc_error(msg, "EVP_PKEY_CTX_new() failed");
-        status = ARC_STAT_NORESOURCE;
-        goto error;
-    }
-    if (EVP_PKEY_sign_init(ctx) <= 0)
-    {
-        arc_error(msg, "EVP_PKEY_sign_init() failed");
-        status = ARC_STAT_INTERNAL;
-        goto error;
-    }
-    if (EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PADDING) <= 0)
-    {
-        arc_error(msg, "EVP_PKEY_CTX_set_rsa_padding() failed");
-        status = ARC_STAT_INTERNAL;
-        goto error;
-    }
-    if (EVP_PKEY_CTX_set_signature_md(ctx, EVP_sha256()) <= 0)
-    {
-        arc_error(msg, "EVP_PKEY_CTX_set_signature_md() failed");
-        status = ARC_STAT_INTERNAL;
-        goto error;
+        if (strncmp((const char *) key, "-----", 5) == 0)
+        {
+            pkey = PEM_read_bio_PrivateKey(keydata, NULL, NULL, NULL);
+            if (pkey == NULL)
+            {
+                arc_error(msg, "PEM_read_bio_PrivateKey() failed");
+                status = ARC_STAT_NORESOURCE;
+                goto error;
+            }
+        }
+        else
+        {
+            pkey = d2i_PrivateKey_bio(keydata, NULL);
+            if (pkey == NULL)
+            {
+                arc_error(msg, "d2i_PrivateKey_bio() failed");
+                status = ARC_STAT_NORESOURCE;
+                goto error;
+            }
+        }
+
+        ctx = EVP_PKEY_CTX_new(pkey, NULL);
+        if (ctx == NULL)
+        {
+            arc_error(msg, "EVP_PKEY_CTX_new() failed");
+            status = ARC_STAT_NORESOURCE;
+            goto error;
+        }
+        if (EVP_PKEY_sign_init(ctx) <= 0)
+        {
+            arc_error(msg, "EVP_PKEY_sign_init() failed");
+            status = ARC_STAT_INTERNAL;
+            goto error;
+        }
+        if (EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PADDING) <= 0)
+        {
+            arc_error(msg, "EVP_PKEY_CTX_set_rsa_padding() failed");
+            status = ARC_STAT_INTERNAL;
+            goto error;
+        }
+        if (EVP_PKEY_CTX_set_signature_md(ctx, EVP_sha256()) <= 0)
+        {
+            arc_error(msg, "EVP_PKEY_CTX_set_signature_md() failed");
+            status = ARC_STAT_INTERNAL;
+            goto error;
+        }
     }
 
-    dstr = arc_dstring_new(ARC_MAXHEADER, 0, msg, &arc_error_cb);
+    dstr = arc_dstring_new_arena(msg->arc_arena, ARC_MAXHEADER, 0, msg,
+                                 &arc_error_cb);
 
     /*
     **  Generate a new signature and store it.
     */
 
-    /* purge any previous seal */
-    if (msg->arc_sealhead != NULL)
-    {
-        ARC_HDRFIELD *tmphdr;
-        ARC_HDRFIELD *next;
-
-        tmphdr = msg->arc_sealhead;
-        while (tmphdr != NULL)
-        {
-            next = tmphdr->hdr_next;
-            ARC_FREE(tmphdr->hdr_text);
-            ARC_FREE(tmphdr);
-            tmphdr = next;
-        }
-
-        msg->arc_sealhead = NULL;
-        msg->arc_sealtail = NULL;
-    }
+    /* purge any previous seal; its fields stay in the arena */
+    msg->arc_sealhead = NULL;
+    msg->arc_sealtail = NULL;
 
     /*
     **  Part 1: Construct a new AAR
@@ -3486,7 +4643,7 @@ arc_getseal(ARC_MESSAGE         *msg,
     }
 
     status = arc_parse_header_field(msg, arc_dstring_get(dstr),
-                                    arc_dstring_len(dstr), &h);
+                                    arc_dstring_len(dstr), false, &h);
     if (status != ARC_STAT_OK)
     {
         arc_error(msg, "arc_parse_header_field() failed");
@@ -3546,31 +4703,44 @@ arc_getseal(ARC_MESSAGE         *msg,
     }
 
     /* encrypt the digest; that's our signature */
-    rstatus = EVP_PKEY_sign(ctx, NULL, &siglen, digest, diglen);
-    if (rstatus >= 0)
+    if (msg->arc_library->arcl_rsapool != NULL)
     {
-        sigout = ARC_MALLOC(siglen);
-        if (sigout == NULL)
+        status = arc_sign_pooled(msg, key, keylen, digest, diglen, sigout,
+                                 &siglen);
+        if (status != ARC_STAT_OK)
         {
-            arc_error(msg, "can't allocate %d bytes for signature", siglen);
-            status = ARC_STAT_NORESOURCE;
             goto error;
         }
-        rstatus = EVP_PKEY_sign(ctx, sigout, &siglen, digest, diglen);
     }
-
-    if (rstatus != 1 || siglen == 0)
+    else
     {
-        arc_error(msg, "EVP_PKEY_sign() failed (status %d, length %d)", rstatus,
-                  siglen);
-        status = ARC_STAT_INTERNAL;
-        goto error;
+        rstatus = EVP_PKEY_sign(ctx, NULL, &siglen, digest, diglen);
+        if (rstatus >= 0)
+        {
+            sigout = ARC_LMALLOC(ARC_MSGALLOC(msg), siglen);
+            if (sigout == NULL)
+            {
+                arc_error(msg, "can't allocate %d bytes for signature",
+                          siglen);
+                status = ARC_STAT_NORESOURCE;
+                goto error;
+            }
+            rstatus = EVP_PKEY_sign(ctx, sigout, &siglen, digest, diglen);
+        }
+
+        if (rstatus != 1 || siglen == 0)
+        {
+            arc_error(msg, "EVP_PKEY_sign() failed (status %d, length %d)",
+                      rstatus, siglen);
+            status = ARC_STAT_INTERNAL;
+            goto error;
+        }
     }
 
     /* base64 encode it */
     b64siglen = siglen * 3 + 5;
     b64siglen += (b64siglen / 60);
-    b64sig = ARC_CALLOC(1, b64siglen);
+    b64sig = ARC_LCALLOC(ARC_MSGALLOC(msg), 1, b64siglen);
     if (b64sig == NULL)
     {
         arc_error(msg, "can't allocate %d bytes for base64 signature",
@@ -3591,7 +4761,7 @@ arc_getseal(ARC_MESSAGE         *msg,
     arc_dstring_cat_wrap(dstr, (char *) b64sig, msg->arc_margin, NULL);
 
     /* add it to the seal */
-    h = ARC_MALLOC(sizeof hdr);
+    h = ARC_AMALLOC(msg->arc_arena, sizeof hdr);
     if (h == NULL)
     {
         arc_error(msg, "can't allocate %d bytes", sizeof hdr);
@@ -3604,12 +4774,12 @@ arc_getseal(ARC_MESSAGE         *msg,
      * just \n.
      */
     arc_dstring_strip(dstr, "\r");
-    h->hdr_text = ARC_STRDUP(arc_dstring_get(dstr));
+    h->hdr_text = ARC_ASTRNDUP(msg->arc_arena, arc_dstring_get(dstr),
+                               arc_dstring_len(dstr));
     if (h->hdr_text == NULL)
     {
         arc_error(msg, "can't allocate %d bytes", arc_dstring_len(dstr));
         status = ARC_STAT_INTERNAL;
-        ARC_FREE(h);
         goto error;
     }
     h->hdr_namelen = ARC_MSGSIG_HDRNAMELEN;
@@ -3667,13 +4837,25 @@ arc_getseal(ARC_MESSAGE         *msg,
     }
 
     /* encrypt the digest; that's our signature */
-    rstatus = EVP_PKEY_sign(ctx, sigout, &siglen, digest, diglen);
-    if (rstatus != 1 || siglen == 0)
+    if (msg->arc_library->arcl_rsapool != NULL)
     {
-        arc_error(msg, "EVP_PKEY_sign() failed (status %d, length %d)", rstatus,
-                  siglen);
-        status = ARC_STAT_INTERNAL;
-        goto error;
+        status = arc_sign_pooled(msg, key, keylen, digest, diglen, sigout,
+                                 &siglen);
+        if (status != ARC_STAT_OK)
+        {
+            goto error;
+        }
+    }
+    else
+    {
+        rstatus = EVP_PKEY_sign(ctx, sigout, &siglen, digest, diglen);
+        if (rstatus != 1 || siglen == 0)
+        {
+            arc_error(msg, "EVP_PKEY_sign() failed (status %d, length %d)",
+                      rstatus, siglen);
+            status = ARC_STAT_INTERNAL;
+            goto error;
+        }
     }
 
     /* base64 encode it */
@@ -3690,7 +4872,7 @@ arc_getseal(ARC_MESSAGE         *msg,
     arc_dstring_cat_wrap(dstr, (char *) b64sig, msg->arc_margin, NULL);
 
     /* add it to the seal */
-    h = ARC_MALLOC(sizeof hdr);
+    h = ARC_AMALLOC(msg->arc_arena, sizeof hdr);
     if (h == NULL)
     {
         arc_error(msg, "can't allocate %d bytes", sizeof hdr);
@@ -3698,11 +4880,11 @@ arc_getseal(ARC_MESSAGE         *msg,
         goto error;
     }
     arc_dstring_strip(dstr, "\r");
-    h->hdr_text = ARC_STRDUP(arc_dstring_get(dstr));
+    h->hdr_text = ARC_ASTRNDUP(msg->arc_arena, arc_dstring_get(dstr),
+                               arc_dstring_len(dstr));
     if (h->hdr_text == NULL)
     {
         arc_error(msg, "can't allocate %d bytes", sizeof hdr);
-        ARC_FREE(h);
         status = ARC_STAT_INTERNAL;
         goto error;
     }
@@ -3721,8 +4903,8 @@ arc_getseal(ARC_MESSAGE         *msg,
 error:
     /* tidy up */
     arc_dstring_free(dstr);
-    ARC_FREE(b64sig);
-    ARC_FREE(sigout);
+    ARC_LFREE(ARC_MSGALLOC(msg), b64sig);
+    ARC_LFREE(ARC_MSGALLOC(msg), sigout);
     EVP_PKEY_free(pkey);
     BIO_free(keydata);
     EVP_PKEY_CTX_free(ctx);
@@ -3746,7 +4928,7 @@ arc_hdr_name(ARC_HDRFIELD *hdr, size_t *len)
     {
         *len = hdr->hdr_namelen;
     }
-    return hdr->hdr_text;
+    return (char *) hdr->hdr_text;
 }
 
 /*
@@ -3762,7 +4944,7 @@ arc_hdr_name(ARC_HDRFIELD *hdr, size_t *len)
 char *
 arc_hdr_value(ARC_HDRFIELD *hdr)
 {
-    return hdr->hdr_text + hdr->hdr_namelen + 1;
+    return (char *) hdr->hdr_text + hdr->hdr_namelen + 1;
 }
 
 /*
@@ -3899,7 +5081,8 @@ arc_chain_custody_str(ARC_MESSAGE *msg, char *buf, size_t buflen)
         return 0;
     }
 
-    tmpbuf = arc_dstring_new(BUFRSZ, MAXBUFRSZ, msg, &arc_error_cb);
+    tmpbuf = arc_dstring_new_arena(msg->arc_arena, BUFRSZ, MAXBUFRSZ, msg,
+                                   &arc_error_cb);
     if (tmpbuf == NULL)
     {
         arc_error(msg, "failed to allocate dynamic string");
@@ -3942,3 +5125,92 @@ arc_chain_oldest_pass(ARC_MESSAGE *msg)
     }
     return -1;
 }
+
+/*
+**  ARC_BODY_NEEDED -- report whether the body still matters
+**
+**  Parameters:
+**      msg -- ARC_MESSAGE object
+**
+**  Return value:
+**      false if arc_eoh() has already settled everything the body would be
+**      used for; true otherwise, including before arc_eoh().
+*/
+
+bool
+arc_body_needed(ARC_MESSAGE *msg)
+{
+    assert(msg != NULL);
+
+    if (msg->arc_state < ARC_STATE_EOH)
+    {
+        return true;
+    }
+
+    /* a new ARC-Message-Signature covers the body */
+    if ((msg->arc_mode & ARC_MODE_SIGN) != 0)
+    {
+        return true;
+    }
+
+    /* wait for background checks to say otherwise */
+    if (msg->arc_bgstarted)
+    {
+        bool done;
+
+        pthread_mutex_lock(&msg->arc_bglock);
+        done = msg->arc_bgdone;
+        pthread_mutex_unlock(&msg->arc_bglock);
+
+        if (!done)
+        {
+            return true;
+        }
+    }
+
+    /*
+    **  The newest ARC-Message-Signature's body hash is all that's left.  A
+    **  bad cv= fails the chain either way, but whether it's a hard failure
+    **  depends on that hash too.
+    */
+
+    return msg->arc_nsets > 0 &&
+           (msg->arc_cstate != ARC_CHAIN_FAIL || msg->arc_cvstop);
+}
+
+/*
+**  ARC_PENDING_QUERIES -- list key lookups that are still outstanding
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE object
+**  	qh -- array to receive the resolver's query handles (or NULL)
+**  	nqh -- number of entries available at "qh"
+**
+**  Return value:
+**  	The number of key queries still waiting for a reply.
+*/
+
+int
+arc_pending_queries(ARC_MESSAGE *msg, void **qh, int nqh)
+{
+    int                  n = 0;
+    struct arc_keyquery *kq;
+
+    assert(msg != NULL);
+
+    for (kq = msg->arc_keyqueries; kq != NULL; kq = kq->kq_next)
+    {
+        if (kq->kq_done)
+        {
+            continue;
+        }
+
+        if (qh != NULL && n < nqh)
+        {
+            qh[n] = kq->kq_handle;
+        }
+        n++;
+    }
+
+    return n;
+}
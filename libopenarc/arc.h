@@ -15,6 +15,7 @@ extern "C" {
 #include <sys/param.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #ifdef HAVE_LIMITS_H
 #include <limits.h>
 #endif /* HAVE_LIMITS_H */
@@ -72,6 +73,7 @@ typedef int ARC_STAT;
 #define ARC_STAT_MULTIDNSREPLY 12 /* multiple DNS replies */
 #define ARC_STAT_SIGGEN        13 /* seal generation failed */
 #define ARC_STAT_BADALG        14 /* unknown or invalid algorithm */
+#define ARC_STAT_AGAIN         15 /* waiting on DNS; call again later */
 
 /*
 **  ARC_CHAIN -- chain state
@@ -145,15 +147,44 @@ typedef int arc_opts_t;
 #define ARC_OPTS_MINKEYSIZE     5
 #define ARC_OPTS_TESTKEYS       6
 #define ARC_OPTS_SIGNATURE_TTL  7
+#define ARC_OPTS_BODYTHREADS    8
+#define ARC_OPTS_BODYTHRESHOLD  9
+#define ARC_OPTS_ARENASIZE      10
+#define ARC_OPTS_ARENAHWM       11
+#define ARC_OPTS_MEMLIVE        12
+#define ARC_OPTS_MEMPEAK        13
+#define ARC_OPTS_CAPTURESAMPLE  14
+#define ARC_OPTS_RSATHREADS     15
+#define ARC_OPTS_RSASTATS       16
 
 /* flags */
 #define ARC_LIBFLAGS_NONE       0x00000000
 #define ARC_LIBFLAGS_FIXCRLF    0x00000001
 #define ARC_LIBFLAGS_KEEPFILES  0x00000002
+#define ARC_LIBFLAGS_BUILTINSHA 0x00000004
+#define ARC_LIBFLAGS_SKIPOLDEST 0x00000008
+#define ARC_LIBFLAGS_BGVERIFY   0x00000010
+#define ARC_LIBFLAGS_NONBLOCK   0x00000020
+#define ARC_LIBFLAGS_CAPTURE    0x00000040
 
 /* default */
 #define ARC_LIBFLAGS_DEFAULT    ARC_LIBFLAGS_NONE
 
+/*
+**  ARC_RSASTATS -- activity of the RSA workers, from ARC_OPTS_RSASTATS
+*/
+
+struct arc_rsastats
+{
+    unsigned int rs_threads;  /* workers (0 = RSA runs on the caller) */
+    unsigned int rs_depth;    /* jobs waiting now */
+    unsigned int rs_maxdepth; /* most jobs ever waiting at once */
+    uint64_t     rs_jobs;     /* signatures made or checked */
+    uint64_t     rs_waitns;   /* total time jobs spent waiting, in ns */
+    uint64_t     rs_waitmax;  /* longest wait, in ns */
+    uint64_t     rs_runns;    /* total time spent on RSA, in ns */
+};
+
 /*
 **  ARC_DNSSEC -- results of DNSSEC queries
 */
@@ -188,8 +219,9 @@ typedef struct arc_lib ARC_LIB;
 
 /* LIBRARY FEATURES */
 #define ARC_FEATURE_SHA256 1
+#define ARC_FEATURE_SHANI  2
 
-#define ARC_FEATURE_MAX    1
+#define ARC_FEATURE_MAX    2
 
 extern bool arc_libfeature(ARC_LIB *lib, unsigned int fc);
 
@@ -293,6 +325,34 @@ extern ARC_STAT arc_set_dns(
     int (*)(void *, void *),
     int (*)(void *, void *, struct timeval *, size_t *, int *, int *));
 
+/*
+**  ARC_SET_ALLOCATOR -- override memory allocation
+**
+**  Parameters:
+**  	lib -- library instance
+**  	alloc_fn -- allocation function
+**  	realloc_fn -- reallocation function
+**  	free_fn -- release function
+**  	ctx -- context passed to each of the above
+**
+**  Return value:
+**  	An ARC_STAT_* constant.
+**
+**  Notes:
+**  	Message handles and what they allocate (buffers, header fields,
+**  	canonicalizations, signatures) use these functions; ARC_OPTS_MEMLIVE
+**  	and ARC_OPTS_MEMPEAK report the bytes outstanding through them.
+**  	They may be called from several threads at once.  This can only be
+**  	changed while no message handles exist.
+*/
+
+extern ARC_STAT arc_set_allocator(
+    ARC_LIB *,
+    void *(*)(void *, size_t),
+    void *(*)(void *, void *, size_t),
+    void (*)(void *, void *),
+    void *);
+
 /*
 **  ARC_GETSSLBUF -- retrieve SSL error buffer
 **
@@ -323,6 +383,33 @@ extern const char *arc_getsslbuf(ARC_LIB *);
 extern ARC_MESSAGE *arc_message(
     ARC_LIB *, arc_canon_t, arc_canon_t, arc_alg_t, arc_mode_t, const char **);
 
+/*
+**  ARC_MESSAGE_RESET -- return a message handle to its initial state
+**
+**  Parameters:
+**  	msg -- message handle to recycle
+**  	canonhdr -- canonicalization to use for the header
+**  	canonbody -- canonicalization to use for the body
+**  	signalg -- signing algorithm
+**  	mode -- mask of mode bits
+**  	err -- error string (returned)
+**
+**  Return value:
+**  	An ARC_STAT_* constant (and "err" is updated on failure).
+**
+**  Notes:
+**  	The handle behaves as if it had just been returned by arc_message(),
+**  	but keeps the memory, buffers and hash contexts it already has, so
+**  	a caller processing many messages can avoid most allocation.
+*/
+
+extern ARC_STAT arc_message_reset(ARC_MESSAGE *,
+                                  arc_canon_t,
+                                  arc_canon_t,
+                                  arc_alg_t,
+                                  arc_mode_t,
+                                  const char **);
+
 /*
 **  ARC_FREE -- deallocate a message object
 **
@@ -349,6 +436,45 @@ extern void arc_free(ARC_MESSAGE *);
 
 extern ARC_STAT arc_header_field(ARC_MESSAGE *, const char *, size_t);
 
+/*
+**  ARC_HEADER_FIELD_REF -- consume a header field without copying it
+**
+**  Parameters:
+**  	msg -- message handle
+**  	hdr -- full text of the header field, NUL-terminated at "hlen"
+**  	hlen -- bytes to use at hdr
+**
+**  Return value:
+**  	An ARC_STAT_* constant.
+**
+**  Notes:
+**  	The caller must leave "hdr" intact until the handle is passed to
+**  	arc_free() or arc_message_reset().
+*/
+
+extern ARC_STAT arc_header_field_ref(ARC_MESSAGE *, const char *, size_t);
+
+/*
+**  ARC_HEADER_FIELD_IOV -- consume a header field supplied in pieces
+**
+**  Parameters:
+**  	msg -- message handle
+**  	iov -- pieces of the header field (name, separator, value and
+**  	       any folded continuations), in order
+**  	iovcnt -- number of entries at "iov"
+**
+**  Return value:
+**  	An ARC_STAT_* constant.
+**
+**  Notes:
+**  	The pieces are copied once, directly into the message handle's own
+**  	storage; they need not outlive the call.
+*/
+
+extern ARC_STAT arc_header_field_iov(ARC_MESSAGE *,
+                                     const struct iovec *,
+                                     int);
+
 /*
 **  ARC_EOH -- declare no more headers are coming
 **
@@ -385,11 +511,35 @@ extern ARC_STAT arc_body(ARC_MESSAGE *, const unsigned char *, size_t);
 **  	msg -- message handle
 **
 **  Return value:
-**  	An ARC_STAT_* constant.
+**  	An ARC_STAT_* constant.  With ARC_LIBFLAGS_NONBLOCK set this can be
+**  	ARC_STAT_AGAIN, meaning key lookups are still outstanding; nothing
+**  	has been done yet and arc_eom() should be called again later.
 */
 
 extern ARC_STAT arc_eom(ARC_MESSAGE *);
 
+/*
+**  ARC_PROCESS_MESSAGE -- process a whole message held in one buffer
+**
+**  Parameters:
+**  	msg -- message handle, fresh from arc_message() or arc_message_reset()
+**  	buf -- the message: header fields, a blank line, then the body
+**  	len -- bytes at "buf"
+**
+**  Return value:
+**  	An ARC_STAT_* constant.  This does the work of arc_header_field(),
+**  	arc_eoh(), arc_body() and arc_eom(); afterward the chain status and
+**  	arc_getseal() are available as usual.  ARC_STAT_AGAIN means only
+**  	arc_eom() is left to call.
+**
+**  Notes:
+**  	Nothing refers to "buf" once this returns.
+*/
+
+extern ARC_STAT arc_process_message(ARC_MESSAGE *,
+                                    const unsigned char *,
+                                    size_t);
+
 /*
 **  ARC_SET_CV -- force the chain state
 **
@@ -534,6 +684,60 @@ extern int arc_chain_custody_str(ARC_MESSAGE *, char *, size_t);
 
 extern int arc_chain_oldest_pass(ARC_MESSAGE *);
 
+/*
+**  ARC_BODY_NEEDED -- report whether the body still matters
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE object
+**
+**  Return value:
+**  	false if arc_eoh() has already settled everything the body would be
+**  	used for, so arc_body() calls can be skipped; true otherwise.
+*/
+
+extern bool arc_body_needed(ARC_MESSAGE *);
+
+/*
+**  ARC_PENDING_QUERIES -- list key lookups that are still outstanding
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE object
+**  	qh -- array to receive the resolver's query handles (or NULL)
+**  	nqh -- number of entries available at "qh"
+**
+**  Return value:
+**  	The number of key queries still waiting for a reply, which may be
+**  	more than "nqh".  The handles are the ones returned by the query
+**  	start function given to arc_set_dns(), so an event-driven resolver
+**  	can map them to whatever it is polling.
+*/
+
+extern int arc_pending_queries(ARC_MESSAGE *, void **, int);
+
+/*
+**  ARC_CAPTURE_PATH -- name the file a message's canonicalizations go to
+**
+**  Parameters:
+**  	msg -- ARC_MESSAGE object
+**
+**  Return value:
+**  	The path of the capture file, or NULL if ARC_LIBFLAGS_CAPTURE is not
+**  	set or this message was not sampled (see ARC_OPTS_CAPTURESAMPLE).
+**  	The file is complete once the message is freed or reset.
+**
+**  Notes:
+**  	A capture file starts with the line "ARC-CAPTURE 1".  Every write to
+**  	a canonicalization follows as a line "@<stream> <length>" and that
+**  	many bytes of canonicalized data, in the order they were hashed.
+**  	After them a newline and the line "#index" start one line per stream:
+**  	"<stream> <type> <canon> <hash> <limit> <bytes> <digest>", where
+**  	type is header, body, seal or ams, limit is the body length limit
+**  	or -1, and digest is hex or "-" if the hash was never finished.
+**  	The last line is "#end <offset of #index>".
+*/
+
+extern const char *arc_capture_path(ARC_MESSAGE *);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
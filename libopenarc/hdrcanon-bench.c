@@ -0,0 +1,536 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#include "build-config.h"
+
+/* system includes */
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+
+/* libopenarc includes */
+#include "arc-hdrcanon.h"
+
+#define BENCH_ROUNDS  20000
+#define BENCH_RANDOM  200000
+#define BENCH_MAXHDR  65536
+
+#define ARC_ISLWSP(x) ((x) == 011 || (x) == 012 || (x) == 015 || (x) == 040)
+
+/* the header block of a typical bulk message after a few ARC hops */
+static const char *bench_corpus[] = {
+    "ARC-Seal: i=2; a=rsa-sha256; t=1700000300; cv=pass;\r\n"
+    "        d=relay.example.net; s=arc-2023;\r\n"
+    "        b=Yc3ZqkzN8mU1s0Xo6bXh2f5vVv3m1qJQm9Yt0k0z7b3r1n8l2k4j6h8g0f2d4s6a\r\n"
+    "         8p0o2i4u6y8t0r2e4w6q8z0x2c4v6b8n0m2l4k6j8h0g2f4d6s8a0p2o4i6u8y\r\n"
+    "         0t2r4e6w8q0z2x4c6v8b0n2m4l6k8j0h2g4f6d8s0a2p4o6i8u0y2t4r6e8w0q\r\n"
+    "         2z4x6c8v0b2n4m6l8k0j2h4g6f8d0s2a4p6o8i0u2y4t6r8e0w2q4z6x8c0v2b==",
+    "ARC-Message-Signature: i=2; a=rsa-sha256; c=relaxed/relaxed;\r\n"
+    "        d=relay.example.net; s=arc-2023; t=1700000300;\r\n"
+    "        h=From:To:Subject:Date:Message-ID:List-Unsubscribe:\r\n"
+    "         List-Unsubscribe-Post:MIME-Version:Content-Type;\r\n"
+    "        bh=47DEQpj8HBSa+/TImW+5JCeuQeRkm5NMpJWZG3hSuFU=;\r\n"
+    "        b=kF8dS2aP0oI9uY7tR5eW3qZ1xC4vB6nM8lK0jH2gF4dS6aP8oI0uY2tR4eW6qZ8x\r\n"
+    "         C0vB2nM4lK6jH8gF0dS2aP4oI6uY8tR0eW2qZ4xC6vB8nM0lK2jH4gF6dS8aP0o\r\n"
+    "         I2uY4tR6eW8qZ0xC2vB4nM6lK8jH0gF2dS4aP6oI8uY0tR2eW4qZ6xC8vB0nM2l==",
+    "ARC-Authentication-Results: i=2; relay.example.net;\r\n"
+    "       dkim=pass header.d=news.example.com header.s=s1 header.b=AbCdEfGh;\r\n"
+    "       spf=pass (relay.example.net: domain of bounce@news.example.com\r\n"
+    "        designates 192.0.2.10 as permitted sender)\r\n"
+    "        smtp.mailfrom=bounce@news.example.com;\r\n"
+    "       dmarc=pass (p=REJECT sp=REJECT dis=NONE) header.from=example.com;\r\n"
+    "       arc=pass (i=1 spf=pass spfdomain=news.example.com dkim=pass\r\n"
+    "        dkdomain=example.com dmarc=pass fromdomain=example.com)",
+    "Received: from mta-42.news.example.com (mta-42.news.example.com\r\n"
+    " [192.0.2.10]) by relay.example.net with ESMTPS id\r\n"
+    " 5b1f17b1804b1-40e5a2b4c3asi1234567f.123.2023.11.14.22.13.20 for\r\n"
+    " <someone@example.org> (version=TLS1_3 cipher=TLS_AES_256_GCM_SHA384\r\n"
+    " bits=256/256); Tue, 14 Nov 2023 22:13:20 -0800 (PST)",
+    "DKIM-Signature: v=1; a=rsa-sha256; c=relaxed/relaxed; d=example.com;\r\n"
+    "\ts=s1; t=1700000000; x=1700604800;\r\n"
+    "\th=From:To:Subject:Date:Message-ID:List-Unsubscribe:\r\n"
+    "\t List-Unsubscribe-Post:MIME-Version:Content-Type:Feedback-ID;\r\n"
+    "\tbh=47DEQpj8HBSa+/TImW+5JCeuQeRkm5NMpJWZG3hSuFU=;\r\n"
+    "\tb=Q2lUoN7vP1kR4wS8xT5yV0zA3bC6dE9fG2hI5jK8lM1nO4pQ7rS0tU3vW6xY9z\r\n"
+    "\t A2bC5dE8fG1hI4jK7lM0nO3pQ6rS9tU2vW5xY8zA1bC4dE7fG0hI3jK6lM9nO2p\r\n"
+    "\t Q5rS8tU1vW4xY7zA0bC3dE6fG9hI2jK5lM8nO1pQ4rS7tU0vW3xY6zA9bC2dE5f==",
+    "From: \"Example Newsletter\" <news@example.com>",
+    "To: someone@example.org",
+    "Subject: =?UTF-8?Q?Your_weekly_digest_=E2=80=94_12_new_items_picked_for_you?=",
+    "Date: Tue, 14 Nov 2023 22:13:20 -0800",
+    "Message-ID: <20231114221320.1a2b3c4d5e6f@news.example.com>",
+    "MIME-Version: 1.0",
+    "Content-Type: multipart/alternative;\r\n"
+    "\tboundary=\"----=_Part_1234567_890123456.1700000000000\"",
+    "List-Unsubscribe: <https://news.example.com/unsubscribe?u=abcdef0123456789"
+    "&list=weekly&sig=0f1e2d3c4b5a69788796a5b4c3d2e1f0>,\r\n"
+    " <mailto:unsubscribe+abcdef0123456789@news.example.com?subject=unsubscribe>",
+    "List-Unsubscribe-Post: List-Unsubscribe=One-Click",
+    "List-Id: Weekly Digest <weekly.news.example.com>",
+    "Feedback-ID: 1234:weekly:campaign-2023-46:example",
+    "X-Campaign-ID: cmp-2023-46-weekly-digest-a",
+    "X-Mailer:   Example Mailer   8.1   (build   20231101)   ",
+    "Precedence: bulk",
+    "Reply-To: Example Support <support@example.com>",
+};
+
+/**
+ *  Canonicalize a header field the way libopenarc did before
+ *  arc_hdrcanon_relaxed() existed. This is the reference the other
+ *  implementations are checked against.
+ *
+ *  Parameters:
+ *      out: output buffer, at least "hdrlen" bytes
+ *      hdr: NUL-terminated header field
+ *      hdrlen: bytes at "hdr"
+ *
+ *  Returns:
+ *      Number of bytes written to "out".
+ */
+
+static size_t
+ref_relaxed(char *out, const char *hdr, size_t hdrlen)
+{
+    bool        space;
+    const char *p;
+    char       *tmp = out;
+
+    /* process header field name (before colon) first */
+    for (p = hdr; p < hdr + hdrlen; p++)
+    {
+        if (isascii(*p))
+        {
+            /* discard spaces */
+            if (ARC_ISLWSP(*p))
+            {
+                continue;
+            }
+
+            /* convert to lowercase */
+            if (isupper(*p))
+            {
+                *tmp++ = tolower(*p);
+            }
+            else
+            {
+                *tmp++ = *p;
+            }
+        }
+        else
+        {
+            *tmp++ = *p;
+        }
+
+        if (*p == ':')
+        {
+            p++;
+            break;
+        }
+    }
+
+    /* skip all spaces before first word */
+    while (*p != '\0' && ARC_ISLWSP(*p))
+    {
+        p++;
+    }
+
+    space = false; /* just saw a space */
+
+    for (; *p != '\0'; p++)
+    {
+        if (isascii(*p) && isspace(*p))
+        {
+            /* mark that there was a space and continue */
+            space = true;
+
+            continue;
+        }
+
+        if (space)
+        {
+            *tmp++ = ' ';
+            space = false;
+        }
+
+        /* copy the byte */
+        *tmp++ = *p;
+    }
+
+    return tmp - out;
+}
+
+/* implementations to check and time */
+static const struct
+{
+    const char    *name;
+    arc_hdrcanon_t func;
+} bench_impls[] = {
+    {"reference", ref_relaxed},
+    {"generic", arc_hdrcanon_relaxed_generic},
+#ifdef ARC_HDRCANON_SSE2
+    {"sse2", arc_hdrcanon_relaxed_sse2},
+#endif /* ARC_HDRCANON_SSE2 */
+};
+
+#define BENCH_NIMPLS (sizeof bench_impls / sizeof bench_impls[0])
+
+/* struct bench_field -- one header field to canonicalize */
+struct bench_field
+{
+    size_t bf_len;
+    char  *bf_text;
+};
+
+/**
+ *  Print a header field that produced different results.
+ *
+ *  Parameters:
+ *      progname: program name
+ *      impl: name of the implementation that disagreed
+ *      hdr: the field
+ *      hdrlen: bytes at "hdr"
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+static void
+bench_report(const char *progname,
+             const char *impl,
+             const char *hdr,
+             size_t      hdrlen)
+{
+    fprintf(stderr, "%s: %s differs from reference on \"", progname, impl);
+    for (size_t c = 0; c < hdrlen; c++)
+    {
+        unsigned char ch = hdr[c];
+
+        if (isascii(ch) && isprint(ch) && ch != '\\' && ch != '"')
+        {
+            fputc(ch, stderr);
+        }
+        else
+        {
+            fprintf(stderr, "\\x%02x", ch);
+        }
+    }
+    fprintf(stderr, "\"\n");
+}
+
+/**
+ *  Run every implementation on one header field and compare the results.
+ *
+ *  Parameters:
+ *      progname: program name
+ *      hdr: NUL-terminated header field
+ *      hdrlen: bytes at "hdr"
+ *      out: scratch space, at least "hdrlen" bytes per implementation
+ *
+ *  Returns:
+ *      true iff all implementations agreed.
+ */
+
+static bool
+bench_check(const char *progname, const char *hdr, size_t hdrlen, char *out)
+{
+    size_t len[BENCH_NIMPLS];
+
+    for (size_t c = 0; c < BENCH_NIMPLS; c++)
+    {
+        len[c] = bench_impls[c].func(out + c * hdrlen, hdr, hdrlen);
+        if (len[c] > hdrlen ||
+            (c > 0 && (len[c] != len[0] ||
+                       memcmp(out, out + c * hdrlen, len[0]) != 0)))
+        {
+            bench_report(progname, bench_impls[c].name, hdr, hdrlen);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ *  Generate a random header field that leans on the cases canonicalization
+ *  has to get right: whitespace runs of every kind, folding, case, colons,
+ *  8-bit bytes and stray NULs.
+ *
+ *  Parameters:
+ *      buf: output buffer, at least "max" + 1 bytes
+ *      max: longest field to generate
+ *      state: PRNG state
+ *
+ *  Returns:
+ *      Length of the field, which is also NUL-terminated.
+ */
+
+static size_t
+bench_random(char *buf, size_t max, uint64_t *state)
+{
+    size_t len;
+    /* weighted towards text, with short and long whitespace runs */
+    static const char alphabet[] = "aaaaaaaaaaaaBBBBzZ09-=;.<>@\"" /* text */
+                                   "        \t\t\r\n\v\f"          /* WSP */
+                                   ":\x80\xe2\xff";                /* odd */
+
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    len = *state % (max + 1);
+
+    for (size_t c = 0; c < len; c++)
+    {
+        *state ^= *state << 13;
+        *state ^= *state >> 7;
+        *state ^= *state << 17;
+
+        /* a NUL now and then */
+        if (*state % 997 == 0)
+        {
+            buf[c] = '\0';
+        }
+        else
+        {
+            buf[c] = alphabet[(*state >> 16) % (sizeof alphabet - 1)];
+        }
+    }
+    buf[len] = '\0';
+
+    return len;
+}
+
+/**
+ *  Load header fields from a message file.
+ *
+ *  Parameters:
+ *      path: file to read
+ *      fields: array to add to (updated)
+ *      nfields: number of entries in "fields" (updated)
+ *
+ *  Returns:
+ *      true on success.
+ */
+
+static bool
+bench_load(const char *path, struct bench_field **fields, size_t *nfields)
+{
+    size_t              n;
+    size_t              len = 0;
+    char               *p;
+    char               *q;
+    char               *text;
+    FILE               *f;
+    struct bench_field *new;
+
+    f = fopen(path, "r");
+    if (f == NULL)
+    {
+        return false;
+    }
+
+    text = malloc(BENCH_MAXHDR * 16);
+    if (text == NULL)
+    {
+        fclose(f);
+        return false;
+    }
+
+    n = fread(text, 1, BENCH_MAXHDR * 16 - 1, f);
+    fclose(f);
+    text[n] = '\0';
+
+    /* fields start at any line not beginning with whitespace, and the
+     * header ends at the first empty line */
+    for (p = text; *p != '\0' && *p != '\r' && *p != '\n'; p = q)
+    {
+        for (q = p; *q != '\0'; q++)
+        {
+            if (*q == '\n' && q[1] != ' ' && q[1] != '\t')
+            {
+                q++;
+                break;
+            }
+        }
+
+        len = q - p;
+        while (len > 0 && (p[len - 1] == '\n' || p[len - 1] == '\r'))
+        {
+            len--;
+        }
+
+        new = realloc(*fields, (*nfields + 1) * sizeof **fields);
+        if (new == NULL)
+        {
+            free(text);
+            return false;
+        }
+        *fields = new;
+
+        new[*nfields].bf_len = len;
+        new[*nfields].bf_text = strndup(p, len);
+        if (new[*nfields].bf_text == NULL)
+        {
+            free(text);
+            return false;
+        }
+        (*nfields)++;
+    }
+
+    free(text);
+
+    return true;
+}
+
+int
+main(int argc, char **argv)
+{
+    bool                mismatch = false;
+    int                 c;
+    long                rounds = BENCH_ROUNDS;
+    size_t              n;
+    size_t              nfields = 0;
+    size_t              total = 0;
+    size_t              maxlen = 0;
+    size_t              sink = 0;
+    uint64_t            state = 0x9e3779b97f4a7c15ULL;
+    char               *p;
+    char               *out;
+    char               *progname;
+    char                rbuf[513];
+    struct bench_field *fields = NULL;
+    struct timespec     start;
+    struct timespec     end;
+
+    progname = (p = strrchr(argv[0], '/')) == NULL ? argv[0] : p + 1;
+
+    while ((c = getopt(argc, argv, "n:")) != -1)
+    {
+        switch (c)
+        {
+        case 'n':
+            rounds = strtol(optarg, &p, 10);
+            if (*p != '\0' || rounds <= 0)
+            {
+                fprintf(stderr, "%s: invalid round count \"%s\"\n", progname,
+                        optarg);
+                return EX_USAGE;
+            }
+            break;
+
+        default:
+            fprintf(stderr, "%s: usage: %s [-n rounds] [message ...]\n",
+                    progname, progname);
+            return EX_USAGE;
+        }
+    }
+
+    for (c = optind; c < argc; c++)
+    {
+        if (!bench_load(argv[c], &fields, &nfields))
+        {
+            fprintf(stderr, "%s: %s: can't load header fields\n", progname,
+                    argv[c]);
+            return EX_NOINPUT;
+        }
+    }
+
+    if (nfields == 0)
+    {
+        nfields = sizeof bench_corpus / sizeof bench_corpus[0];
+        fields = calloc(nfields, sizeof *fields);
+        if (fields == NULL)
+        {
+            return EX_OSERR;
+        }
+        for (n = 0; n < nfields; n++)
+        {
+            fields[n].bf_text = (char *) bench_corpus[n];
+            fields[n].bf_len = strlen(bench_corpus[n]);
+        }
+    }
+
+    for (n = 0; n < nfields; n++)
+    {
+        total += fields[n].bf_len;
+        if (fields[n].bf_len > maxlen)
+        {
+            maxlen = fields[n].bf_len;
+        }
+    }
+    if (maxlen < sizeof rbuf)
+    {
+        maxlen = sizeof rbuf;
+    }
+
+    out = malloc(maxlen * BENCH_NIMPLS);
+    if (out == NULL)
+    {
+        return EX_OSERR;
+    }
+
+    /* differential checks: the corpus, then random fields */
+    for (n = 0; n < nfields && !mismatch; n++)
+    {
+        mismatch = !bench_check(progname, fields[n].bf_text, fields[n].bf_len,
+                                out);
+    }
+    for (n = 0; n < BENCH_RANDOM && !mismatch; n++)
+    {
+        size_t len = bench_random(rbuf, sizeof rbuf - 1, &state);
+
+        mismatch = !bench_check(progname, rbuf, len, out);
+    }
+
+    if (mismatch)
+    {
+        free(out);
+        return EX_SOFTWARE;
+    }
+
+    printf("%zu fields, %zu bytes; %zu random fields agree\n", nfields, total,
+           (size_t) BENCH_RANDOM);
+    printf("%-10s %10s %12s\n", "impl", "MB/s", "ns/field");
+
+    for (size_t i = 0; i < BENCH_NIMPLS; i++)
+    {
+        double secs;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (long r = 0; r < rounds; r++)
+        {
+            for (n = 0; n < nfields; n++)
+            {
+                sink += bench_impls[i].func(out, fields[n].bf_text,
+                                            fields[n].bf_len);
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("%-10s %10.1f %12.1f\n", bench_impls[i].name,
+               (double) total * rounds / secs / (1024 * 1024),
+               secs * 1e9 / ((double) rounds * nfields));
+    }
+
+    /* keep the timed calls from being optimized away */
+    if (sink == 0)
+    {
+        printf("\n");
+    }
+
+    free(out);
+    for (n = 0; n < nfields && optind < argc; n++)
+    {
+        free(fields[n].bf_text);
+    }
+    free(fields);
+
+    return EX_OK;
+}
@@ -0,0 +1,850 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#include "build-config.h"
+
+/* system includes */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/time.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+
+/* libopenarc includes */
+#include "arc.h"
+
+#define TEST_MAXKEYS    16
+#define TEST_MAXPENDING 16
+#define TEST_TXTCHUNK   255
+
+/* struct test_msg -- a message read from stdin, split for libopenarc */
+struct test_msg
+{
+    size_t  tm_nhdrs;
+    char  **tm_hdrs;
+    size_t *tm_hdrlens;
+    char   *tm_body;
+    size_t  tm_bodylen;
+    char   *tm_raw;
+    size_t  tm_rawlen;
+};
+
+/* struct test_query -- one query given to the fake resolver */
+struct test_query
+{
+    bool           tq_ready;
+    size_t         tq_anslen;
+    unsigned char *tq_ans;
+};
+
+/* key records the fake resolver answers from */
+static char  *test_keynames[TEST_MAXKEYS];
+static char  *test_keydata[TEST_MAXKEYS];
+static size_t test_nkeys;
+
+/* whether new queries have their reply in already */
+static bool test_ready = true;
+
+/* whether to use arc_process_message() instead of feeding the pieces */
+static bool test_whole = false;
+
+/**
+ *  Fake resolver: nothing to set up.
+ *
+ *  Parameters:
+ *      srv: resolver handle (returned)
+ *
+ *  Returns:
+ *      0.
+ */
+
+static int
+test_dns_init(void **srv)
+{
+    *srv = &test_nkeys;
+
+    return 0;
+}
+
+/**
+ *  Fake resolver: build the reply to a TXT query for a key record.
+ *
+ *  Parameters:
+ *      srv: resolver handle
+ *      type: query type
+ *      query: name to look up
+ *      buf: buffer for the reply
+ *      buflen: bytes available at "buf"
+ *      qh: query handle (returned)
+ *
+ *  Returns:
+ *      0 on success, -1 on error.
+ */
+
+static int
+test_dns_start(void          *srv,
+               int            type,
+               const char    *query,
+               unsigned char *buf,
+               size_t         buflen,
+               void         **qh)
+{
+    size_t             len;
+    size_t             n;
+    const char        *data = NULL;
+    const char        *p;
+    unsigned char     *cp;
+    unsigned char     *rdlen;
+    struct test_query *tq;
+
+    (void) srv;
+
+    for (n = 0; n < test_nkeys; n++)
+    {
+        if (strcasecmp(test_keynames[n], query) == 0)
+        {
+            data = test_keydata[n];
+            break;
+        }
+    }
+
+    if (buflen < 12 + strlen(query) + 2 + 4 + 12 +
+                     (data == NULL ? 0 : strlen(data) * 2))
+    {
+        return -1;
+    }
+
+    tq = calloc(1, sizeof *tq);
+    if (tq == NULL)
+    {
+        return -1;
+    }
+
+    /* header: response, authoritative, NXDOMAIN if there's no record */
+    cp = buf;
+    memset(cp, '\0', 12);
+    cp[2] = 0x84;
+    cp[3] = data == NULL ? 3 : 0;
+    cp[5] = 1;
+    cp[7] = data == NULL ? 0 : 1;
+    cp += 12;
+
+    /* question */
+    for (p = query; *p != '\0'; p += len + (p[len] == '.'))
+    {
+        len = strcspn(p, ".");
+        *cp++ = (unsigned char) len;
+        memcpy(cp, p, len);
+        cp += len;
+    }
+    *cp++ = 0;
+    *cp++ = 0;
+    *cp++ = type;
+    *cp++ = 0;
+    *cp++ = 1;
+
+    /* answer: the record as a string of at most 255-byte pieces */
+    if (data != NULL)
+    {
+        *cp++ = 0xc0;
+        *cp++ = 12;
+        *cp++ = 0;
+        *cp++ = type;
+        *cp++ = 0;
+        *cp++ = 1;
+        memset(cp, '\0', 4);
+        cp += 4;
+        rdlen = cp;
+        cp += 2;
+        for (p = data; *p != '\0'; p += len)
+        {
+            len = strlen(p);
+            if (len > TEST_TXTCHUNK)
+            {
+                len = TEST_TXTCHUNK;
+            }
+            *cp++ = (unsigned char) len;
+            memcpy(cp, p, len);
+            cp += len;
+        }
+        n = cp - rdlen - 2;
+        rdlen[0] = (unsigned char) (n >> 8);
+        rdlen[1] = (unsigned char) n;
+    }
+
+    tq->tq_ready = test_ready;
+    tq->tq_ans = buf;
+    tq->tq_anslen = cp - buf;
+    *qh = tq;
+
+    return 0;
+}
+
+/**
+ *  Fake resolver: forget a query.
+ *
+ *  Parameters:
+ *      srv: resolver handle
+ *      qh: query handle
+ *
+ *  Returns:
+ *      0.
+ */
+
+static int
+test_dns_cancel(void *srv, void *qh)
+{
+    (void) srv;
+
+    free(qh);
+
+    return 0;
+}
+
+/**
+ *  Fake resolver: report a reply if it has "arrived".
+ *
+ *  Parameters:
+ *      srv: resolver handle
+ *      qh: query handle
+ *      to: timeout
+ *      bytes: length of the reply (returned)
+ *      error: error code (returned)
+ *      dnssec: DNSSEC status (returned)
+ *
+ *  Returns:
+ *      An ARC_DNS_* constant.
+ */
+
+static int
+test_dns_waitreply(void           *srv,
+                   void           *qh,
+                   struct timeval *to,
+                   size_t         *bytes,
+                   int            *error,
+                   int            *dnssec)
+{
+    struct test_query *tq = qh;
+
+    (void) srv;
+    (void) to;
+
+    if (!tq->tq_ready)
+    {
+        return ARC_DNS_NOREPLY;
+    }
+
+    *bytes = tq->tq_anslen;
+    if (error != NULL)
+    {
+        *error = 0;
+    }
+    if (dnssec != NULL)
+    {
+        *dnssec = ARC_DNSSEC_UNKNOWN;
+    }
+
+    return ARC_DNS_SUCCESS;
+}
+
+/**
+ *  Read a file into memory.
+ *
+ *  Parameters:
+ *      f: open file
+ *      len: bytes read (returned)
+ *
+ *  Returns:
+ *      The contents, NUL-terminated, or NULL on error.
+ */
+
+static char *
+read_all(FILE *f, size_t *len)
+{
+    size_t n;
+    size_t alloc = 65536;
+    char  *buf;
+    char  *tmp;
+
+    buf = malloc(alloc);
+    if (buf == NULL)
+    {
+        return NULL;
+    }
+
+    *len = 0;
+    while ((n = fread(buf + *len, 1, alloc - *len - 1, f)) > 0)
+    {
+        *len += n;
+        if (alloc - *len - 1 == 0)
+        {
+            alloc *= 2;
+            tmp = realloc(buf, alloc);
+            if (tmp == NULL)
+            {
+                free(buf);
+                return NULL;
+            }
+            buf = tmp;
+        }
+    }
+    buf[*len] = '\0';
+
+    return buf;
+}
+
+/**
+ *  Load key records: lines of "<selector>._domainkey.<domain> <record>".
+ *
+ *  Parameters:
+ *      path: file to read
+ *
+ *  Returns:
+ *      true on success.
+ */
+
+static bool
+load_keys(const char *path)
+{
+    size_t len;
+    char  *buf;
+    char  *line;
+    char  *last;
+    char  *sp;
+    FILE  *f;
+
+    f = fopen(path, "r");
+    if (f == NULL)
+    {
+        return false;
+    }
+    buf = read_all(f, &len);
+    fclose(f);
+    if (buf == NULL)
+    {
+        return false;
+    }
+
+    for (line = strtok_r(buf, "\n", &last); line != NULL;
+         line = strtok_r(NULL, "\n", &last))
+    {
+        sp = strchr(line, ' ');
+        if (sp == NULL || test_nkeys == TEST_MAXKEYS)
+        {
+            return false;
+        }
+        *sp = '\0';
+        test_keynames[test_nkeys] = line;
+        test_keydata[test_nkeys] = sp + 1;
+        test_nkeys++;
+    }
+
+    return true;
+}
+
+/**
+ *  Split a message into header fields and body.
+ *
+ *  Parameters:
+ *      raw: the message, with CRLF line endings
+ *      rawlen: bytes at "raw"
+ *      tm: split message (returned)
+ *
+ *  Returns:
+ *      true on success.
+ */
+
+static bool
+split_message(char *raw, size_t rawlen, struct test_msg *tm)
+{
+    char *p;
+    char *eoh;
+    char *end;
+
+    memset(tm, '\0', sizeof *tm);
+    tm->tm_raw = raw;
+    tm->tm_rawlen = rawlen;
+
+    eoh = strstr(raw, "\r\n\r\n");
+    if (eoh == NULL)
+    {
+        return false;
+    }
+    tm->tm_body = eoh + 4;
+    tm->tm_bodylen = raw + rawlen - tm->tm_body;
+
+    tm->tm_hdrs = calloc(rawlen, sizeof *tm->tm_hdrs);
+    tm->tm_hdrlens = calloc(rawlen, sizeof *tm->tm_hdrlens);
+    if (tm->tm_hdrs == NULL || tm->tm_hdrlens == NULL)
+    {
+        return false;
+    }
+
+    /* fields are copied out and NUL-terminated, as a milter passes them */
+    p = strndup(raw, eoh + 2 - raw);
+    if (p == NULL)
+    {
+        return false;
+    }
+    eoh = p + (eoh - raw);
+
+    /* a field ends at a CRLF that isn't followed by whitespace */
+    for (; p < eoh + 2; p = end + 2)
+    {
+        end = strstr(p, "\r\n");
+        while (end < eoh && (end[2] == ' ' || end[2] == '\t'))
+        {
+            end = strstr(end + 2, "\r\n");
+        }
+
+        *end = '\0';
+        tm->tm_hdrs[tm->tm_nhdrs] = p;
+        tm->tm_hdrlens[tm->tm_nhdrs] = end - p;
+        tm->tm_nhdrs++;
+    }
+
+    return true;
+}
+
+/**
+ *  Set up a library instance that uses the fake resolver.
+ *
+ *  Parameters:
+ *      flags: ARC_LIBFLAGS_* to set
+ *
+ *  Returns:
+ *      The library instance, or NULL on error.
+ */
+
+static ARC_LIB *
+test_lib(unsigned int flags)
+{
+    time_t   fixed = 1234567890;
+    ARC_LIB *lib;
+
+    lib = arc_init();
+    if (lib == NULL)
+    {
+        return NULL;
+    }
+
+    if (arc_options(lib, ARC_OP_SETOPT, ARC_OPTS_FLAGS, &flags,
+                    sizeof flags) != ARC_STAT_OK ||
+        arc_options(lib, ARC_OP_SETOPT, ARC_OPTS_FIXEDTIME, &fixed,
+                    sizeof fixed) != ARC_STAT_OK ||
+        arc_set_dns(lib, test_dns_init, NULL, 0, NULL, test_dns_start,
+                    test_dns_cancel, test_dns_waitreply) != ARC_STAT_OK)
+    {
+        arc_close(lib);
+        return NULL;
+    }
+
+    return lib;
+}
+
+/**
+ *  Run a message through libopenarc, either a header field at a time or
+ *  all at once with arc_process_message().
+ *
+ *  Parameters:
+ *      msg: message handle
+ *      tm: the message
+ *
+ *  Returns:
+ *      An ARC_STAT_* constant; ARC_STAT_AGAIN means arc_eom() is left.
+ */
+
+static ARC_STAT
+run_message(ARC_MESSAGE *msg, struct test_msg *tm)
+{
+    ARC_STAT status;
+
+    if (test_whole)
+    {
+        return arc_process_message(msg, (unsigned char *) tm->tm_raw,
+                                   tm->tm_rawlen);
+    }
+
+    for (size_t n = 0; n < tm->tm_nhdrs; n++)
+    {
+        status = arc_header_field(msg, tm->tm_hdrs[n], tm->tm_hdrlens[n]);
+        if (status != ARC_STAT_OK)
+        {
+            return status;
+        }
+    }
+
+    status = arc_eoh(msg);
+    if (status != ARC_STAT_OK)
+    {
+        return status;
+    }
+
+    status = arc_body(msg, (unsigned char *) tm->tm_body, tm->tm_bodylen);
+    if (status != ARC_STAT_OK)
+    {
+        return status;
+    }
+
+    return arc_eom(msg);
+}
+
+/**
+ *  Seal a message and write it out with the new ARC set in front.
+ *
+ *  Parameters:
+ *      progname: program name
+ *      tm: the message
+ *      spec: "<selector>:<domain>:<private key file>"
+ *
+ *  Returns:
+ *      An EX_* constant.
+ */
+
+static int
+seal_message(const char *progname, struct test_msg *tm, char *spec)
+{
+    ARC_STAT      status;
+    size_t        keylen;
+    size_t        namelen;
+    const char   *err = NULL;
+    char         *selector;
+    char         *domain;
+    char         *keyfile;
+    char         *key;
+    char         *p;
+    FILE         *f;
+    ARC_LIB      *lib;
+    ARC_MESSAGE  *msg;
+    ARC_HDRFIELD *seal = NULL;
+
+    selector = strtok(spec, ":");
+    domain = strtok(NULL, ":");
+    keyfile = strtok(NULL, "");
+    if (selector == NULL || domain == NULL || keyfile == NULL)
+    {
+        fprintf(stderr, "%s: -s wants selector:domain:keyfile\n", progname);
+        return EX_USAGE;
+    }
+
+    f = fopen(keyfile, "r");
+    if (f == NULL || (key = read_all(f, &keylen)) == NULL)
+    {
+        fprintf(stderr, "%s: %s: cannot read\n", progname, keyfile);
+        return EX_NOINPUT;
+    }
+    fclose(f);
+
+    lib = test_lib(ARC_LIBFLAGS_DEFAULT);
+    if (lib == NULL)
+    {
+        fprintf(stderr, "%s: arc_init() failed\n", progname);
+        return EX_SOFTWARE;
+    }
+
+    msg = arc_message(lib, ARC_CANON_RELAXED, ARC_CANON_RELAXED,
+                      ARC_SIGN_RSASHA256, ARC_MODE_SIGN | ARC_MODE_VERIFY,
+                      &err);
+    if (msg == NULL)
+    {
+        fprintf(stderr, "%s: arc_message(): %s\n", progname, err);
+        return EX_SOFTWARE;
+    }
+
+    status = run_message(msg, tm);
+    if (status == ARC_STAT_OK)
+    {
+        status = arc_getseal(msg, &seal, "test.example.com", selector, domain,
+                             (unsigned char *) key, keylen, NULL);
+    }
+    if (status != ARC_STAT_OK)
+    {
+        fprintf(stderr, "%s: sealing failed: %s\n", progname, arc_geterror(msg));
+        return EX_SOFTWARE;
+    }
+
+    /* the values are folded with bare newlines */
+    for (; seal != NULL; seal = arc_hdr_next(seal))
+    {
+        p = arc_hdr_name(seal, &namelen);
+        printf("%.*s:", (int) namelen, p);
+        for (p = arc_hdr_value(seal); *p != '\0'; p++)
+        {
+            if (*p == '\n')
+            {
+                putchar('\r');
+            }
+            putchar(*p);
+        }
+        printf("\r\n");
+    }
+    fwrite(tm->tm_raw, 1, tm->tm_rawlen, stdout);
+
+    arc_free(msg);
+    arc_close(lib);
+    free(key);
+
+    return EX_OK;
+}
+
+/**
+ *  Verify a message, optionally without blocking on key lookups.
+ *
+ *  Parameters:
+ *      progname: program name
+ *      tm: the message
+ *      nonblock: use ARC_LIBFLAGS_NONBLOCK with replies that arrive late
+ *      rounds: number of times arc_eom() said to come back (returned)
+ *
+ *  Returns:
+ *      The chain status string, or NULL on error.
+ */
+
+static const char *
+verify_message(const char      *progname,
+               struct test_msg *tm,
+               bool             nonblock,
+               unsigned int    *rounds)
+{
+    ARC_STAT     status;
+    int          npending;
+    const char  *err = NULL;
+    const char  *ret;
+    void        *pending[TEST_MAXPENDING];
+    ARC_LIB     *lib;
+    ARC_MESSAGE *msg;
+
+    lib = test_lib(nonblock ? ARC_LIBFLAGS_NONBLOCK : ARC_LIBFLAGS_DEFAULT);
+    if (lib == NULL)
+    {
+        fprintf(stderr, "%s: arc_init() failed\n", progname);
+        return NULL;
+    }
+
+    msg = arc_message(lib, ARC_CANON_RELAXED, ARC_CANON_RELAXED,
+                      ARC_SIGN_RSASHA256, ARC_MODE_VERIFY, &err);
+    if (msg == NULL)
+    {
+        fprintf(stderr, "%s: arc_message(): %s\n", progname, err);
+        return NULL;
+    }
+
+    test_ready = !nonblock;
+    *rounds = 0;
+
+    /* let one reply "arrive" each time arc_eom() would have blocked */
+    for (status = run_message(msg, tm); status == ARC_STAT_AGAIN;
+         status = arc_eom(msg))
+    {
+        npending = arc_pending_queries(msg, pending, TEST_MAXPENDING);
+        if (npending <= 0)
+        {
+            fprintf(stderr, "%s: ARC_STAT_AGAIN with no queries pending\n",
+                    progname);
+            return NULL;
+        }
+        ((struct test_query *) pending[0])->tq_ready = true;
+        (*rounds)++;
+    }
+
+    if (arc_pending_queries(msg, NULL, 0) != 0)
+    {
+        fprintf(stderr, "%s: queries still pending after arc_eom()\n",
+                progname);
+        return NULL;
+    }
+
+    ret = arc_chain_status_str(msg);
+
+    arc_free(msg);
+    arc_close(lib);
+
+    return ret;
+}
+
+/**
+ *  Time verifying a message with each way of handing it to libopenarc.
+ *
+ *  Parameters:
+ *      progname: program name
+ *      tm: the message
+ *      rounds: number of times to verify it each way
+ *
+ *  Returns:
+ *      An EX_* constant.
+ */
+
+static int
+bench_message(const char *progname, struct test_msg *tm, unsigned long rounds)
+{
+    double          t;
+    const char     *err = NULL;
+    ARC_LIB        *lib;
+    ARC_MESSAGE    *msg;
+    struct timespec start;
+    struct timespec end;
+
+    lib = test_lib(ARC_LIBFLAGS_DEFAULT);
+    if (lib == NULL)
+    {
+        fprintf(stderr, "%s: arc_init() failed\n", progname);
+        return EX_SOFTWARE;
+    }
+
+    printf("%u header fields, %zu body bytes\n", (unsigned int) tm->tm_nhdrs,
+           tm->tm_bodylen);
+
+    for (int whole = 0; whole < 2; whole++)
+    {
+        test_whole = whole;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (unsigned long n = 0; n < rounds; n++)
+        {
+            msg = arc_message(lib, ARC_CANON_RELAXED, ARC_CANON_RELAXED,
+                              ARC_SIGN_RSASHA256, ARC_MODE_VERIFY, &err);
+            if (msg == NULL)
+            {
+                fprintf(stderr, "%s: arc_message(): %s\n", progname, err);
+                return EX_SOFTWARE;
+            }
+            (void) run_message(msg, tm);
+            arc_free(msg);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        t = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("%-22s %10.0f msgs/s\n",
+               whole ? "arc_process_message" : "arc_header_field", rounds / t);
+    }
+
+    arc_close(lib);
+
+    return EX_OK;
+}
+
+/**
+ *  Print a usage message.
+ *
+ *  Parameters:
+ *      progname: program name
+ *
+ *  Returns:
+ *      EX_USAGE.
+ */
+
+static int
+usage(const char *progname)
+{
+    fprintf(stderr,
+            "%s: usage: %s -k keys [-p] {-b rounds | -n | "
+            "-s selector:domain:keyfile} < msg\n",
+            progname, progname);
+
+    return EX_USAGE;
+}
+
+int
+main(int argc, char **argv)
+{
+    int             c;
+    bool            nonblock = false;
+    unsigned long   bench = 0;
+    size_t          rawlen;
+    unsigned int    rounds;
+    char           *p;
+    char           *progname;
+    char           *raw;
+    char           *seal = NULL;
+    char           *keys = NULL;
+    const char     *blocking;
+    const char     *async;
+    struct test_msg tm;
+
+    progname = (p = strrchr(argv[0], '/')) == NULL ? argv[0] : p + 1;
+
+    while ((c = getopt(argc, argv, "b:k:nps:")) != -1)
+    {
+        switch (c)
+        {
+        case 'b':
+            bench = strtoul(optarg, NULL, 10);
+            if (bench == 0)
+            {
+                return usage(progname);
+            }
+            break;
+
+        case 'k':
+            keys = optarg;
+            break;
+
+        case 'n':
+            nonblock = true;
+            break;
+
+        case 'p':
+            test_whole = true;
+            break;
+
+        case 's':
+            seal = optarg;
+            break;
+
+        default:
+            return usage(progname);
+        }
+    }
+
+    if (optind != argc || keys == NULL ||
+        (bench != 0) + nonblock + (seal != NULL) != 1)
+    {
+        return usage(progname);
+    }
+
+    if (!load_keys(keys))
+    {
+        fprintf(stderr, "%s: %s: cannot load key records\n", progname, keys);
+        return EX_NOINPUT;
+    }
+
+    raw = read_all(stdin, &rawlen);
+    if (raw == NULL || !split_message(raw, rawlen, &tm))
+    {
+        fprintf(stderr, "%s: cannot read message\n", progname);
+        return EX_DATAERR;
+    }
+
+    if (bench != 0)
+    {
+        return bench_message(progname, &tm, bench);
+    }
+
+    if (seal != NULL)
+    {
+        return seal_message(progname, &tm, seal);
+    }
+
+    /* the same message, with and without blocking on key lookups */
+    blocking = verify_message(progname, &tm, false, &rounds);
+    if (blocking == NULL)
+    {
+        return EX_SOFTWARE;
+    }
+    printf("blocking %s %u\n", blocking, rounds);
+
+    async = verify_message(progname, &tm, true, &rounds);
+    if (async == NULL)
+    {
+        return EX_SOFTWARE;
+    }
+    printf("nonblock %s %u\n", async, rounds);
+
+    return EX_OK;
+}
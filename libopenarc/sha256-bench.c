@@ -0,0 +1,323 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#include "build-config.h"
+
+/* system includes */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <time.h>
+
+/* OpenSSL includes */
+#include <openssl/evp.h>
+
+/* libopenarc includes */
+#include "arc-sha256.h"
+
+#define BENCH_BYTES (64 * 1024 * 1024)
+
+/**
+ *  Hash "total" bytes in "chunk"-sized writes with EVP.
+ *
+ *  Parameters:
+ *      buf: input data, at least "chunk" bytes
+ *      chunk: size of each update
+ *      total: number of bytes to hash
+ *      out: digest (returned)
+ *
+ *  Returns:
+ *      Elapsed time in seconds.
+ */
+
+static double
+bench_evp(const unsigned char *buf,
+          size_t               chunk,
+          size_t               total,
+          unsigned char       *out)
+{
+    unsigned int    outlen;
+    size_t          done;
+    EVP_MD_CTX     *ctx;
+    struct timespec start;
+    struct timespec end;
+
+    ctx = EVP_MD_CTX_new();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    EVP_DigestInit_ex(ctx, EVP_sha256(), NULL);
+    for (done = 0; done < total; done += chunk)
+    {
+        EVP_DigestUpdate(ctx, buf, chunk);
+    }
+    EVP_DigestFinal(ctx, out, &outlen);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    EVP_MD_CTX_free(ctx);
+
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/**
+ *  Hash "total" bytes in "chunk"-sized writes with the built-in code.
+ *
+ *  Parameters:
+ *      block: compression function to use
+ *      buf: input data, at least "chunk" bytes
+ *      chunk: size of each update
+ *      total: number of bytes to hash
+ *      out: digest (returned)
+ *
+ *  Returns:
+ *      Elapsed time in seconds.
+ */
+
+static double
+bench_builtin(arc_sha256_block_t   block,
+              const unsigned char *buf,
+              size_t               chunk,
+              size_t               total,
+              unsigned char       *out)
+{
+    size_t            done;
+    struct arc_sha256 ctx;
+    struct timespec   start;
+    struct timespec   end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    arc_sha256_init(&ctx, block);
+    for (done = 0; done < total; done += chunk)
+    {
+        arc_sha256_update(&ctx, buf, chunk);
+    }
+    arc_sha256_final(&ctx, out);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/**
+ *  Hash a buffer with the built-in code, feeding it in pieces that grow
+ *  by one byte at a time so that every buffering path is taken.
+ *
+ *  Parameters:
+ *      block: compression function to use
+ *      buf: input data
+ *      len: length of "buf"
+ *      step: size of the first piece
+ *      out: digest (returned)
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+static void
+hash_pieces(arc_sha256_block_t   block,
+            const unsigned char *buf,
+            size_t               len,
+            size_t               step,
+            unsigned char       *out)
+{
+    size_t            off = 0;
+    struct arc_sha256 ctx;
+
+    arc_sha256_init(&ctx, block);
+    while (off < len)
+    {
+        size_t n = len - off < step ? len - off : step;
+
+        arc_sha256_update(&ctx, buf + off, n);
+        off += n;
+        step++;
+    }
+    arc_sha256_final(&ctx, out);
+}
+
+/**
+ *  Print a digest in hex after a label.
+ *
+ *  Parameters:
+ *      label: what produced it
+ *      step: size of the first piece fed in, or 0 for EVP
+ *      md: digest
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+static void
+print_digest(const char *label, size_t step, const unsigned char *md)
+{
+    printf("%s %zu ", label, step);
+    for (int c = 0; c < ARC_SHA256_DIGESTSIZE; c++)
+    {
+        printf("%02x", md[c]);
+    }
+    printf("\n");
+}
+
+/**
+ *  Hash standard input with EVP and with each built-in implementation, and
+ *  print every digest so they can be checked against known values.
+ *
+ *  Parameters:
+ *      progname: program name for error messages
+ *
+ *  Returns:
+ *      An exit status.
+ */
+
+static int
+digest_stdin(const char *progname)
+{
+    bool                accel;
+    unsigned int        outlen;
+    size_t              len = 0;
+    size_t              size = 65536;
+    size_t              n;
+    unsigned char      *buf;
+    unsigned char       out[EVP_MAX_MD_SIZE];
+    arc_sha256_block_t  best;
+    static const size_t steps[] = {1, 55, 64, 65, 4096};
+
+    buf = malloc(size);
+    while (buf != NULL && (n = fread(buf + len, 1, size - len, stdin)) > 0)
+    {
+        len += n;
+        if (len == size)
+        {
+            unsigned char *nbuf;
+
+            size *= 2;
+            nbuf = realloc(buf, size);
+            if (nbuf == NULL)
+            {
+                free(buf);
+            }
+            buf = nbuf;
+        }
+    }
+    if (buf == NULL)
+    {
+        fprintf(stderr, "%s: out of memory\n", progname);
+        return EX_OSERR;
+    }
+
+    (void) EVP_Digest(buf, len, out, &outlen, EVP_sha256(), NULL);
+    print_digest("evp", 0, out);
+
+    best = arc_sha256_select(&accel);
+    for (size_t c = 0; c < sizeof steps / sizeof steps[0]; c++)
+    {
+        hash_pieces(arc_sha256_block_generic, buf, len, steps[c], out);
+        print_digest("generic", steps[c], out);
+        if (accel)
+        {
+            hash_pieces(best, buf, len, steps[c], out);
+            print_digest("sha-ni", steps[c], out);
+        }
+    }
+
+    free(buf);
+    return EX_OK;
+}
+
+int
+main(int argc, char **argv)
+{
+    bool               accel;
+    bool               mismatch = false;
+    int                c;
+    size_t             total = BENCH_BYTES;
+    char              *p;
+    char              *progname;
+    unsigned char      buf[65536];
+    unsigned char      ref[EVP_MAX_MD_SIZE];
+    unsigned char      out[ARC_SHA256_DIGESTSIZE];
+    arc_sha256_block_t best;
+    /* roughly: header field pieces, whole header fields, body chunks */
+    static const size_t chunks[] = {16, 80, 1024, 65536};
+
+    progname = (p = strrchr(argv[0], '/')) == NULL ? argv[0] : p + 1;
+
+    if (argc == 2 && strcmp(argv[1], "-d") == 0)
+    {
+        return digest_stdin(progname);
+    }
+
+    if (argc > 2)
+    {
+        fprintf(stderr, "%s: usage: %s [-d | megabytes]\n", progname,
+                progname);
+        return EX_USAGE;
+    }
+    else if (argc == 2)
+    {
+        total = strtoul(argv[1], NULL, 10) * 1024 * 1024;
+        if (total == 0)
+        {
+            fprintf(stderr, "%s: invalid size \"%s\"\n", progname, argv[1]);
+            return EX_USAGE;
+        }
+    }
+
+    for (c = 0; c < (int) sizeof buf; c++)
+    {
+        buf[c] = (unsigned char) (c * 31 + 7);
+    }
+
+    best = arc_sha256_select(&accel);
+    printf("built-in implementation: %s\n", accel ? "SHA-NI" : "generic");
+    printf("%8s %10s %10s %10s\n", "write", "EVP MB/s", "C MB/s",
+           accel ? "NI MB/s" : "-");
+
+    for (c = 0; c < (int) (sizeof chunks / sizeof chunks[0]); c++)
+    {
+        size_t n;
+        double mb;
+        double t_evp;
+        double t_gen;
+        double t_best = 0;
+
+        /* hash a whole number of writes */
+        n = total - (total % chunks[c]);
+        mb = (double) n / (1024 * 1024);
+
+        t_evp = bench_evp(buf, chunks[c], n, ref);
+
+        t_gen = bench_builtin(arc_sha256_block_generic, buf, chunks[c], n, out);
+        if (memcmp(ref, out, sizeof out) != 0)
+        {
+            mismatch = true;
+        }
+
+        if (accel)
+        {
+            t_best = bench_builtin(best, buf, chunks[c], n, out);
+            if (memcmp(ref, out, sizeof out) != 0)
+            {
+                mismatch = true;
+            }
+        }
+
+        if (accel)
+        {
+            printf("%8zu %10.1f %10.1f %10.1f\n", chunks[c], mb / t_evp,
+                   mb / t_gen, mb / t_best);
+        }
+        else
+        {
+            printf("%8zu %10.1f %10.1f %10s\n", chunks[c], mb / t_evp,
+                   mb / t_gen, "-");
+        }
+    }
+
+    if (mismatch)
+    {
+        fprintf(stderr, "%s: digest mismatch\n", progname);
+        return EX_SOFTWARE;
+    }
+
+    return EX_OK;
+}
@@ -10,18 +10,60 @@
 
 /* system includes */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
 
 /* openarc includes */
 #include "openarc-ar.h"
 
+/*
+**  BENCH -- time parsing a header field
+**
+**  Parameters:
+**  	hdr -- header field value
+**  	rounds -- how many times to parse it
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+bench(const char *hdr, long rounds)
+{
+    size_t          len;
+    size_t          results = 0;
+    double          secs;
+    struct authres  ar;
+    struct timespec start;
+    struct timespec end;
+
+    len = strlen(hdr);
+    memset(&ar, '\0', sizeof ar);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long r = 0; r < rounds; r++)
+    {
+        (void) ares_parse(hdr, &ar, NULL);
+        results += ar.ares_count;
+        ares_free(&ar);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%ld parses, %zu results: %.1f ns/parse, %.1f MB/s\n", rounds,
+           results, secs * 1e9 / rounds,
+           (double) len * rounds / secs / (1024 * 1024));
+}
+
 int
 main(int argc, char **argv)
 {
     int            c;
-    int            d;
     int            status;
+    long           rounds = 0;
     char          *p;
     char          *progname;
     struct authres ar;
@@ -30,51 +72,90 @@ main(int argc, char **argv)
 
     progname = (p = strrchr(argv[0], '/')) == NULL ? argv[0] : p + 1;
 
-    if (argc != 2)
+    while ((c = getopt(argc, argv, "n:")) != -1)
     {
-        printf("%s: usage: %s header-value\n", progname, progname);
+        switch (c)
+        {
+        case 'n':
+            rounds = strtol(optarg, &p, 10);
+            if (*p != '\0' || rounds <= 0)
+            {
+                fprintf(stderr, "%s: invalid round count \"%s\"\n", progname,
+                        optarg);
+                return EX_USAGE;
+            }
+            break;
+
+        default:
+            optind = argc;
+            break;
+        }
+    }
+
+    if (optind != argc - 1)
+    {
+        printf("%s: usage: %s [-n rounds] header-value\n", progname, progname);
         return EX_USAGE;
     }
 
-    c = ares_tokenize(argv[1], buf, sizeof buf, toks, 1024);
-    for (d = 0; d < c; d++)
+    if (rounds > 0)
+    {
+        bench(argv[optind], rounds);
+        return EX_OK;
+    }
+
+    c = ares_tokenize(argv[optind], buf, sizeof buf, toks, 1024);
+    for (int d = 0; d < c && d < 1024; d++)
     {
         printf("token %d = '%s'\n", d, toks[d]);
     }
 
     printf("\n");
 
-    status = ares_parse(argv[1], &ar, NULL);
+    memset(&ar, '\0', sizeof ar);
+    status = ares_parse(argv[optind], &ar, NULL);
     if (status == -1)
     {
         printf("%s: ares_parse() returned -1\n", progname);
+        ares_free(&ar);
         return EX_OK;
     }
 
-    printf("%d result%s found\n", ar.ares_count, ar.ares_count == 1 ? "" : "s");
+    printf("%zu result%s found\n", ar.ares_count,
+           ar.ares_count == 1 ? "" : "s");
 
-    printf("authserv-id '%s'\n", ar.ares_host);
-    printf("version '%s'\n", ar.ares_version);
+    printf("authserv-id '%.*s'\n", (int) ar.ares_host.as_len,
+           ar.ares_host.as_str);
+    printf("version '%.*s'\n", (int) ar.ares_version.as_len,
+           ar.ares_version.as_str);
 
-    for (c = 0; c < ar.ares_count; c++)
+    for (size_t i = 0; i < ar.ares_count; i++)
     {
-        printf("result #%d, %d propert%s\n", c, ar.ares_result[c].result_props,
-               ar.ares_result[c].result_props == 1 ? "y" : "ies");
+        struct result *r = &ar.ares_result[i];
+
+        printf("result #%zu, %zu propert%s\n", i, r->result_props,
+               r->result_props == 1 ? "y" : "ies");
 
-        printf("\tmethod \"%s\"\n",
-               ares_getmethod(ar.ares_result[c].result_method));
-        printf("\tresult \"%s\"\n",
-               ares_getresult(ar.ares_result[c].result_result));
-        printf("\treason \"%s\"\n", ar.ares_result[c].result_reason);
+        printf("\tmethod \"%s\"\n", ares_getmethod(r->result_method));
+        printf("\tresult \"%s\"\n", ares_getresult(r->result_result));
+        printf("\treason \"%.*s\"\n", (int) r->result_reason.as_len,
+               r->result_reason.as_str);
 
-        for (d = 0; d < ar.ares_result[c].result_props; d++)
+        for (size_t j = 0; j < r->result_props; j++)
         {
-            printf("\tproperty #%d\n", d);
-            printf("\t\tptype \"%s\"\n",
-                   ares_getptype(ar.ares_result[c].result_ptype[d]));
-            printf("\t\tproperty \"%s\"\n",
-                   ar.ares_result[c].result_property[d]);
-            printf("\t\tvalue \"%s\"\n", ar.ares_result[c].result_value[d]);
+            struct ares_prop *prop = &ar.ares_props[r->result_prop + j];
+
+            printf("\tproperty #%zu\n", j);
+            printf("\t\tptype \"%s\"\n", ares_getptype(prop->prop_ptype));
+            printf("\t\tproperty \"%.*s\"\n",
+                   (int) prop->prop_property.as_len,
+                   prop->prop_property.as_str);
+            printf("\t\tvalue \"%.*s\"\n", (int) prop->prop_value.as_len,
+                   prop->prop_value.as_str);
         }
     }
+
+    ares_free(&ar);
+
+    return EX_OK;
 }
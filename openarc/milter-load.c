@@ -0,0 +1,757 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#include "build-config.h"
+
+/* system includes */
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+**  Plays the MTA against a running milter: each of -c connections sends
+**  -n messages one after another, and the time from MAIL to the end of
+**  message reply is recorded for every message.  With -p, the milter's
+**  thread count and resident size are sampled from /proc while it runs,
+**  so different MilterEngine settings can be compared under the same load.
+*/
+
+#define LOAD_CONNS     50
+#define LOAD_MSGS      20
+#define LOAD_BODY      4096
+#define LOAD_MAXPKT    (1024 * 1024)
+#define LOAD_SAMPLEMS  100
+
+/* milter protocol, as much of it as an MTA needs here */
+#define LOAD_VERSION   6
+#define LOAD_ACTIONS   0x1ff
+#define LOAD_NOCONNECT 0x001
+#define LOAD_NOHELO    0x002
+#define LOAD_NOMAIL    0x004
+#define LOAD_NORCPT    0x008
+#define LOAD_NOBODY    0x010
+#define LOAD_NOHDRS    0x020
+#define LOAD_NOEOH     0x040
+#define LOAD_NODATA    0x200
+#define LOAD_PROTO     0x27f
+#define LOAD_CHUNK     65535
+
+/* struct load_conn -- one simulated MTA connection */
+struct load_conn
+{
+    int            lc_fd;
+    unsigned long  lc_proto;
+    size_t         lc_done;    /* messages that got a final reply */
+    size_t         lc_mods;    /* modification packets received */
+    size_t         lc_accept;  /* final reply was 'c' or 'a' */
+    double        *lc_latency; /* seconds, one per message */
+    const char    *lc_error;
+    unsigned char *lc_buf;
+    pthread_t      lc_thread;
+};
+
+/* settings shared by all connections */
+static const char *load_spec;
+static size_t      load_msgs = LOAD_MSGS;
+static size_t      load_body = LOAD_BODY;
+static char       *load_bodydata;
+static atomic_bool load_running = true;
+
+/**
+ *  Get the time in seconds.
+ *
+ *  Parameters:
+ *      None.
+ *
+ *  Returns:
+ *      A monotonic clock reading.
+ */
+
+static double
+load_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ *  Connect to the milter.
+ *
+ *  Parameters:
+ *      spec: socket specification, as for the milter's Socket setting
+ *
+ *  Returns:
+ *      A socket, or -1.
+ */
+
+static int
+load_connect(const char *spec)
+{
+    int              fd;
+    const char      *colon = strchr(spec, ':');
+    char             port[NI_MAXSERV];
+    char            *host;
+    struct addrinfo  hints;
+    struct addrinfo *res;
+
+    if (colon == NULL || strncasecmp(spec, "unix:", 5) == 0 ||
+        strncasecmp(spec, "local:", 6) == 0)
+    {
+        struct sockaddr_un sun;
+
+        memset(&sun, '\0', sizeof sun);
+        sun.sun_family = AF_UNIX;
+        strncpy(sun.sun_path, colon == NULL ? spec : colon + 1,
+                sizeof sun.sun_path - 1);
+
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd != -1 && connect(fd, (struct sockaddr *) &sun, sizeof sun) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+        return fd;
+    }
+
+    snprintf(port, sizeof port, "%s", colon + 1);
+    host = strchr(port, '@');
+    if (host != NULL)
+    {
+        *host++ = '\0';
+    }
+
+    memset(&hints, '\0', sizeof hints);
+    hints.ai_family = spec[4] == '6' ? AF_INET6 : AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host == NULL ? "localhost" : host, port, &hints, &res) !=
+        0)
+    {
+        return -1;
+    }
+
+    fd = socket(res->ai_family, SOCK_STREAM, 0);
+    if (fd != -1 && connect(fd, res->ai_addr, res->ai_addrlen) != 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+
+    return fd;
+}
+
+/**
+ *  Send one packet.
+ *
+ *  Parameters:
+ *      lc: connection
+ *      cmd: command
+ *      data: payload
+ *      len: bytes at "data"
+ *
+ *  Returns:
+ *      false on error.
+ */
+
+static bool
+load_send(struct load_conn *lc, char cmd, const void *data, size_t len)
+{
+    uint32_t       nlen = htonl(len + 1);
+    unsigned char *p = lc->lc_buf;
+    size_t         total = sizeof nlen + 1 + len;
+
+    memcpy(p, &nlen, sizeof nlen);
+    p[sizeof nlen] = cmd;
+    memcpy(p + sizeof nlen + 1, data, len);
+
+    for (size_t off = 0; off < total;)
+    {
+        ssize_t n = write(lc->lc_fd, p + off, total - off);
+
+        if (n <= 0)
+        {
+            if (n == -1 && errno == EINTR)
+            {
+                continue;
+            }
+            lc->lc_error = "write failed";
+            return false;
+        }
+        off += n;
+    }
+
+    return true;
+}
+
+/**
+ *  Read exactly some bytes.
+ *
+ *  Parameters:
+ *      fd: socket
+ *      buf: where to put them
+ *      len: how many
+ *
+ *  Returns:
+ *      false on error or EOF.
+ */
+
+static bool
+load_readn(int fd, void *buf, size_t len)
+{
+    for (size_t off = 0; off < len;)
+    {
+        ssize_t n = read(fd, (char *) buf + off, len - off);
+
+        if (n <= 0)
+        {
+            if (n == -1 && errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        off += n;
+    }
+
+    return true;
+}
+
+/**
+ *  Read one packet.
+ *
+ *  Parameters:
+ *      lc: connection
+ *      len: set to the payload length
+ *
+ *  Returns:
+ *      The command, or '\0' on error; the payload is in lc_buf.
+ */
+
+static char
+load_recv(struct load_conn *lc, size_t *len)
+{
+    uint32_t nlen;
+    size_t   plen;
+    char     cmd;
+
+    if (!load_readn(lc->lc_fd, &nlen, sizeof nlen))
+    {
+        lc->lc_error = "read failed";
+        return '\0';
+    }
+    plen = ntohl(nlen);
+    if (plen == 0 || plen > LOAD_MAXPKT ||
+        !load_readn(lc->lc_fd, &cmd, 1) ||
+        !load_readn(lc->lc_fd, lc->lc_buf, plen - 1))
+    {
+        lc->lc_error = "bad reply";
+        return '\0';
+    }
+    *len = plen - 1;
+
+    return cmd;
+}
+
+/**
+ *  Send a command and take its reply.
+ *
+ *  Parameters:
+ *      lc: connection
+ *      cmd: command
+ *      data: payload
+ *      len: bytes at "data"
+ *
+ *  Returns:
+ *      The reply code, or '\0' on error.
+ */
+
+static char
+load_command(struct load_conn *lc, char cmd, const void *data, size_t len)
+{
+    size_t rlen;
+
+    if (!load_send(lc, cmd, data, len))
+    {
+        return '\0';
+    }
+
+    return load_recv(lc, &rlen);
+}
+
+/**
+ *  Send one message.
+ *
+ *  Parameters:
+ *      lc: connection
+ *      seq: message number, for unique header fields
+ *
+ *  Returns:
+ *      false if the connection can't be used any more.
+ */
+
+static bool
+load_message(struct load_conn *lc, size_t seq)
+{
+    bool               eom = false;
+    char               reply = 'c';
+    size_t             len;
+    char               buf[256];
+    static const char *hdrs[][2] = {
+        {"From",    " sender@example.com"},
+        {"To",      " recipient@example.com"},
+        {"Date",    " Fri, 04 Oct 2024 10:11:12 -0400"},
+        {"Subject", " load test"},
+    };
+
+    if (!(lc->lc_proto & LOAD_NOMAIL))
+    {
+        reply = load_command(lc, 'M', "<sender@example.com>", 21);
+    }
+    if (reply == 'c' && !(lc->lc_proto & LOAD_NORCPT))
+    {
+        reply = load_command(lc, 'R', "<recipient@example.com>", 24);
+    }
+    if (reply == 'c' && !(lc->lc_proto & LOAD_NODATA))
+    {
+        reply = load_command(lc, 'T', NULL, 0);
+    }
+
+    for (size_t n = 0; reply == 'c' && !(lc->lc_proto & LOAD_NOHDRS) &&
+                       n <= sizeof hdrs / sizeof hdrs[0];
+         n++)
+    {
+        if (n == sizeof hdrs / sizeof hdrs[0])
+        {
+            len = snprintf(buf, sizeof buf, "Message-ID%c <%zu.%p@example.com>",
+                           '\0', seq, (void *) lc);
+        }
+        else
+        {
+            len = snprintf(buf, sizeof buf, "%s%c%s", hdrs[n][0], '\0',
+                           hdrs[n][1]);
+        }
+        reply = load_command(lc, 'L', buf, len + 1);
+    }
+
+    if (reply == 'c' && !(lc->lc_proto & LOAD_NOEOH))
+    {
+        reply = load_command(lc, 'N', NULL, 0);
+    }
+
+    for (size_t off = 0; reply == 'c' && !(lc->lc_proto & LOAD_NOBODY) &&
+                         off < load_body;
+         off += LOAD_CHUNK)
+    {
+        len = load_body - off < LOAD_CHUNK ? load_body - off : LOAD_CHUNK;
+        reply = load_command(lc, 'B', load_bodydata + off, len);
+    }
+
+    if (reply == 'c')
+    {
+        if (!load_send(lc, 'E', NULL, 0))
+        {
+            return false;
+        }
+        eom = true;
+
+        /* modifications come first, then the final reply */
+        for (;;)
+        {
+            reply = load_recv(lc, &len);
+            if (reply == '\0' || strchr("+-hicm", reply) == NULL)
+            {
+                break;
+            }
+            lc->lc_mods++;
+        }
+    }
+
+    switch (reply)
+    {
+    case '\0':
+        return false;
+
+    case 'c':
+    case 'a':
+        lc->lc_accept++;
+        break;
+
+    case 'r':
+    case 't':
+    case 'y':
+    case 'd':
+        /* a final answer; nothing else to do */
+        break;
+
+    default:
+        lc->lc_error = "unexpected reply";
+        return false;
+    }
+
+    /* a message cut short has to be aborted */
+    return eom || load_send(lc, 'A', NULL, 0);
+}
+
+/**
+ *  Connection thread: negotiate, then send messages.
+ *
+ *  Parameters:
+ *      vp: the connection
+ *
+ *  Returns:
+ *      NULL.
+ */
+
+static void *
+load_run(void *vp)
+{
+    char              reply;
+    size_t            len;
+    uint32_t          vals[3];
+    struct load_conn *lc = vp;
+    static const char conn[] = "client.example.com\0" "4\0\0" "192.0.2.1";
+
+    lc->lc_fd = load_connect(load_spec);
+    if (lc->lc_fd == -1)
+    {
+        lc->lc_error = "connect failed";
+        return NULL;
+    }
+
+    vals[0] = htonl(LOAD_VERSION);
+    vals[1] = htonl(LOAD_ACTIONS);
+    vals[2] = htonl(LOAD_PROTO);
+    if (!load_send(lc, 'O', vals, sizeof vals))
+    {
+        return NULL;
+    }
+    reply = load_recv(lc, &len);
+    if (reply != 'O' || len < sizeof vals)
+    {
+        lc->lc_error = "negotiation failed";
+        return NULL;
+    }
+    memcpy(vals, lc->lc_buf, sizeof vals);
+    lc->lc_proto = ntohl(vals[2]);
+
+    reply = 'c';
+    if (!(lc->lc_proto & LOAD_NOCONNECT))
+    {
+        reply = load_command(lc, 'C', conn, sizeof conn);
+    }
+    if (reply == 'c' && !(lc->lc_proto & LOAD_NOHELO))
+    {
+        reply = load_command(lc, 'H', "mx.example.com", 15);
+    }
+    if (reply != 'c')
+    {
+        lc->lc_error = "connection refused";
+        return NULL;
+    }
+
+    for (size_t n = 0; n < load_msgs; n++)
+    {
+        double start = load_now();
+
+        if (!load_message(lc, n))
+        {
+            if (lc->lc_error == NULL)
+            {
+                lc->lc_error = "connection lost";
+            }
+            break;
+        }
+        lc->lc_latency[lc->lc_done++] = load_now() - start;
+    }
+
+    (void) load_send(lc, 'Q', NULL, 0);
+    close(lc->lc_fd);
+
+    return NULL;
+}
+
+/**
+ *  Read a "Name: value" line from /proc/<pid>/status.
+ *
+ *  Parameters:
+ *      pid: process
+ *      name: field name with colon
+ *
+ *  Returns:
+ *      The number, or -1.
+ */
+
+static long
+load_procstat(long pid, const char *name)
+{
+    long  value = -1;
+    FILE *f;
+    char  path[64];
+    char  line[256];
+
+    snprintf(path, sizeof path, "/proc/%ld/status", pid);
+    f = fopen(path, "r");
+    if (f == NULL)
+    {
+        return -1;
+    }
+
+    while (fgets(line, sizeof line, f) != NULL)
+    {
+        if (strncmp(line, name, strlen(name)) == 0)
+        {
+            value = strtol(line + strlen(name), NULL, 10);
+            break;
+        }
+    }
+    fclose(f);
+
+    return value;
+}
+
+/* struct load_sample -- peak resource use of the milter */
+struct load_sample
+{
+    long ls_pid;
+    long ls_threads;
+    long ls_rss; /* kB */
+};
+
+/**
+ *  Sampler thread: track the milter's peak threads and memory.
+ *
+ *  Parameters:
+ *      vp: a struct load_sample
+ *
+ *  Returns:
+ *      NULL.
+ */
+
+static void *
+load_sample(void *vp)
+{
+    struct load_sample *ls = vp;
+    struct timespec     ts = {0, LOAD_SAMPLEMS * 1000000L};
+
+    while (atomic_load(&load_running))
+    {
+        long v;
+
+        v = load_procstat(ls->ls_pid, "Threads:");
+        if (v > ls->ls_threads)
+        {
+            ls->ls_threads = v;
+        }
+        v = load_procstat(ls->ls_pid, "VmRSS:");
+        if (v > ls->ls_rss)
+        {
+            ls->ls_rss = v;
+        }
+        nanosleep(&ts, NULL);
+    }
+
+    return NULL;
+}
+
+/**
+ *  Compare two latencies for qsort().
+ *
+ *  Parameters:
+ *      a, b: pointers to doubles
+ *
+ *  Returns:
+ *      <0, 0 or >0.
+ */
+
+static int
+load_cmp(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+int
+main(int argc, char **argv)
+{
+    int                c;
+    long               nconns = LOAD_CONNS;
+    long               v;
+    size_t             total = 0;
+    size_t             mods = 0;
+    size_t             accepted = 0;
+    size_t             failed = 0;
+    double             t;
+    double            *all;
+    char              *p;
+    char              *progname;
+    struct load_conn  *conns;
+    struct load_sample sample = {0, 0, 0};
+    pthread_t          sampler;
+
+    progname = (p = strrchr(argv[0], '/')) == NULL ? argv[0] : p + 1;
+
+    while ((c = getopt(argc, argv, "b:c:n:p:s:")) != -1)
+    {
+        v = optarg == NULL ? -1 : strtol(optarg, &p, 10);
+        if (c != 's' && c != '?' && (*p != '\0' || v < 0))
+        {
+            fprintf(stderr, "%s: invalid value \"%s\" for -%c\n", progname,
+                    optarg, c);
+            return EX_USAGE;
+        }
+
+        switch (c)
+        {
+        case 'b':
+            load_body = v;
+            break;
+
+        case 'c':
+            nconns = v;
+            break;
+
+        case 'n':
+            load_msgs = v;
+            break;
+
+        case 'p':
+            sample.ls_pid = v;
+            break;
+
+        case 's':
+            load_spec = optarg;
+            break;
+
+        default:
+            fprintf(stderr,
+                    "%s: usage: %s -s socket [-b bodysize] [-c connections] "
+                    "[-n messages] [-p milterpid]\n",
+                    progname, progname);
+            return EX_USAGE;
+        }
+    }
+
+    if (load_spec == NULL || nconns == 0 || load_msgs == 0)
+    {
+        fprintf(stderr, "%s: a socket, connections and messages are needed\n",
+                progname);
+        return EX_USAGE;
+    }
+
+    conns = calloc(nconns, sizeof *conns);
+    load_bodydata = malloc(load_body + 1);
+    if (conns == NULL || load_bodydata == NULL)
+    {
+        return EX_OSERR;
+    }
+
+    /* lines of 78 characters plus CRLF */
+    for (size_t n = 0; n < load_body; n++)
+    {
+        load_bodydata[n] = n % 80 == 78 ? '\r'
+                         : n % 80 == 79 ? '\n'
+                                        : 'a' + n % 26;
+    }
+
+    if (sample.ls_pid > 0)
+    {
+        if (load_procstat(sample.ls_pid, "Threads:") == -1)
+        {
+            fprintf(stderr, "%s: can't read /proc/%ld/status\n", progname,
+                    sample.ls_pid);
+            return EX_NOINPUT;
+        }
+        if (pthread_create(&sampler, NULL, load_sample, &sample) != 0)
+        {
+            return EX_OSERR;
+        }
+    }
+
+    t = load_now();
+    for (long n = 0; n < nconns; n++)
+    {
+        conns[n].lc_latency = calloc(load_msgs, sizeof(double));
+        conns[n].lc_buf = malloc(LOAD_MAXPKT + 8);
+        if (conns[n].lc_latency == NULL || conns[n].lc_buf == NULL ||
+            pthread_create(&conns[n].lc_thread, NULL, load_run, &conns[n]) !=
+                0)
+        {
+            fprintf(stderr, "%s: can't start connection %ld\n", progname, n);
+            return EX_OSERR;
+        }
+    }
+    for (long n = 0; n < nconns; n++)
+    {
+        pthread_join(conns[n].lc_thread, NULL);
+        total += conns[n].lc_done;
+    }
+    t = load_now() - t;
+
+    if (sample.ls_pid > 0)
+    {
+        atomic_store(&load_running, false);
+        pthread_join(sampler, NULL);
+    }
+
+    all = calloc(total + 1, sizeof *all);
+    if (all == NULL)
+    {
+        return EX_OSERR;
+    }
+    total = 0;
+    for (long n = 0; n < nconns; n++)
+    {
+        memcpy(all + total, conns[n].lc_latency,
+               conns[n].lc_done * sizeof *all);
+        total += conns[n].lc_done;
+        mods += conns[n].lc_mods;
+        accepted += conns[n].lc_accept;
+        if (conns[n].lc_error != NULL)
+        {
+            if (failed == 0)
+            {
+                fprintf(stderr, "%s: connection %ld: %s\n", progname, n,
+                        conns[n].lc_error);
+            }
+            failed++;
+        }
+    }
+    qsort(all, total, sizeof *all, load_cmp);
+
+    printf("%zu messages on %ld connections in %.2f s: %.0f msgs/sec\n",
+           total, nconns, t, total / t);
+    printf("%zu accepted, %zu header changes, %zu connections failed\n",
+           accepted, mods, failed);
+    if (total > 0)
+    {
+        printf("latency ms: p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n",
+               all[total / 2] * 1e3, all[total * 9 / 10] * 1e3,
+               all[total * 99 / 100] * 1e3, all[total - 1] * 1e3);
+    }
+    if (sample.ls_pid > 0)
+    {
+        printf("milter peak: %ld threads, %ld kB resident\n",
+               sample.ls_threads, sample.ls_rss);
+    }
+
+    return failed == 0 ? EX_OK : EX_SOFTWARE;
+}
@@ -12,31 +12,35 @@
 #include <assert.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/param.h>
 #include <sys/types.h>
 
-/* libbsd if found */
-#ifdef USE_BSD_H
-#include <bsd/string.h>
-#endif /* USE_BSD_H */
-
-/* libstrl if needed */
-#ifdef USE_STRL_H
-#include <strl.h>
-#endif /* USE_STRL_H */
-
 /* openarc includes */
+#include "arc-arena.h"
+#include "arc-malloc.h"
 #include "arc-nametable.h"
 #include "openarc-ar.h"
 
 /* macros */
-#define ARES_ENDOF(x)     ((x) + sizeof(x) - 1)
-#define ARES_STRORNULL(x) ((x) == NULL ? "(null)" : (x))
-#define ARES_TOKENS       ";=."
-#define ARES_TOKENS2      "=."
+#define ARES_TOKENS     ";=."
+#define ARES_TOKENS2    "=."
+
+/* one of ARES_TOKENS, without a call for every character */
+#define ARES_ISDELIM(c) ((c) == ';' || (c) == '=' || (c) == '.')
 
-#define ARES_MAXTOKENS    1024
+/* ASCII whitespace, as isspace() has it in the C locale */
+#define ARES_ISSPACE(c)                                                        \
+    ((c) == ' ' || ((c) >= '\t' && (c) <= '\r'))
+
+/* a character the tokenizer just copies, outside of quotes */
+#define ARES_ISPLAIN(c)                                                        \
+    ((c) != '\0' && (c) != '\\' && (c) != '"' && (c) != '(' && (c) != ')' && \
+     !ARES_ISSPACE(c) && !ARES_ISDELIM(c))
+
+#define ARES_ARENASIZE 1024 /* first arena chunk, for rewritten tokens */
+#define ARES_MINALLOC  8    /* first results or properties allocated */
 
 struct nametable methods[] = {
     {"arc",        ARES_METHOD_ARC       },
@@ -100,68 +104,173 @@ enum ar_parser_state
     ARP_STATE_DONE,
 };
 
+/* ARES_LEXER -- tokenizer state for one header field */
+struct ares_lexer
+{
+    const char        *al_p;       /* next input character */
+    size_t             al_len;     /* input length, bounding all copies */
+    size_t             al_used;    /* bytes used at "al_scratch" */
+    char              *al_scratch; /* copies of rewritten tokens */
+    struct arc_arena **al_arena;   /* where to get "al_scratch" */
+};
+
+/* ARES_LEXTOK -- a token being assembled */
+struct ares_lextok
+{
+    const char *lt_start; /* input the token has matched so far */
+    char       *lt_copy;  /* rewritten token, if it stopped matching */
+    size_t      lt_len;
+};
+
 /*
-**  ARES_TOKENIZE -- tokenize a string
+**  ARES_ARENA -- get the arena holding rewritten tokens, creating it if
+**                this is the first one
 **
 **  Parameters:
-**  	input -- input string
-**  	outbuf -- output buffer
-**  	outbuflen -- number of bytes available at "outbuf"
-**  	tokens -- array of token pointers
-**  	ntokens -- number of token pointers available at "tokens"
+**  	arena -- pointer to the arena
 **
 **  Return value:
-**  	-1 -- bad syntax or not enough space at "outbuf" for tokenizing
-**  	other -- number of tokens identified; may be greater than
-**  	"ntokens" if there were more tokens found than there were
-**  	pointers available.
+**  	The arena, or NULL on allocation failure.
 */
 
-int
-ares_tokenize(const char *input,
-              char       *outbuf,
-              size_t      outbuflen,
-              char      **tokens,
-              int         ntokens)
+static struct arc_arena *
+ares_arena(struct arc_arena **arena)
 {
-    bool  quoted = false;
-    bool  escaped = false;
-    bool  intok = false;
-    int   n = 0;
-    int   parens = 0;
-    char *q;
-    char *end;
+    if (*arena == NULL)
+    {
+        *arena = arc_arena_new(ARES_ARENASIZE, NULL);
+    }
 
-    assert(input != NULL);
-    assert(outbuf != NULL);
-    assert(outbuflen > 0);
-    assert(tokens != NULL);
-    assert(ntokens > 0);
+    return *arena;
+}
+
+/*
+**  ARES_LEX_COPY -- switch a token to a copy once it stops matching the
+**                   input, and append a character to it
+**
+**  Parameters:
+**  	lx -- lexer
+**  	lt -- token being assembled
+**  	c -- character to append
+**
+**  Return value:
+**  	false on allocation failure.
+*/
+
+static bool
+ares_lex_copy(struct ares_lexer *lx, struct ares_lextok *lt, char c)
+{
+    if (lx->al_scratch == NULL)
+    {
+        if (ares_arena(lx->al_arena) == NULL)
+        {
+            return false;
+        }
+        lx->al_scratch = ARC_AMALLOC(*lx->al_arena, lx->al_len);
+        if (lx->al_scratch == NULL)
+        {
+            return false;
+        }
+    }
+
+    lt->lt_copy = lx->al_scratch + lx->al_used;
+    memcpy(lt->lt_copy, lt->lt_start, lt->lt_len);
+    lt->lt_copy[lt->lt_len++] = c;
+
+    return true;
+}
+
+/*
+**  ARES_LEX_PUT -- append a character to a token
+**
+**  Parameters:
+**  	lx -- lexer
+**  	lt -- token being assembled
+**  	c -- character to append
+**  	at -- input position "c" was produced from
+**
+**  Return value:
+**  	false on allocation failure.
+**
+**  Notes:
+**  	Tokens point into the input for as long as their text matches it,
+**  	which is nearly always; only quoted-pairs, folded comments and
+**  	the like get copied.  Every character comes from a distinct input
+**  	position, so the copies never need more room than the input.
+*/
+
+static inline bool
+ares_lex_put(struct ares_lexer  *lx,
+             struct ares_lextok *lt,
+             char                c,
+             const char         *at)
+{
+    if (lt->lt_copy != NULL)
+    {
+        lt->lt_copy[lt->lt_len++] = c;
+        return true;
+    }
+
+    if (lt->lt_len == 0)
+    {
+        lt->lt_start = at;
+    }
 
-    q = outbuf;
-    end = outbuf + outbuflen - 1;
+    if (at == lt->lt_start + lt->lt_len && *at == c)
+    {
+        lt->lt_len++;
+        return true;
+    }
+
+    return ares_lex_copy(lx, lt, c);
+}
+
+/*
+**  ARES_LEX -- get the next token from a header field
+**
+**  Parameters:
+**  	lx -- lexer
+**  	tok -- token (returned)
+**
+**  Return value:
+**  	1 if a token was found, 0 at the end of the input, -1 on bad
+**  	syntax or allocation failure.
+**
+**  Notes:
+**  	Quotes are removed from quoted-strings, but quoted-pairs that
+**  	need to stay quoted are left escaped.  Comments are returned as
+**  	single tokens, with runs of whitespace inside them turned into
+**  	single spaces.  Each of ARES_TOKENS is a token by itself.
+*/
 
-    for (const char *p = input; *p != '\0' && q <= end; p++)
+static int
+ares_lex(struct ares_lexer *lx, struct ares_span *tok)
+{
+    bool               quoted = false;
+    bool               escaped = false;
+    bool               intok = false;
+    int                parens = 0;
+    const char        *p;
+    struct ares_lextok lt = {NULL, NULL, 0};
+
+#define ARES_PUT(c, at)                                                        \
+    if (!ares_lex_put(lx, &lt, (c), (at)))                                     \
+    {                                                                          \
+        return -1;                                                             \
+    }
+
+    for (p = lx->al_p; *p != '\0'; p++)
     {
         if (escaped) /* escape */
         {
-            if (!intok)
-            {
-                if (n < ntokens)
-                {
-                    tokens[n] = q;
-                }
-                intok = true;
-            }
+            intok = true;
 
             if (*p == '\\' || *p == '"')
             {
                 /* Needs to remain escaped. */
-                *q = '\\';
-                q++;
+                ARES_PUT('\\', p - 1);
             }
-            *q = *p;
-            q++;
+            ARES_PUT(*p, p);
             escaped = false;
         }
         else if (*p == '\\' && quoted) /* escape */
@@ -171,158 +280,367 @@ ares_tokenize(const char *input,
         else if (*p == '"' && parens == 0) /* quoting */
         {
             quoted = !quoted;
-
-            if (!intok)
-            {
-                if (n < ntokens)
-                {
-                    tokens[n] = q;
-                }
-                intok = true;
-            }
+            intok = true;
         }
         else if (*p == '(' && !quoted) /* "(" (comment) */
         {
             parens++;
-
-            if (!intok)
-            {
-                if (n < ntokens)
-                {
-                    tokens[n] = q;
-                }
-                intok = true;
-            }
-
-            *q = *p;
-            q++;
+            intok = true;
+            ARES_PUT(*p, p);
         }
         else if (*p == ')' && !quoted) /* ")" (comment) */
         {
             if (parens > 0)
             {
                 parens--;
+                ARES_PUT(*p, p);
 
                 if (parens == 0)
                 {
-                    intok = false;
-                    n++;
-
-                    *q = ')';
-                    q++;
-                    if (q <= end)
-                    {
-                        *q = '\0';
-                        q++;
-                    }
+                    p++;
+                    break;
                 }
             }
         }
         else if (quoted) /* quoted character */
         {
-            *q = *p;
-            q++;
-        }
-        else if (isascii(*p) && isspace(*p)) /* whitespace */
-        {
-            if (intok)
+            ARES_PUT(*p, p);
+
+            /* take the rest of a run that needs no rewriting at once */
+            while (lt.lt_copy == NULL && p[1] != '\0' && p[1] != '\\' &&
+                   p[1] != '"')
             {
-                if (quoted)
-                {
-                    *q = *p;
-                    q++;
-                }
-                else if (parens > 0)
-                {
-                    /* turn all whitespace in comments into single spaces */
-                    *q = ' ';
-                    q++;
-                    while (isspace(p[1]))
-                    {
-                        p++;
-                    }
-                }
-                else
-                {
-                    intok = false;
-                    *q = '\0';
-                    q++;
-                    n++;
-                }
+                p++;
+                lt.lt_len++;
             }
         }
-        else if (strchr(ARES_TOKENS, *p) != NULL) /* delimiter */
+        else if (ARES_ISSPACE(*p)) /* whitespace */
         {
-            if (parens > 0)
+            if (!intok)
             {
-                *q = *p;
-                q++;
                 continue;
             }
 
-            if (intok)
+            if (parens == 0)
             {
-                intok = false;
-                *q = '\0';
-                q++;
-                n++;
+                p++;
+                break;
             }
 
-            if (q <= end)
+            /* turn all whitespace in comments into single spaces */
+            ARES_PUT(' ', p);
+            while (ARES_ISSPACE(p[1]))
+            {
+                p++;
+            }
+        }
+        else if (ARES_ISDELIM(*p)) /* delimiter */
+        {
+            if (parens == 0)
             {
-                *q = *p;
-                if (n < ntokens)
+                /* a delimiter ends a token and then is one */
+                if (!intok)
                 {
-                    tokens[n] = q;
-                    n++;
+                    intok = true;
+                    ARES_PUT(*p, p);
+                    p++;
                 }
-                q++;
+                break;
             }
 
-            if (q <= end)
-            {
-                *q = '\0';
-                q++;
-            }
+            ARES_PUT(*p, p);
         }
         else /* other */
         {
-            if (!intok)
+            intok = true;
+            ARES_PUT(*p, p);
+
+            while (lt.lt_copy == NULL && ARES_ISPLAIN(p[1]))
             {
-                if (n < ntokens)
-                {
-                    tokens[n] = q;
-                }
-                intok = true;
+                p++;
+                lt.lt_len++;
             }
-
-            *q = *p;
-            q++;
         }
     }
 
-    if (quoted || parens > 0)
+#undef ARES_PUT
+
+    lx->al_p = p;
+
+    if (*p == '\0' && (quoted || parens > 0))
     {
         return -1;
     }
 
-    if (q >= end)
+    if (!intok)
     {
-        return -1;
+        return 0;
     }
 
-    if (intok)
+    if (lt.lt_copy != NULL)
+    {
+        tok->as_str = lt.lt_copy;
+        lx->al_used += lt.lt_len;
+    }
+    else
+    {
+        tok->as_str = lt.lt_len == 0 ? p : lt.lt_start;
+    }
+    tok->as_len = lt.lt_len;
+
+    return 1;
+}
+
+/*
+**  ARES_TOKENIZE -- tokenize a string
+**
+**  Parameters:
+**  	input -- input string
+**  	outbuf -- output buffer
+**  	outbuflen -- number of bytes available at "outbuf"
+**  	tokens -- array of token pointers
+**  	ntokens -- number of token pointers available at "tokens"
+**
+**  Return value:
+**  	-1 -- bad syntax or not enough space at "outbuf" for tokenizing
+**  	other -- number of tokens identified; may be greater than
+**  	"ntokens" if there were more tokens found than there were
+**  	pointers available.
+*/
+
+int
+ares_tokenize(const char *input,
+              char       *outbuf,
+              size_t      outbuflen,
+              char      **tokens,
+              int         ntokens)
+{
+    int               n = 0;
+    int               status;
+    size_t            used = 0;
+    struct arc_arena *arena = NULL;
+    struct ares_span  tok;
+    struct ares_lexer lx;
+
+    assert(input != NULL);
+    assert(outbuf != NULL);
+    assert(outbuflen > 0);
+    assert(tokens != NULL);
+    assert(ntokens > 0);
+
+    memset(&lx, '\0', sizeof lx);
+    lx.al_p = input;
+    lx.al_len = strlen(input);
+    lx.al_arena = &arena;
+
+    while ((status = ares_lex(&lx, &tok)) == 1)
     {
-        *q = '\0';
+        if (tok.as_len + 1 > outbuflen - used)
+        {
+            status = -1;
+            break;
+        }
+
+        memcpy(outbuf + used, tok.as_str, tok.as_len);
+        outbuf[used + tok.as_len] = '\0';
+        if (n < ntokens)
+        {
+            tokens[n] = outbuf + used;
+        }
+        used += tok.as_len + 1;
         n++;
     }
 
-    return n;
+    if (arena != NULL)
+    {
+        arc_arena_free(arena);
+    }
+
+    return status == -1 ? -1 : n;
 }
 
 /*
-**  ARES_METHOD_ADD -- add a parsed method to the results if there's room
-**  and we haven't already seen it.
+**  ARES_TOKIS -- see if a token is a particular single character
+**
+**  Parameters:
+**  	tok -- token
+**  	c -- character
+**
+**  Return value:
+**  	true iff "tok" is exactly "c".
+*/
+
+static inline bool
+ares_tokis(const struct ares_span *tok, char c)
+{
+    return tok->as_len == 1 && tok->as_str[0] == c;
+}
+
+/*
+**  ARES_TOKFIRST -- get the first character of a token
+**
+**  Parameters:
+**  	tok -- token
+**
+**  Return value:
+**  	The first character, or NUL if the token is empty.
+*/
+
+static inline char
+ares_tokfirst(const struct ares_span *tok)
+{
+    return tok->as_len == 0 ? '\0' : tok->as_str[0];
+}
+
+/*
+**  ARES_TOKCODE -- look up a token in a name table
+**
+**  Parameters:
+**  	table -- name table
+**  	tok -- token
+**
+**  Return value:
+**  	The code for the token, or the table's default.
+*/
+
+static int
+ares_tokcode(struct nametable *table, const struct ares_span *tok)
+{
+    for (; table->nt_name != NULL; table++)
+    {
+        /* cheap first-letter test before the real comparison */
+        if (tok->as_len > 0 &&
+            tolower((unsigned char) table->nt_name[0]) ==
+                tolower((unsigned char) tok->as_str[0]) &&
+            strncasecmp(table->nt_name, tok->as_str, tok->as_len) == 0 &&
+            table->nt_name[tok->as_len] == '\0')
+        {
+            break;
+        }
+    }
+
+    return table->nt_code;
+}
+
+/*
+**  ARES_JOIN -- append a token to a span
+**
+**  Parameters:
+**  	arena -- where to put a copy if one is needed
+**  	span -- span to extend
+**  	tok -- token to append
+**
+**  Return value:
+**  	false on allocation failure.
+*/
+
+static bool
+ares_join(struct arc_arena      **arena,
+          struct ares_span       *span,
+          const struct ares_span *tok)
+{
+    char *buf;
+
+    if (span->as_len == 0)
+    {
+        *span = *tok;
+        return true;
+    }
+
+    /* usually the two were adjacent to start with */
+    if (span->as_str + span->as_len == tok->as_str)
+    {
+        span->as_len += tok->as_len;
+        return true;
+    }
+
+    if (ares_arena(arena) == NULL)
+    {
+        return false;
+    }
+    buf = ARC_AMALLOC(*arena, span->as_len + tok->as_len);
+    if (buf == NULL)
+    {
+        return false;
+    }
+
+    memcpy(buf, span->as_str, span->as_len);
+    memcpy(buf + span->as_len, tok->as_str, tok->as_len);
+    span->as_str = buf;
+    span->as_len += tok->as_len;
+
+    return true;
+}
+
+/*
+**  ARES_GROW -- make room for one more element in an array
+**
+**  Parameters:
+**  	array -- pointer to the array
+**  	nalloc -- pointer to the number of elements allocated
+**  	count -- number of elements in use
+**  	size -- element size
+**
+**  Return value:
+**  	false on allocation failure.
+*/
+
+static bool
+ares_grow(void **array, size_t *nalloc, size_t count, size_t size)
+{
+    size_t newalloc;
+    void  *new;
+
+    if (count < *nalloc)
+    {
+        return true;
+    }
+
+    newalloc = *nalloc == 0 ? ARES_MINALLOC : *nalloc * 2;
+    new = ARC_REALLOC(*array, newalloc * size);
+    if (new == NULL)
+    {
+        return false;
+    }
+
+    *array = new;
+    *nalloc = newalloc;
+
+    return true;
+}
+
+/*
+**  ARES_PROP_NEW -- start a property for the current result
+**
+**  Parameters:
+**  	ar -- authentication results
+**  	ptype -- property type
+**
+**  Return value:
+**  	The new property, not yet counted, or NULL on allocation failure.
+*/
+
+static struct ares_prop *
+ares_prop_new(struct authres *ar, ares_ptype ptype)
+{
+    struct ares_prop *prop;
+
+    if (!ares_grow((void **) &ar->ares_props, &ar->ares_propalloc,
+                   ar->ares_nprops, sizeof *ar->ares_props))
+    {
+        return NULL;
+    }
+
+    prop = ar->ares_props + ar->ares_nprops;
+    memset(prop, '\0', sizeof *prop);
+    prop->prop_ptype = ptype;
+
+    return prop;
+}
+
+/*
+**  ARES_METHOD_ADD -- add a parsed method to the results if we haven't
+**  already seen it.
 **
 **  Parameters:
 **  	ar -- authentication results
@@ -330,33 +648,67 @@ ares_tokenize(const char *input,
 **
 **  Return value:
 **  	Whether the method was added
+**
+**  Notes:
+**  	The properties of a result that isn't added are dropped.
 */
 
 static bool
 ares_method_add(struct authres *ar, struct result *r)
 {
-    if (r->result_method == ARES_METHOD_UNKNOWN ||
-        ar->ares_count >= MAXARESULTS)
+    bool add = true;
+
+    if (r->result_method == ARES_METHOD_UNKNOWN)
     {
-        return false;
+        add = false;
     }
-    if (r->result_method != ARES_METHOD_DKIM)
+    else if (r->result_method != ARES_METHOD_DKIM)
     {
-        for (int i = 0; i < ar->ares_count; i++)
+        for (size_t i = 0; i < ar->ares_count; i++)
         {
             if (ar->ares_result[i].result_method == r->result_method)
             {
-                return false;
+                add = false;
+                break;
             }
         }
     }
 
-    memcpy(ar->ares_result + ar->ares_count, r,
-           sizeof ar->ares_result[ar->ares_count]);
+    if (add && !ares_grow((void **) &ar->ares_result, &ar->ares_nresults,
+                          ar->ares_count, sizeof *ar->ares_result))
+    {
+        add = false;
+    }
+
+    if (!add)
+    {
+        ar->ares_nprops = r->result_prop;
+        return false;
+    }
+
+    ar->ares_result[ar->ares_count] = *r;
     ar->ares_count++;
     return true;
 }
 
+/*
+**  ARES_RESULT_RESET -- start a new result
+**
+**  Parameters:
+**  	ar -- authentication results
+**  	r -- result to reset
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+ares_result_reset(struct authres *ar, struct result *r)
+{
+    memset(r, '\0', sizeof *r);
+    r->result_prop = ar->ares_nprops;
+}
+
 /*
 **  ARES_PARSE -- parse an Authentication-Results: header, return a
 **                structure containing a parsed result
@@ -369,53 +721,61 @@ ares_method_add(struct authres *ar, struct result *r)
 **
 **  Return value:
 **  	0 on success, -1 on failure, -2 when a header is uninteresting.
+**
+**  Notes:
+**  	Results are added to any already in "ar".  Most of what is stored
+**  	points into "hdr", which has to outlive "ar"; release "ar" with
+**  	ares_free() when done.  A header that turns out to be for another
+**  	authserv-id is not tokenized past its authserv-id.
 */
 
 int
 ares_parse(const char *hdr, struct authres *ar, const char *authserv)
 {
-    int                  ntoks;
+    int                  status;
     enum ar_parser_state state;
     enum ar_parser_state prevstate;
-    ares_method          m;
-    char                 tmp[ARC_MAXHEADER + 2];
-    char                *tokens[ARES_MAXTOKENS];
-    char                 ares_host[ARC_MAXHOSTNAMELEN + 1];
+    struct ares_lexer    lx;
+    struct ares_span     tok;
+    struct ares_span     ares_host;
+    struct ares_prop    *prop;
     struct result        cur;
-    int                  initial_ares_count;
+    size_t               initial_ares_count;
+    size_t               initial_ares_nprops;
 
     assert(hdr != NULL);
     assert(ar != NULL);
 
-    memset(tmp, '\0', sizeof tmp);
-    memset(&cur, '\0', sizeof cur);
-    memset(ares_host, '\0', sizeof ares_host);
+    memset(&lx, '\0', sizeof lx);
+    lx.al_p = hdr;
+    lx.al_len = strlen(hdr);
+    lx.al_arena = &ar->ares_arena;
 
-    ntoks = ares_tokenize(hdr, tmp, sizeof tmp, tokens, ARES_MAXTOKENS);
-    if (ntoks == -1 || ntoks > ARES_MAXTOKENS)
-    {
-        return -1;
-    }
+    memset(&ares_host, '\0', sizeof ares_host);
 
     prevstate = ARP_STATE_AUTHSERVID;
     state = ARP_STATE_AUTHSERVID;
     initial_ares_count = ar->ares_count;
+    initial_ares_nprops = ar->ares_nprops;
+    ares_result_reset(ar, &cur);
 
-    for (int c = 0; c < ntoks; c++)
+    while ((status = ares_lex(&lx, &tok)) == 1)
     {
-        if (tokens[c][0] == '(')
+        if (ares_tokfirst(&tok) == '(')
         {
             /* Comments are valid in a lot of places, but we're
              * only interested in storing ones that are placed
              * like properties
              */
-            if (cur.result_props < MAXPROPS &&
-                (state == ARP_STATE_PROP_OR_REASON || state == ARP_STATE_PTYPE))
+            if (state == ARP_STATE_PROP_OR_REASON || state == ARP_STATE_PTYPE)
             {
-                cur.result_ptype[cur.result_props] = ARES_PTYPE_COMMENT;
-                strlcpy((char *) cur.result_value[cur.result_props],
-                        (char *) tokens[c],
-                        sizeof cur.result_value[cur.result_props]);
+                prop = ares_prop_new(ar, ARES_PTYPE_COMMENT);
+                if (prop == NULL)
+                {
+                    break;
+                }
+                prop->prop_value = tok;
+                ar->ares_nprops++;
                 cur.result_props++;
             }
             continue;
@@ -424,21 +784,24 @@ ares_parse(const char *hdr, struct authres *ar, const char *authserv)
         switch (state)
         {
         case ARP_STATE_AUTHSERVID:
-            if (isascii(tokens[c][0]) && !isalnum(tokens[c][0]))
+            if (isascii(ares_tokfirst(&tok)) && !isalnum(ares_tokfirst(&tok)))
             {
-                ar->ares_count = initial_ares_count;
-                return -1;
+                status = -1;
+                break;
             }
 
-            if (tokens[c][0] == ';')
+            if (ares_tokis(&tok, ';'))
             {
                 prevstate = state;
                 state = ARP_STATE_METHODSPEC;
             }
             else
             {
-                strlcat((char *) ares_host, (char *) tokens[c],
-                        sizeof ares_host);
+                if (!ares_join(&ar->ares_arena, &ares_host, &tok))
+                {
+                    status = -1;
+                    break;
+                }
 
                 prevstate = state;
                 state = ARP_STATE_AUTHRESVERSION_OR_AUTHSERVID;
@@ -447,11 +810,13 @@ ares_parse(const char *hdr, struct authres *ar, const char *authserv)
             break;
 
         case ARP_STATE_AUTHRESVERSION_OR_AUTHSERVID:
-            if (tokens[c][0] == '.' && tokens[c][1] == '\0' &&
-                prevstate == ARP_STATE_AUTHSERVID)
+            if (ares_tokis(&tok, '.') && prevstate == ARP_STATE_AUTHSERVID)
             {
-                strlcat((char *) ares_host, (char *) tokens[c],
-                        sizeof ares_host);
+                if (!ares_join(&ar->ares_arena, &ares_host, &tok))
+                {
+                    status = -1;
+                    break;
+                }
 
                 prevstate = state;
                 state = ARP_STATE_AUTHSERVID;
@@ -462,39 +827,41 @@ ares_parse(const char *hdr, struct authres *ar, const char *authserv)
             /* We've successfully assembled the authserv-id,
              * see if it's what we're looking for.
              */
-            if (authserv && strcasecmp(authserv, ares_host) != 0)
+            if (authserv && (strlen(authserv) != ares_host.as_len ||
+                             strncasecmp(authserv, ares_host.as_str,
+                                         ares_host.as_len) != 0))
             {
                 ar->ares_count = initial_ares_count;
+                ar->ares_nprops = initial_ares_nprops;
                 return -2;
             }
-            strlcpy(ar->ares_host, ares_host, sizeof ar->ares_host);
+            ar->ares_host = ares_host;
 
-            if (tokens[c][0] == ';')
+            if (ares_tokis(&tok, ';'))
             {
                 prevstate = state;
                 state = ARP_STATE_METHODSPEC;
             }
-            else if (isascii(tokens[c][0]) && isdigit(tokens[c][0]))
+            else if (isascii(ares_tokfirst(&tok)) &&
+                     isdigit(ares_tokfirst(&tok)))
             {
-                strlcpy((char *) ar->ares_version, (char *) tokens[c],
-                        sizeof ar->ares_version);
+                ar->ares_version = tok;
 
                 prevstate = state;
                 state = ARP_STATE_RESINFO;
             }
             else
             {
-                ar->ares_count = initial_ares_count;
-                return -1;
+                status = -1;
             }
 
             break;
 
         case ARP_STATE_RESINFO:
-            if (tokens[c][0] != ';' || tokens[c][1] != '\0')
+            if (!ares_tokis(&tok, ';'))
             {
-                ar->ares_count = initial_ares_count;
-                return -1;
+                status = -1;
+                break;
             }
 
             prevstate = state;
@@ -503,7 +870,7 @@ ares_parse(const char *hdr, struct authres *ar, const char *authserv)
             break;
 
         case ARP_STATE_METHODSPEC:
-            if (strcasecmp((char *) tokens[c], "none") == 0)
+            if (tok.as_len == 4 && strncasecmp(tok.as_str, "none", 4) == 0)
             {
                 switch (prevstate)
                 {
@@ -512,29 +879,28 @@ ares_parse(const char *hdr, struct authres *ar, const char *authserv)
                 case ARP_STATE_RESINFO:
                     prevstate = state;
                     state = ARP_STATE_DONE;
-                    continue;
+                    break;
                 default:
                     /* should not have other resinfo */
-                    ar->ares_count = initial_ares_count;
-                    return -1;
+                    status = -1;
+                    break;
                 }
+                break;
             }
 
-            memset(&cur, '\0', sizeof cur);
+            ares_result_reset(ar, &cur);
+            cur.result_method = ares_tokcode(methods, &tok);
 
-            m = arc_name_to_code(methods, (char *) tokens[c]);
-
-            cur.result_method = m;
             prevstate = state;
             state = ARP_STATE_METHODSPEC_EQUALS;
 
             break;
 
         case ARP_STATE_METHODSPEC_EQUALS:
-            if (tokens[c][0] != '=' || tokens[c][1] != '\0')
+            if (!ares_tokis(&tok, '='))
             {
-                ar->ares_count = initial_ares_count;
-                return -1;
+                status = -1;
+                break;
             }
 
             prevstate = state;
@@ -543,17 +909,17 @@ ares_parse(const char *hdr, struct authres *ar, const char *authserv)
             break;
 
         case ARP_STATE_RESULT:
-            cur.result_result = arc_name_to_code(aresults, (char *) tokens[c]);
+            cur.result_result = ares_tokcode(aresults, &tok);
             prevstate = state;
             state = ARP_STATE_PROP_OR_REASON;
 
             break;
 
         case ARP_STATE_REASONSPEC_EQUALS:
-            if (tokens[c][0] != '=' || tokens[c][1] != '\0')
+            if (!ares_tokis(&tok, '='))
             {
-                ar->ares_count = initial_ares_count;
-                return -1;
+                status = -1;
+                break;
             }
             prevstate = state;
             state = ARP_STATE_REASONSPEC_VALUE;
@@ -561,8 +927,7 @@ ares_parse(const char *hdr, struct authres *ar, const char *authserv)
             break;
 
         case ARP_STATE_REASONSPEC_VALUE:
-            strlcpy((char *) cur.result_reason, (char *) tokens[c],
-                    sizeof cur.result_reason);
+            cur.result_reason = tok;
 
             prevstate = state;
             state = ARP_STATE_PTYPE;
@@ -570,22 +935,21 @@ ares_parse(const char *hdr, struct authres *ar, const char *authserv)
             break;
 
         case ARP_STATE_PROP_OR_REASON:
-            if (tokens[c][0] == ';' && /* neither */
-                tokens[c][1] == '\0')
+            if (ares_tokis(&tok, ';')) /* neither */
             {
                 ares_method_add(ar, &cur);
-                memset(&cur, '\0', sizeof cur);
+                ares_result_reset(ar, &cur);
                 prevstate = state;
                 state = ARP_STATE_METHODSPEC;
 
-                continue;
+                break;
             }
 
-            if (strcasecmp((char *) tokens[c], "reason") == 0)
+            if (tok.as_len == 6 && strncasecmp(tok.as_str, "reason", 6) == 0)
             { /* reason */
                 prevstate = state;
                 state = ARP_STATE_REASONSPEC_EQUALS;
-                continue;
+                break;
             }
             else
             {
@@ -596,43 +960,41 @@ ares_parse(const char *hdr, struct authres *ar, const char *authserv)
             /* FALLTHROUGH */
 
         case ARP_STATE_PTYPE:
-            if (prevstate == ARP_STATE_PVALUE &&
-                strchr(ARES_TOKENS2, tokens[c][0]) != NULL &&
-                tokens[c][1] == '\0')
+            if (prevstate == ARP_STATE_PVALUE && tok.as_len == 1 &&
+                strchr(ARES_TOKENS2, tok.as_str[0]) != NULL)
             {
                 /* actually a part of the previous value */
+                ar->ares_nprops--;
                 cur.result_props--;
-                strlcat((char *) cur.result_value[cur.result_props],
-                        (char *) tokens[c],
-                        sizeof cur.result_value[cur.result_props]);
+                if (!ares_join(&ar->ares_arena,
+                               &ar->ares_props[ar->ares_nprops].prop_value,
+                               &tok))
+                {
+                    status = -1;
+                    break;
+                }
 
                 prevstate = state;
                 state = ARP_STATE_PVALUE;
-                continue;
+                break;
             }
 
-            if (tokens[c][0] == ';' && tokens[c][1] == '\0')
+            if (ares_tokis(&tok, ';'))
             {
                 ares_method_add(ar, &cur);
-                memset(&cur, '\0', sizeof(cur));
+                ares_result_reset(ar, &cur);
                 prevstate = state;
                 state = ARP_STATE_METHODSPEC;
-                continue;
             }
             else
             {
                 ares_ptype x;
 
-                x = arc_name_to_code(ptypes, (char *) tokens[c]);
-                if (x == ARES_PTYPE_UNKNOWN)
-                {
-                    ar->ares_count = initial_ares_count;
-                    return -1;
-                }
-
-                if (cur.result_props < MAXPROPS)
+                x = ares_tokcode(ptypes, &tok);
+                if (x == ARES_PTYPE_UNKNOWN || ares_prop_new(ar, x) == NULL)
                 {
-                    cur.result_ptype[cur.result_props] = x;
+                    status = -1;
+                    break;
                 }
 
                 prevstate = state;
@@ -642,10 +1004,10 @@ ares_parse(const char *hdr, struct authres *ar, const char *authserv)
             break;
 
         case ARP_STATE_PROPSPEC_DOT:
-            if (tokens[c][0] != '.' || tokens[c][1] != '\0')
+            if (!ares_tokis(&tok, '.'))
             {
-                ar->ares_count = initial_ares_count;
-                return -1;
+                status = -1;
+                break;
             }
 
             prevstate = state;
@@ -654,12 +1016,7 @@ ares_parse(const char *hdr, struct authres *ar, const char *authserv)
             break;
 
         case ARP_STATE_PROPERTY:
-            if (cur.result_props < MAXPROPS)
-            {
-                strlcpy((char *) cur.result_property[cur.result_props],
-                        (char *) tokens[c],
-                        sizeof cur.result_property[cur.result_props]);
-            }
+            ar->ares_props[ar->ares_nprops].prop_property = tok;
 
             prevstate = state;
             state = ARP_STATE_PROPSPEC_EQUALS;
@@ -667,10 +1024,10 @@ ares_parse(const char *hdr, struct authres *ar, const char *authserv)
             break;
 
         case ARP_STATE_PROPSPEC_EQUALS:
-            if (tokens[c][0] != '=' || tokens[c][1] != '\0')
+            if (!ares_tokis(&tok, '='))
             {
-                ar->ares_count = initial_ares_count;
-                return -1;
+                status = -1;
+                break;
             }
 
             prevstate = state;
@@ -679,13 +1036,14 @@ ares_parse(const char *hdr, struct authres *ar, const char *authserv)
             break;
 
         case ARP_STATE_PVALUE:
-            if (cur.result_props < MAXPROPS)
+            if (!ares_join(&ar->ares_arena,
+                           &ar->ares_props[ar->ares_nprops].prop_value, &tok))
             {
-                strlcat((char *) cur.result_value[cur.result_props],
-                        (char *) tokens[c],
-                        sizeof cur.result_value[cur.result_props]);
-                cur.result_props++;
+                status = -1;
+                break;
             }
+            ar->ares_nprops++;
+            cur.result_props++;
 
             prevstate = state;
             state = ARP_STATE_PTYPE;
@@ -694,16 +1052,23 @@ ares_parse(const char *hdr, struct authres *ar, const char *authserv)
 
         case ARP_STATE_DONE:
             /* unexpected content after a singleton value */
-            ar->ares_count = initial_ares_count;
-            return -1;
+            status = -1;
+            break;
+        }
+
+        if (status != 1)
+        {
+            break;
         }
     }
 
-    /* error out on non-terminal states */
-    if (state != ARP_STATE_METHODSPEC && state != ARP_STATE_PROP_OR_REASON &&
-        state != ARP_STATE_PTYPE && state != ARP_STATE_DONE)
+    /* error out on bad syntax and non-terminal states */
+    if (status != 0 ||
+        (state != ARP_STATE_METHODSPEC && state != ARP_STATE_PROP_OR_REASON &&
+         state != ARP_STATE_PTYPE && state != ARP_STATE_DONE))
     {
         ar->ares_count = initial_ares_count;
+        ar->ares_nprops = initial_ares_nprops;
         return -1;
     }
 
@@ -713,28 +1078,58 @@ ares_parse(const char *hdr, struct authres *ar, const char *authserv)
 }
 
 /*
-**  ARES_ISTOKEN -- check whether a string is a valid token
+**  ARES_FREE -- release memory held by parsed results
+**
+**  Parameters:
+**  	ar -- authentication results
+**
+**  Return value:
+**  	None.
+**
+**  Notes:
+**  	"ar" is left empty and can be used again.
+*/
+
+void
+ares_free(struct authres *ar)
+{
+    assert(ar != NULL);
+
+    ARC_FREE(ar->ares_result);
+    ARC_FREE(ar->ares_props);
+    if (ar->ares_arena != NULL)
+    {
+        arc_arena_free(ar->ares_arena);
+    }
+
+    memset(ar, '\0', sizeof *ar);
+}
+
+/*
+**  ARES_ISTOKENN -- check whether a string of known length is a valid token
 **
 **  Parameters:
 **	str -- string to check
+**	len -- length of "str"
 **
 **  Return value:
 **	true if the string contains no characters that require quoting,
 **      false otherwise.
 */
+
 bool
-ares_istoken(const char *str)
+ares_istokenn(const char *str, size_t len)
 {
-    for (const char *c = str; *c != '\0'; c++)
+    for (size_t i = 0; i < len; i++)
     {
-        if (iscntrl(*c))
+        if (iscntrl(str[i]))
         {
             return false;
         }
         /* ' ' and tspecials from RFC 2045 except @
          * (local-part@domain-name doesn't require quoting)
          */
-        if (strchr(" ()<>,;:\\\"/[]?=", *c) != NULL)
+        if (strchr(" ()<>,;:\\\"/[]?=", str[i]) != NULL)
         {
             return false;
         }
@@ -742,6 +1137,22 @@ ares_istoken(const char *str)
     return true;
 }
 
+/*
+**  ARES_ISTOKEN -- check whether a string is a valid token
+**
+**  Parameters:
+**	str -- string to check
+**
+**  Return value:
+**	true if the string contains no characters that require quoting,
+**      false otherwise.
+*/
+bool
+ares_istoken(const char *str)
+{
+    return ares_istokenn(str, strlen(str));
+}
+
 /*
 **  ARES_GETMETHOD -- translate a method code to its name
 **
@@ -10,16 +10,12 @@
 #define _OPENARC_AR_H_
 
 /* system includes */
+#include <stdbool.h>
 #include <sys/types.h>
 
 /* openarc includes */
 #include "openarc.h"
 
-/* limits */
-#define MAXARESULTS 16
-#define MAXPROPS    16
-#define MAXAVALUE   256
-
 /* ARES_METHOD -- type for specifying an authentication method */
 typedef enum
 {
@@ -70,30 +66,50 @@ typedef enum
     ARES_PTYPE_SMTP,
 } ares_ptype;
 
+/* ARES_SPAN -- a run of text from a parsed header field; not NUL-terminated */
+struct ares_span
+{
+    const char *as_str;
+    size_t      as_len;
+};
+
+/* ARES_PROP -- a single property or comment */
+struct ares_prop
+{
+    ares_ptype       prop_ptype;
+    struct ares_span prop_property;
+    struct ares_span prop_value;
+};
+
 /* RESULT structure -- a single result */
 struct result
 {
-    int         result_props;
-    ares_method result_method;
-    ares_result result_result;
-    ares_ptype  result_ptype[MAXPROPS];
-    char        result_reason[MAXAVALUE + 1];
-    char        result_property[MAXPROPS][MAXAVALUE + 1];
-    char        result_value[MAXPROPS][MAXAVALUE + 1];
+    ares_method      result_method;
+    ares_result      result_result;
+    struct ares_span result_reason;
+    size_t           result_prop;  /* first property in ares_props */
+    size_t           result_props; /* number of properties */
 };
 
-/* AUTHRES structure -- the entire header parsed */
+/* AUTHRES structure -- the entire header parsed; zero it before use */
 struct authres
 {
-    int           ares_count;
-    char          ares_host[ARC_MAXHOSTNAMELEN + 1];
-    char          ares_version[MAXAVALUE + 1];
-    struct result ares_result[MAXARESULTS];
+    size_t            ares_count;
+    size_t            ares_nresults; /* allocated at ares_result */
+    size_t            ares_nprops;
+    size_t            ares_propalloc; /* allocated at ares_props */
+    struct ares_span  ares_host;
+    struct ares_span  ares_version;
+    struct result    *ares_result;
+    struct ares_prop *ares_props;
+    struct arc_arena *ares_arena; /* rewritten tokens */
 };
 
 extern int         ares_tokenize(const char *, char *, size_t, char **, int);
 extern int         ares_parse(const char *, struct authres *, const char *);
+extern void        ares_free(struct authres *);
 extern bool        ares_istoken(const char *);
+extern bool        ares_istokenn(const char *, size_t);
 
 extern const char *ares_getmethod(ares_method);
 extern const char *ares_getresult(ares_result);
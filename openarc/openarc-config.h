@@ -15,14 +15,21 @@
 struct configdef arcf_config[] = {
     {"AuthResComments",               CONFIG_TYPE_BOOLEAN, false},
     {"AuthResIP",                     CONFIG_TYPE_BOOLEAN, false},
+    {"AuthResOldestPass",             CONFIG_TYPE_BOOLEAN, false},
     {"AuthservID",                    CONFIG_TYPE_STRING,  false},
     {"AutoRestart",                   CONFIG_TYPE_BOOLEAN, false},
     {"AutoRestartCount",              CONFIG_TYPE_INTEGER, false},
     {"AutoRestartRate",               CONFIG_TYPE_STRING,  false},
     {"Background",                    CONFIG_TYPE_BOOLEAN, false},
+    {"BackgroundVerification",        CONFIG_TYPE_BOOLEAN, false},
     {"BaseDirectory",                 CONFIG_TYPE_STRING,  false},
+    {"BodyHashThreads",               CONFIG_TYPE_INTEGER, false},
+    {"BodyHashThreshold",             CONFIG_TYPE_INTEGER, false},
     {"Canonicalization",              CONFIG_TYPE_STRING,  false},
+    {"CaptureCanonicalization",       CONFIG_TYPE_INTEGER, false},
     {"ChangeRootDirectory",           CONFIG_TYPE_STRING,  false},
+    {"CryptoStatsInterval",           CONFIG_TYPE_INTEGER, false},
+    {"CryptoThreads",                 CONFIG_TYPE_INTEGER, false},
     {"Domain",                        CONFIG_TYPE_STRING,  false},
     {"EnableCoredumps",               CONFIG_TYPE_BOOLEAN, false},
     {"FinalReceiver",                 CONFIG_TYPE_BOOLEAN, false},
@@ -31,10 +38,15 @@ struct configdef arcf_config[] = {
     {"InternalHosts",                 CONFIG_TYPE_STRING,  false},
     {"KeepTemporaryFiles",            CONFIG_TYPE_BOOLEAN, false},
     {"KeyFile",                       CONFIG_TYPE_STRING,  false},
+    {"LogAllocations",                CONFIG_TYPE_BOOLEAN, false},
     {"MaximumHeaders",                CONFIG_TYPE_INTEGER, false},
+    {"MessageArenaSize",              CONFIG_TYPE_INTEGER, false},
     {"MilterDebug",                   CONFIG_TYPE_INTEGER, false},
+    {"MilterEngine",                  CONFIG_TYPE_STRING,  false},
+    {"MilterWorkers",                 CONFIG_TYPE_INTEGER, false},
     {"MinimumKeySizeRSA",             CONFIG_TYPE_INTEGER, false},
     {"Mode",                          CONFIG_TYPE_STRING,  false},
+    {"Nameservers",                   CONFIG_TYPE_STRING,  false},
     {"OverSignHeaders",               CONFIG_TYPE_STRING,  false},
     {"PeerList",                      CONFIG_TYPE_STRING,  false},
     {"PermitAuthenticationOverrides", CONFIG_TYPE_BOOLEAN, false},
@@ -52,6 +64,7 @@ struct configdef arcf_config[] = {
     {"SoftwareHeader",                CONFIG_TYPE_BOOLEAN, false},
     {"Syslog",                        CONFIG_TYPE_BOOLEAN, false},
     {"SyslogFacility",                CONFIG_TYPE_STRING,  false},
+    {"SyslogStderr",                  CONFIG_TYPE_BOOLEAN, false},
     {"TemporaryDirectory",            CONFIG_TYPE_STRING,  false},
     {"TestKeys",                      CONFIG_TYPE_STRING,  false},
     {"UMask",                         CONFIG_TYPE_INTEGER, false},
@@ -0,0 +1,721 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#include "build-config.h"
+
+/* system includes */
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <arpa/nameser.h>
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <resolv.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* libopenarc includes */
+#include "arc.h"
+
+/* openarc includes */
+#include "arc-malloc.h"
+#include "openarc-dns.h"
+
+/*
+**  A stub resolver for the event engine.  Every query has a UDP socket of
+**  its own and nothing here waits unless the caller's timeout says to, so
+**  a callback whose replies haven't arrived can hand the sockets to the
+**  event loop and give its worker back until one of them is readable.
+**
+**  Servers are asked in turn, each for ARCF_DNS_RETRYMS, until every one
+**  has been asked ARCF_DNS_ATTEMPTS times; after that the query fails.
+*/
+
+#ifndef _PATH_RESCONF
+#define _PATH_RESCONF "/etc/resolv.conf"
+#endif /* ! _PATH_RESCONF */
+
+#define ARCF_DNS_MAXNS    3    /* servers used, as with res_init() */
+#define ARCF_DNS_ATTEMPTS 2    /* times each server is asked */
+#define ARCF_DNS_RETRYMS  2000 /* wait before asking the next server */
+#define ARCF_DNS_EDNSSIZE 4096 /* reply size offered in the OPT record */
+#define ARCF_DNS_OPTSIZE  11   /* bytes in that OPT record */
+#define ARCF_DNS_MAXQUERY                                                      \
+    (NS_HFIXEDSZ + NS_MAXCDNAME + NS_QFIXEDSZ + ARCF_DNS_OPTSIZE)
+
+/* struct arcf_dns -- the servers to ask */
+struct arcf_dns
+{
+    size_t                  dns_nservers;
+    socklen_t               dns_addrlen[ARCF_DNS_MAXNS];
+    struct sockaddr_storage dns_addr[ARCF_DNS_MAXNS];
+};
+
+/* struct arcf_dnsquery -- one query in flight */
+struct arcf_dnsquery
+{
+    int            dq_fd;
+    bool           dq_edns;   /* the query has an OPT record */
+    uint16_t       dq_id;
+    size_t         dq_server; /* server last asked */
+    size_t         dq_tries;  /* times the query has been sent */
+    size_t         dq_errors; /* servers that refused in a row */
+    size_t         dq_len;    /* bytes at dq_query */
+    size_t         dq_buflen;
+    unsigned char *dq_buf;    /* caller's reply buffer */
+    struct timeval dq_sent;
+    unsigned char  dq_query[ARCF_DNS_MAXQUERY];
+};
+
+/* servers from "Nameservers"; resolv.conf is read when there are none */
+static struct arcf_dns dns_servers;
+
+/**
+ *  Add a server to a list.
+ *
+ *  Parameters:
+ *      dns: list
+ *      host: numeric address
+ *      port: port number
+ *
+ *  Returns:
+ *      false if the address can't be used.
+ */
+
+static bool
+arcf_dns_addserver(struct arcf_dns *dns, const char *host, const char *port)
+{
+    struct addrinfo  hints;
+    struct addrinfo *res;
+
+    if (dns->dns_nservers == ARCF_DNS_MAXNS)
+    {
+        return true;
+    }
+
+    memset(&hints, '\0', sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+
+    if (getaddrinfo(host, port, &hints, &res) != 0)
+    {
+        return false;
+    }
+
+    memcpy(&dns->dns_addr[dns->dns_nservers], res->ai_addr, res->ai_addrlen);
+    dns->dns_addrlen[dns->dns_nservers] = res->ai_addrlen;
+    dns->dns_nservers++;
+    freeaddrinfo(res);
+
+    return true;
+}
+
+/**
+ *  Set the servers to ask instead of the ones in resolv.conf.
+ *
+ *  Parameters:
+ *      list: comma or space separated addresses, each optionally with a
+ *            port as "192.0.2.1:5353" or "[2001:db8::1]:5353"
+ *
+ *  Returns:
+ *      0 on success, -1 if an entry isn't an address.
+ */
+
+int
+arcf_dns_setservers(const char *list)
+{
+    char *copy;
+    char *ctx;
+    char *p;
+    bool  ok = true;
+
+    assert(list != NULL);
+
+    copy = ARC_STRDUP(list);
+    if (copy == NULL)
+    {
+        return -1;
+    }
+
+    memset(&dns_servers, '\0', sizeof dns_servers);
+
+    for (p = strtok_r(copy, ", \t", &ctx); p != NULL && ok;
+         p = strtok_r(NULL, ", \t", &ctx))
+    {
+        char *port = NULL;
+
+        if (*p == '[')
+        {
+            char *end = strchr(p, ']');
+
+            if (end == NULL || (end[1] != '\0' && end[1] != ':'))
+            {
+                ok = false;
+                break;
+            }
+            if (end[1] == ':')
+            {
+                port = end + 2;
+            }
+            *end = '\0';
+            p++;
+        }
+        else if ((port = strchr(p, ':')) != NULL &&
+                 strchr(port + 1, ':') == NULL)
+        {
+            *port++ = '\0';
+        }
+        else
+        {
+            /* a bare IPv6 address */
+            port = NULL;
+        }
+
+        ok = arcf_dns_addserver(&dns_servers, p, port == NULL ? "53" : port);
+    }
+
+    ARC_FREE(copy);
+
+    if (!ok || dns_servers.dns_nservers == 0)
+    {
+        memset(&dns_servers, '\0', sizeof dns_servers);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ *  Set up the resolver.
+ *
+ *  Parameters:
+ *      srv: service handle (returned)
+ *
+ *  Returns:
+ *      0 on success, -1 on failure.
+ */
+
+int
+arcf_dns_init(void **srv)
+{
+    FILE            *f;
+    struct arcf_dns *dns;
+    char             line[BUFSIZ];
+
+    dns = ARC_CALLOC(1, sizeof *dns);
+    if (dns == NULL)
+    {
+        return -1;
+    }
+
+    if (dns_servers.dns_nservers > 0)
+    {
+        memcpy(dns, &dns_servers, sizeof *dns);
+        *srv = dns;
+        return 0;
+    }
+
+    f = fopen(_PATH_RESCONF, "r");
+    if (f != NULL)
+    {
+        while (fgets(line, sizeof line, f) != NULL)
+        {
+            char *p = line;
+            char *end;
+
+            if (strncmp(p, "nameserver", 10) != 0 ||
+                !isspace((unsigned char) p[10]))
+            {
+                continue;
+            }
+
+            for (p += 10; isspace((unsigned char) *p); p++)
+            {
+                continue;
+            }
+            for (end = p; *end != '\0' && !isspace((unsigned char) *end);
+                 end++)
+            {
+                continue;
+            }
+            *end = '\0';
+
+            (void) arcf_dns_addserver(dns, p, "53");
+        }
+
+        fclose(f);
+    }
+
+    /* the same default as the system resolver */
+    if (dns->dns_nservers == 0)
+    {
+        (void) arcf_dns_addserver(dns, "127.0.0.1", "53");
+    }
+
+    *srv = dns;
+
+    return 0;
+}
+
+/**
+ *  Shut down the resolver.
+ *
+ *  Parameters:
+ *      srv: service handle
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+void
+arcf_dns_close(void *srv)
+{
+    ARC_FREE(srv);
+}
+
+/**
+ *  Store a 16-bit value in network order.
+ *
+ *  Parameters:
+ *      p: where to put it
+ *      v: value
+ *
+ *  Returns:
+ *      The byte after it.
+ */
+
+static unsigned char *
+arcf_dns_put16(unsigned char *p, unsigned int v)
+{
+    p[0] = (v >> 8) & 0xff;
+    p[1] = v & 0xff;
+    return p + 2;
+}
+
+/**
+ *  Build the packet for a query.
+ *
+ *  Parameters:
+ *      dq: query, with dq_id and dq_edns set
+ *      type: RR type
+ *      name: name to ask about
+ *
+ *  Returns:
+ *      false if the name can't be encoded.
+ */
+
+static bool
+arcf_dns_mkquery(struct arcf_dnsquery *dq, int type, const char *name)
+{
+    size_t         namelen = 0;
+    unsigned char *p = dq->dq_query;
+
+    p = arcf_dns_put16(p, dq->dq_id);
+    p = arcf_dns_put16(p, 0x0100); /* standard query, recursion desired */
+    p = arcf_dns_put16(p, 1);
+    p = arcf_dns_put16(p, 0);
+    p = arcf_dns_put16(p, 0);
+    p = arcf_dns_put16(p, dq->dq_edns ? 1 : 0);
+
+    while (*name != '\0')
+    {
+        const char *dot = strchr(name, '.');
+        size_t      len = dot == NULL ? strlen(name) : (size_t) (dot - name);
+
+        if (len == 0 || len > NS_MAXLABEL)
+        {
+            return false;
+        }
+
+        namelen += len + 1;
+        if (namelen + 1 > NS_MAXCDNAME)
+        {
+            return false;
+        }
+
+        *p++ = len;
+        memcpy(p, name, len);
+        p += len;
+
+        name += len;
+        if (*name == '.')
+        {
+            name++;
+        }
+    }
+    *p++ = '\0';
+
+    p = arcf_dns_put16(p, type);
+    p = arcf_dns_put16(p, ns_c_in);
+
+    if (dq->dq_edns)
+    {
+        *p++ = '\0';
+        p = arcf_dns_put16(p, ns_t_opt);
+        p = arcf_dns_put16(p, ARCF_DNS_EDNSSIZE);
+        p = arcf_dns_put16(p, 0);
+        p = arcf_dns_put16(p, 0);
+        p = arcf_dns_put16(p, 0);
+    }
+
+    dq->dq_len = p - dq->dq_query;
+
+    return true;
+}
+
+/**
+ *  Send a query to its current server.
+ *
+ *  Parameters:
+ *      dns: service handle
+ *      dq: query
+ *
+ *  Returns:
+ *      false if nothing could be sent.
+ */
+
+static bool
+arcf_dns_send(struct arcf_dns *dns, struct arcf_dnsquery *dq)
+{
+    struct sockaddr *sa = (struct sockaddr *) &dns->dns_addr[dq->dq_server];
+
+    /* a connected socket only hears from the server it last asked */
+    if (dq->dq_fd == -1)
+    {
+        dq->dq_fd = socket(sa->sa_family, SOCK_DGRAM, 0);
+        if (dq->dq_fd == -1)
+        {
+            return false;
+        }
+        (void) fcntl(dq->dq_fd, F_SETFD, FD_CLOEXEC);
+        (void) fcntl(dq->dq_fd, F_SETFL,
+                     fcntl(dq->dq_fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    (void) gettimeofday(&dq->dq_sent, NULL);
+    dq->dq_tries++;
+
+    if (connect(dq->dq_fd, sa, dns->dns_addrlen[dq->dq_server]) != 0 ||
+        send(dq->dq_fd, dq->dq_query, dq->dq_len, 0) == -1)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ *  Send a query to the next server, if there are tries left.
+ *
+ *  Parameters:
+ *      dns: service handle
+ *      dq: query
+ *      refused: the current server can't be reached at all
+ *
+ *  Returns:
+ *      false if the query has failed.
+ */
+
+static bool
+arcf_dns_next(struct arcf_dns *dns, struct arcf_dnsquery *dq, bool refused)
+{
+    dq->dq_errors = refused ? dq->dq_errors + 1 : 0;
+
+    while (dq->dq_errors < dns->dns_nservers &&
+           dq->dq_tries < dns->dns_nservers * ARCF_DNS_ATTEMPTS)
+    {
+        struct sockaddr *cur;
+        struct sockaddr *next;
+
+        cur = (struct sockaddr *) &dns->dns_addr[dq->dq_server];
+        dq->dq_server = (dq->dq_server + 1) % dns->dns_nservers;
+        next = (struct sockaddr *) &dns->dns_addr[dq->dq_server];
+
+        if (cur->sa_family != next->sa_family)
+        {
+            (void) close(dq->dq_fd);
+            dq->dq_fd = -1;
+        }
+
+        if (arcf_dns_send(dns, dq))
+        {
+            return true;
+        }
+
+        dq->dq_errors++;
+    }
+
+    return false;
+}
+
+/**
+ *  Start a query.
+ *
+ *  Parameters:
+ *      srv: service handle
+ *      type: RR type
+ *      query: name to ask about
+ *      buf: where the reply goes
+ *      buflen: bytes at "buf"
+ *      qh: query handle (returned)
+ *
+ *  Returns:
+ *      An ARC_DNS_* constant.
+ */
+
+int
+arcf_dns_start(void          *srv,
+               int            type,
+               const char    *query,
+               unsigned char *buf,
+               size_t         buflen,
+               void         **qh)
+{
+    struct arcf_dns      *dns = srv;
+    struct arcf_dnsquery *dq;
+
+    assert(dns != NULL);
+    assert(query != NULL);
+    assert(buf != NULL);
+    assert(qh != NULL);
+
+    dq = ARC_CALLOC(1, sizeof *dq);
+    if (dq == NULL)
+    {
+        return ARC_DNS_ERROR;
+    }
+
+    dq->dq_fd = -1;
+    dq->dq_buf = buf;
+    dq->dq_buflen = buflen;
+    dq->dq_edns = buflen > NS_PACKETSZ;
+#ifdef HAVE_GETENTROPY
+    if (getentropy(&dq->dq_id, sizeof dq->dq_id) != 0)
+#endif /* HAVE_GETENTROPY */
+    {
+        dq->dq_id = (uint16_t) random();
+    }
+
+    if (!arcf_dns_mkquery(dq, type, query))
+    {
+        ARC_FREE(dq);
+        return ARC_DNS_INVALID;
+    }
+
+    if (!arcf_dns_send(dns, dq) && !arcf_dns_next(dns, dq, true))
+    {
+        if (dq->dq_fd != -1)
+        {
+            (void) close(dq->dq_fd);
+        }
+        ARC_FREE(dq);
+        return ARC_DNS_ERROR;
+    }
+
+    *qh = dq;
+
+    return ARC_DNS_SUCCESS;
+}
+
+/**
+ *  Abandon a query, or free one that's finished.
+ *
+ *  Parameters:
+ *      srv: service handle
+ *      qh: query handle
+ *
+ *  Returns:
+ *      0.
+ */
+
+int
+arcf_dns_cancel(void *srv, void *qh)
+{
+    struct arcf_dnsquery *dq = qh;
+
+    (void) srv;
+
+    if (dq != NULL)
+    {
+        if (dq->dq_fd != -1)
+        {
+            (void) close(dq->dq_fd);
+        }
+        ARC_FREE(dq);
+    }
+
+    return 0;
+}
+
+/**
+ *  Collect the reply to a query.
+ *
+ *  Parameters:
+ *      srv: service handle
+ *      qh: query handle
+ *      to: longest wait; NULL waits until the query succeeds or fails,
+ *          and a zero timeout only checks
+ *      bytes: reply length (returned)
+ *      error: errno of a failure (returned)
+ *      dnssec: DNSSEC status (returned)
+ *
+ *  Returns:
+ *      ARC_DNS_SUCCESS, ARC_DNS_ERROR, ARC_DNS_NOREPLY if a zero timeout
+ *      found nothing, or ARC_DNS_EXPIRED if another timeout ran out.
+ */
+
+int
+arcf_dns_waitreply(void           *srv,
+                   void           *qh,
+                   struct timeval *to,
+                   size_t         *bytes,
+                   int            *error,
+                   int            *dnssec)
+{
+    struct arcf_dns      *dns = srv;
+    struct arcf_dnsquery *dq = qh;
+    struct timeval        deadline;
+
+    assert(dns != NULL);
+    assert(dq != NULL);
+
+    if (to != NULL)
+    {
+        (void) gettimeofday(&deadline, NULL);
+        timeradd(&deadline, to, &deadline);
+    }
+
+    for (;;)
+    {
+        ssize_t        n;
+        long           wait;
+        struct timeval now;
+        struct timeval elapsed;
+        struct pollfd  pfd;
+
+        n = recv(dq->dq_fd, dq->dq_buf, dq->dq_buflen, 0);
+        if (n >= NS_HFIXEDSZ)
+        {
+            unsigned int id = (dq->dq_buf[0] << 8) | dq->dq_buf[1];
+
+            if (id != dq->dq_id || (dq->dq_buf[2] & 0x80) == 0)
+            {
+                continue;
+            }
+
+            /* a server that doesn't know EDNS0 is asked again without it */
+            if ((dq->dq_buf[3] & 0x0f) == ns_r_formerr && dq->dq_edns)
+            {
+                dq->dq_edns = false;
+                dq->dq_len -= ARCF_DNS_OPTSIZE;
+                (void) arcf_dns_put16(dq->dq_query + 10, 0);
+                if (!arcf_dns_send(dns, dq) && !arcf_dns_next(dns, dq, true))
+                {
+                    if (error != NULL)
+                    {
+                        *error = errno;
+                    }
+                    return ARC_DNS_ERROR;
+                }
+                continue;
+            }
+
+            *bytes = n;
+            if (error != NULL)
+            {
+                *error = 0;
+            }
+            if (dnssec != NULL)
+            {
+                *dnssec = ARC_DNSSEC_UNKNOWN;
+            }
+            return ARC_DNS_SUCCESS;
+        }
+        else if (n >= 0 || errno == EINTR)
+        {
+            continue;
+        }
+        else if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            if (!arcf_dns_next(dns, dq, true))
+            {
+                if (error != NULL)
+                {
+                    *error = errno;
+                }
+                return ARC_DNS_ERROR;
+            }
+            continue;
+        }
+
+        (void) gettimeofday(&now, NULL);
+        timersub(&now, &dq->dq_sent, &elapsed);
+        wait = ARCF_DNS_RETRYMS -
+               (elapsed.tv_sec * 1000 + elapsed.tv_usec / 1000);
+        if (wait <= 0)
+        {
+            if (!arcf_dns_next(dns, dq, false))
+            {
+                if (error != NULL)
+                {
+                    *error = ETIMEDOUT;
+                }
+                return ARC_DNS_ERROR;
+            }
+            continue;
+        }
+
+        if (to != NULL)
+        {
+            long left;
+
+            timersub(&deadline, &now, &elapsed);
+            left = elapsed.tv_sec * 1000 + elapsed.tv_usec / 1000;
+            if (elapsed.tv_sec < 0 || left <= 0)
+            {
+                return to->tv_sec == 0 && to->tv_usec == 0 ? ARC_DNS_NOREPLY
+                                                           : ARC_DNS_EXPIRED;
+            }
+            if (left < wait)
+            {
+                wait = left;
+            }
+        }
+
+        pfd.fd = dq->dq_fd;
+        pfd.events = POLLIN;
+        (void) poll(&pfd, 1, (int) wait);
+    }
+}
+
+/**
+ *  Get the socket a query's reply will arrive on.
+ *
+ *  Parameters:
+ *      qh: query handle
+ *
+ *  Returns:
+ *      A descriptor that becomes readable when there's something for
+ *      arcf_dns_waitreply() to look at.
+ */
+
+int
+arcf_dns_fd(void *qh)
+{
+    struct arcf_dnsquery *dq = qh;
+
+    assert(dq != NULL);
+
+    return dq->dq_fd;
+}
@@ -0,0 +1,29 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#ifndef OPENARC_DNS_H
+#define OPENARC_DNS_H
+
+#include <sys/time.h>
+#include <sys/types.h>
+
+extern int  arcf_dns_setservers(const char *);
+extern int  arcf_dns_init(void **);
+extern void arcf_dns_close(void *);
+extern int  arcf_dns_start(void *,
+                           int,
+                           const char *,
+                           unsigned char *,
+                           size_t,
+                           void **);
+extern int  arcf_dns_cancel(void *, void *);
+extern int  arcf_dns_waitreply(void *,
+                               void *,
+                               struct timeval *,
+                               size_t *,
+                               int *,
+                               int *);
+extern int  arcf_dns_fd(void *);
+
+#endif /* OPENARC_DNS_H */
@@ -0,0 +1,2082 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#include "build-config.h"
+
+/* system includes */
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#endif /* HAVE_SYS_EPOLL_H */
+
+/* libmilter includes */
+#include <libmilter/mfapi.h>
+
+/* openarc includes */
+#include "arc-malloc.h"
+#include "openarc-engine.h"
+#include "openarc.h"
+
+#ifdef HAVE_SYS_EPOLL_H
+
+/*
+**  A built-in implementation of the filter side of the milter protocol, as
+**  an alternative to libmilter's thread per connection.  One thread runs an
+**  epoll loop that does all socket I/O and splits the input into packets;
+**  every packet that needs a filter callback becomes a task for a fixed
+**  pool of worker threads.  A connection has at most one task at a time,
+**  so its callbacks still run one after another, and the loop neither
+**  reads from nor writes to a connection while a worker has it.  Callbacks
+**  that block (RSA) only hold up a worker, not the loop.
+**
+**  The end of message callback doesn't block on DNS.  When key lookups are
+**  still out it names their sockets with arcf_engine_waitfd() and returns
+**  ARCF_ENGINE_AGAIN; the connection then waits without a worker until one
+**  of the sockets is readable or ARCF_ENGINE_TICKMS has passed, and the
+**  callback is run again.
+*/
+
+/* commands from the MTA */
+#define SMFIC_ABORT          'A'
+#define SMFIC_BODY           'B'
+#define SMFIC_CONNECT        'C'
+#define SMFIC_MACRO          'D'
+#define SMFIC_BODYEOB        'E'
+#define SMFIC_HELO           'H'
+#define SMFIC_QUIT_NC        'K'
+#define SMFIC_HEADER         'L'
+#define SMFIC_MAIL           'M'
+#define SMFIC_EOH            'N'
+#define SMFIC_OPTNEG         'O'
+#define SMFIC_QUIT           'Q'
+#define SMFIC_RCPT           'R'
+#define SMFIC_DATA           'T'
+#define SMFIC_UNKNOWN        'U'
+
+/* not a protocol command; the connection went away */
+#define SMFIC_GONE           '\0'
+
+/* replies to the MTA */
+#define SMFIR_ADDRCPT        '+'
+#define SMFIR_DELRCPT        '-'
+#define SMFIR_ACCEPT         'a'
+#define SMFIR_CONTINUE       'c'
+#define SMFIR_DISCARD        'd'
+#define SMFIR_ADDHEADER      'h'
+#define SMFIR_INSHEADER      'i'
+#define SMFIR_CHGHEADER      'm'
+#define SMFIR_REJECT         'r'
+#define SMFIR_SKIP           's'
+#define SMFIR_TEMPFAIL       't'
+#define SMFIR_REPLYCODE      'y'
+
+/* connection address families */
+#define SMFIA_UNKNOWN        'U'
+#define SMFIA_UNIX           'L'
+#define SMFIA_INET           '4'
+#define SMFIA_INET6          '6'
+
+#define ARCF_ENGINE_VERSION  6     /* protocol version spoken */
+#define ARCF_ENGINE_READSIZE 65536 /* least room made for each read */
+#define ARCF_ENGINE_EVENTS   64    /* events taken per epoll_wait() */
+#define ARCF_ENGINE_TICKMS   1000  /* longest wait for a suspended EOM */
+
+/* protocol steps this engine can leave out or act on */
+#define ARCF_ENGINE_PROTO                                                      \
+    (SMFIP_NOCONNECT | SMFIP_NOHELO | SMFIP_NOMAIL | SMFIP_NORCPT |            \
+     SMFIP_NOBODY | SMFIP_NOHDRS | SMFIP_NOEOH | SMFIP_NOUNKNOWN |             \
+     SMFIP_NODATA | SMFIP_SKIP | SMFIP_RCPT_REJ | SMFIP_HDR_LEADSPC)
+
+/* commands that can have macros, in the order they're searched */
+static const char arcf_engine_stages[] = {
+    SMFIC_BODYEOB, SMFIC_EOH,  SMFIC_DATA,    SMFIC_RCPT,
+    SMFIC_MAIL,    SMFIC_HELO, SMFIC_CONNECT,
+};
+#define ARCF_ENGINE_NSTAGES  (sizeof arcf_engine_stages)
+#define ARCF_ENGINE_MSGSTAGE 5 /* stages before this are per message */
+
+/* struct arcf_engbuf -- a byte buffer consumed from the front */
+struct arcf_engbuf
+{
+    unsigned char *eb_data;
+    size_t         eb_off; /* first unconsumed byte */
+    size_t         eb_len; /* end of the data */
+    size_t         eb_size;
+};
+
+/* struct arcf_engconn -- one MTA connection */
+struct arcf_engconn
+{
+    int                  ec_fd;
+    bool                 ec_busy;     /* a worker has it */
+    bool                 ec_readable; /* epoll said so since the last EAGAIN */
+    bool                 ec_writable;
+    bool                 ec_eof;      /* peer is gone or must be dropped */
+    bool                 ec_open;     /* close callback is owed */
+    bool                 ec_done;     /* drop once output is flushed */
+    bool                 ec_ineom;    /* modifications are allowed */
+    bool                 ec_dropped;  /* closed; freed after this batch */
+    bool                 ec_waiting;  /* end of message waits on DNS */
+    unsigned long        ec_actions;  /* negotiated SMFIF_* */
+    unsigned long        ec_proto;    /* negotiated SMFIP_* */
+    void                *ec_priv;
+    char                *ec_reply;    /* from arcf_engine_setreply() */
+    char                 ec_cmd;      /* packet for the worker */
+    unsigned char       *ec_data;
+    size_t               ec_len;
+    char                *ec_macros[ARCF_ENGINE_NSTAGES];
+    size_t               ec_maclen[ARCF_ENGINE_NSTAGES];
+    size_t               ec_nwait;
+    int                  ec_waitfd[ARCF_ENGINE_MAXWAIT];
+    time_t               ec_waitsince;
+    struct arcf_engbuf   ec_in;
+    struct arcf_engbuf   ec_out;
+    struct arcf_engconn *ec_next;     /* task, completion or drop queue */
+    struct arcf_engconn *ec_prevconn; /* all connections */
+    struct arcf_engconn *ec_nextconn;
+};
+
+/* engine state; there is only one engine per process */
+static int                  eng_listen = -1;
+static char                *eng_path;    /* UNIX socket to remove */
+static struct smfiDesc     *eng_desc;
+static pthread_mutex_t      eng_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t       eng_cond = PTHREAD_COND_INITIALIZER;
+static struct arcf_engconn *eng_tasks;   /* waiting for a worker */
+static struct arcf_engconn *eng_taskend;
+static struct arcf_engconn *eng_done;    /* finished by a worker */
+static struct arcf_engconn *eng_dropped; /* closed, not yet freed */
+static bool                 eng_stop;    /* workers should exit */
+static int                  eng_wake = -1;
+static int                  eng_waitep = -1; /* sockets EOMs wait on */
+static size_t               eng_nwaiting;
+static struct arcf_engconn *eng_conns;
+static size_t               eng_nconns;
+
+/**
+ *  Say whether this platform has the event engine.
+ *
+ *  Parameters:
+ *      None.
+ *
+ *  Returns:
+ *      true.
+ */
+
+bool
+arcf_engine_available(void)
+{
+    return true;
+}
+
+/**
+ *  Make room at the end of a buffer.
+ *
+ *  Parameters:
+ *      eb: buffer
+ *      need: bytes wanted after eb_len
+ *
+ *  Returns:
+ *      false on allocation failure.
+ */
+
+static bool
+arcf_engine_reserve(struct arcf_engbuf *eb, size_t need)
+{
+    size_t         size;
+    unsigned char *data;
+
+    if (eb->eb_off > 0 && eb->eb_size - eb->eb_len < need)
+    {
+        memmove(eb->eb_data, eb->eb_data + eb->eb_off,
+                eb->eb_len - eb->eb_off);
+        eb->eb_len -= eb->eb_off;
+        eb->eb_off = 0;
+    }
+
+    if (eb->eb_size - eb->eb_len >= need)
+    {
+        return true;
+    }
+
+    size = eb->eb_size == 0 ? ARCF_ENGINE_READSIZE : eb->eb_size;
+    while (size - eb->eb_len < need)
+    {
+        size *= 2;
+    }
+
+    data = ARC_REALLOC(eb->eb_data, size);
+    if (data == NULL)
+    {
+        return false;
+    }
+    eb->eb_data = data;
+    eb->eb_size = size;
+
+    return true;
+}
+
+/**
+ *  Queue a packet for the MTA.
+ *
+ *  Parameters:
+ *      ec: connection
+ *      cmd: reply code
+ *      ...: pairs of (const void *, size_t) pieces, ending with NULL
+ *
+ *  Returns:
+ *      MI_SUCCESS or MI_FAILURE.
+ */
+
+static int
+arcf_engine_send(struct arcf_engconn *ec, char cmd, const void *piece, ...)
+{
+    size_t         len = 1;
+    uint32_t       nlen;
+    const void    *p;
+    unsigned char *out;
+    va_list        ap;
+
+    va_start(ap, piece);
+    for (p = piece; p != NULL; p = va_arg(ap, const void *))
+    {
+        len += va_arg(ap, size_t);
+    }
+    va_end(ap);
+
+    if (len > ARCF_ENGINE_MAXPACKET ||
+        !arcf_engine_reserve(&ec->ec_out, len + sizeof nlen))
+    {
+        return MI_FAILURE;
+    }
+
+    out = ec->ec_out.eb_data + ec->ec_out.eb_len;
+    nlen = htonl(len);
+    memcpy(out, &nlen, sizeof nlen);
+    out += sizeof nlen;
+    *out++ = cmd;
+
+    va_start(ap, piece);
+    for (p = piece; p != NULL; p = va_arg(ap, const void *))
+    {
+        size_t n = va_arg(ap, size_t);
+
+        memcpy(out, p, n);
+        out += n;
+    }
+    va_end(ap);
+
+    ec->ec_out.eb_len += len + sizeof nlen;
+
+    return MI_SUCCESS;
+}
+
+/**
+ *  Queue the reply for a callback's result.
+ *
+ *  Parameters:
+ *      ec: connection
+ *      status: SMFIS_* result
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+static void
+arcf_engine_status(struct arcf_engconn *ec, sfsistat status)
+{
+    char code;
+
+    switch (status)
+    {
+    case SMFIS_CONTINUE:
+    case SMFIS_NOREPLY: /* never negotiated */
+        code = SMFIR_CONTINUE;
+        break;
+
+    case SMFIS_ACCEPT:
+        code = SMFIR_ACCEPT;
+        break;
+
+    case SMFIS_DISCARD:
+        code = SMFIR_DISCARD;
+        break;
+
+    case SMFIS_SKIP:
+        code = (ec->ec_proto & SMFIP_SKIP) ? SMFIR_SKIP : SMFIR_CONTINUE;
+        break;
+
+    case SMFIS_REJECT:
+        code = SMFIR_REJECT;
+        if (ec->ec_reply != NULL && ec->ec_reply[0] == '5')
+        {
+            code = SMFIR_REPLYCODE;
+        }
+        break;
+
+    case SMFIS_TEMPFAIL:
+    default:
+        code = SMFIR_TEMPFAIL;
+        if (ec->ec_reply != NULL && ec->ec_reply[0] == '4')
+        {
+            code = SMFIR_REPLYCODE;
+        }
+        break;
+    }
+
+    if (code == SMFIR_REPLYCODE)
+    {
+        (void) arcf_engine_send(ec, code, ec->ec_reply,
+                                strlen(ec->ec_reply) + 1, NULL);
+    }
+    else
+    {
+        (void) arcf_engine_send(ec, code, NULL);
+    }
+
+    ARC_FREE(ec->ec_reply);
+    ec->ec_reply = NULL;
+}
+
+/**
+ *  Forget the macros for some stages.
+ *
+ *  Parameters:
+ *      ec: connection
+ *      upto: stage index to stop at; ARCF_ENGINE_MSGSTAGE for the stages
+ *            of one message, ARCF_ENGINE_NSTAGES for all of them
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+static void
+arcf_engine_clearmacros(struct arcf_engconn *ec, size_t upto)
+{
+    for (size_t n = 0; n < upto; n++)
+    {
+        ARC_FREE(ec->ec_macros[n]);
+        ec->ec_macros[n] = NULL;
+        ec->ec_maclen[n] = 0;
+    }
+}
+
+/**
+ *  Store the macros sent for a stage.
+ *
+ *  Parameters:
+ *      ec: connection
+ *      data: packet data: the stage's command, then names and values
+ *      len: bytes at "data"
+ *
+ *  Returns:
+ *      false if the packet is malformed or memory ran out.
+ */
+
+static bool
+arcf_engine_macros(struct arcf_engconn *ec, const unsigned char *data,
+                   size_t len)
+{
+    const char *stage;
+    char       *copy;
+    size_t      n;
+
+    if (len == 0)
+    {
+        return false;
+    }
+
+    stage = memchr(arcf_engine_stages, data[0], ARCF_ENGINE_NSTAGES);
+    if (stage == NULL || data[0] == '\0')
+    {
+        /* macros for a stage nobody asks about */
+        return true;
+    }
+    n = stage - arcf_engine_stages;
+
+    if (len > 1 && data[len - 1] != '\0')
+    {
+        return false;
+    }
+
+    copy = ARC_MALLOC(len);
+    if (copy == NULL)
+    {
+        return false;
+    }
+    memcpy(copy, data + 1, len - 1);
+
+    ARC_FREE(ec->ec_macros[n]);
+    ec->ec_macros[n] = copy;
+    ec->ec_maclen[n] = len - 1;
+
+    return true;
+}
+
+/**
+ *  Split NUL-terminated strings into an argument vector.
+ *
+ *  Parameters:
+ *      data: strings
+ *      len: bytes at "data", ending with a NUL
+ *
+ *  Returns:
+ *      A NULL-terminated vector to be freed by the caller, or NULL.
+ */
+
+static char **
+arcf_engine_argv(unsigned char *data, size_t len)
+{
+    size_t n = 0;
+    char **argv;
+
+    for (size_t c = 0; c < len; c++)
+    {
+        if (data[c] == '\0')
+        {
+            n++;
+        }
+    }
+
+    argv = ARC_MALLOC((n + 1) * sizeof *argv);
+    if (argv == NULL)
+    {
+        return NULL;
+    }
+
+    n = 0;
+    for (size_t c = 0; c < len; c += strlen((char *) data + c) + 1)
+    {
+        argv[n++] = (char *) data + c;
+    }
+    argv[n] = NULL;
+
+    return argv;
+}
+
+/**
+ *  Handle option negotiation.
+ *
+ *  Parameters:
+ *      ec: connection
+ *
+ *  Returns:
+ *      false if the connection has to be dropped.
+ */
+
+static bool
+arcf_engine_optneg(struct arcf_engconn *ec)
+{
+    uint32_t      vals[3];
+    unsigned long version;
+    unsigned long f0;
+    unsigned long f1;
+    unsigned long pf0;
+    unsigned long pf1;
+    unsigned long pf2 = 0;
+    unsigned long pf3 = 0;
+
+    if (ec->ec_len < sizeof vals)
+    {
+        return false;
+    }
+    memcpy(vals, ec->ec_data, sizeof vals);
+    version = ntohl(vals[0]);
+    f0 = ntohl(vals[1]);
+    f1 = ntohl(vals[2]) & ARCF_ENGINE_PROTO;
+
+    if (version < 2)
+    {
+        return false;
+    }
+    if (version > ARCF_ENGINE_VERSION)
+    {
+        version = ARCF_ENGINE_VERSION;
+    }
+
+    pf0 = eng_desc->xxfi_flags & f0;
+    pf1 = 0;
+    if (eng_desc->xxfi_negotiate != NULL)
+    {
+        sfsistat status;
+
+        status = eng_desc->xxfi_negotiate((SMFICTX *) ec, f0, f1, 0, 0, &pf0,
+                                          &pf1, &pf2, &pf3);
+        if (status == SMFIS_ALL_OPTS)
+        {
+            pf0 = f0;
+            pf1 = f1;
+        }
+        else if (status != SMFIS_CONTINUE)
+        {
+            return false;
+        }
+    }
+
+    ec->ec_actions = pf0 & f0;
+    ec->ec_proto = pf1 & f1;
+    ec->ec_open = true;
+
+    vals[0] = htonl(version);
+    vals[1] = htonl(ec->ec_actions);
+    vals[2] = htonl(ec->ec_proto);
+
+    return arcf_engine_send(ec, SMFIC_OPTNEG, vals, sizeof vals, NULL) ==
+           MI_SUCCESS;
+}
+
+/**
+ *  Handle a new SMTP client.
+ *
+ *  Parameters:
+ *      ec: connection
+ *
+ *  Returns:
+ *      false if the packet is malformed.
+ */
+
+static bool
+arcf_engine_connect(struct arcf_engconn *ec)
+{
+    char                   *host;
+    char                   *addr;
+    unsigned char          *p;
+    unsigned char          *end;
+    uint16_t                port;
+    struct sockaddr        *sa = NULL;
+    struct sockaddr_storage ss;
+
+    p = ec->ec_data;
+    end = p + ec->ec_len;
+
+    host = (char *) p;
+    p = memchr(p, '\0', end - p);
+    if (p == NULL || ++p >= end)
+    {
+        return false;
+    }
+
+    memset(&ss, '\0', sizeof ss);
+
+    if (*p != SMFIA_UNKNOWN)
+    {
+        char family = *p++;
+
+        if (end - p < (ptrdiff_t) sizeof port + 1 || end[-1] != '\0')
+        {
+            return false;
+        }
+        memcpy(&port, p, sizeof port);
+        addr = (char *) p + sizeof port;
+
+        if (family == SMFIA_INET)
+        {
+            struct sockaddr_in *sin = (struct sockaddr_in *) &ss;
+
+            sin->sin_family = AF_INET;
+            sin->sin_port = port;
+            if (inet_pton(AF_INET, addr, &sin->sin_addr) == 1)
+            {
+                sa = (struct sockaddr *) sin;
+            }
+        }
+        else if (family == SMFIA_INET6)
+        {
+            struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *) &ss;
+
+            if (strncasecmp(addr, "IPv6:", 5) == 0)
+            {
+                addr += 5;
+            }
+
+            sin6->sin6_family = AF_INET6;
+            sin6->sin6_port = port;
+            if (inet_pton(AF_INET6, addr, &sin6->sin6_addr) == 1)
+            {
+                sa = (struct sockaddr *) sin6;
+            }
+        }
+        else if (family == SMFIA_UNIX)
+        {
+            struct sockaddr_un *sun = (struct sockaddr_un *) &ss;
+
+            sun->sun_family = AF_UNIX;
+            strncpy(sun->sun_path, addr, sizeof sun->sun_path - 1);
+            sa = (struct sockaddr *) sun;
+        }
+    }
+
+    if (eng_desc->xxfi_connect == NULL)
+    {
+        arcf_engine_status(ec, SMFIS_CONTINUE);
+    }
+    else
+    {
+        arcf_engine_status(ec, eng_desc->xxfi_connect((SMFICTX *) ec, host,
+                                                      sa));
+    }
+
+    return true;
+}
+
+/**
+ *  Run the callbacks for the packet a worker was given.
+ *
+ *  Parameters:
+ *      ec: connection
+ *
+ *  Returns:
+ *      Nothing.
+ *
+ *  Notes:
+ *      Malformed packets and failed negotiation mark the connection to
+ *      be dropped; the close callback still runs for it.
+ */
+
+static void
+arcf_engine_task(struct arcf_engconn *ec)
+{
+    bool             ok = true;
+    char           **argv;
+    struct smfiDesc *d = eng_desc;
+    SMFICTX         *ctx = (SMFICTX *) ec;
+    unsigned char   *data = ec->ec_data;
+    size_t           len = ec->ec_len;
+
+    /* string arguments have to be terminated */
+    switch (ec->ec_cmd)
+    {
+    case SMFIC_CONNECT:
+    case SMFIC_HELO:
+    case SMFIC_MAIL:
+    case SMFIC_RCPT:
+    case SMFIC_HEADER:
+    case SMFIC_UNKNOWN:
+        if (len == 0 || data[len - 1] != '\0')
+        {
+            ok = false;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    if (!ok)
+    {
+        /* fall through to dropping the connection */
+    }
+    else if (!ec->ec_open && ec->ec_cmd != SMFIC_OPTNEG &&
+             ec->ec_cmd != SMFIC_GONE && ec->ec_cmd != SMFIC_QUIT)
+    {
+        /* nothing but negotiation makes sense yet */
+        ok = false;
+    }
+    else
+    {
+        switch (ec->ec_cmd)
+        {
+        case SMFIC_OPTNEG:
+            ok = arcf_engine_optneg(ec);
+            break;
+
+        case SMFIC_CONNECT:
+            ok = arcf_engine_connect(ec);
+            break;
+
+        case SMFIC_HELO:
+            arcf_engine_status(ec, d->xxfi_helo == NULL
+                                       ? SMFIS_CONTINUE
+                                       : d->xxfi_helo(ctx, (char *) data));
+            break;
+
+        case SMFIC_MAIL:
+        case SMFIC_RCPT:
+            argv = arcf_engine_argv(data, len);
+            if (argv == NULL)
+            {
+                arcf_engine_status(ec, SMFIS_TEMPFAIL);
+            }
+            else if (ec->ec_cmd == SMFIC_MAIL)
+            {
+                arcf_engine_status(ec, d->xxfi_envfrom == NULL
+                                           ? SMFIS_CONTINUE
+                                           : d->xxfi_envfrom(ctx, argv));
+            }
+            else
+            {
+                arcf_engine_status(ec, d->xxfi_envrcpt == NULL
+                                           ? SMFIS_CONTINUE
+                                           : d->xxfi_envrcpt(ctx, argv));
+            }
+            ARC_FREE(argv);
+            break;
+
+        case SMFIC_DATA:
+            arcf_engine_status(ec, d->xxfi_data == NULL ? SMFIS_CONTINUE
+                                                        : d->xxfi_data(ctx));
+            break;
+
+        case SMFIC_HEADER:
+        {
+            char *name = (char *) data;
+            char *value = memchr(data, '\0', len);
+
+            /* name and value, both terminated */
+            if (value == (char *) data + len - 1)
+            {
+                ok = false;
+                break;
+            }
+            value++;
+            arcf_engine_status(ec, d->xxfi_header == NULL
+                                       ? SMFIS_CONTINUE
+                                       : d->xxfi_header(ctx, name, value));
+            break;
+        }
+
+        case SMFIC_EOH:
+            arcf_engine_status(ec, d->xxfi_eoh == NULL ? SMFIS_CONTINUE
+                                                       : d->xxfi_eoh(ctx));
+            break;
+
+        case SMFIC_BODY:
+            arcf_engine_status(ec, d->xxfi_body == NULL
+                                       ? SMFIS_CONTINUE
+                                       : d->xxfi_body(ctx, data, len));
+            break;
+
+        case SMFIC_BODYEOB:
+        {
+            sfsistat status = SMFIS_CONTINUE;
+
+            /* the last piece of the body can come along */
+            if (len > 0 && d->xxfi_body != NULL)
+            {
+                status = d->xxfi_body(ctx, data, len);
+            }
+
+            if (status == SMFIS_CONTINUE || status == SMFIS_SKIP)
+            {
+                ec->ec_ineom = true;
+                status = d->xxfi_eom == NULL ? SMFIS_CONTINUE
+                                             : d->xxfi_eom(ctx);
+                ec->ec_ineom = false;
+            }
+
+            /* the loop sets the connection aside; nothing is sent yet */
+            if (status == ARCF_ENGINE_AGAIN)
+            {
+                ec->ec_waiting = true;
+                break;
+            }
+
+            arcf_engine_status(ec, status);
+            arcf_engine_clearmacros(ec, ARCF_ENGINE_MSGSTAGE);
+            break;
+        }
+
+        case SMFIC_ABORT:
+            if (d->xxfi_abort != NULL)
+            {
+                (void) d->xxfi_abort(ctx);
+            }
+            ARC_FREE(ec->ec_reply);
+            ec->ec_reply = NULL;
+            arcf_engine_clearmacros(ec, ARCF_ENGINE_MSGSTAGE);
+            break;
+
+        case SMFIC_UNKNOWN:
+            arcf_engine_status(
+                ec, d->xxfi_unknown == NULL
+                        ? SMFIS_CONTINUE
+                        : d->xxfi_unknown(ctx, (const char *) data));
+            break;
+
+        case SMFIC_QUIT_NC:
+            /* another SMTP client follows on this connection */
+            if (d->xxfi_close != NULL)
+            {
+                (void) d->xxfi_close(ctx);
+            }
+            ec->ec_priv = NULL;
+            arcf_engine_clearmacros(ec, ARCF_ENGINE_NSTAGES);
+            break;
+
+        case SMFIC_QUIT:
+        case SMFIC_GONE:
+            ec->ec_done = true;
+            break;
+
+        default:
+            ok = false;
+            break;
+        }
+    }
+
+    if (!ok)
+    {
+        if (ec->ec_cmd != SMFIC_GONE && dolog)
+        {
+            syslog(LOG_NOTICE, "milter protocol error (command 0x%02x)",
+                   (unsigned char) ec->ec_cmd);
+        }
+        ec->ec_done = true;
+        ec->ec_eof = true;
+    }
+
+    if (ec->ec_done && ec->ec_open)
+    {
+        if (d->xxfi_close != NULL)
+        {
+            (void) d->xxfi_close(ctx);
+        }
+        ec->ec_open = false;
+    }
+}
+
+/**
+ *  Worker thread: run tasks until told to stop.
+ *
+ *  Parameters:
+ *      vp: unused
+ *
+ *  Returns:
+ *      NULL.
+ */
+
+static void *
+arcf_engine_worker(void *vp)
+{
+    uint64_t             one = 1;
+    struct arcf_engconn *ec;
+
+    (void) vp;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&eng_lock);
+        while (eng_tasks == NULL && !eng_stop)
+        {
+            pthread_cond_wait(&eng_cond, &eng_lock);
+        }
+        ec = eng_tasks;
+        if (ec == NULL)
+        {
+            pthread_mutex_unlock(&eng_lock);
+            break;
+        }
+        eng_tasks = ec->ec_next;
+        pthread_mutex_unlock(&eng_lock);
+
+        arcf_engine_task(ec);
+
+        pthread_mutex_lock(&eng_lock);
+        ec->ec_next = eng_done;
+        eng_done = ec;
+        pthread_mutex_unlock(&eng_lock);
+
+        (void) write(eng_wake, &one, sizeof one);
+    }
+
+    return NULL;
+}
+
+/**
+ *  Hand a connection's current packet to the workers.
+ *
+ *  Parameters:
+ *      ec: connection
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+static void
+arcf_engine_dispatch(struct arcf_engconn *ec)
+{
+    ec->ec_busy = true;
+    ec->ec_next = NULL;
+
+    pthread_mutex_lock(&eng_lock);
+    if (eng_tasks == NULL)
+    {
+        eng_tasks = ec;
+    }
+    else
+    {
+        eng_taskend->ec_next = ec;
+    }
+    eng_taskend = ec;
+    pthread_cond_signal(&eng_cond);
+    pthread_mutex_unlock(&eng_lock);
+}
+
+/**
+ *  Set aside a connection whose end of message is waiting on DNS.
+ *
+ *  Parameters:
+ *      ec: connection, back from a worker with ec_waiting set
+ *
+ *  Returns:
+ *      Nothing.
+ *
+ *  Notes:
+ *      The connection stays busy, so nothing is read from or written to
+ *      it until arcf_engine_resume().
+ */
+
+static void
+arcf_engine_suspend(struct arcf_engconn *ec)
+{
+    struct epoll_event ev;
+
+    memset(&ev, '\0', sizeof ev);
+    ev.events = EPOLLIN;
+    ev.data.ptr = ec;
+
+    for (size_t n = 0; n < ec->ec_nwait; n++)
+    {
+        (void) epoll_ctl(eng_waitep, EPOLL_CTL_ADD, ec->ec_waitfd[n], &ev);
+    }
+
+    ec->ec_waitsince = time(NULL);
+    eng_nwaiting++;
+}
+
+/**
+ *  Run a suspended end of message callback again.
+ *
+ *  Parameters:
+ *      ec: connection
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+static void
+arcf_engine_resume(struct arcf_engconn *ec)
+{
+    /* the callback closes any descriptor it's finished with */
+    for (size_t n = 0; n < ec->ec_nwait; n++)
+    {
+        (void) epoll_ctl(eng_waitep, EPOLL_CTL_DEL, ec->ec_waitfd[n], NULL);
+    }
+
+    ec->ec_nwait = 0;
+    ec->ec_waiting = false;
+    eng_nwaiting--;
+
+    /* the body that came with the command has been delivered */
+    ec->ec_len = 0;
+    arcf_engine_dispatch(ec);
+}
+
+/**
+ *  Close a connection.
+ *
+ *  Parameters:
+ *      ec: connection, with no task and no close callback owed
+ *
+ *  Returns:
+ *      Nothing.
+ *
+ *  Notes:
+ *      The memory is kept until the current epoll_wait() batch has been
+ *      handled, since later events in it may still point here.
+ */
+
+static void
+arcf_engine_drop(struct arcf_engconn *ec)
+{
+    (void) close(ec->ec_fd);
+    ec->ec_dropped = true;
+
+    if (ec->ec_prevconn == NULL)
+    {
+        eng_conns = ec->ec_nextconn;
+    }
+    else
+    {
+        ec->ec_prevconn->ec_nextconn = ec->ec_nextconn;
+    }
+    if (ec->ec_nextconn != NULL)
+    {
+        ec->ec_nextconn->ec_prevconn = ec->ec_prevconn;
+    }
+    eng_nconns--;
+
+    ec->ec_next = eng_dropped;
+    eng_dropped = ec;
+}
+
+/**
+ *  Free the connections dropped since the last call.
+ *
+ *  Parameters:
+ *      None.
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+static void
+arcf_engine_reap(void)
+{
+    while (eng_dropped != NULL)
+    {
+        struct arcf_engconn *ec = eng_dropped;
+
+        eng_dropped = ec->ec_next;
+        arcf_engine_clearmacros(ec, ARCF_ENGINE_NSTAGES);
+        ARC_FREE(ec->ec_reply);
+        ARC_FREE(ec->ec_in.eb_data);
+        ARC_FREE(ec->ec_out.eb_data);
+        ARC_FREE(ec);
+    }
+}
+
+/**
+ *  Move a connection along as far as it can go without waiting.
+ *
+ *  Parameters:
+ *      ec: connection, not busy
+ *
+ *  Returns:
+ *      Nothing.
+ *
+ *  Notes:
+ *      Output is flushed before any more input is looked at; the MTA
+ *      doesn't send the next command until it has the reply to the last.
+ */
+
+static void
+arcf_engine_run(struct arcf_engconn *ec)
+{
+    struct arcf_engbuf *in = &ec->ec_in;
+    struct arcf_engbuf *out = &ec->ec_out;
+
+    while (!ec->ec_busy)
+    {
+        ssize_t  n;
+        uint32_t nlen;
+        size_t   plen;
+
+        /* flush replies */
+        while (out->eb_off < out->eb_len && !ec->ec_eof)
+        {
+            if (!ec->ec_writable)
+            {
+                return;
+            }
+
+            n = send(ec->ec_fd, out->eb_data + out->eb_off,
+                     out->eb_len - out->eb_off, MSG_NOSIGNAL);
+            if (n > 0)
+            {
+                out->eb_off += n;
+            }
+            else if (n == -1 && errno == EAGAIN)
+            {
+                ec->ec_writable = false;
+            }
+            else if (n == -1 && errno != EINTR)
+            {
+                ec->ec_eof = true;
+            }
+        }
+        out->eb_off = out->eb_len = 0;
+
+        if (ec->ec_done)
+        {
+            arcf_engine_drop(ec);
+            return;
+        }
+
+        /* take the next complete packet */
+        if (in->eb_len - in->eb_off >= sizeof nlen)
+        {
+            memcpy(&nlen, in->eb_data + in->eb_off, sizeof nlen);
+            plen = ntohl(nlen);
+            if (plen == 0 || plen > ARCF_ENGINE_MAXPACKET)
+            {
+                ec->ec_eof = true;
+                in->eb_off = in->eb_len;
+            }
+            else if (in->eb_len - in->eb_off >= sizeof nlen + plen)
+            {
+                unsigned char *pkt = in->eb_data + in->eb_off + sizeof nlen;
+
+                in->eb_off += sizeof nlen + plen;
+
+                if (pkt[0] == SMFIC_MACRO)
+                {
+                    if (!arcf_engine_macros(ec, pkt + 1, plen - 1))
+                    {
+                        ec->ec_eof = true;
+                    }
+                    continue;
+                }
+
+                ec->ec_cmd = pkt[0];
+                ec->ec_data = pkt + 1;
+                ec->ec_len = plen - 1;
+                arcf_engine_dispatch(ec);
+                return;
+            }
+            else if (!arcf_engine_reserve(in, sizeof nlen + plen -
+                                                  (in->eb_len - in->eb_off)))
+            {
+                ec->ec_eof = true;
+            }
+        }
+
+        /* nothing more is coming; let the filter clean up */
+        if (ec->ec_eof)
+        {
+            ec->ec_cmd = SMFIC_GONE;
+            ec->ec_data = NULL;
+            ec->ec_len = 0;
+            arcf_engine_dispatch(ec);
+            return;
+        }
+
+        if (!ec->ec_readable)
+        {
+            return;
+        }
+
+        if (!arcf_engine_reserve(in, ARCF_ENGINE_READSIZE))
+        {
+            ec->ec_eof = true;
+            continue;
+        }
+
+        n = read(ec->ec_fd, in->eb_data + in->eb_len, in->eb_size - in->eb_len);
+        if (n > 0)
+        {
+            in->eb_len += n;
+        }
+        else if (n == 0)
+        {
+            ec->ec_eof = true;
+        }
+        else if (errno == EAGAIN)
+        {
+            ec->ec_readable = false;
+        }
+        else if (errno != EINTR)
+        {
+            ec->ec_eof = true;
+        }
+    }
+}
+
+/**
+ *  Accept waiting connections.
+ *
+ *  Parameters:
+ *      ep: epoll descriptor
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+static void
+arcf_engine_accept(int ep)
+{
+    for (;;)
+    {
+        int                  fd;
+        struct arcf_engconn *ec;
+        struct epoll_event   ev;
+
+        fd = accept(eng_listen, NULL, NULL);
+        if (fd == -1)
+        {
+            if (errno != EAGAIN && errno != EINTR && dolog)
+            {
+                syslog(LOG_ERR, "accept(): %s", strerror(errno));
+            }
+            return;
+        }
+        (void) fcntl(fd, F_SETFD, FD_CLOEXEC);
+        (void) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        ec = ARC_CALLOC(1, sizeof *ec);
+        if (ec == NULL)
+        {
+            if (dolog)
+            {
+                syslog(LOG_ERR, "malloc(): %s", strerror(errno));
+            }
+            (void) close(fd);
+            continue;
+        }
+        ec->ec_fd = fd;
+        ec->ec_writable = true;
+
+        memset(&ev, '\0', sizeof ev);
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = ec;
+        if (epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev) != 0)
+        {
+            if (dolog)
+            {
+                syslog(LOG_ERR, "epoll_ctl(): %s", strerror(errno));
+            }
+            (void) close(fd);
+            ARC_FREE(ec);
+            continue;
+        }
+
+        ec->ec_nextconn = eng_conns;
+        if (eng_conns != NULL)
+        {
+            eng_conns->ec_prevconn = ec;
+        }
+        eng_conns = ec;
+        eng_nconns++;
+    }
+}
+
+/**
+ *  Open the milter socket.
+ *
+ *  Parameters:
+ *      spec: socket specification, as for libmilter: "unix:path",
+ *            "local:path", "inet:port[@host]", "inet6:port[@host]" or
+ *            a bare path
+ *      backlog: listen queue length
+ *
+ *  Returns:
+ *      0 on success, or an error number.
+ */
+
+int
+arcf_engine_open(const char *spec, int backlog)
+{
+    int              fd;
+    int              on = 1;
+    int              status;
+    const char      *colon;
+    struct addrinfo  hints;
+    struct addrinfo *res;
+
+    assert(spec != NULL);
+
+    colon = strchr(spec, ':');
+    if (colon == NULL || strncasecmp(spec, "unix:", 5) == 0 ||
+        strncasecmp(spec, "local:", 6) == 0)
+    {
+        struct sockaddr_un sun;
+        const char        *path = colon == NULL ? spec : colon + 1;
+
+        memset(&sun, '\0', sizeof sun);
+        sun.sun_family = AF_UNIX;
+        if (strlen(path) >= sizeof sun.sun_path)
+        {
+            return ENAMETOOLONG;
+        }
+        strcpy(sun.sun_path, path);
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd == -1)
+        {
+            return errno;
+        }
+        if (bind(fd, (struct sockaddr *) &sun, sizeof sun) != 0 ||
+            listen(fd, backlog) != 0)
+        {
+            status = errno;
+            (void) close(fd);
+            return status;
+        }
+
+        eng_path = ARC_STRDUP(path);
+        eng_listen = fd;
+        return 0;
+    }
+    else if (strncasecmp(spec, "inet:", 5) == 0 ||
+             strncasecmp(spec, "inet6:", 6) == 0)
+    {
+        char *port;
+        char *host;
+
+        memset(&hints, '\0', sizeof hints);
+        hints.ai_family = spec[4] == '6' ? AF_INET6 : AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+
+        port = ARC_STRDUP(colon + 1);
+        if (port == NULL)
+        {
+            return ENOMEM;
+        }
+        host = strchr(port, '@');
+        if (host != NULL)
+        {
+            *host++ = '\0';
+        }
+
+        status = getaddrinfo(host, port, &hints, &res);
+        ARC_FREE(port);
+        if (status != 0)
+        {
+            return EADDRNOTAVAIL;
+        }
+
+        fd = socket(res->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                    0);
+        if (fd == -1)
+        {
+            status = errno;
+            freeaddrinfo(res);
+            return status;
+        }
+        (void) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+        if (bind(fd, res->ai_addr, res->ai_addrlen) != 0 ||
+            listen(fd, backlog) != 0)
+        {
+            status = errno;
+            freeaddrinfo(res);
+            (void) close(fd);
+            return status;
+        }
+        freeaddrinfo(res);
+
+        eng_listen = fd;
+        return 0;
+    }
+
+    return EINVAL;
+}
+
+/**
+ *  Run the event loop until a termination signal arrives.
+ *
+ *  Parameters:
+ *      desc: filter callbacks, as given to smfi_register()
+ *      workers: number of worker threads; 0 means one per CPU
+ *
+ *  Returns:
+ *      MI_SUCCESS or MI_FAILURE.
+ *
+ *  Notes:
+ *      SIGHUP, SIGINT and SIGTERM must already be blocked in all threads;
+ *      they're taken through a signalfd.  Once one arrives, no new
+ *      connections are accepted, idle ones are closed, and the loop
+ *      returns when the rest have finished their current command.
+ */
+
+int
+arcf_engine_main(struct smfiDesc *desc, unsigned int workers)
+{
+    int                ep;
+    int                sfd;
+    int                status = MI_SUCCESS;
+    bool               stopping = false;
+    unsigned int       nthreads = 0;
+    pthread_t         *threads;
+    sigset_t           mask;
+    struct epoll_event ev;
+    struct epoll_event events[ARCF_ENGINE_EVENTS];
+
+    assert(desc != NULL);
+
+    if (eng_listen == -1)
+    {
+        return MI_FAILURE;
+    }
+
+    eng_desc = desc;
+
+    if (workers == 0)
+    {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+        workers = ncpu > 0 ? (unsigned int) ncpu : 1;
+    }
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+
+    ep = epoll_create1(EPOLL_CLOEXEC);
+    sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    eng_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    eng_waitep = epoll_create1(EPOLL_CLOEXEC);
+    threads = ARC_CALLOC(workers, sizeof *threads);
+    if (ep == -1 || sfd == -1 || eng_wake == -1 || eng_waitep == -1 ||
+        threads == NULL)
+    {
+        if (dolog)
+        {
+            syslog(LOG_ERR, "event engine setup: %s", strerror(errno));
+        }
+        status = MI_FAILURE;
+        goto done;
+    }
+
+    memset(&ev, '\0', sizeof ev);
+    ev.events = EPOLLIN;
+    ev.data.ptr = &eng_listen;
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, eng_listen, &ev) != 0)
+    {
+        status = MI_FAILURE;
+        goto done;
+    }
+    ev.data.ptr = &sfd;
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, sfd, &ev) != 0)
+    {
+        status = MI_FAILURE;
+        goto done;
+    }
+    ev.data.ptr = &eng_wake;
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, eng_wake, &ev) != 0)
+    {
+        status = MI_FAILURE;
+        goto done;
+    }
+    ev.data.ptr = &eng_waitep;
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, eng_waitep, &ev) != 0)
+    {
+        status = MI_FAILURE;
+        goto done;
+    }
+
+    for (; nthreads < workers; nthreads++)
+    {
+        int error;
+
+        error = pthread_create(&threads[nthreads], NULL, arcf_engine_worker,
+                               NULL);
+        if (error != 0)
+        {
+            if (dolog)
+            {
+                syslog(LOG_ERR, "pthread_create(): %s", strerror(error));
+            }
+            status = MI_FAILURE;
+            goto done;
+        }
+    }
+
+    if (dolog)
+    {
+        syslog(LOG_INFO, "event engine running with %u workers", workers);
+    }
+
+    while (!stopping || eng_nconns > 0)
+    {
+        int n;
+
+        n = epoll_wait(ep, events, ARCF_ENGINE_EVENTS,
+                       eng_nwaiting > 0 ? ARCF_ENGINE_TICKMS : -1);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (dolog)
+            {
+                syslog(LOG_ERR, "epoll_wait(): %s", strerror(errno));
+            }
+            status = MI_FAILURE;
+            break;
+        }
+
+        for (int c = 0; c < n; c++)
+        {
+            void *ptr = events[c].data.ptr;
+
+            if (ptr == &eng_listen)
+            {
+                arcf_engine_accept(ep);
+            }
+            else if (ptr == &sfd)
+            {
+                struct signalfd_siginfo si;
+
+                while (read(sfd, &si, sizeof si) == sizeof si)
+                {
+                    stopping = true;
+                }
+                if (stopping && eng_listen != -1)
+                {
+                    (void) epoll_ctl(ep, EPOLL_CTL_DEL, eng_listen, NULL);
+                    (void) close(eng_listen);
+                    eng_listen = -1;
+
+                    /* idle connections go now, busy ones when done */
+                    for (struct arcf_engconn *ec = eng_conns, *next;
+                         ec != NULL; ec = next)
+                    {
+                        next = ec->ec_nextconn;
+                        ec->ec_eof = true;
+                        if (!ec->ec_busy)
+                        {
+                            arcf_engine_run(ec);
+                        }
+                    }
+                }
+            }
+            else if (ptr == &eng_wake)
+            {
+                uint64_t             count;
+                struct arcf_engconn *ec;
+                struct arcf_engconn *next;
+
+                (void) read(eng_wake, &count, sizeof count);
+
+                pthread_mutex_lock(&eng_lock);
+                ec = eng_done;
+                eng_done = NULL;
+                pthread_mutex_unlock(&eng_lock);
+
+                for (; ec != NULL; ec = next)
+                {
+                    next = ec->ec_next;
+                    if (ec->ec_waiting)
+                    {
+                        arcf_engine_suspend(ec);
+                        continue;
+                    }
+                    ec->ec_busy = false;
+                    if (stopping)
+                    {
+                        ec->ec_eof = true;
+                    }
+                    arcf_engine_run(ec);
+                }
+            }
+            else if (ptr == &eng_waitep)
+            {
+                int                nw;
+                struct epoll_event wev[ARCF_ENGINE_EVENTS];
+
+                nw = epoll_wait(eng_waitep, wev, ARCF_ENGINE_EVENTS, 0);
+                for (int w = 0; w < nw; w++)
+                {
+                    struct arcf_engconn *ec = wev[w].data.ptr;
+
+                    /* another of its sockets may have resumed it already */
+                    if (ec->ec_waiting)
+                    {
+                        arcf_engine_resume(ec);
+                    }
+                }
+            }
+            else
+            {
+                struct arcf_engconn *ec = ptr;
+
+                if (ec->ec_dropped)
+                {
+                    continue;
+                }
+                if (events[c].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP |
+                                        EPOLLERR))
+                {
+                    ec->ec_readable = true;
+                }
+                if (events[c].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+                {
+                    ec->ec_writable = true;
+                }
+                if (!ec->ec_busy)
+                {
+                    arcf_engine_run(ec);
+                }
+            }
+        }
+
+        /* give lookups that haven't been heard from a chance to retry */
+        if (eng_nwaiting > 0)
+        {
+            time_t now = time(NULL);
+
+            for (struct arcf_engconn *ec = eng_conns; ec != NULL;
+                 ec = ec->ec_nextconn)
+            {
+                if (ec->ec_waiting &&
+                    (now - ec->ec_waitsince) * 1000 >= ARCF_ENGINE_TICKMS)
+                {
+                    arcf_engine_resume(ec);
+                }
+            }
+        }
+
+        arcf_engine_reap();
+    }
+
+done:
+    pthread_mutex_lock(&eng_lock);
+    eng_stop = true;
+    pthread_cond_broadcast(&eng_cond);
+    pthread_mutex_unlock(&eng_lock);
+
+    while (nthreads > 0)
+    {
+        (void) pthread_join(threads[--nthreads], NULL);
+    }
+    ARC_FREE(threads);
+
+    if (eng_listen != -1)
+    {
+        (void) close(eng_listen);
+        eng_listen = -1;
+    }
+    if (eng_path != NULL)
+    {
+        (void) unlink(eng_path);
+        ARC_FREE(eng_path);
+        eng_path = NULL;
+    }
+    if (eng_wake != -1)
+    {
+        (void) close(eng_wake);
+    }
+    if (eng_waitep != -1)
+    {
+        (void) close(eng_waitep);
+    }
+    if (sfd != -1)
+    {
+        (void) close(sfd);
+    }
+    if (ep != -1)
+    {
+        (void) close(ep);
+    }
+
+    return status;
+}
+
+/**
+ *  Get the private pointer of a connection.
+ *
+ *  Parameters:
+ *      ctx: connection
+ *
+ *  Returns:
+ *      The pointer last stored.
+ */
+
+void *
+arcf_engine_getpriv(void *ctx)
+{
+    return ((struct arcf_engconn *) ctx)->ec_priv;
+}
+
+/**
+ *  Set the private pointer of a connection.
+ *
+ *  Parameters:
+ *      ctx: connection
+ *      ptr: pointer to store
+ *
+ *  Returns:
+ *      MI_SUCCESS.
+ */
+
+int
+arcf_engine_setpriv(void *ctx, void *ptr)
+{
+    ((struct arcf_engconn *) ctx)->ec_priv = ptr;
+
+    return MI_SUCCESS;
+}
+
+/**
+ *  Look up a macro sent by the MTA.
+ *
+ *  Parameters:
+ *      ctx: connection
+ *      sym: macro name, with or without braces
+ *
+ *  Returns:
+ *      Its value from the latest stage that has it, or NULL.
+ */
+
+char *
+arcf_engine_getsymval(void *ctx, char *sym)
+{
+    size_t               symlen;
+    struct arcf_engconn *ec = ctx;
+
+    assert(sym != NULL);
+
+    /* compare without braces */
+    if (sym[0] == '{')
+    {
+        sym++;
+    }
+    symlen = strcspn(sym, "}");
+
+    for (size_t n = 0; n < ARCF_ENGINE_NSTAGES; n++)
+    {
+        char *p = ec->ec_macros[n];
+        char *end = p + ec->ec_maclen[n];
+
+        while (p != NULL && p < end)
+        {
+            char  *name = p;
+            char  *value = name + strlen(name) + 1;
+            size_t namelen;
+
+            if (value >= end)
+            {
+                break;
+            }
+            p = value + strlen(value) + 1;
+
+            if (name[0] == '{')
+            {
+                name++;
+            }
+            namelen = strcspn(name, "}");
+            if (namelen == symlen && strncmp(name, sym, symlen) == 0)
+            {
+                return value;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ *  Set the SMTP reply for a rejection or temporary failure.
+ *
+ *  Parameters:
+ *      ctx: connection
+ *      rcode: SMTP reply code (4xx or 5xx)
+ *      xcode: enhanced status code, or NULL
+ *      replytxt: text, or NULL
+ *
+ *  Returns:
+ *      MI_SUCCESS or MI_FAILURE.
+ */
+
+int
+arcf_engine_setreply(void *ctx, char *rcode, char *xcode, char *replytxt)
+{
+    size_t               len;
+    char                *reply;
+    struct arcf_engconn *ec = ctx;
+
+    if (rcode == NULL || strlen(rcode) != 3 ||
+        (rcode[0] != '4' && rcode[0] != '5'))
+    {
+        return MI_FAILURE;
+    }
+
+    len = strlen(rcode) + 3;
+    len += xcode == NULL ? 0 : strlen(xcode);
+    len += replytxt == NULL ? 0 : strlen(replytxt);
+    reply = ARC_MALLOC(len);
+    if (reply == NULL)
+    {
+        return MI_FAILURE;
+    }
+    snprintf(reply, len, "%s %s%s%s", rcode, xcode == NULL ? "" : xcode,
+             xcode == NULL ? "" : " ", replytxt == NULL ? "" : replytxt);
+
+    ARC_FREE(ec->ec_reply);
+    ec->ec_reply = reply;
+
+    return MI_SUCCESS;
+}
+
+/**
+ *  Name a descriptor a suspended end of message callback waits on.
+ *
+ *  Parameters:
+ *      ctx: connection
+ *      fd: descriptor that becomes readable when there's news
+ *
+ *  Returns:
+ *      MI_SUCCESS, or MI_FAILURE if the connection already has
+ *      ARCF_ENGINE_MAXWAIT of them; it is still woken every
+ *      ARCF_ENGINE_TICKMS.
+ */
+
+int
+arcf_engine_waitfd(void *ctx, int fd)
+{
+    struct arcf_engconn *ec = ctx;
+
+    if (!ec->ec_ineom || fd < 0 || ec->ec_nwait == ARCF_ENGINE_MAXWAIT)
+    {
+        return MI_FAILURE;
+    }
+
+    ec->ec_waitfd[ec->ec_nwait++] = fd;
+
+    return MI_SUCCESS;
+}
+
+/**
+ *  Queue a header or envelope change.
+ *
+ *  Parameters:
+ *      ec: connection
+ *      action: SMFIF_* flag that had to be negotiated
+ *      cmd: reply code
+ *      idx: index to send first, or -1 for none
+ *      a: first string
+ *      b: second string, or NULL
+ *
+ *  Returns:
+ *      MI_SUCCESS or MI_FAILURE.
+ */
+
+static int
+arcf_engine_modify(struct arcf_engconn *ec,
+                   unsigned long        action,
+                   char                 cmd,
+                   int                  idx,
+                   const char          *a,
+                   const char          *b)
+{
+    uint32_t nidx = htonl((uint32_t) idx);
+
+    if (!ec->ec_ineom || (ec->ec_actions & action) == 0 || a == NULL)
+    {
+        return MI_FAILURE;
+    }
+
+    if (b == NULL)
+    {
+        b = "";
+    }
+
+    if (idx < 0)
+    {
+        return arcf_engine_send(ec, cmd, a, strlen(a) + 1, b,
+                                cmd == SMFIR_ADDHEADER ? strlen(b) + 1 : 0,
+                                NULL);
+    }
+
+    return arcf_engine_send(ec, cmd, &nidx, sizeof nidx, a, strlen(a) + 1, b,
+                            strlen(b) + 1, NULL);
+}
+
+/**
+ *  Add a header field at the end.
+ *
+ *  Parameters:
+ *      ctx: connection
+ *      hname: field name
+ *      hvalue: field value
+ *
+ *  Returns:
+ *      MI_SUCCESS or MI_FAILURE.
+ */
+
+int
+arcf_engine_addheader(void *ctx, char *hname, char *hvalue)
+{
+    if (hvalue == NULL)
+    {
+        return MI_FAILURE;
+    }
+
+    return arcf_engine_modify(ctx, SMFIF_ADDHDRS, SMFIR_ADDHEADER, -1, hname,
+                              hvalue);
+}
+
+/**
+ *  Insert a header field.
+ *
+ *  Parameters:
+ *      ctx: connection
+ *      idx: position
+ *      hname: field name
+ *      hvalue: field value
+ *
+ *  Returns:
+ *      MI_SUCCESS or MI_FAILURE.
+ */
+
+int
+arcf_engine_insheader(void *ctx, int idx, char *hname, char *hvalue)
+{
+    if (hvalue == NULL)
+    {
+        return MI_FAILURE;
+    }
+
+    return arcf_engine_modify(ctx, SMFIF_ADDHDRS, SMFIR_INSHEADER,
+                              idx < 0 ? 0 : idx, hname, hvalue);
+}
+
+/**
+ *  Change or delete a header field.
+ *
+ *  Parameters:
+ *      ctx: connection
+ *      hname: field name
+ *      idx: which instance (1 = first)
+ *      hvalue: new value, or NULL to delete it
+ *
+ *  Returns:
+ *      MI_SUCCESS or MI_FAILURE.
+ */
+
+int
+arcf_engine_chgheader(void *ctx, char *hname, int idx, char *hvalue)
+{
+    return arcf_engine_modify(ctx, SMFIF_CHGHDRS, SMFIR_CHGHEADER,
+                              idx < 0 ? 0 : idx, hname, hvalue);
+}
+
+/**
+ *  Add a recipient.
+ *
+ *  Parameters:
+ *      ctx: connection
+ *      addr: address
+ *
+ *  Returns:
+ *      MI_SUCCESS or MI_FAILURE.
+ */
+
+int
+arcf_engine_addrcpt(void *ctx, char *addr)
+{
+    return arcf_engine_modify(ctx, SMFIF_ADDRCPT, SMFIR_ADDRCPT, -1, addr,
+                              NULL);
+}
+
+/**
+ *  Remove a recipient.
+ *
+ *  Parameters:
+ *      ctx: connection
+ *      addr: address
+ *
+ *  Returns:
+ *      MI_SUCCESS or MI_FAILURE.
+ */
+
+int
+arcf_engine_delrcpt(void *ctx, char *addr)
+{
+    return arcf_engine_modify(ctx, SMFIF_DELRCPT, SMFIR_DELRCPT, -1, addr,
+                              NULL);
+}
+
+#else /* HAVE_SYS_EPOLL_H */
+
+/*
+**  Without epoll there is no event engine; the configuration code refuses
+**  to select it, so the rest of these are never called.
+*/
+
+bool
+arcf_engine_available(void)
+{
+    return false;
+}
+
+int
+arcf_engine_open(const char *spec, int backlog)
+{
+    return ENOSYS;
+}
+
+int
+arcf_engine_main(struct smfiDesc *desc, unsigned int workers)
+{
+    return MI_FAILURE;
+}
+
+int
+arcf_engine_addheader(void *ctx, char *hname, char *hvalue)
+{
+    return MI_FAILURE;
+}
+
+int
+arcf_engine_addrcpt(void *ctx, char *addr)
+{
+    return MI_FAILURE;
+}
+
+int
+arcf_engine_chgheader(void *ctx, char *hname, int idx, char *hvalue)
+{
+    return MI_FAILURE;
+}
+
+int
+arcf_engine_delrcpt(void *ctx, char *addr)
+{
+    return MI_FAILURE;
+}
+
+void *
+arcf_engine_getpriv(void *ctx)
+{
+    return NULL;
+}
+
+char *
+arcf_engine_getsymval(void *ctx, char *sym)
+{
+    return NULL;
+}
+
+int
+arcf_engine_insheader(void *ctx, int idx, char *hname, char *hvalue)
+{
+    return MI_FAILURE;
+}
+
+int
+arcf_engine_setpriv(void *ctx, void *ptr)
+{
+    return MI_FAILURE;
+}
+
+int
+arcf_engine_setreply(void *ctx, char *rcode, char *xcode, char *replytxt)
+{
+    return MI_FAILURE;
+}
+
+int
+arcf_engine_waitfd(void *ctx, int fd)
+{
+    return MI_FAILURE;
+}
+
+#endif /* HAVE_SYS_EPOLL_H */
@@ -0,0 +1,38 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#ifndef OPENARC_ENGINE_H
+#define OPENARC_ENGINE_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* libmilter includes */
+#include <libmilter/mfapi.h>
+
+/* largest milter packet accepted, including the command byte */
+#define ARCF_ENGINE_MAXPACKET (1024 * 1024)
+
+/* descriptors one connection can wait on with arcf_engine_waitfd() */
+#define ARCF_ENGINE_MAXWAIT   16
+
+/* xxfi_eom() result: call again once a descriptor it gave is readable */
+#define ARCF_ENGINE_AGAIN     0x100
+
+extern bool  arcf_engine_available(void);
+extern int   arcf_engine_open(const char *, int);
+extern int   arcf_engine_main(struct smfiDesc *, unsigned int);
+
+extern int   arcf_engine_addheader(void *, char *, char *);
+extern int   arcf_engine_addrcpt(void *, char *);
+extern int   arcf_engine_chgheader(void *, char *, int, char *);
+extern int   arcf_engine_delrcpt(void *, char *);
+extern void *arcf_engine_getpriv(void *);
+extern char *arcf_engine_getsymval(void *, char *);
+extern int   arcf_engine_insheader(void *, int, char *, char *);
+extern int   arcf_engine_setpriv(void *, void *);
+extern int   arcf_engine_setreply(void *, char *, char *, char *);
+extern int   arcf_engine_waitfd(void *, int);
+
+#endif /* OPENARC_ENGINE_H */
@@ -0,0 +1,329 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#include "build-config.h"
+
+/* system includes */
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+/* openarc includes */
+#include "arc-malloc.h"
+#include "openarc-hdrq.h"
+
+/* initial name slots; always a power of two, at most half full */
+#define ARCF_HDRQ_MIN   32
+
+/* FNV-1a */
+#define ARCF_HASH_BASIS 2166136261U
+#define ARCF_HASH_PRIME 16777619U
+
+/**
+ *  Hash a field name without regard to case.
+ *
+ *  Parameters:
+ *      name: field name
+ *
+ *  Returns:
+ *      The hash.
+ */
+
+static uint32_t
+arcf_hdrq_hash(const char *name)
+{
+    uint32_t hash = ARCF_HASH_BASIS;
+
+    for (const unsigned char *p = (const unsigned char *) name; *p != '\0';
+         p++)
+    {
+        unsigned char c = *p;
+
+        if (c >= 'A' && c <= 'Z')
+        {
+            c += 'a' - 'A';
+        }
+        hash = (hash ^ c) * ARCF_HASH_PRIME;
+    }
+
+    return hash;
+}
+
+/**
+ *  Find a field name's slot.
+ *
+ *  Parameters:
+ *      hq: header queue, with a table
+ *      name: field name
+ *      hash: its hash
+ *
+ *  Returns:
+ *      The name's slot, or the free slot where it belongs.
+ */
+
+static struct arcf_hdrname *
+arcf_hdrq_slot(struct arcf_hdrq *hq, const char *name, uint32_t hash)
+{
+    size_t               mask = hq->hq_size - 1;
+    struct arcf_hdrname *hn;
+
+    for (size_t n = hash & mask;; n = (n + 1) & mask)
+    {
+        hn = &hq->hq_names[n];
+        if (hn->hn_first == NULL ||
+            (hn->hn_hash == hash &&
+             strcasecmp(hn->hn_first->hdr_hdr, name) == 0))
+        {
+            return hn;
+        }
+    }
+}
+
+/**
+ *  Make sure there's room for one more name.
+ *
+ *  Parameters:
+ *      hq: header queue
+ *
+ *  Returns:
+ *      false on allocation failure.
+ */
+
+static bool
+arcf_hdrq_reserve(struct arcf_hdrq *hq)
+{
+    size_t               oldsize = hq->hq_size;
+    size_t               newsize;
+    struct arcf_hdrname *old = hq->hq_names;
+    struct arcf_hdrname *new;
+
+    if ((hq->hq_nnames + 1) * 2 <= oldsize)
+    {
+        return true;
+    }
+
+    newsize = oldsize == 0 ? ARCF_HDRQ_MIN : oldsize * 2;
+    new = ARC_CALLOC(newsize, sizeof *new);
+    if (new == NULL)
+    {
+        return false;
+    }
+
+    hq->hq_names = new;
+    hq->hq_size = newsize;
+
+    for (size_t n = 0; n < oldsize; n++)
+    {
+        if (old[n].hn_first != NULL)
+        {
+            *arcf_hdrq_slot(hq, old[n].hn_first->hdr_hdr, old[n].hn_hash) =
+                old[n];
+        }
+    }
+
+    ARC_FREE(old);
+
+    return true;
+}
+
+/**
+ *  Append a header field.
+ *
+ *  Parameters:
+ *      hq: header queue
+ *      hdr: field to append, with its name and value set
+ *
+ *  Returns:
+ *      false on allocation failure, in which case "hdr" isn't added.
+ */
+
+bool
+arcf_hdrq_add(struct arcf_hdrq *hq, Header hdr)
+{
+    uint32_t             hash;
+    struct arcf_hdrname *hn;
+
+    assert(hq != NULL);
+    assert(hdr != NULL);
+
+    if (!arcf_hdrq_reserve(hq))
+    {
+        return false;
+    }
+
+    hash = arcf_hdrq_hash(hdr->hdr_hdr);
+    hn = arcf_hdrq_slot(hq, hdr->hdr_hdr, hash);
+
+    hdr->hdr_next = NULL;
+    hdr->hdr_prev = hq->hq_tail;
+    hdr->hdr_nextname = NULL;
+    hdr->hdr_prevname = hn->hn_last;
+
+    if (hn->hn_first == NULL)
+    {
+        hn->hn_hash = hash;
+        hn->hn_first = hdr;
+        hq->hq_nnames++;
+    }
+    else
+    {
+        hn->hn_last->hdr_nextname = hdr;
+    }
+    hn->hn_last = hdr;
+    hn->hn_count++;
+
+    if (hq->hq_head == NULL)
+    {
+        hq->hq_head = hdr;
+    }
+    else
+    {
+        hq->hq_tail->hdr_next = hdr;
+    }
+    hq->hq_tail = hdr;
+
+    return true;
+}
+
+/**
+ *  Find an instance of a header field.
+ *
+ *  Parameters:
+ *      hq: header queue
+ *      name: name of the field of interest
+ *      instance: which instance is wanted (0 = first)
+ *
+ *  Returns:
+ *      The field, or NULL if not found.
+ *
+ *  Notes:
+ *      Negative values of "instance" search backwards from the end.  Only
+ *      fields with the same name are stepped over, so finding the first or
+ *      last instance doesn't depend on the size of the header.
+ */
+
+Header
+arcf_hdrq_find(struct arcf_hdrq *hq, const char *name, int instance)
+{
+    Header               hdr;
+    struct arcf_hdrname *hn;
+
+    assert(hq != NULL);
+    assert(name != NULL);
+
+    if (hq->hq_nnames == 0)
+    {
+        return NULL;
+    }
+
+    hn = arcf_hdrq_slot(hq, name, arcf_hdrq_hash(name));
+
+    if (instance < 0)
+    {
+        for (hdr = hn->hn_last; hdr != NULL && instance < -1; instance++)
+        {
+            hdr = hdr->hdr_prevname;
+        }
+    }
+    else
+    {
+        for (hdr = hn->hn_first; hdr != NULL && instance > 0; instance--)
+        {
+            hdr = hdr->hdr_nextname;
+        }
+    }
+
+    return hdr;
+}
+
+/**
+ *  Count the instances of a header field.
+ *
+ *  Parameters:
+ *      hq: header queue
+ *      name: name of the field of interest
+ *
+ *  Returns:
+ *      How many fields have that name.
+ */
+
+size_t
+arcf_hdrq_count(struct arcf_hdrq *hq, const char *name)
+{
+    assert(hq != NULL);
+    assert(name != NULL);
+
+    if (hq->hq_nnames == 0)
+    {
+        return 0;
+    }
+
+    return arcf_hdrq_slot(hq, name, arcf_hdrq_hash(name))->hn_count;
+}
+
+/**
+ *  Empty a header queue, keeping its index for the next message.
+ *
+ *  Parameters:
+ *      hq: header queue
+ *
+ *  Returns:
+ *      The fields that were in the queue, in order and linked through
+ *      hdr_next, for the caller to reuse or free.
+ */
+
+Header
+arcf_hdrq_reset(struct arcf_hdrq *hq)
+{
+    Header hdr;
+
+    assert(hq != NULL);
+
+    hdr = hq->hq_head;
+
+    if (hq->hq_nnames > 0)
+    {
+        memset(hq->hq_names, '\0', hq->hq_size * sizeof hq->hq_names[0]);
+    }
+    hq->hq_head = NULL;
+    hq->hq_tail = NULL;
+    hq->hq_nnames = 0;
+
+    return hdr;
+}
+
+/**
+ *  Free a header queue's fields and index.
+ *
+ *  Parameters:
+ *      hq: header queue
+ *
+ *  Returns:
+ *      Nothing.
+ *
+ *  Notes:
+ *      "hq" is left empty and can be used again.
+ */
+
+void
+arcf_hdrq_free(struct arcf_hdrq *hq)
+{
+    Header hdr;
+    Header next;
+
+    assert(hq != NULL);
+
+    for (hdr = hq->hq_head; hdr != NULL; hdr = next)
+    {
+        next = hdr->hdr_next;
+        ARC_FREE(hdr->hdr_hdr);
+        ARC_FREE(hdr);
+    }
+
+    ARC_FREE(hq->hq_names);
+    memset(hq, '\0', sizeof *hq);
+}
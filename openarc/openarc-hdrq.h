@@ -0,0 +1,40 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#ifndef OPENARC_HDRQ_H
+#define OPENARC_HDRQ_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* openarc includes */
+#include "openarc.h"
+
+/* struct arcf_hdrname -- one field name and where its instances are */
+struct arcf_hdrname
+{
+    uint32_t hn_hash;
+    size_t   hn_count;
+    Header   hn_first; /* NULL if the slot is free */
+    Header   hn_last;
+};
+
+/* struct arcf_hdrq -- a message's header fields, indexed by name */
+struct arcf_hdrq
+{
+    Header               hq_head;
+    Header               hq_tail;
+    size_t               hq_nnames;
+    size_t               hq_size; /* slots at hq_names, a power of two */
+    struct arcf_hdrname *hq_names;
+};
+
+extern bool   arcf_hdrq_add(struct arcf_hdrq *, Header);
+extern Header arcf_hdrq_find(struct arcf_hdrq *, const char *, int);
+extern size_t arcf_hdrq_count(struct arcf_hdrq *, const char *);
+extern Header arcf_hdrq_reset(struct arcf_hdrq *);
+extern void   arcf_hdrq_free(struct arcf_hdrq *);
+
+#endif /* OPENARC_HDRQ_H */
@@ -0,0 +1,1088 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#include "build-config.h"
+
+/* system includes */
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+/* openarc includes */
+#include "arc-arena.h"
+#include "arc-malloc.h"
+#include "openarc-peerlist.h"
+#include "openarc.h"
+#include "util.h"
+
+/* no entry ends at this node */
+#define ARCF_IPRANK_NONE    0xff
+
+/* first chunk of the arena holding names and trie nodes */
+#define ARCF_PEERLIST_ARENA 16384
+
+/* initial host table slots; always a power of two, at most half full */
+#define ARCF_HOSTS_MIN      64
+
+/* most names a host table can hold, so that slots fit in 32 bits */
+#define ARCF_HOSTS_MAX      (UINT32_MAX / 4)
+
+/* kinds of host entry seen for a name */
+#define ARCF_HOST_NEG       0x01
+#define ARCF_HOST_POS       0x02
+
+/* FNV-1a */
+#define ARCF_HASH_BASIS     2166136261U
+#define ARCF_HASH_PRIME     16777619U
+
+/*
+**  Entries for the same prefix used to be tried in this order, and the
+**  first one that matched decided: the bare address, then in brackets, then
+**  with a prefix length, then in brackets with a prefix length, each
+**  negated form just before the plain one.  The rank records where an entry
+**  fell in that order; even ranks are negations.
+*/
+
+#define ARCF_IPFORM_BRACKET 2
+#define ARCF_IPFORM_PREFIX  4
+
+/* struct arcf_ipnode -- a node in a path-compressed binary trie */
+struct arcf_ipnode
+{
+    unsigned char       in_addr[16]; /* prefix, zero past in_plen */
+    unsigned char       in_plen;     /* prefix length in bits */
+    unsigned char       in_rank;     /* best entry for this prefix */
+    struct arcf_ipnode *in_child[2];
+};
+
+/* struct arcf_ipentry -- an address entry waiting to go into a trie; the
+ * address is kept as two big-endian words so that sorting is cheap */
+struct arcf_ipentry
+{
+    uint64_t      ie_key[2];
+    unsigned char ie_plen;
+    unsigned char ie_rank;
+    bool          ie_v6;
+};
+
+/* struct arcf_hostent -- a name in the host table, stored in lowercase;
+ * the table's slots hold indexes into an array of these, so that it stays
+ * small enough to cache while a big list is loaded */
+struct arcf_hostent
+{
+    const char   *he_name;
+    uint32_t      he_len;
+    uint32_t      he_hash;
+    unsigned char he_flags;
+};
+
+/* struct arcf_peerlist -- addresses by prefix, names by hashed suffix */
+struct arcf_peerlist
+{
+    size_t               pl_count;
+    size_t               pl_nhosts;
+    size_t               pl_hostalloc;
+    size_t               pl_nslots;
+    uint32_t            *pl_slots;
+    struct arcf_hostent *pl_hosts;
+    struct arcf_ipnode  *pl_v4;
+    struct arcf_ipnode  *pl_v6;
+    struct arc_arena    *pl_arena;
+};
+
+/**
+ *  Get one bit of an address.
+ *
+ *  Parameters:
+ *      addr: address, most significant byte first
+ *      bit: bit number, counting from the most significant
+ *
+ *  Returns:
+ *      0 or 1.
+ */
+
+static inline int
+arcf_ip_bit(const unsigned char *addr, unsigned int bit)
+{
+    return (addr[bit / 8] >> (7 - (bit % 8))) & 1;
+}
+
+/**
+ *  Count the leading bits two addresses have in common.
+ *
+ *  Parameters:
+ *      a: first address
+ *      b: second address
+ *      max: most bits to compare
+ *
+ *  Returns:
+ *      Number of equal leading bits, at most "max".
+ */
+
+static unsigned int
+arcf_ip_common(const unsigned char *a, const unsigned char *b, unsigned int max)
+{
+    unsigned int  n;
+    unsigned char x;
+
+    for (n = 0; n < max && a[n / 8] == b[n / 8]; n += 8)
+    {
+        continue;
+    }
+
+    if (n >= max)
+    {
+        return max;
+    }
+
+    for (x = a[n / 8] ^ b[n / 8]; (x & 0x80) == 0; x <<= 1)
+    {
+        n++;
+    }
+
+    return n < max ? n : max;
+}
+
+/**
+ *  Make a trie node.
+ *
+ *  Parameters:
+ *      arena: where to allocate it
+ *      addr: address
+ *      plen: prefix length
+ *      rank: entry rank, or ARCF_IPRANK_NONE
+ *
+ *  Returns:
+ *      The node, with "addr" cleared past "plen", or NULL.
+ */
+
+static struct arcf_ipnode *
+arcf_ip_node(struct arc_arena    *arena,
+             const unsigned char *addr,
+             unsigned int         plen,
+             unsigned char        rank)
+{
+    struct arcf_ipnode *node;
+
+    node = ARC_ACALLOC(arena, 1, sizeof *node);
+    if (node == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(node->in_addr, addr, (plen + 7) / 8);
+    if (plen % 8 != 0)
+    {
+        node->in_addr[plen / 8] &= 0xff << (8 - (plen % 8));
+    }
+    node->in_plen = plen;
+    node->in_rank = rank;
+
+    return node;
+}
+
+/**
+ *  Add a prefix to a trie.
+ *
+ *  Parameters:
+ *      arena: where to allocate nodes
+ *      root: trie
+ *      addr: address
+ *      plen: prefix length
+ *      rank: entry rank
+ *
+ *  Returns:
+ *      false if memory ran out.
+ */
+
+static bool
+arcf_ip_insert(struct arc_arena    *arena,
+               struct arcf_ipnode **root,
+               const unsigned char *addr,
+               unsigned int         plen,
+               unsigned char        rank)
+{
+    unsigned int         common;
+    struct arcf_ipnode  *node;
+    struct arcf_ipnode  *leaf;
+    struct arcf_ipnode  *branch;
+    struct arcf_ipnode **pp = root;
+
+    while ((node = *pp) != NULL)
+    {
+        common = arcf_ip_common(node->in_addr, addr,
+                                node->in_plen < plen ? node->in_plen : plen);
+
+        if (common < node->in_plen)
+        {
+            leaf = arcf_ip_node(arena, addr, plen, rank);
+            if (leaf == NULL)
+            {
+                return false;
+            }
+
+            if (common == plen)
+            {
+                /* the new prefix contains this node */
+                leaf->in_child[arcf_ip_bit(node->in_addr, plen)] = node;
+                *pp = leaf;
+                return true;
+            }
+
+            /* the two part ways at "common" */
+            branch = arcf_ip_node(arena, addr, common, ARCF_IPRANK_NONE);
+            if (branch == NULL)
+            {
+                return false;
+            }
+            branch->in_child[arcf_ip_bit(addr, common)] = leaf;
+            branch->in_child[arcf_ip_bit(node->in_addr, common)] = node;
+            *pp = branch;
+            return true;
+        }
+
+        if (node->in_plen == plen)
+        {
+            if (rank < node->in_rank)
+            {
+                node->in_rank = rank;
+            }
+            return true;
+        }
+
+        pp = &node->in_child[arcf_ip_bit(addr, node->in_plen)];
+    }
+
+    *pp = arcf_ip_node(arena, addr, plen, rank);
+    return *pp != NULL;
+}
+
+/**
+ *  Find the most specific entry covering an address.
+ *
+ *  Parameters:
+ *      node: trie
+ *      addr: address
+ *      bits: address length in bits
+ *
+ *  Returns:
+ *      The entry's rank, or ARCF_IPRANK_NONE.
+ */
+
+static unsigned char
+arcf_ip_lookup(const struct arcf_ipnode *node,
+               const unsigned char      *addr,
+               unsigned int              bits)
+{
+    unsigned char rank = ARCF_IPRANK_NONE;
+
+    while (node != NULL &&
+           arcf_ip_common(node->in_addr, addr, node->in_plen) == node->in_plen)
+    {
+        if (node->in_rank != ARCF_IPRANK_NONE)
+        {
+            rank = node->in_rank;
+        }
+        if (node->in_plen == bits)
+        {
+            break;
+        }
+        node = node->in_child[arcf_ip_bit(addr, node->in_plen)];
+    }
+
+    return rank;
+}
+
+/**
+ *  Fold a byte into a hash, ignoring ASCII case.
+ *
+ *  Parameters:
+ *      hash: hash so far
+ *      c: byte
+ *
+ *  Returns:
+ *      The new hash.
+ *
+ *  Notes:
+ *      Names are hashed from the last byte to the first, so hashing a host
+ *      name once yields the hash of every suffix along the way.
+ */
+
+static inline uint32_t
+arcf_host_hashstep(uint32_t hash, unsigned char c)
+{
+    if (c >= 'A' && c <= 'Z')
+    {
+        c += 'a' - 'A';
+    }
+
+    return (hash ^ c) * ARCF_HASH_PRIME;
+}
+
+/**
+ *  Find a name's slot in the host table.
+ *
+ *  Parameters:
+ *      pl: peer list
+ *      name: name, in any case
+ *      len: length of "name"
+ *      hash: hash of "name"
+ *
+ *  Returns:
+ *      The slot holding the name's index plus one, or the empty slot where
+ *      it would go.
+ */
+
+static uint32_t *
+arcf_host_find(struct arcf_peerlist *pl,
+               const char           *name,
+               size_t                len,
+               uint32_t              hash)
+{
+    size_t               mask = pl->pl_nslots - 1;
+    uint32_t            *slot;
+    struct arcf_hostent *he;
+
+    for (size_t n = hash & mask;; n = (n + 1) & mask)
+    {
+        slot = &pl->pl_slots[n];
+        if (*slot == 0)
+        {
+            return slot;
+        }
+
+        he = &pl->pl_hosts[*slot - 1];
+        if (he->he_hash == hash && he->he_len == len &&
+            strncasecmp(he->he_name, name, len) == 0)
+        {
+            return slot;
+        }
+    }
+}
+
+/**
+ *  Make room in the host table.
+ *
+ *  Parameters:
+ *      pl: peer list
+ *      want: number of names it should hold
+ *
+ *  Returns:
+ *      false if memory ran out.
+ */
+
+static bool
+arcf_host_reserve(struct arcf_peerlist *pl, size_t want)
+{
+    size_t               nslots;
+    uint32_t            *slots;
+    struct arcf_hostent *hosts;
+
+    if (want > ARCF_HOSTS_MAX)
+    {
+        return false;
+    }
+
+    if (want > pl->pl_hostalloc)
+    {
+        size_t alloc = want < pl->pl_hostalloc * 2 ? pl->pl_hostalloc * 2
+                                                   : want;
+
+        hosts = ARC_REALLOC(pl->pl_hosts, alloc * sizeof *hosts);
+        if (hosts == NULL)
+        {
+            return false;
+        }
+        pl->pl_hosts = hosts;
+        pl->pl_hostalloc = alloc;
+    }
+
+    if (want * 2 <= pl->pl_nslots)
+    {
+        return true;
+    }
+
+    for (nslots = ARCF_HOSTS_MIN; nslots < want * 2; nslots *= 2)
+    {
+        continue;
+    }
+
+    slots = ARC_CALLOC(nslots, sizeof *slots);
+    if (slots == NULL)
+    {
+        return false;
+    }
+    ARC_FREE(pl->pl_slots);
+    pl->pl_slots = slots;
+    pl->pl_nslots = nslots;
+
+    for (size_t n = 0; n < pl->pl_nhosts; n++)
+    {
+        *arcf_host_find(pl, pl->pl_hosts[n].he_name, pl->pl_hosts[n].he_len,
+                        pl->pl_hosts[n].he_hash) = n + 1;
+    }
+
+    return true;
+}
+
+/**
+ *  Add a name to the host table.
+ *
+ *  Parameters:
+ *      pl: peer list
+ *      name: name, without any "!"; it is lowercased in place and must
+ *            last as long as the list
+ *      len: length of "name"
+ *      flag: ARCF_HOST_NEG or ARCF_HOST_POS
+ *
+ *  Returns:
+ *      false if memory ran out.
+ */
+
+static bool
+arcf_host_insert(struct arcf_peerlist *pl,
+                 char                 *name,
+                 size_t                len,
+                 unsigned char         flag)
+{
+    uint32_t             hash = ARCF_HASH_BASIS;
+    uint32_t            *slot;
+    struct arcf_hostent *he;
+
+    if (len == 0 || len > UINT32_MAX)
+    {
+        return true;
+    }
+
+    if (!arcf_host_reserve(pl, pl->pl_nhosts + 1))
+    {
+        return false;
+    }
+
+    for (size_t n = len; n > 0; n--)
+    {
+        if (name[n - 1] >= 'A' && name[n - 1] <= 'Z')
+        {
+            name[n - 1] += 'a' - 'A';
+        }
+        hash = arcf_host_hashstep(hash, name[n - 1]);
+    }
+
+    slot = arcf_host_find(pl, name, len, hash);
+    if (*slot == 0)
+    {
+        he = &pl->pl_hosts[pl->pl_nhosts++];
+        he->he_name = name;
+        he->he_len = len;
+        he->he_hash = hash;
+        he->he_flags = 0;
+        *slot = pl->pl_nhosts;
+    }
+    pl->pl_hosts[*slot - 1].he_flags |= flag;
+
+    return true;
+}
+
+/**
+ *  Parse an entry that's an address or prefix a lookup could ever have
+ *  matched.
+ *
+ *  Parameters:
+ *      entry: list entry
+ *      ie: parsed entry (returned)
+ *
+ *  Returns:
+ *      true if the entry belongs in a trie.
+ *
+ *  Notes:
+ *      Lookups used to compare the text of the client address to each
+ *      entry, so only the forms they generated can match: canonical
+ *      dotted quads, lowercase inet_ntop(3) text, decimal prefix lengths,
+ *      and no address bits set past the prefix.
+ */
+
+static bool
+arcf_ip_parse(const char *entry, struct arcf_ipentry *ie)
+{
+    int           form = 0;
+    unsigned int  bits;
+    unsigned int  plen;
+    size_t        len;
+    const char   *p = entry;
+    const char   *end;
+    char         *q;
+    unsigned char addr[16];
+    char          text[INET6_ADDRSTRLEN + 1];
+    char          canon[INET6_ADDRSTRLEN + 1];
+
+    if (*p == '!')
+    {
+        p++;
+    }
+
+    if (*p == '[')
+    {
+        form |= ARCF_IPFORM_BRACKET;
+        p++;
+        end = strchr(p, ']');
+        if (end == NULL || (end[1] != '\0' && end[1] != '/'))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        end = strchr(p, '/');
+        if (end == NULL)
+        {
+            end = p + strlen(p);
+        }
+    }
+
+    len = end - p;
+    if (len == 0 || len >= sizeof text)
+    {
+        return false;
+    }
+    memcpy(text, p, len);
+    text[len] = '\0';
+
+    if (*end == ']')
+    {
+        end++;
+    }
+
+    memset(addr, '\0', sizeof addr);
+    if (strchr(text, ':') == NULL)
+    {
+        /* inet_pton(3) only takes the dotted quads arcf_inet_ntoa() makes */
+        if (inet_pton(AF_INET, text, addr) != 1)
+        {
+            return false;
+        }
+        ie->ie_v6 = false;
+        bits = 32;
+    }
+    else
+    {
+        if (inet_pton(AF_INET6, text, addr) != 1 ||
+            inet_ntop(AF_INET6, addr, canon, sizeof canon) == NULL ||
+            strcmp(canon, text) != 0)
+        {
+            return false;
+        }
+        ie->ie_v6 = true;
+        bits = 128;
+    }
+
+    plen = bits;
+    if (*end == '/')
+    {
+        unsigned long n;
+
+        /* "%d" never produced leading zeros or signs */
+        if (end[1] < '0' || end[1] > '9' || (end[1] == '0' && end[2] != '\0'))
+        {
+            return false;
+        }
+        errno = 0;
+        n = strtoul(end + 1, &q, 10);
+        if (errno != 0 || *q != '\0' || n > bits)
+        {
+            return false;
+        }
+        plen = n;
+        form |= ARCF_IPFORM_PREFIX;
+
+        /* a lookup only ever tried the network address */
+        for (unsigned int b = plen; b < bits; b++)
+        {
+            if (arcf_ip_bit(addr, b) != 0)
+            {
+                return false;
+            }
+        }
+    }
+    else if (*end != '\0')
+    {
+        return false;
+    }
+
+    ie->ie_key[0] = 0;
+    ie->ie_key[1] = 0;
+    for (unsigned int n = 0; n < 16; n++)
+    {
+        ie->ie_key[n / 8] = ie->ie_key[n / 8] << 8 | addr[n];
+    }
+    ie->ie_plen = plen;
+    ie->ie_rank = form + (entry[0] == '!' ? 0 : 1);
+    return true;
+}
+
+/**
+ *  Compare two parsed entries.
+ *
+ *  Parameters:
+ *      x: first entry
+ *      y: second entry
+ *
+ *  Returns:
+ *      true if "x" sorts no later than "y".
+ */
+
+static inline bool
+arcf_ip_before(const struct arcf_ipentry *x, const struct arcf_ipentry *y)
+{
+    if (x->ie_v6 != y->ie_v6)
+    {
+        return y->ie_v6;
+    }
+    if (x->ie_key[0] != y->ie_key[0])
+    {
+        return x->ie_key[0] < y->ie_key[0];
+    }
+    return x->ie_key[1] <= y->ie_key[1];
+}
+
+/**
+ *  Sort parsed entries by address, so that inserting them in turn keeps
+ *  walking the same, recently touched, trie nodes.
+ *
+ *  Parameters:
+ *      ips: entries
+ *      tmp: scratch space for as many entries
+ *      n: number of entries
+ *
+ *  Returns:
+ *      Nothing.
+ *
+ *  Notes:
+ *      A bottom-up merge sort; qsort(3) spends most of its time calling
+ *      the comparison function.
+ */
+
+static void
+arcf_ip_sort(struct arcf_ipentry *ips, struct arcf_ipentry *tmp, size_t n)
+{
+    struct arcf_ipentry *src = ips;
+    struct arcf_ipentry *dst = tmp;
+    struct arcf_ipentry *swap;
+
+    for (size_t width = 1; width < n; width *= 2)
+    {
+        for (size_t lo = 0; lo < n; lo += 2 * width)
+        {
+            size_t mid = lo + width < n ? lo + width : n;
+            size_t hi = mid + width < n ? mid + width : n;
+            size_t i = lo;
+            size_t j = mid;
+            size_t k = lo;
+
+            while (i < mid && j < hi)
+            {
+                dst[k++] = arcf_ip_before(&src[i], &src[j]) ? src[i++]
+                                                            : src[j++];
+            }
+            while (i < mid)
+            {
+                dst[k++] = src[i++];
+            }
+            while (j < hi)
+            {
+                dst[k++] = src[j++];
+            }
+        }
+
+        swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != ips)
+    {
+        memcpy(ips, src, n * sizeof *ips);
+    }
+}
+
+/**
+ *  Add a parsed entry to a peer list's tries.
+ *
+ *  Parameters:
+ *      pl: peer list
+ *      ie: parsed entry
+ *
+ *  Returns:
+ *      false if memory ran out.
+ */
+
+static bool
+arcf_ip_add(struct arcf_peerlist *pl, const struct arcf_ipentry *ie)
+{
+    unsigned char addr[16];
+
+    for (unsigned int n = 0; n < 16; n++)
+    {
+        addr[n] = ie->ie_key[n / 8] >> (56 - 8 * (n % 8));
+    }
+
+    return arcf_ip_insert(pl->pl_arena, ie->ie_v6 ? &pl->pl_v6 : &pl->pl_v4,
+                          addr, ie->ie_plen, ie->ie_rank);
+}
+
+/**
+ *  Add an entry's name to the host table and count it.
+ *
+ *  Parameters:
+ *      pl: peer list
+ *      entry: list entry, kept as for arcf_host_insert()
+ *
+ *  Returns:
+ *      false if memory ran out.
+ */
+
+static bool
+arcf_peerlist_addname(struct arcf_peerlist *pl, char *entry)
+{
+    bool neg = entry[0] == '!';
+
+    /* every entry is also tried as a name, as the MTA may pass "[addr]" */
+    if (!arcf_host_insert(pl, entry + neg, strlen(entry + neg),
+                          neg ? ARCF_HOST_NEG : ARCF_HOST_POS))
+    {
+        return false;
+    }
+
+    pl->pl_count++;
+    return true;
+}
+
+/**
+ *  Create an empty peer list.
+ *
+ *  Parameters:
+ *      None.
+ *
+ *  Returns:
+ *      A new peer list, or NULL.
+ */
+
+peerlist
+arcf_peerlist_new(void)
+{
+    struct arcf_peerlist *pl;
+
+    pl = ARC_CALLOC(1, sizeof *pl);
+    if (pl == NULL)
+    {
+        return NULL;
+    }
+
+    pl->pl_arena = arc_arena_new(ARCF_PEERLIST_ARENA, NULL);
+    if (pl->pl_arena == NULL)
+    {
+        ARC_FREE(pl);
+        return NULL;
+    }
+
+    return pl;
+}
+
+/**
+ *  Add an entry to a peer list.
+ *
+ *  Parameters:
+ *      pl: peer list
+ *      entry: host name, domain, address or prefix, possibly negated
+ *      err: error string (returned)
+ *
+ *  Returns:
+ *      true on success.
+ */
+
+bool
+arcf_peerlist_add(peerlist pl, const char *entry, char **err)
+{
+    char               *copy;
+    struct arcf_ipentry ie;
+
+    assert(pl != NULL);
+    assert(entry != NULL);
+
+    copy = ARC_ASTRNDUP(pl->pl_arena, entry, strlen(entry));
+    if (copy == NULL || !arcf_peerlist_addname(pl, copy) ||
+        (arcf_ip_parse(entry, &ie) && !arcf_ip_add(pl, &ie)))
+    {
+        *err = strerror(ENOMEM);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ *  Add the entries in a file to a peer list.
+ *
+ *  Parameters:
+ *      pl: peer list
+ *      path: file with one entry per line
+ *      err: error string (returned)
+ *
+ *  Returns:
+ *      true on success.
+ */
+
+bool
+arcf_peerlist_load(peerlist pl, const char *path, char **err)
+{
+    bool                 ok;
+    size_t               len = 0;
+    size_t               alloc = BUFRSZ;
+    size_t               nlines = 1;
+    size_t               nips = 0;
+    ssize_t              r;
+    int                  fd;
+    char                *p;
+    char                *eol;
+    char                *buf;
+    char                *text;
+    struct arcf_ipentry *ips;
+
+    assert(pl != NULL);
+    assert(path != NULL);
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        *err = strerror(errno);
+        return false;
+    }
+
+    /* the whole file is read at once and its lines become the names */
+    buf = ARC_MALLOC(alloc);
+    while (buf != NULL && (r = read(fd, buf + len, alloc - len)) != 0)
+    {
+        if (r == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            *err = strerror(errno);
+            ARC_FREE(buf);
+            close(fd);
+            return false;
+        }
+
+        len += r;
+        if (len == alloc)
+        {
+            p = ARC_REALLOC(buf, alloc * 2);
+            if (p == NULL)
+            {
+                ARC_FREE(buf);
+            }
+            buf = p;
+            alloc *= 2;
+        }
+    }
+    close(fd);
+
+    text = buf == NULL ? NULL : ARC_AMALLOC(pl->pl_arena, len + 1);
+    if (text == NULL)
+    {
+        *err = strerror(ENOMEM);
+        ARC_FREE(buf);
+        return false;
+    }
+    memcpy(text, buf, len);
+    text[len] = '\0';
+    ARC_FREE(buf);
+
+    for (p = text; (p = memchr(p, '\n', text + len - p)) != NULL; p++)
+    {
+        nlines++;
+    }
+
+    /* twice over, to have room to sort them */
+    ips = ARC_MALLOC(nlines * 2 * sizeof *ips);
+    ok = ips != NULL && arcf_host_reserve(pl, pl->pl_nhosts + nlines);
+
+    for (p = text; ok && p < text + len; p = eol + 1)
+    {
+        eol = memchr(p, '\n', text + len - p);
+        if (eol == NULL)
+        {
+            eol = text + len;
+        }
+        *eol = '\0';
+
+        /* before the name is lowercased, which would change the address */
+        if (arcf_ip_parse(p, &ips[nips]))
+        {
+            nips++;
+        }
+        ok = arcf_peerlist_addname(pl, p);
+    }
+
+    /* a big list goes in much faster in address order */
+    if (ok)
+    {
+        arcf_ip_sort(ips, ips + nlines, nips);
+    }
+    for (size_t n = 0; ok && n < nips; n++)
+    {
+        ok = arcf_ip_add(pl, &ips[n]);
+    }
+
+    ARC_FREE(ips);
+
+    if (!ok)
+    {
+        *err = strerror(ENOMEM);
+    }
+    return ok;
+}
+
+/**
+ *  Check a peer list for a host name and the domains it is in.
+ *
+ *  Parameters:
+ *      pl: peer list
+ *      host: host name
+ *
+ *  Returns:
+ *      true if the most specific matching entry isn't negated.
+ */
+
+bool
+arcf_peerlist_checkhost(peerlist pl, const char *host)
+{
+    bool      result = false;
+    size_t    len;
+    uint32_t  hash = ARCF_HASH_BASIS;
+    uint32_t *slot;
+
+    assert(host != NULL);
+
+    if (pl == NULL || pl->pl_nhosts == 0 || host[0] == '\0')
+    {
+        return false;
+    }
+
+    /* the host itself, then each suffix starting at a later dot; the
+     * longest one listed wins, and "!name" beats "name" */
+    len = strlen(host);
+    for (size_t n = len; n > 0; n--)
+    {
+        hash = arcf_host_hashstep(hash, host[n - 1]);
+        if (n - 1 != 0 && host[n - 1] != '.')
+        {
+            continue;
+        }
+
+        slot = arcf_host_find(pl, host + n - 1, len - n + 1, hash);
+        if (*slot != 0)
+        {
+            result = (pl->pl_hosts[*slot - 1].he_flags & ARCF_HOST_NEG) == 0;
+        }
+    }
+
+    return result;
+}
+
+/**
+ *  Check a peer list for an address.
+ *
+ *  Parameters:
+ *      pl: peer list
+ *      ip: address
+ *
+ *  Returns:
+ *      true if the most specific matching entry isn't negated.
+ */
+
+bool
+arcf_peerlist_checkip(peerlist pl, struct sockaddr *ip)
+{
+    unsigned char rank = ARCF_IPRANK_NONE;
+
+    assert(ip != NULL);
+
+    if (pl == NULL)
+    {
+        return false;
+    }
+
+#ifdef AF_INET6
+    if (ip->sa_family == AF_INET6)
+    {
+        struct sockaddr_in6 sin6;
+
+        memcpy(&sin6, ip, sizeof sin6);
+        rank = arcf_ip_lookup(pl->pl_v6, sin6.sin6_addr.s6_addr, 128);
+    }
+#endif /* AF_INET6 */
+
+    if (ip->sa_family == AF_INET)
+    {
+        struct sockaddr_in sin;
+
+        memcpy(&sin, ip, sizeof sin);
+        rank = arcf_ip_lookup(pl->pl_v4,
+                              (const unsigned char *) &sin.sin_addr.s_addr, 32);
+    }
+
+    return rank != ARCF_IPRANK_NONE && (rank & 1) != 0;
+}
+
+/**
+ *  Count the entries in a peer list.
+ *
+ *  Parameters:
+ *      pl: peer list
+ *
+ *  Returns:
+ *      Number of entries added.
+ */
+
+size_t
+arcf_peerlist_count(peerlist pl)
+{
+    return pl == NULL ? 0 : pl->pl_count;
+}
+
+/**
+ *  Free a peer list.
+ *
+ *  Parameters:
+ *      pl: peer list, or NULL
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+void
+arcf_peerlist_free(peerlist pl)
+{
+    if (pl == NULL)
+    {
+        return;
+    }
+
+    ARC_FREE(pl->pl_slots);
+    ARC_FREE(pl->pl_hosts);
+    arc_arena_free(pl->pl_arena);
+    ARC_FREE(pl);
+}
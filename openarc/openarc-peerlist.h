@@ -0,0 +1,23 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#ifndef OPENARC_PEERLIST_H
+#define OPENARC_PEERLIST_H
+
+#include <stdbool.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+/* PEERLIST -- a compiled PeerList or InternalHosts set */
+typedef struct arcf_peerlist *peerlist;
+
+extern peerlist arcf_peerlist_new(void);
+extern bool     arcf_peerlist_add(peerlist, const char *, char **);
+extern bool     arcf_peerlist_load(peerlist, const char *, char **);
+extern bool     arcf_peerlist_checkhost(peerlist, const char *);
+extern bool     arcf_peerlist_checkip(peerlist, struct sockaddr *);
+extern size_t   arcf_peerlist_count(peerlist);
+extern void     arcf_peerlist_free(peerlist);
+
+#endif /* OPENARC_PEERLIST_H */
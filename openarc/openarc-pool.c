@@ -0,0 +1,184 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#include "build-config.h"
+
+/* system includes */
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+/* openarc includes */
+#include "arc-malloc.h"
+#include "openarc-pool.h"
+
+/*
+**  Each thread keeps its own list, so getting and putting objects never
+**  takes a lock.  libmilter may run a connection's callbacks on different
+**  threads, so an object can be put on another thread's list than the one
+**  it came from; the per-thread limit keeps that from growing without
+**  bound.  A thread's list is freed when the thread exits.
+*/
+
+/* struct arcf_poolcache -- one thread's free objects */
+struct arcf_poolcache
+{
+    struct arcf_pool *pc_pool;
+    size_t            pc_count;
+    void             *pc_items[];
+};
+
+/**
+ *  Free a thread's list.
+ *
+ *  Parameters:
+ *      vp: the list
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+static void
+arcf_pool_release(void *vp)
+{
+    struct arcf_poolcache *pc = vp;
+
+    while (pc->pc_count > 0)
+    {
+        pc->pc_pool->pool_free(pc->pc_items[--pc->pc_count]);
+    }
+
+    ARC_FREE(pc);
+}
+
+/**
+ *  Set up a pool.
+ *
+ *  Parameters:
+ *      pool: pool to set up
+ *      max: most free objects each thread keeps
+ *      freefn: function that frees an object for good
+ *
+ *  Returns:
+ *      0 on success, or an error number.
+ */
+
+int
+arcf_pool_init(struct arcf_pool *pool, size_t max, void (*freefn)(void *))
+{
+    assert(pool != NULL);
+    assert(max > 0);
+    assert(freefn != NULL);
+
+    pool->pool_max = max;
+    pool->pool_free = freefn;
+
+    return pthread_key_create(&pool->pool_key, arcf_pool_release);
+}
+
+/**
+ *  Take a free object.
+ *
+ *  Parameters:
+ *      pool: pool
+ *
+ *  Returns:
+ *      An object last given to arcf_pool_put(), or NULL if the calling
+ *      thread has none; the caller then allocates a new one.
+ */
+
+void *
+arcf_pool_get(struct arcf_pool *pool)
+{
+    struct arcf_poolcache *pc;
+
+    assert(pool != NULL);
+
+    pc = pthread_getspecific(pool->pool_key);
+    if (pc == NULL || pc->pc_count == 0)
+    {
+        return NULL;
+    }
+
+    return pc->pc_items[--pc->pc_count];
+}
+
+/**
+ *  Give an object back for reuse.
+ *
+ *  Parameters:
+ *      pool: pool
+ *      obj: object, already reset by the caller
+ *
+ *  Returns:
+ *      false if the calling thread's list is full or couldn't be made; the
+ *      caller then frees the object itself.
+ */
+
+bool
+arcf_pool_put(struct arcf_pool *pool, void *obj)
+{
+    struct arcf_poolcache *pc;
+
+    assert(pool != NULL);
+    assert(obj != NULL);
+
+    pc = pthread_getspecific(pool->pool_key);
+    if (pc == NULL)
+    {
+        pc = ARC_MALLOC(sizeof *pc + pool->pool_max * sizeof pc->pc_items[0]);
+        if (pc == NULL)
+        {
+            return false;
+        }
+        pc->pc_pool = pool;
+        pc->pc_count = 0;
+
+        if (pthread_setspecific(pool->pool_key, pc) != 0)
+        {
+            ARC_FREE(pc);
+            return false;
+        }
+    }
+
+    if (pc->pc_count == pool->pool_max)
+    {
+        return false;
+    }
+
+    pc->pc_items[pc->pc_count++] = obj;
+
+    return true;
+}
+
+/**
+ *  Free the calling thread's objects and stop using a pool.
+ *
+ *  Parameters:
+ *      pool: pool
+ *
+ *  Returns:
+ *      Nothing.
+ *
+ *  Notes:
+ *      Meant for shutdown, once no other threads are using the pool.
+ */
+
+void
+arcf_pool_destroy(struct arcf_pool *pool)
+{
+    struct arcf_poolcache *pc;
+
+    assert(pool != NULL);
+
+    pc = pthread_getspecific(pool->pool_key);
+    if (pc != NULL)
+    {
+        (void) pthread_setspecific(pool->pool_key, NULL);
+        arcf_pool_release(pc);
+    }
+
+    (void) pthread_key_delete(pool->pool_key);
+}
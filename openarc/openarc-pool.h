@@ -0,0 +1,25 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#ifndef OPENARC_POOL_H
+#define OPENARC_POOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* struct arcf_pool -- per-thread free lists of one kind of object */
+struct arcf_pool
+{
+    pthread_key_t pool_key;
+    size_t        pool_max; /* objects kept by each thread */
+    void (*pool_free)(void *);
+};
+
+extern int   arcf_pool_init(struct arcf_pool *, size_t, void (*)(void *));
+extern void *arcf_pool_get(struct arcf_pool *);
+extern bool  arcf_pool_put(struct arcf_pool *, void *);
+extern void  arcf_pool_destroy(struct arcf_pool *);
+
+#endif /* OPENARC_POOL_H */
@@ -0,0 +1,243 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#include "build-config.h"
+
+/* system includes */
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+/* openarc includes */
+#include "arc-malloc.h"
+#include "openarc-rcu.h"
+
+/*
+**  Readers mark the epoch they started in for the few instructions it takes
+**  to load a shared pointer and take a reference to what it points to; a
+**  writer that has swapped the pointer bumps the epoch and waits until no
+**  reader is still marked with an older one.  After that, nobody can pick
+**  up the old object without already holding a reference to it.
+**
+**  Each thread gets a reader record the first time it reads.  Records are
+**  never freed while the filter runs, but a thread's record goes back for
+**  reuse when the thread exits, so there are only ever as many as the most
+**  threads that have been alive at once.
+*/
+
+/* struct arcf_rcu_reader -- one thread's read-side state */
+struct arcf_rcu_reader
+{
+    atomic_ulong            rr_epoch; /* epoch at entry, 0 outside */
+    atomic_bool             rr_inuse; /* owned by a live thread */
+    struct arcf_rcu_reader *rr_next;
+};
+
+static atomic_ulong                      rcu_epoch = 1;
+static _Atomic(struct arcf_rcu_reader *) rcu_readers;
+static pthread_key_t                     rcu_key;
+
+/**
+ *  Give a reader record back when its thread exits.
+ *
+ *  Parameters:
+ *      vp: the thread's record
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+static void
+arcf_rcu_release(void *vp)
+{
+    struct arcf_rcu_reader *r = vp;
+
+    atomic_store(&r->rr_epoch, 0);
+    atomic_store(&r->rr_inuse, false);
+}
+
+/**
+ *  Find or make the calling thread's reader record.
+ *
+ *  Parameters:
+ *      None.
+ *
+ *  Returns:
+ *      The record, or NULL if memory ran out.
+ */
+
+static struct arcf_rcu_reader *
+arcf_rcu_reader(void)
+{
+    struct arcf_rcu_reader *r;
+
+    r = pthread_getspecific(rcu_key);
+    if (r != NULL)
+    {
+        return r;
+    }
+
+    /* reuse one left behind by an exited thread */
+    for (r = atomic_load(&rcu_readers); r != NULL; r = r->rr_next)
+    {
+        if (!atomic_load(&r->rr_inuse) && !atomic_exchange(&r->rr_inuse, true))
+        {
+            break;
+        }
+    }
+
+    if (r == NULL)
+    {
+        r = ARC_MALLOC(sizeof *r);
+        if (r == NULL)
+        {
+            return NULL;
+        }
+        atomic_init(&r->rr_epoch, 0);
+        atomic_init(&r->rr_inuse, true);
+
+        r->rr_next = atomic_load(&rcu_readers);
+        while (!atomic_compare_exchange_weak(&rcu_readers, &r->rr_next, r))
+        {
+            continue;
+        }
+    }
+
+    if (pthread_setspecific(rcu_key, r) != 0)
+    {
+        atomic_store(&r->rr_inuse, false);
+        return NULL;
+    }
+
+    return r;
+}
+
+/**
+ *  Set up reader tracking.
+ *
+ *  Parameters:
+ *      None.
+ *
+ *  Returns:
+ *      0 on success, or an error number.
+ */
+
+int
+arcf_rcu_init(void)
+{
+    return pthread_key_create(&rcu_key, arcf_rcu_release);
+}
+
+/**
+ *  Start reading a shared pointer.
+ *
+ *  Parameters:
+ *      None.
+ *
+ *  Returns:
+ *      false if the thread couldn't be set up as a reader.
+ *
+ *  Notes:
+ *      The section must be short and must not nest; it is meant for
+ *      loading a pointer and taking a reference, nothing more.
+ */
+
+bool
+arcf_rcu_read_lock(void)
+{
+    struct arcf_rcu_reader *r;
+
+    r = arcf_rcu_reader();
+    if (r == NULL)
+    {
+        return false;
+    }
+
+    assert(atomic_load(&r->rr_epoch) == 0);
+    atomic_store(&r->rr_epoch, atomic_load(&rcu_epoch));
+
+    return true;
+}
+
+/**
+ *  Finish reading a shared pointer.
+ *
+ *  Parameters:
+ *      None.
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+void
+arcf_rcu_read_unlock(void)
+{
+    struct arcf_rcu_reader *r;
+
+    r = pthread_getspecific(rcu_key);
+    assert(r != NULL);
+
+    atomic_store(&r->rr_epoch, 0);
+}
+
+/**
+ *  Wait until every reader that might have seen a pointer before it was
+ *  replaced has finished.
+ *
+ *  Parameters:
+ *      None.
+ *
+ *  Returns:
+ *      Nothing.
+ *
+ *  Notes:
+ *      Writers must be serialized by the caller.
+ */
+
+void
+arcf_rcu_synchronize(void)
+{
+    unsigned long epoch;
+    unsigned long seen;
+
+    epoch = atomic_fetch_add(&rcu_epoch, 1) + 1;
+
+    for (struct arcf_rcu_reader *r = atomic_load(&rcu_readers); r != NULL;
+         r = r->rr_next)
+    {
+        while ((seen = atomic_load(&r->rr_epoch)) != 0 && seen < epoch)
+        {
+            sched_yield();
+        }
+    }
+}
+
+/**
+ *  Free reader records once no other threads are left.
+ *
+ *  Parameters:
+ *      None.
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+void
+arcf_rcu_shutdown(void)
+{
+    struct arcf_rcu_reader *r;
+    struct arcf_rcu_reader *next;
+
+    (void) pthread_setspecific(rcu_key, NULL);
+    (void) pthread_key_delete(rcu_key);
+
+    for (r = atomic_exchange(&rcu_readers, NULL); r != NULL; r = next)
+    {
+        next = r->rr_next;
+        ARC_FREE(r);
+    }
+}
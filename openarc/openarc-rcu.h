@@ -0,0 +1,16 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#ifndef OPENARC_RCU_H
+#define OPENARC_RCU_H
+
+#include <stdbool.h>
+
+extern int  arcf_rcu_init(void);
+extern bool arcf_rcu_read_lock(void);
+extern void arcf_rcu_read_unlock(void);
+extern void arcf_rcu_synchronize(void);
+extern void arcf_rcu_shutdown(void);
+
+#endif /* OPENARC_RCU_H */
@@ -0,0 +1,711 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#include "build-config.h"
+
+/* system includes */
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <regex.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/types.h>
+
+#ifdef USE_JANSSON
+#include <jansson.h>
+#endif /* USE_JANSSON */
+
+/* libbsd if found */
+#ifdef USE_BSD_H
+#include <bsd/string.h>
+#endif /* USE_BSD_H */
+
+/* libstrl if needed */
+#ifdef USE_STRL_H
+#include <strl.h>
+#endif /* USE_STRL_H */
+
+/* openarc includes */
+#include "arc-malloc.h"
+#include "openarc-sealcheck.h"
+#include "openarc.h"
+
+/* struct arcf_sealrule -- one "name:regexp" entry */
+struct arcf_sealrule
+{
+    unsigned int sr_name;    /* index into sc_names */
+    char        *sr_literal; /* text every match contains, or NULL */
+    regex_t      sr_re;      /* compiled expression */
+};
+
+/* struct arcf_sealcheck -- rules and the distinct field names they use */
+struct arcf_sealcheck
+{
+    unsigned int          sc_nnames;
+    unsigned int          sc_nrules;
+    char                **sc_names;
+    struct arcf_sealrule *sc_rules;
+};
+
+/* struct arcf_sealvalue -- what's been worked out about one field value */
+struct arcf_sealvalue
+{
+    const char *sv_val;     /* the value */
+    bool        sv_plain;   /* no backslashes, so JSON can't hide text */
+    char        sv_kind;    /* '[' or '{' if it might be JSON, else 0 */
+    int         sv_scanned; /* 1 spans are good, -1 needs a decoder */
+    unsigned    sv_nspans;
+    struct
+    {
+        const char *s;
+        size_t      len;
+    } sv_span[ARCF_SEALCHECK_MAXSPANS];
+};
+
+/* whitespace between JSON tokens */
+#define ARCF_JSON_ISWS(c)                                                      \
+    ((c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r')
+
+/**
+ *  Find a run of text that must appear in anything a basic regular
+ *  expression matches.
+ *
+ *  Parameters:
+ *      re: the expression, which has already compiled
+ *
+ *  Returns:
+ *      A copy of the longest such run, or NULL if there isn't one worth
+ *      looking for.
+ *
+ *  Notes:
+ *      Only text outside groups is considered, and a character followed by
+ *      a repetition is optional, so it's left off.  Anything unfamiliar
+ *      just ends the current run.
+ */
+
+static char *
+arcf_sealcheck_literal(const char *re)
+{
+    size_t      len = 0;
+    size_t      bestlen = 0;
+    int         depth = 0;
+    const char *p;
+    const char *best = NULL;
+    char       *ret;
+    char        run[BUFRSZ];
+    char        bestrun[BUFRSZ];
+
+    for (p = re; *p != '\0'; p++)
+    {
+        if (*p == '\\' && p[1] != '\0')
+        {
+            p++;
+            if (*p == '(')
+            {
+                depth++;
+            }
+            else if (*p == ')')
+            {
+                depth--;
+            }
+            else if (*p == '|' && depth == 0)
+            {
+                /* alternatives at the top level; nothing is required */
+                return NULL;
+            }
+            else if (depth == 0 && ispunct((unsigned char) *p) &&
+                     strchr("{}+?<>`'", *p) == NULL)
+            {
+                if (len < sizeof run - 1)
+                {
+                    run[len++] = *p;
+                }
+                continue;
+            }
+            else if (*p == '{' || *p == '+' || *p == '?')
+            {
+                /* the previous character can repeat or be left out */
+                if (len > 0)
+                {
+                    len--;
+                }
+
+                /* and the bounds aren't text to look for */
+                if (*p == '{')
+                {
+                    while (p[1] != '\0' && !(p[0] == '\\' && p[1] == '}'))
+                    {
+                        p++;
+                    }
+                    if (p[1] != '\0')
+                    {
+                        p++;
+                    }
+                }
+            }
+        }
+        else if (*p == '[')
+        {
+            /* skip the bracket expression, which is known to be valid */
+            p++;
+            if (*p == '^')
+            {
+                p++;
+            }
+            if (*p == ']')
+            {
+                p++;
+            }
+            for (; *p != '\0' && *p != ']'; p++)
+            {
+                if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '='))
+                {
+                    char close = p[1];
+
+                    for (p += 2; *p != '\0'; p++)
+                    {
+                        if (*p == close && p[1] == ']')
+                        {
+                            p++;
+                            break;
+                        }
+                    }
+                }
+            }
+            if (*p == '\0')
+            {
+                return NULL;
+            }
+        }
+        else if (*p == '*')
+        {
+            if (len > 0)
+            {
+                len--;
+            }
+        }
+        else if (depth == 0 && *p != '.' && *p != '^' && *p != '$')
+        {
+            if (len < sizeof run - 1)
+            {
+                run[len++] = *p;
+            }
+            continue;
+        }
+
+        /* anything that gets here ends the run */
+        if (len > bestlen)
+        {
+            memcpy(bestrun, run, len);
+            bestlen = len;
+            best = bestrun;
+        }
+        len = 0;
+    }
+
+    if (len > bestlen)
+    {
+        memcpy(bestrun, run, len);
+        bestlen = len;
+        best = bestrun;
+    }
+
+    if (best == NULL)
+    {
+        return NULL;
+    }
+
+    ret = ARC_MALLOC(bestlen + 1);
+    if (ret != NULL)
+    {
+        memcpy(ret, best, bestlen);
+        ret[bestlen] = '\0';
+    }
+
+    return ret;
+}
+
+/**
+ *  Add a rule to a set.
+ *
+ *  Parameters:
+ *      sc: rule set
+ *      line: "name:regexp"
+ *      err: error buffer
+ *      errlen: bytes available at "err"
+ *
+ *  Returns:
+ *      true on success.
+ */
+
+static bool
+arcf_sealcheck_add(struct arcf_sealcheck *sc,
+                   char                  *line,
+                   char                  *err,
+                   size_t                 errlen)
+{
+    int                   status;
+    unsigned int          n;
+    char                 *re;
+    struct arcf_sealrule *rule;
+
+    re = strchr(line, ':');
+    if (re == NULL || re == line)
+    {
+        snprintf(err, errlen, "invalid seal header check \"%s\"", line);
+        return false;
+    }
+    *re++ = '\0';
+
+    for (n = 0; n < sc->sc_nnames; n++)
+    {
+        if (strcasecmp(sc->sc_names[n], line) == 0)
+        {
+            break;
+        }
+    }
+
+    if (n == sc->sc_nnames)
+    {
+        char **names;
+
+        names = ARC_REALLOC(sc->sc_names, (n + 1) * sizeof *names);
+        if (names == NULL)
+        {
+            snprintf(err, errlen, "%s", strerror(errno));
+            return false;
+        }
+        sc->sc_names = names;
+
+        names[n] = ARC_STRDUP(line);
+        if (names[n] == NULL)
+        {
+            snprintf(err, errlen, "%s", strerror(errno));
+            return false;
+        }
+        sc->sc_nnames++;
+    }
+
+    rule = ARC_REALLOC(sc->sc_rules, (sc->sc_nrules + 1) * sizeof *rule);
+    if (rule == NULL)
+    {
+        snprintf(err, errlen, "%s", strerror(errno));
+        return false;
+    }
+    sc->sc_rules = rule;
+    rule += sc->sc_nrules;
+
+    status = regcomp(&rule->sr_re, re, 0);
+    if (status != 0)
+    {
+        char errbuf[BUFRSZ];
+
+        regerror(status, &rule->sr_re, errbuf, sizeof errbuf);
+        snprintf(err, errlen, "invalid seal header check \"%s:%s\": %s", line,
+                 re, errbuf);
+        return false;
+    }
+
+    rule->sr_name = n;
+    rule->sr_literal = arcf_sealcheck_literal(re);
+    sc->sc_nrules++;
+
+    return true;
+}
+
+/**
+ *  Pick the strings out of a simple JSON list without decoding it.
+ *
+ *  Parameters:
+ *      sv: field value
+ *
+ *  Returns:
+ *      Nothing; sv_scanned is set to 1 if every string was found and to -1
+ *      if the list has to go through a real decoder.
+ *
+ *  Notes:
+ *      Only lists of printable ASCII strings without escapes are handled
+ *      here; everything else, including input that isn't valid JSON, is
+ *      left to the decoder so that the results don't change.
+ */
+
+static void
+arcf_sealcheck_scan(struct arcf_sealvalue *sv)
+{
+    const char *p = sv->sv_val;
+
+    sv->sv_scanned = -1;
+    sv->sv_nspans = 0;
+
+    while (ARCF_JSON_ISWS(*p))
+    {
+        p++;
+    }
+    if (*p++ != '[')
+    {
+        return;
+    }
+    while (ARCF_JSON_ISWS(*p))
+    {
+        p++;
+    }
+
+    if (*p == ']')
+    {
+        p++;
+    }
+    else
+    {
+        for (;;)
+        {
+            const char *s;
+
+            if (*p != '"' || sv->sv_nspans == ARCF_SEALCHECK_MAXSPANS)
+            {
+                return;
+            }
+
+            for (s = ++p; *p >= 0x20 && *p < 0x7f && *p != '"' && *p != '\\';
+                 p++)
+            {
+                continue;
+            }
+            if (*p != '"' || p - s >= BUFRSZ)
+            {
+                return;
+            }
+
+            sv->sv_span[sv->sv_nspans].s = s;
+            sv->sv_span[sv->sv_nspans].len = p - s;
+            sv->sv_nspans++;
+
+            for (p++; ARCF_JSON_ISWS(*p); p++)
+            {
+                continue;
+            }
+            if (*p == ']')
+            {
+                p++;
+                break;
+            }
+            if (*p++ != ',')
+            {
+                return;
+            }
+            while (ARCF_JSON_ISWS(*p))
+            {
+                p++;
+            }
+        }
+    }
+
+    while (ARCF_JSON_ISWS(*p))
+    {
+        p++;
+    }
+    if (*p == '\0')
+    {
+        sv->sv_scanned = 1;
+    }
+}
+
+/**
+ *  Check a field value the slow way, decoding it as JSON if possible.
+ *
+ *  Parameters:
+ *      rule: rule to apply
+ *      val: field value
+ *
+ *  Returns:
+ *      true if the rule matches.
+ */
+
+static bool
+arcf_sealcheck_decode(const struct arcf_sealrule *rule, const char *val)
+{
+#ifdef USE_JANSSON
+    bool         found = false;
+    json_t      *json;
+    json_error_t json_err;
+
+    json = json_loads(val, 0, &json_err);
+    if (json == NULL)
+    {
+        return regexec(&rule->sr_re, val, 0, NULL, 0) == 0;
+    }
+
+    if (json_is_string(json))
+    {
+        found = regexec(&rule->sr_re, json_string_value(json), 0, NULL, 0) ==
+                0;
+    }
+    else if (json_is_array(json))
+    {
+        for (size_t jn = 0; !found && jn < json_array_size(json); jn++)
+        {
+            json_t *entry = json_array_get(json, jn);
+
+            if (json_is_string(entry) &&
+                regexec(&rule->sr_re, json_string_value(entry), 0, NULL, 0) ==
+                    0)
+            {
+                found = true;
+            }
+        }
+    }
+
+    json_decref(json);
+    return found;
+#else  /* USE_JANSSON */
+    return regexec(&rule->sr_re, val, 0, NULL, 0) == 0;
+#endif /* USE_JANSSON */
+}
+
+/**
+ *  Apply one rule to a field value.
+ *
+ *  Parameters:
+ *      rule: rule to apply
+ *      sv: field value
+ *
+ *  Returns:
+ *      true if the rule matches.
+ */
+
+static bool
+arcf_sealcheck_value(const struct arcf_sealrule *rule,
+                     struct arcf_sealvalue      *sv)
+{
+    char buf[BUFRSZ];
+
+    /* without escapes, every string in a list is also in the raw value */
+    if (rule->sr_literal != NULL && sv->sv_plain &&
+        strstr(sv->sv_val, rule->sr_literal) == NULL)
+    {
+        return false;
+    }
+
+    if (sv->sv_kind == '\0')
+    {
+        return regexec(&rule->sr_re, sv->sv_val, 0, NULL, 0) == 0;
+    }
+
+    if (sv->sv_kind == '[' && sv->sv_scanned == 0)
+    {
+        arcf_sealcheck_scan(sv);
+    }
+
+    if (sv->sv_scanned != 1)
+    {
+        return arcf_sealcheck_decode(rule, sv->sv_val);
+    }
+
+    for (unsigned int n = 0; n < sv->sv_nspans; n++)
+    {
+        memcpy(buf, sv->sv_span[n].s, sv->sv_span[n].len);
+        buf[sv->sv_span[n].len] = '\0';
+
+        if (regexec(&rule->sr_re, buf, 0, NULL, 0) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ *  Load and compile SealHeaderChecks rules.
+ *
+ *  Parameters:
+ *      path: file of "name:regexp" lines
+ *      err: error buffer
+ *      errlen: bytes available at "err"
+ *
+ *  Returns:
+ *      A rule set, or NULL with "err" filled in.
+ */
+
+sealcheck
+arcf_sealcheck_load(const char *path, char *err, size_t errlen)
+{
+    int                    line = 0;
+    FILE                  *f;
+    char                  *p;
+    struct arcf_sealcheck *sc;
+    char                   buf[BUFRSZ + 1];
+
+    assert(path != NULL);
+
+    f = fopen(path, "r");
+    if (f == NULL)
+    {
+        snprintf(err, errlen, "%s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    sc = ARC_CALLOC(1, sizeof *sc);
+    if (sc == NULL)
+    {
+        snprintf(err, errlen, "%s", strerror(errno));
+        fclose(f);
+        return NULL;
+    }
+
+    memset(buf, '\0', sizeof buf);
+    while (fgets(buf, sizeof buf - 1, f) != NULL)
+    {
+        line++;
+
+        p = strchr(buf, '\n');
+        if (p != NULL)
+        {
+            *p = '\0';
+        }
+
+        if (buf[0] == '\0')
+        {
+            continue;
+        }
+
+        if (!arcf_sealcheck_add(sc, buf, err, errlen))
+        {
+            char msg[BUFRSZ];
+
+            strlcpy(msg, err, sizeof msg);
+            snprintf(err, errlen, "%s: line %d: %s", path, line, msg);
+            arcf_sealcheck_free(sc);
+            fclose(f);
+            return NULL;
+        }
+    }
+
+    fclose(f);
+    return sc;
+}
+
+/**
+ *  See whether any rule looks at a header field.
+ *
+ *  Parameters:
+ *      sc: rule set
+ *      name: field name
+ *
+ *  Returns:
+ *      true if fields with this name have to be kept for matching.
+ */
+
+bool
+arcf_sealcheck_wants(sealcheck sc, const char *name)
+{
+    assert(sc != NULL);
+    assert(name != NULL);
+
+    for (unsigned int n = 0; n < sc->sc_nnames; n++)
+    {
+        if (strcasecmp(sc->sc_names[n], name) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ *  See whether any rule matches a message's header.
+ *
+ *  Parameters:
+ *      sc: rule set
+ *      hq: the message's header fields
+ *
+ *  Returns:
+ *      true if some instance of a named field matches its expression.
+ *
+ *  Notes:
+ *      Nothing is allocated unless a value looks like JSON that can't be
+ *      handled in place.  Only fields with the names in the rules are
+ *      visited.
+ */
+
+bool
+arcf_sealcheck_match(sealcheck sc, struct arcf_hdrq *hq)
+{
+    Header                hdr;
+    struct arcf_sealvalue sv;
+
+    assert(sc != NULL);
+    assert(hq != NULL);
+
+    for (unsigned int name = 0; name < sc->sc_nnames; name++)
+    {
+        for (hdr = arcf_hdrq_find(hq, sc->sc_names[name], 0); hdr != NULL;
+             hdr = hdr->hdr_nextname)
+        {
+            sv.sv_val = hdr->hdr_val;
+            sv.sv_plain = strchr(hdr->hdr_val, '\\') == NULL;
+            sv.sv_scanned = 0;
+            sv.sv_kind = '\0';
+            for (const char *p = hdr->hdr_val; *p != '\0'; p++)
+            {
+                if (!ARCF_JSON_ISWS(*p))
+                {
+                    if (*p == '[' || *p == '{')
+                    {
+                        sv.sv_kind = *p;
+                    }
+                    break;
+                }
+            }
+
+            for (unsigned int n = 0; n < sc->sc_nrules; n++)
+            {
+                if (sc->sc_rules[n].sr_name == name &&
+                    arcf_sealcheck_value(&sc->sc_rules[n], &sv))
+                {
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+/**
+ *  Free a rule set.
+ *
+ *  Parameters:
+ *      sc: rule set, or NULL
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+void
+arcf_sealcheck_free(sealcheck sc)
+{
+    if (sc == NULL)
+    {
+        return;
+    }
+
+    for (unsigned int n = 0; n < sc->sc_nrules; n++)
+    {
+        regfree(&sc->sc_rules[n].sr_re);
+        ARC_FREE(sc->sc_rules[n].sr_literal);
+    }
+    for (unsigned int n = 0; n < sc->sc_nnames; n++)
+    {
+        ARC_FREE(sc->sc_names[n]);
+    }
+
+    ARC_FREE(sc->sc_rules);
+    ARC_FREE(sc->sc_names);
+    ARC_FREE(sc);
+}
@@ -0,0 +1,26 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#ifndef OPENARC_SEALCHECK_H
+#define OPENARC_SEALCHECK_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* openarc includes */
+#include "openarc-hdrq.h"
+#include "openarc.h"
+
+/* most strings in a JSON list that are checked without decoding it */
+#define ARCF_SEALCHECK_MAXSPANS 32
+
+/* SEALCHECK -- a compiled set of SealHeaderChecks rules */
+typedef struct arcf_sealcheck *sealcheck;
+
+extern sealcheck arcf_sealcheck_load(const char *, char *, size_t);
+extern bool      arcf_sealcheck_wants(sealcheck, const char *);
+extern bool      arcf_sealcheck_match(sealcheck, struct arcf_hdrq *);
+extern void      arcf_sealcheck_free(sealcheck);
+
+#endif /* OPENARC_SEALCHECK_H */
@@ -13,6 +13,7 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #ifdef HAVE_ISO_LIMITS_ISO_H
 #include <iso/limits_iso.h>
@@ -38,12 +39,14 @@
 #include <pwd.h>
 #include <regex.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sysexits.h>
 #include <syslog.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <openssl/err.h>
@@ -79,6 +82,13 @@
 #include "openarc-ar.h"
 #include "openarc-config.h"
 #include "openarc-crypto.h"
+#include "openarc-dns.h"
+#include "openarc-engine.h"
+#include "openarc-hdrq.h"
+#include "openarc-peerlist.h"
+#include "openarc-pool.h"
+#include "openarc-rcu.h"
+#include "openarc-sealcheck.h"
 #include "openarc-test.h"
 #include "openarc.h"
 #include "util.h"
@@ -86,65 +96,63 @@
 /* macros */
 #define CMDLINEOPTS "Ac:fhlnp:P:r:t:u:vV"
 
-/*
-**  CONFIGVALUE -- a list of configuration values
-*/
-
-struct configvalue
-{
-    char *value;
-    LIST_ENTRY(configvalue) entries;
-};
-LIST_HEAD(conflist, configvalue);
-
 /*
 **  CONFIG -- configuration data
 */
 
 struct arcf_config
 {
-    bool            conf_dolog;             /* syslog interesting stuff? */
-    bool            conf_milterv2;          /* using milter v2? */
-    bool            conf_disablecryptoinit; /* disable crypto lib init */
-    bool            conf_enablecores;       /* enable coredumps */
-    bool            conf_reqhdrs;           /* enforce RFC5322 */
-    bool            conf_addswhdr;          /* add software header field */
-    bool            conf_safekeys;          /* require safe keys */
-    bool            conf_keeptmpfiles;      /* keep temp files */
-    bool            conf_finalreceiver;     /* act as final receiver */
-    bool            conf_overridecv;        /* allow A-R to override CV */
-    bool            conf_authrescomments;   /* include comments in A-R */
-    bool            conf_authresip;         /* include remote IP in A-R */
-    unsigned int    conf_refcnt;            /* reference count */
-    unsigned int    conf_mode;              /* mode flags */
-    arc_canon_t     conf_canonhdr;          /* canonicalization for header */
-    arc_canon_t     conf_canonbody;         /* canonicalization for body */
-    arc_alg_t       conf_signalg;           /* signing algorithm */
-    uint64_t        conf_fixedtime;         /* fixed timestamp */
-    char           *conf_selector;          /* signing selector */
-    char           *conf_keyfile;           /* key file */
-    char           *conf_testkeys;          /* keys for non-DNS lookup */
-    char           *conf_tmpdir;            /* temp file directory */
-    char           *conf_authservid;        /* ID for A-R fields */
-    char           *conf_peerfile;          /* peer hosts table */
-    char           *conf_domain;            /* domain */
-    char           *conf_signhdrs_raw;      /* headers to sign (raw) */
-    const char    **conf_signhdrs;          /* headers to sign (array) */
-    char           *conf_oversignhdrs_raw;  /* fields to over-sign (raw) */
-    const char    **conf_oversignhdrs;      /* fields to over-sign (array) */
-    unsigned char  *conf_keydata;           /* binary key data */
-    size_t          conf_keylen;            /* key length */
-    int             conf_maxhdrsz;          /* max. header size */
-    int             conf_minkeysz;          /* min. key size */
-    int             conf_sigttl;            /* signature TTL */
-    int             conf_ret_disabled;      /* configured not to process */
-    int             conf_ret_unable;        /* internal error */
-    int             conf_ret_unwilling;     /* badly formed message */
-    struct config  *conf_data;              /* configuration data */
-    ARC_LIB        *conf_libopenarc;        /* shared library instance */
-    struct conflist conf_peers;             /* peers hosts */
-    struct conflist conf_internal;          /* internal hosts */
-    struct conflist conf_sealheaderchecks;  /* header checks for sealing */
+    bool           conf_dolog;             /* syslog interesting stuff? */
+    bool           conf_milterv2;          /* using milter v2? */
+    bool           conf_disablecryptoinit; /* disable crypto lib init */
+    bool           conf_enablecores;       /* enable coredumps */
+    bool           conf_reqhdrs;           /* enforce RFC5322 */
+    bool           conf_addswhdr;          /* add software header field */
+    bool           conf_safekeys;          /* require safe keys */
+    bool           conf_keeptmpfiles;      /* keep temp files */
+    bool           conf_finalreceiver;     /* act as final receiver */
+    bool           conf_overridecv;        /* allow A-R to override CV */
+    bool           conf_authrescomments;   /* include comments in A-R */
+    bool           conf_authresip;         /* include remote IP in A-R */
+    bool           conf_authresoldest;     /* include oldest-pass in A-R */
+    bool           conf_bgverify;          /* verify during the body */
+    bool           conf_logallocs;         /* log allocations per message */
+    atomic_uint    conf_refcnt;            /* references, one if current */
+    unsigned int   conf_mode;              /* mode flags */
+    arc_canon_t    conf_canonhdr;          /* canonicalization for header */
+    arc_canon_t    conf_canonbody;         /* canonicalization for body */
+    arc_alg_t      conf_signalg;           /* signing algorithm */
+    uint64_t       conf_fixedtime;         /* fixed timestamp */
+    char          *conf_selector;          /* signing selector */
+    char          *conf_keyfile;           /* key file */
+    char          *conf_testkeys;          /* keys for non-DNS lookup */
+    char          *conf_tmpdir;            /* temp file directory */
+    char          *conf_authservid;        /* ID for A-R fields */
+    char          *conf_peerfile;          /* peer hosts table */
+    char          *conf_domain;            /* domain */
+    char          *conf_signhdrs_raw;      /* headers to sign (raw) */
+    const char   **conf_signhdrs;          /* headers to sign (array) */
+    char          *conf_oversignhdrs_raw;  /* fields to over-sign (raw) */
+    const char   **conf_oversignhdrs;      /* fields to over-sign (array) */
+    unsigned char *conf_keydata;           /* binary key data */
+    size_t         conf_keylen;            /* key length */
+    int            conf_maxhdrsz;          /* max. header size */
+    int            conf_minkeysz;          /* min. key size */
+    int            conf_sigttl;            /* signature TTL */
+    int            conf_bodythreads;       /* body hashing threads */
+    int            conf_bodythreshold;     /* body size for threads */
+    int            conf_cryptothreads;     /* RSA worker threads */
+    int            conf_cryptostats;       /* seconds between RSA stats */
+    int            conf_arenasize;         /* message arena size */
+    int            conf_capture;           /* capture 1 in N messages */
+    int            conf_ret_disabled;      /* configured not to process */
+    int            conf_ret_unable;        /* internal error */
+    int            conf_ret_unwilling;     /* badly formed message */
+    struct config *conf_data;              /* configuration data */
+    ARC_LIB       *conf_libopenarc;        /* shared library instance */
+    peerlist       conf_peers;             /* peers hosts */
+    peerlist       conf_internal;          /* internal hosts */
+    sealcheck      conf_sealheaderchecks;  /* header checks for sealing */
 };
 
 /*
@@ -156,9 +164,11 @@ struct msgctx
 {
     bool                mctx_peer;     /* peer source? */
     ssize_t             mctx_hdrbytes; /* count of header bytes */
+    ARC_STAT            mctx_hdrstat;  /* first header field failure */
+    unsigned int        mctx_allocs;   /* allocations for this message */
+    unsigned int        mctx_reused;   /* pooled objects picked up */
     unsigned char      *mctx_jobid;    /* job ID */
-    struct Header      *mctx_hqhead;   /* header queue head */
-    struct Header      *mctx_hqtail;   /* header queue tail */
+    struct arcf_hdrq    mctx_hq;       /* header queue */
     ARC_MESSAGE        *mctx_arcmsg;   /* libopenarc message */
     struct arc_dstring *mctx_tmpstr;   /* temporary string */
 };
@@ -178,6 +188,9 @@ struct connctx
     struct sockaddr_storage cctx_ip;     /* IP info */
     struct arcf_config     *cctx_config; /* configuration in use */
     struct msgctx          *cctx_msg;    /* message context */
+    ARC_MESSAGE            *cctx_arcmsg; /* handle for the next message */
+    struct iovec           *cctx_iov;    /* header field pieces */
+    size_t                  cctx_iovsz;  /* entries at cctx_iov */
 };
 
 /*
@@ -234,6 +247,28 @@ struct nametable arcf_responses[] = {
     {NULL,       -1            }
 };
 
+/*
+**  REQHDRS -- how many of each field RFC5322 3.6 allows
+*/
+
+static const struct
+{
+    const char *rh_name;
+    size_t      rh_min;
+    size_t      rh_max;
+} reqhdrs[] = {
+    {"From",        1, 1},
+    {"Date",        1, 1},
+    {"Reply-To",    0, 1},
+    {"To",          0, 1},
+    {"Cc",          0, 1},
+    {"Bcc",         0, 1},
+    {"Message-Id",  0, 1},
+    {"In-Reply-To", 0, 1},
+    {"References",  0, 1},
+    {"Subject",     0, 1},
+};
+
 /* PROTOTYPES */
 sfsistat      mlfi_abort(SMFICTX *);
 sfsistat      mlfi_close(SMFICTX *);
@@ -253,7 +288,8 @@ sfsistat      mlfi_negotiate(SMFICTX *,
                              unsigned long *,
                              unsigned long *);
 
-static Header arcf_findheader(msgctx, char *, int);
+static void   arcf_config_reload(void);
+static void   arcf_log_rsastats(struct arcf_config *);
 
 /* GLOBALS */
 bool                dolog;      /* logging? (exported) */
@@ -261,17 +297,25 @@ bool                reload;     /* reload requested */
 bool                no_i_whine; /* noted ${i} is undefined */
 bool                die;        /* global "die" flag */
 bool                testmode;   /* test mode */
+bool                eventmode;  /* built-in milter engine */
+bool                dnsservers; /* "Nameservers" was given */
 int                 diesig;     /* signal to distribute */
 char               *progname;   /* program name */
 char               *sock;       /* listening socket */
 char               *conffile;   /* configuration file */
-struct arcf_config *curconf;    /* current configuration */
-pthread_mutex_t     conf_lock;  /* config lock */
+struct arcf_config *_Atomic curconf; /* current configuration */
+pthread_mutex_t     conf_lock;  /* serializes reloads */
 pthread_mutex_t     pwdb_lock;  /* passwd/group lock */
+struct arcf_pool    connpool;   /* free connection contexts */
+struct arcf_pool    msgpool;    /* free message contexts */
+struct arcf_pool    hdrpool;    /* free header field nodes */
 char                myhostname[MAXHOSTNAMELEN + 1]; /* local host's name */
 
 /* Other useful definitions */
 #define CRLF           "\r\n" /* CRLF */
+#define CONNPOOLMAX    16     /* connection contexts kept per thread */
+#define MSGPOOLMAX     16     /* message contexts kept per thread */
+#define HDRPOOLMAX     512    /* header field nodes kept per thread */
 #define SUPERUSER      "root" /* superuser name */
 
 /* MACROS */
@@ -329,6 +373,10 @@ arcf_getpriv(SMFICTX *ctx)
     {
         return arcf_test_getpriv((void *) ctx);
     }
+    else if (eventmode)
+    {
+        return arcf_engine_getpriv((void *) ctx);
+    }
     else
     {
         return smfi_getpriv(ctx);
@@ -354,6 +402,10 @@ arcf_setpriv(SMFICTX *ctx, void *ptr)
     {
         return arcf_test_setpriv((void *) ctx, ptr);
     }
+    else if (eventmode)
+    {
+        return arcf_engine_setpriv((void *) ctx, ptr);
+    }
     else
     {
         return smfi_setpriv(ctx, ptr);
@@ -384,6 +436,10 @@ arcf_insheader(SMFICTX *ctx, int idx, char *hname, char *hvalue)
     {
         return arcf_test_insheader(ctx, idx, hname, hvalue);
     }
+    else if (eventmode)
+    {
+        return arcf_engine_insheader(ctx, idx, hname, hvalue);
+    }
     else
 #ifdef HAVE_SMFI_INSHEADER
         return smfi_insheader(ctx, idx, hname, hvalue);
@@ -415,6 +471,10 @@ arcf_chgheader(SMFICTX *ctx, char *hname, int idx, char *hvalue)
     {
         return arcf_test_chgheader(ctx, hname, idx, hvalue);
     }
+    else if (eventmode)
+    {
+        return arcf_engine_chgheader(ctx, hname, idx, hvalue);
+    }
     else
     {
         return smfi_chgheader(ctx, hname, idx, hvalue);
@@ -444,6 +504,10 @@ arcf_addheader(SMFICTX *ctx, char *hname, char *hvalue)
     {
         return arcf_test_addheader(ctx, hname, hvalue);
     }
+    else if (eventmode)
+    {
+        return arcf_engine_addheader(ctx, hname, hvalue);
+    }
     else
     {
         return smfi_addheader(ctx, hname, hvalue);
@@ -471,6 +535,10 @@ arcf_addrcpt(SMFICTX *ctx, char *addr)
     {
         return arcf_test_addrcpt(ctx, addr);
     }
+    else if (eventmode)
+    {
+        return arcf_engine_addrcpt(ctx, addr);
+    }
     else
     {
         return smfi_addrcpt(ctx, addr);
@@ -498,6 +566,10 @@ arcf_delrcpt(SMFICTX *ctx, char *addr)
     {
         return arcf_test_delrcpt(ctx, addr);
     }
+    else if (eventmode)
+    {
+        return arcf_engine_delrcpt(ctx, addr);
+    }
     else
     {
         return smfi_delrcpt(ctx, addr);
@@ -526,6 +598,10 @@ arcf_setreply(SMFICTX *ctx, char *rcode, char *xcode, char *replytxt)
     {
         return arcf_test_setreply(ctx, rcode, xcode, replytxt);
     }
+    else if (eventmode)
+    {
+        return arcf_engine_setreply(ctx, rcode, xcode, replytxt);
+    }
     else
     {
         return smfi_setreply(ctx, rcode, xcode, replytxt);
@@ -553,6 +629,10 @@ arcf_getsymval(SMFICTX *ctx, char *sym)
     {
         return arcf_test_getsymval(ctx, sym);
     }
+    else if (eventmode)
+    {
+        return arcf_engine_getsymval(ctx, sym);
+    }
     else
     {
         return smfi_getsymval(ctx, sym);
@@ -565,17 +645,28 @@ arcf_getsymval(SMFICTX *ctx, char *sym)
 **  Parameters:
 **  	facility -- name of the syslog facility to use when logging;
 **  	            can be NULL to request the default
+**  	tostderr -- also copy messages to standard error
 **
 **  Return value:
 **  	None.
 */
 
 static void
-arcf_init_syslog(char *facility)
+arcf_init_syslog(char *facility, bool tostderr)
 {
+    int opts = LOG_PID;
 #ifdef LOG_MAIL
     int code = -1;
+#endif /* LOG_MAIL */
+
+#ifdef LOG_PERROR
+    if (tostderr)
+    {
+        opts |= LOG_PERROR;
+    }
+#endif /* LOG_PERROR */
 
+#ifdef LOG_MAIL
     closelog();
 
     if (facility)
@@ -587,11 +678,11 @@ arcf_init_syslog(char *facility)
         code = LOG_MAIL;
     }
 
-    openlog(progname, LOG_PID, code);
+    openlog(progname, opts, code);
 #else  /* LOG_MAIL */
     closelog();
 
-    openlog(progname, LOG_PID);
+    openlog(progname, opts);
 #endif /* LOG_MAIL */
 }
 
@@ -1096,6 +1187,11 @@ arcf_sighandler(int sig)
 **
 **  Return value:
 **  	NULL.
+**
+**  Notes:
+**  	Also logs the RSA workers' activity every "CryptoStatsInterval"
+**  	seconds.  "conf_lock" keeps main() from freeing "curconf" on the
+**  	way out while it's being read here.
 */
 
 static void *
@@ -1111,11 +1207,45 @@ arcf_reloader(/* UNUSED */ void *vp)
 
     while (!die)
     {
-        (void) sigwait(&mask, &sig);
+#ifdef HAVE_SIGTIMEDWAIT
+        int interval = 0;
 
-        if (conffile != NULL)
+        pthread_mutex_lock(&conf_lock);
+        if (curconf != NULL && curconf->conf_dolog &&
+            curconf->conf_cryptothreads > 0)
+        {
+            interval = curconf->conf_cryptostats;
+        }
+        pthread_mutex_unlock(&conf_lock);
+
+        if (interval > 0)
+        {
+            struct timespec ts = {interval, 0};
+
+            if (sigtimedwait(&mask, NULL, &ts) == -1)
+            {
+                if (errno == EAGAIN)
+                {
+                    pthread_mutex_lock(&conf_lock);
+                    if (curconf != NULL)
+                    {
+                        arcf_log_rsastats(curconf);
+                    }
+                    pthread_mutex_unlock(&conf_lock);
+                }
+                continue;
+            }
+        }
+        else
+#endif /* HAVE_SIGTIMEDWAIT */
+        {
+            (void) sigwait(&mask, &sig);
+        }
+
+        if (conffile != NULL && !die)
         {
             reload = true;
+            arcf_config_reload();
         }
     }
 
@@ -1168,130 +1298,47 @@ arcf_config_new(void)
     new->conf_safekeys = true;
     new->conf_authrescomments = false;
     new->conf_authresip = true;
+    new->conf_authresoldest = true;
 
     new->conf_ret_disabled = SMFIS_ACCEPT;
     new->conf_ret_unable = SMFIS_TEMPFAIL;
     new->conf_ret_unwilling = SMFIS_REJECT;
 
-    LIST_INIT(&new->conf_peers);
-    LIST_INIT(&new->conf_internal);
+    /* the reference held by whoever publishes it as "curconf" */
+    atomic_init(&new->conf_refcnt, 1);
 
     return new;
 }
 
 /*
-**  ARCF_LIST_LOAD -- load a list
-**
-**  Parameters:
-**  	f -- input file
-**  	list -- list to update
-**  	err -- error string (returned)
-**
-**  Return value:
-**  	true iff the operation succeeded.
-*/
-
-bool
-arcf_list_load(struct conflist *list, char *path, char **err)
-{
-    FILE               *f;
-    char               *p;
-    struct configvalue *v;
-    char                buf[BUFRSZ + 1];
-
-    f = fopen(path, "r");
-    if (f == NULL)
-    {
-        *err = strerror(errno);
-        return false;
-    }
-
-    memset(buf, '\0', sizeof buf);
-    while (fgets(buf, sizeof buf - 1, f) != NULL)
-    {
-        for (p = buf; *p != '\0'; p++)
-        {
-            if (*p == '\n')
-            {
-                *p = '\0';
-                break;
-            }
-        }
-
-        v = ARC_MALLOC(sizeof(struct configvalue));
-        if (v == NULL)
-        {
-            *err = strerror(errno);
-            fclose(f);
-            return false;
-        }
-        v->value = ARC_STRDUP(buf);
-        if (v->value == NULL)
-        {
-            *err = strerror(errno);
-            fclose(f);
-            ARC_FREE(v);
-            return false;
-        }
-
-        LIST_INSERT_HEAD(list, v, entries);
-    }
-
-    fclose(f);
-    return true;
-}
-
-/*
-**  ARCF_ADDLIST -- add an entry to a list
+**  ARCF_LOG_RSASTATS -- log how busy a configuration's RSA workers have been
 **
 **  Parameters:
-**  	list -- list to update
-**  	str -- string to add
-**  	err -- error string (returned)
+**  	conf -- configuration handle
 **
 **  Return value:
-**  	true iff the operation succeeded.
+**  	None.
 */
 
-bool
-arcf_addlist(struct conflist *list, char *str, char **err)
+static void
+arcf_log_rsastats(struct arcf_config *conf)
 {
-    struct configvalue *v;
+    struct arc_rsastats rs;
 
-    v = ARC_MALLOC(sizeof(struct configvalue));
-    if (v == NULL)
+    if (arc_options(conf->conf_libopenarc, ARC_OP_GETOPT, ARC_OPTS_RSASTATS,
+                    &rs, sizeof rs) != ARC_STAT_OK ||
+        rs.rs_jobs == 0)
     {
-        *err = strerror(errno);
-        return false;
+        return;
     }
-    v->value = ARC_STRDUP(str);
-
-    LIST_INSERT_HEAD(list, v, entries);
-    return true;
-}
-
-/*
-**  ARCF_LIST_DESTROY -- destroy a list
-**
-**  Parameters:
-**  	list -- LIST to be destroyed
-**
-**  Return value:
-**  	None.
-*/
-
-void
-arcf_list_destroy(struct conflist *list)
-{
-    while (!LIST_EMPTY(list))
-    {
-        struct configvalue *n;
 
-        n = LIST_FIRST(list);
-        LIST_REMOVE(n, entries);
-        ARC_FREE(n->value);
-        ARC_FREE(n);
-    }
+    syslog(LOG_INFO,
+           "RSA workers: %u threads, %" PRIu64 " operations, "
+           "queue depth max %u, wait avg %.3f ms max %.3f ms, "
+           "run avg %.3f ms",
+           rs.rs_threads, rs.rs_jobs, rs.rs_maxdepth,
+           rs.rs_waitns / 1e6 / rs.rs_jobs, rs.rs_waitmax / 1e6,
+           rs.rs_runns / 1e6 / rs.rs_jobs);
 }
 
 /*
@@ -1314,6 +1361,11 @@ arcf_config_free(struct arcf_config *conf)
 
     if (conf->conf_libopenarc != NULL)
     {
+        if (conf->conf_dolog && conf->conf_cryptothreads > 0)
+        {
+            arcf_log_rsastats(conf);
+        }
+
         arc_close(conf->conf_libopenarc);
     }
 
@@ -1322,15 +1374,8 @@ arcf_config_free(struct arcf_config *conf)
         ARC_FREE(conf->conf_authservid);
     }
 
-    if (!LIST_EMPTY(&conf->conf_peers))
-    {
-        arcf_list_destroy(&conf->conf_peers);
-    }
-
-    if (!LIST_EMPTY(&conf->conf_internal))
-    {
-        arcf_list_destroy(&conf->conf_internal);
-    }
+    arcf_peerlist_free(conf->conf_peers);
+    arcf_peerlist_free(conf->conf_internal);
 
     if (conf->conf_data != NULL)
     {
@@ -1347,12 +1392,66 @@ arcf_config_free(struct arcf_config *conf)
         ARC_FREE(conf->conf_oversignhdrs);
     }
 
-    if (!LIST_EMPTY(&conf->conf_sealheaderchecks))
+    arcf_sealcheck_free(conf->conf_sealheaderchecks);
+
+    ARC_FREE(conf);
+}
+
+/*
+**  ARCF_CONFIG_GET -- take a reference to the current configuration
+**
+**  Parameters:
+**  	None.
+**
+**  Return value:
+**  	The current configuration handle, or NULL if the calling thread
+**  	couldn't be set up to read it.
+**
+**  Notes:
+**  	No lock is taken; arcf_config_reload() waits for any thread that
+**  	might have loaded the old handle to count its reference.
+*/
+
+static struct arcf_config *
+arcf_config_get(void)
+{
+    struct arcf_config *conf;
+
+    if (!arcf_rcu_read_lock())
     {
-        arcf_list_destroy(&conf->conf_sealheaderchecks);
+        return NULL;
     }
 
-    ARC_FREE(conf);
+    conf = atomic_load(&curconf);
+    atomic_fetch_add_explicit(&conf->conf_refcnt, 1, memory_order_relaxed);
+
+    arcf_rcu_read_unlock();
+
+    return conf;
+}
+
+/*
+**  ARCF_CONFIG_PUT -- drop a reference to a configuration
+**
+**  Parameters:
+**  	conf -- configuration handle
+**
+**  Return value:
+**  	None.
+**
+**  Side effects:
+**  	The handle is destroyed once it is no longer current and the last
+**  	connection using it lets go.
+*/
+
+static void
+arcf_config_put(struct arcf_config *conf)
+{
+    if (atomic_fetch_sub_explicit(&conf->conf_refcnt, 1,
+                                  memory_order_acq_rel) == 1)
+    {
+        arcf_config_free(conf);
+    }
 }
 
 /*
@@ -1521,12 +1620,18 @@ arcf_config_load(struct config      *data,
         config_get(data, "AuthResIP", &conf->conf_authresip,
                    sizeof conf->conf_authresip);
 
+        config_get(data, "AuthResOldestPass", &conf->conf_authresoldest,
+                   sizeof conf->conf_authresoldest);
+
         (void) config_get(data, "TemporaryDirectory", &conf->conf_tmpdir,
                           sizeof conf->conf_tmpdir);
 
         (void) config_get(data, "KeepTemporaryFiles", &conf->conf_keeptmpfiles,
                           sizeof conf->conf_keeptmpfiles);
 
+        (void) config_get(data, "CaptureCanonicalization",
+                          &conf->conf_capture, sizeof conf->conf_capture);
+
         (void) config_get(data, "MaximumHeaders", &conf->conf_maxhdrsz,
                           sizeof conf->conf_maxhdrsz);
 
@@ -1543,13 +1648,10 @@ arcf_config_load(struct config      *data,
         (void) config_get(data, "SealHeaderChecks", &str, sizeof str);
         if (str != NULL)
         {
-            bool  status;
-            char *dberr = NULL;
-
-            status = arcf_list_load(&conf->conf_sealheaderchecks, str, &dberr);
-            if (!status)
+            /* compiled once here rather than for every message */
+            conf->conf_sealheaderchecks = arcf_sealcheck_load(str, err, errlen);
+            if (conf->conf_sealheaderchecks == NULL)
             {
-                snprintf(err, errlen, "%s: arcf_list_load(): %s", str, dberr);
                 return -1;
             }
         }
@@ -1566,6 +1668,27 @@ arcf_config_load(struct config      *data,
         config_get(data, "SignatureTTL", &conf->conf_sigttl,
                    sizeof conf->conf_sigttl);
 
+        config_get(data, "BodyHashThreads", &conf->conf_bodythreads,
+                   sizeof conf->conf_bodythreads);
+
+        config_get(data, "BodyHashThreshold", &conf->conf_bodythreshold,
+                   sizeof conf->conf_bodythreshold);
+
+        config_get(data, "CryptoThreads", &conf->conf_cryptothreads,
+                   sizeof conf->conf_cryptothreads);
+
+        config_get(data, "CryptoStatsInterval", &conf->conf_cryptostats,
+                   sizeof conf->conf_cryptostats);
+
+        config_get(data, "BackgroundVerification", &conf->conf_bgverify,
+                   sizeof conf->conf_bgverify);
+
+        config_get(data, "LogAllocations", &conf->conf_logallocs,
+                   sizeof conf->conf_logallocs);
+
+        config_get(data, "MessageArenaSize", &conf->conf_arenasize,
+                   sizeof conf->conf_arenasize);
+
         str = NULL;
         config_get(data, "ResponseDisabled", &str, sizeof str);
         if (str)
@@ -1656,10 +1779,17 @@ arcf_config_load(struct config      *data,
         bool  status;
         char *dberr = NULL;
 
-        status = arcf_list_load(&conf->conf_peers, str, &dberr);
+        conf->conf_peers = arcf_peerlist_new();
+        if (conf->conf_peers == NULL)
+        {
+            snprintf(err, errlen, "arcf_peerlist_new(): %s", strerror(errno));
+            return -1;
+        }
+
+        status = arcf_peerlist_load(conf->conf_peers, str, &dberr);
         if (!status)
         {
-            snprintf(err, errlen, "%s: arcf_list_load(): %s", str, dberr);
+            snprintf(err, errlen, "%s: arcf_peerlist_load(): %s", str, dberr);
             return -1;
         }
     }
@@ -1674,10 +1804,17 @@ arcf_config_load(struct config      *data,
         bool  status;
         char *dberr = NULL;
 
-        status = arcf_list_load(&conf->conf_internal, str, &dberr);
+        conf->conf_internal = arcf_peerlist_new();
+        if (conf->conf_internal == NULL)
+        {
+            snprintf(err, errlen, "arcf_peerlist_new(): %s", strerror(errno));
+            return -1;
+        }
+
+        status = arcf_peerlist_load(conf->conf_internal, str, &dberr);
         if (!status)
         {
-            snprintf(err, errlen, "%s: arcf_list_load(): %s", str, dberr);
+            snprintf(err, errlen, "%s: arcf_peerlist_load(): %s", str, dberr);
             return -1;
         }
     }
@@ -1686,19 +1823,26 @@ arcf_config_load(struct config      *data,
         bool  status;
         char *dberr = NULL;
 
+        conf->conf_internal = arcf_peerlist_new();
+        if (conf->conf_internal == NULL)
+        {
+            snprintf(err, errlen, "arcf_peerlist_new(): %s", strerror(errno));
+            return -1;
+        }
+
         str = LOCALHOST;
-        status = arcf_addlist(&conf->conf_internal, str, &dberr);
+        status = arcf_peerlist_add(conf->conf_internal, str, &dberr);
         if (!status)
         {
-            snprintf(err, errlen, "%s: arcf_addlist(): %s", str, dberr);
+            snprintf(err, errlen, "%s: arcf_peerlist_add(): %s", str, dberr);
             return -1;
         }
 
         str = LOCALHOST6;
-        status = arcf_addlist(&conf->conf_internal, str, &dberr);
+        status = arcf_peerlist_add(conf->conf_internal, str, &dberr);
         if (!status)
         {
-            snprintf(err, errlen, "%s: arcf_addlist(): %s", str, dberr);
+            snprintf(err, errlen, "%s: arcf_peerlist_add(): %s", str, dberr);
             return -1;
         }
     }
@@ -1870,15 +2014,18 @@ arcf_config_load(struct config      *data,
     /* activate logging if requested */
     if (conf->conf_dolog)
     {
+        bool  log_stderr = false;
         char *log_facility = NULL;
 
         if (data != NULL)
         {
             (void) config_get(data, "SyslogFacility", &log_facility,
                               sizeof log_facility);
+            (void) config_get(data, "SyslogStderr", &log_stderr,
+                              sizeof log_stderr);
         }
 
-        arcf_init_syslog(log_facility);
+        arcf_init_syslog(log_facility, log_stderr);
     }
 
     return 0;
@@ -1937,10 +2084,38 @@ arcf_config_setlib(struct arcf_config *conf, char **err)
             opts |= ARC_LIBFLAGS_KEEPFILES;
         }
 
+        if (!conf->conf_authresoldest)
+        {
+            opts |= ARC_LIBFLAGS_SKIPOLDEST;
+        }
+
+        if (conf->conf_bgverify)
+        {
+            opts |= ARC_LIBFLAGS_BGVERIFY;
+        }
+
+        if (conf->conf_capture > 0)
+        {
+            opts |= ARC_LIBFLAGS_CAPTURE;
+        }
+
+        /* the event engine comes back to arc_eom() when replies arrive */
+        if (eventmode)
+        {
+            opts |= ARC_LIBFLAGS_NONBLOCK;
+        }
+
         status = arc_options(conf->conf_libopenarc, ARC_OP_SETOPT,
                              ARC_OPTS_FLAGS, &opts, sizeof opts);
     }
 
+    if (status == ARC_STAT_OK && (eventmode || dnsservers))
+    {
+        status = arc_set_dns(conf->conf_libopenarc, arcf_dns_init, NULL, 0,
+                             arcf_dns_close, arcf_dns_start, arcf_dns_cancel,
+                             arcf_dns_waitreply);
+    }
+
     if (conf->conf_fixedtime != 0)
     {
         arc_options(conf->conf_libopenarc, ARC_OP_SETOPT, ARC_OPTS_FIXEDTIME,
@@ -1988,6 +2163,82 @@ arcf_config_setlib(struct arcf_config *conf, char **err)
         return false;
     }
 
+    if (conf->conf_cryptothreads > 0)
+    {
+        unsigned int threads = conf->conf_cryptothreads;
+
+        status = arc_options(conf->conf_libopenarc, ARC_OP_SETOPT,
+                             ARC_OPTS_RSATHREADS, &threads, sizeof threads);
+        if (status != ARC_STAT_OK)
+        {
+            if (err != NULL)
+            {
+                *err = "failed to start RSA worker threads";
+            }
+            return false;
+        }
+    }
+
+    if (conf->conf_bodythreads > 0)
+    {
+        unsigned int threads = conf->conf_bodythreads;
+
+        status = arc_options(conf->conf_libopenarc, ARC_OP_SETOPT,
+                             ARC_OPTS_BODYTHREADS, &threads, sizeof threads);
+
+        if (status == ARC_STAT_OK && conf->conf_bodythreshold > 0)
+        {
+            size_t threshold = conf->conf_bodythreshold;
+
+            status = arc_options(conf->conf_libopenarc, ARC_OP_SETOPT,
+                                 ARC_OPTS_BODYTHRESHOLD, &threshold,
+                                 sizeof threshold);
+        }
+
+        if (status != ARC_STAT_OK)
+        {
+            if (err != NULL)
+            {
+                *err = "failed to set ARC library options";
+            }
+            return false;
+        }
+    }
+
+    if (conf->conf_arenasize > 0)
+    {
+        size_t arenasize = conf->conf_arenasize;
+
+        status = arc_options(conf->conf_libopenarc, ARC_OP_SETOPT,
+                             ARC_OPTS_ARENASIZE, &arenasize, sizeof arenasize);
+
+        if (status != ARC_STAT_OK)
+        {
+            if (err != NULL)
+            {
+                *err = "failed to set ARC library options";
+            }
+            return false;
+        }
+    }
+
+    if (conf->conf_capture > 0)
+    {
+        unsigned int sample = conf->conf_capture;
+
+        status = arc_options(conf->conf_libopenarc, ARC_OP_SETOPT,
+                             ARC_OPTS_CAPTURESAMPLE, &sample, sizeof sample);
+
+        if (status != ARC_STAT_OK)
+        {
+            if (err != NULL)
+            {
+                *err = "failed to set ARC library options";
+            }
+            return false;
+        }
+    }
+
     if (conf->conf_testkeys)
     {
         status = arc_options(conf->conf_libopenarc, ARC_OP_SETOPT,
@@ -2053,6 +2304,9 @@ arcf_config_setlib(struct arcf_config *conf, char **err)
 **  Side effects:
 **  	If a reload was requested and is successful, "curconf" now points
 **  	to a new configuration handle.
+**
+**  Notes:
+**  	Called from the reload thread, so connections never wait on it.
 */
 
 static void
@@ -2063,7 +2317,7 @@ arcf_config_reload(void)
 
     pthread_mutex_lock(&conf_lock);
 
-    if (!reload)
+    if (!reload || curconf == NULL)
     {
         pthread_mutex_unlock(&conf_lock);
         return;
@@ -2168,15 +2422,17 @@ arcf_config_reload(void)
         }
         else
         {
-            if (curconf->conf_refcnt == 0)
-            {
-                arcf_config_free(curconf);
-            }
+            struct arcf_config *old;
 
             dolog = new->conf_dolog;
-            curconf = new;
             new->conf_data = cfg;
 
+            /* publish it, wait for readers of the old one to have counted
+             * themselves, then let go of it */
+            old = atomic_exchange(&curconf, new);
+            arcf_rcu_synchronize();
+            arcf_config_put(old);
+
             if (new->conf_dolog)
             {
                 syslog(LOG_INFO, "configuration reloaded from %s", conffile);
@@ -2223,502 +2479,273 @@ arcf_stdio(void)
 }
 
 /*
-**  ARCF_INITCONTEXT -- initialize filter context
+**  ARCF_FREECONN -- free a connection context for good
 **
 **  Parameters:
-**  	conf -- pointer to the configuration for this connection
+**  	vp -- connection context, already reset
 **
 **  Return value:
-**  	A pointer to an allocated and initialized filter context, or NULL
-**  	on failure.
-**
-**  Side effects:
-**  	Crop circles near Birmingham.
+**  	None.
 */
 
-static msgctx
-arcf_initcontext(struct arcf_config *conf)
+static void
+arcf_freeconn(void *vp)
 {
-    msgctx ctx;
+    connctx cc = vp;
 
-    assert(conf != NULL);
-
-    ctx = ARC_CALLOC(1, sizeof(struct msgctx));
-    if (ctx == NULL)
-    {
-        return NULL;
-    }
-
-    return ctx;
+    ARC_FREE(cc->cctx_iov);
+    ARC_FREE(cc);
 }
 
 /*
-**  ARCF_CLEANUP -- release local resources related to a message
+**  ARCF_FREEMSG -- free a message context for good
 **
 **  Parameters:
-**  	ctx -- milter context
+**  	vp -- message context, already reset
 **
 **  Return value:
 **  	None.
 */
 
 static void
-arcf_cleanup(SMFICTX *ctx)
+arcf_freemsg(void *vp)
 {
-    msgctx  afc;
-    connctx cc;
-
-    assert(ctx != NULL);
-
-    cc = (connctx) arcf_getpriv(ctx);
-
-    if (cc == NULL)
-    {
-        return;
-    }
+    msgctx afc = vp;
 
-    afc = cc->cctx_msg;
-
-    /* release memory, reset state */
-    if (afc != NULL)
+    arcf_hdrq_free(&afc->mctx_hq);
+    if (afc->mctx_tmpstr != NULL)
     {
-        if (afc->mctx_hqhead != NULL)
-        {
-            Header hdr;
-            Header prev;
-
-            hdr = afc->mctx_hqhead;
-            while (hdr != NULL)
-            {
-                ARC_FREE(hdr->hdr_hdr);
-                ARC_FREE(hdr->hdr_val);
-                prev = hdr;
-                hdr = hdr->hdr_next;
-                ARC_FREE(prev);
-            }
-        }
-
-        if (afc->mctx_arcmsg != NULL)
-        {
-            arc_free(afc->mctx_arcmsg);
-        }
-
-        if (afc->mctx_tmpstr != NULL)
-        {
-            arc_dstring_free(afc->mctx_tmpstr);
-        }
-
-        ARC_FREE(afc);
-        cc->cctx_msg = NULL;
+        arc_dstring_free(afc->mctx_tmpstr);
     }
+    ARC_FREE(afc);
 }
 
 /*
-**  ARCF_GETARC -- retrieve ARC handle in use
+**  ARCF_FREEHDR -- free a header field node for good
 **
 **  Parameters:
-**  	vp -- opaque pointer (from test.c)
+**  	vp -- header field node
 **
 **  Return value:
-**  	ARC handle in use, or NULL.
+**  	None.
 */
 
-ARC_MESSAGE *
-arcf_getarc(void *vp)
+static void
+arcf_freehdr(void *vp)
 {
-    struct connctx *cc;
-
-    assert(vp != NULL);
+    Header hdr = vp;
 
-    cc = vp;
-    if (cc->cctx_msg != NULL)
-    {
-        return cc->cctx_msg->mctx_arcmsg;
-    }
-    else
-    {
-        return NULL;
-    }
+    ARC_FREE(hdr->hdr_hdr);
+    ARC_FREE(hdr);
 }
 
 /*
-**  ARCF_FINDHEADER -- find a header
+**  ARCF_NEWCONN -- get a connection context
 **
 **  Parameters:
-**  	afc -- filter context
-**  	hname -- name of the header of interest
-**  	instance -- which instance is wanted (0 = first)
+**  	None.
 **
 **  Return value:
-**  	Header handle, or NULL if not found.
+**  	A cleared connection context, or NULL on failure.
 **
 **  Notes:
-**  	Negative values of "instance" search backwards from the end.
+**  	One left by an earlier connection on this thread is used if there
+**  	is one, along with its header field buffer.
 */
 
-static Header
-arcf_findheader(msgctx afc, char *hname, int instance)
+static connctx
+arcf_newconn(void)
 {
-    Header hdr;
-
-    assert(afc != NULL);
-    assert(hname != NULL);
-
-    if (instance < 0)
-    {
-        hdr = afc->mctx_hqtail;
-    }
-    else
-    {
-        hdr = afc->mctx_hqhead;
-    }
+    connctx cc;
 
-    while (hdr != NULL)
+    cc = arcf_pool_get(&connpool);
+    if (cc == NULL)
     {
-        if (strcasecmp(hdr->hdr_hdr, hname) == 0)
-        {
-            if (instance == 0 || instance == -1)
-            {
-                return hdr;
-            }
-            else if (instance > 0)
-            {
-                instance--;
-            }
-            else
-            {
-                instance++;
-            }
-        }
-
-        if (instance < 0)
-        {
-            hdr = hdr->hdr_prev;
-        }
-        else
-        {
-            hdr = hdr->hdr_next;
-        }
+        cc = ARC_CALLOC(1, sizeof(struct connctx));
     }
 
-    return NULL;
+    return cc;
 }
 
 /*
-**  ARCF_CHECKHOST -- check the peerlist for a host and its wildcards
+**  ARCF_PUTCONN -- give back a connection context
 **
 **  Parameters:
-**  	list -- list to check
-**  	host -- hostname to find
+**  	cc -- connection context, with its handle and configuration released
 **
 **  Return value:
-**  	true if there's a match, false otherwise.
+**  	None.
 */
 
-bool
-arcf_checkhost(struct conflist *list, char *host)
+static void
+arcf_putconn(connctx cc)
 {
-    char               *p;
-    struct configvalue *node;
-    char                buf[BUFRSZ + 1];
+    struct iovec *iov = cc->cctx_iov;
+    size_t        iovsz = cc->cctx_iovsz;
 
-    assert(host != NULL);
+    memset(cc, '\0', sizeof *cc);
+    cc->cctx_iov = iov;
+    cc->cctx_iovsz = iovsz;
 
-    /* short circuits */
-    if (list == NULL || host[0] == '\0')
+    if (!arcf_pool_put(&connpool, cc))
     {
-        return false;
+        arcf_freeconn(cc);
     }
-
-    /* iterate over the possibilities */
-    for (p = host; p != NULL; p = strchr(p + 1, '.'))
-    {
-        /* try the negative case */
-        snprintf(buf, sizeof buf, "!%s", p);
-        LIST_FOREACH(node, list, entries)
-        if (strcmp(node->value, buf) == 0)
-        {
-            return false;
-        }
-
-        /* ...and now the positive case */
-        LIST_FOREACH(node, list, entries)
-        if (strcmp(node->value, &buf[1]) == 0)
-        {
-            return true;
-        }
-    }
-
-    return false;
 }
 
 /*
-**  ARCF_CHECKIP -- check a peerlist table for an IP address or its matching
-**                 wildcards
+**  ARCF_INITCONTEXT -- initialize filter context
 **
 **  Parameters:
-**  	list -- list to check
-**  	ip -- IP address to find
+**  	conf -- pointer to the configuration for this connection
 **
 **  Return value:
-**  	true if there's a match, false otherwise.
+**  	A pointer to an allocated and initialized filter context, or NULL
+**  	on failure.
+**
+**  Side effects:
+**  	Crop circles near Birmingham.
+**
+**  Notes:
+**  	A context left by an earlier message on this thread is used if
+**  	there is one, along with its header index and temporary string.
 */
 
-bool
-arcf_checkip(struct conflist *list, struct sockaddr *ip)
+static msgctx
+arcf_initcontext(struct arcf_config *conf)
 {
-    char ipbuf[ARC_MAXHOSTNAMELEN + 1];
+    msgctx ctx;
 
-    assert(ip != NULL);
+    assert(conf != NULL);
 
-    /* short circuit */
-    if (list == NULL)
+    ctx = arcf_pool_get(&msgpool);
+    if (ctx != NULL)
     {
-        return false;
+        ctx->mctx_reused++;
+        return ctx;
     }
 
-#if AF_INET6
-    if (ip->sa_family == AF_INET6)
+    ctx = ARC_CALLOC(1, sizeof(struct msgctx));
+    if (ctx == NULL)
     {
-        int                 bits;
-        size_t              dst_len;
-        size_t              iplen;
-        char               *dst;
-        struct configvalue *node;
-        struct sockaddr_in6 sin6;
-        struct in6_addr     addr;
+        return NULL;
+    }
+    ctx->mctx_allocs++;
 
-        memcpy(&sin6, ip, sizeof sin6);
+    return ctx;
+}
 
-        memcpy(&addr, &sin6.sin6_addr, sizeof addr);
+/*
+**  ARCF_CLEANUP -- release local resources related to a message
+**
+**  Parameters:
+**  	ctx -- milter context
+**
+**  Return value:
+**  	None.
+*/
 
-        memset(ipbuf, '\0', sizeof ipbuf);
-        ipbuf[0] = '!';
+static void
+arcf_cleanup(SMFICTX *ctx)
+{
+    msgctx  afc;
+    connctx cc;
 
-        dst = &ipbuf[1];
-        dst_len = sizeof ipbuf - 1;
+    assert(ctx != NULL);
 
-        inet_ntop(AF_INET6, &addr, dst, dst_len);
-        arc_lowercase(dst);
-        iplen = strlen(dst);
+    cc = (connctx) arcf_getpriv(ctx);
 
-        LIST_FOREACH(node, list, entries)
-        if (strcmp(ipbuf, node->value) == 0)
-        {
-            return false;
-        }
-        LIST_FOREACH(node, list, entries)
-        if (strcmp(&ipbuf[1], node->value) == 0)
-        {
-            return true;
-        }
+    if (cc == NULL)
+    {
+        return;
+    }
 
-        /* try it with square brackets */
-        memmove(&ipbuf[2], &ipbuf[1], iplen + 1);
-        ipbuf[1] = '[';
-        ipbuf[iplen + 2] = ']';
+    afc = cc->cctx_msg;
 
-        LIST_FOREACH(node, list, entries)
-        if (strcmp(ipbuf, node->value) == 0)
-        {
-            return false;
-        }
-        LIST_FOREACH(node, list, entries)
-        if (strcmp(&ipbuf[1], node->value) == 0)
-        {
-            return true;
-        }
+    /* release memory, reset state */
+    if (afc != NULL)
+    {
+        struct arcf_config *conf = cc->cctx_config;
+        struct arcf_hdrq    hq;
+        struct arc_dstring *tmpstr;
+        Header              hdr;
+        Header              next;
 
-        /* iterate over possible bitwise expressions */
-        for (bits = 0; bits <= 128; bits++)
+        for (hdr = arcf_hdrq_reset(&afc->mctx_hq); hdr != NULL; hdr = next)
         {
-            size_t sz;
-
-            /* try this one */
-            memset(ipbuf, '\0', sizeof ipbuf);
-            ipbuf[0] = '!';
-
-            dst = &ipbuf[1];
-            dst_len = sizeof ipbuf - 1;
-
-            inet_ntop(AF_INET6, &addr, dst, dst_len);
-            arc_lowercase(dst);
-            iplen = strlen(dst);
-
-            sz = strlcat(ipbuf, "/", sizeof ipbuf);
-            if (sz >= sizeof ipbuf)
+            next = hdr->hdr_next;
+            if (!arcf_pool_put(&hdrpool, hdr))
             {
-                return false;
-            }
-
-            dst = &ipbuf[sz];
-            dst_len = sizeof ipbuf - sz;
-
-            sz = snprintf(dst, dst_len, "%d", 128 - bits);
-            if (sz >= sizeof ipbuf)
-            {
-                return false;
-            }
-
-            LIST_FOREACH(node, list, entries)
-            if (strcmp(ipbuf, node->value) == 0)
-            {
-                return false;
-            }
-            LIST_FOREACH(node, list, entries)
-            if (strcmp(&ipbuf[1], node->value) == 0)
-            {
-                return true;
-            }
-
-            /* try it with square brackets */
-            memmove(&ipbuf[2], &ipbuf[1], iplen + 1);
-            ipbuf[1] = '[';
-            ipbuf[iplen + 2] = ']';
-            ipbuf[iplen + 3] = '\0';
-
-            sz = strlcat(ipbuf, "/", sizeof ipbuf);
-            if (sz >= sizeof ipbuf)
-            {
-                return false;
-            }
-
-            dst = &ipbuf[sz];
-            dst_len = sizeof ipbuf - sz;
-
-            sz = snprintf(dst, dst_len, "%d", 128 - bits);
-            if (sz >= sizeof ipbuf)
-            {
-                return false;
+                arcf_freehdr(hdr);
             }
+        }
 
-            LIST_FOREACH(node, list, entries)
-            if (strcmp(ipbuf, node->value) == 0)
-            {
-                return false;
-            }
-            LIST_FOREACH(node, list, entries)
-            if (strcmp(&ipbuf[1], node->value) == 0)
+        /* keep the handle for the connection's next message */
+        if (afc->mctx_arcmsg != NULL)
+        {
+            if (cc->cctx_arcmsg == NULL)
             {
-                return true;
+                cc->cctx_arcmsg = afc->mctx_arcmsg;
             }
-
-            /* flip off a bit */
-            if (bits != 128)
+            else
             {
-                int idx;
-                int bit;
-
-                idx = 15 - (bits / 8);
-                bit = bits % 8;
-                addr.s6_addr[idx] &= ~(1 << bit);
+                arc_free(afc->mctx_arcmsg);
             }
         }
-    }
-#endif /* AF_INET6 */
 
-    if (ip->sa_family == AF_INET)
-    {
-        int                 c;
-        int                 bits;
-        size_t              iplen;
-        struct configvalue *node;
-        struct in_addr      addr;
-        struct in_addr      mask;
-        struct sockaddr_in  sin;
-
-        memcpy(&sin, ip, sizeof sin);
-        memcpy(&addr.s_addr, &sin.sin_addr, sizeof addr.s_addr);
-
-        ipbuf[0] = '!';
-        (void) arcf_inet_ntoa(addr, &ipbuf[1], sizeof ipbuf - 1);
-        LIST_FOREACH(node, list, entries)
-        if (strcmp(ipbuf, node->value) == 0)
+        if (afc->mctx_tmpstr != NULL)
         {
-            return false;
+            arc_dstring_blank(afc->mctx_tmpstr);
         }
-        LIST_FOREACH(node, list, entries)
-        if (strcmp(&ipbuf[1], node->value) == 0)
+
+        if (conf->conf_dolog && conf->conf_logallocs)
         {
-            return true;
+            syslog(LOG_INFO, "%s: %u allocations, %u objects reused",
+                   JOBID(afc->mctx_jobid), afc->mctx_allocs,
+                   afc->mctx_reused);
         }
 
-        /* try it with square brackets */
-        memmove(&ipbuf[2], &ipbuf[1], strlen(&ipbuf[1]) + 1);
-        ipbuf[1] = '[';
-        ipbuf[strlen(ipbuf)] = ']';
+        /* keep the (now empty) header index and string for reuse */
+        hq = afc->mctx_hq;
+        tmpstr = afc->mctx_tmpstr;
+        memset(afc, '\0', sizeof *afc);
+        afc->mctx_hq = hq;
+        afc->mctx_tmpstr = tmpstr;
 
-        LIST_FOREACH(node, list, entries)
-        if (strcmp(ipbuf, node->value) == 0)
+        if (!arcf_pool_put(&msgpool, afc))
         {
-            return false;
+            arcf_freemsg(afc);
         }
-        LIST_FOREACH(node, list, entries)
-        if (strcmp(&ipbuf[1], node->value) == 0)
-        {
-            return true;
-        }
-
-        /* iterate over possible bitwise expressions */
-        for (bits = 32; bits >= 0; bits--)
-        {
-            if (bits == 32)
-            {
-                mask.s_addr = 0xffffffff;
-            }
-            else
-            {
-                mask.s_addr = 0;
-                for (c = 0; c < bits; c++)
-                {
-                    mask.s_addr |= htonl(1 << (31 - c));
-                }
-            }
-
-            addr.s_addr = addr.s_addr & mask.s_addr;
-
-            memset(ipbuf, '\0', sizeof ipbuf);
-            ipbuf[0] = '!';
-            (void) arcf_inet_ntoa(addr, &ipbuf[1], sizeof ipbuf - 1);
-            iplen = strlen(&ipbuf[1]);
-            c = strlen(ipbuf);
-            ipbuf[c] = '/';
-            c++;
+        cc->cctx_msg = NULL;
+    }
+}
 
-            snprintf(&ipbuf[c], sizeof ipbuf - c, "%d", bits);
+/*
+**  ARCF_GETARC -- retrieve ARC handle in use
+**
+**  Parameters:
+**  	vp -- opaque pointer (from test.c)
+**
+**  Return value:
+**  	ARC handle in use, or NULL.
+*/
 
-            LIST_FOREACH(node, list, entries)
-            if (strcmp(ipbuf, node->value) == 0)
-            {
-                return false;
-            }
-            LIST_FOREACH(node, list, entries)
-            if (strcmp(&ipbuf[1], node->value) == 0)
-            {
-                return true;
-            }
+ARC_MESSAGE *
+arcf_getarc(void *vp)
+{
+    struct connctx *cc;
 
-            /* try it with square brackets */
-            memmove(&ipbuf[2], &ipbuf[1], strlen(&ipbuf[1]) + 1);
-            ipbuf[1] = '[';
-            ipbuf[iplen + 2] = ']';
-            ipbuf[iplen + 3] = '/';
-            snprintf(&ipbuf[iplen + 4], sizeof ipbuf - iplen - 4, "%d", bits);
+    assert(vp != NULL);
 
-            LIST_FOREACH(node, list, entries)
-            if (strcmp(ipbuf, node->value) == 0)
-            {
-                return false;
-            }
-            LIST_FOREACH(node, list, entries)
-            if (strcmp(&ipbuf[1], node->value) == 0)
-            {
-                return true;
-            }
-        }
+    cc = vp;
+    if (cc->cctx_msg != NULL)
+    {
+        return cc->cctx_msg->mctx_arcmsg;
+    }
+    else
+    {
+        return NULL;
     }
-
-    return false;
 }
 
 #if SMFI_VERSION >= 0x01000000
@@ -2759,13 +2786,11 @@ mlfi_negotiate(SMFICTX       *ctx,
     connctx       cc;
     struct arcf_config *conf;
 
-    arcf_config_reload();
-
     /* initialize connection context */
-    cc = ARC_CALLOC(1, sizeof(struct connctx));
+    cc = arcf_newconn();
     if (cc == NULL)
     {
-        if (curconf->conf_dolog)
+        if (dolog)
         {
             syslog(LOG_ERR, "mlfi_negotiate(): malloc(): %s", strerror(errno));
         }
@@ -2773,13 +2798,21 @@ mlfi_negotiate(SMFICTX       *ctx,
         return SMFIS_TEMPFAIL;
     }
 
-    pthread_mutex_lock(&conf_lock);
+    conf = arcf_config_get();
+    if (conf == NULL)
+    {
+        if (dolog)
+        {
+            syslog(LOG_ERR, "mlfi_negotiate(): arcf_config_get(): %s",
+                   strerror(ENOMEM));
+        }
 
-    cc->cctx_config = curconf;
-    curconf->conf_refcnt++;
-    conf = curconf;
+        arcf_putconn(cc);
 
-    pthread_mutex_unlock(&conf_lock);
+        return SMFIS_TEMPFAIL;
+    }
+
+    cc->cctx_config = conf;
 
     /* verify the actions we need are available */
     if ((f0 & reqactions) != reqactions)
@@ -2792,11 +2825,9 @@ mlfi_negotiate(SMFICTX       *ctx,
                 f0, reqactions);
         }
 
-        pthread_mutex_lock(&conf_lock);
-        conf->conf_refcnt--;
-        pthread_mutex_unlock(&conf_lock);
+        arcf_config_put(conf);
 
-        ARC_FREE(cc);
+        arcf_putconn(cc);
 
         return SMFIS_REJECT;
     }
@@ -2852,40 +2883,47 @@ mlfi_negotiate(SMFICTX       *ctx,
 sfsistat
 mlfi_connect(SMFICTX *ctx, char *host, _SOCK_ADDR *ip)
 {
-    connctx cc;
-
-    arcf_config_reload();
+    connctx             cc;
+    struct arcf_config *conf;
 
     /* copy hostname and IP information to a connection context */
     cc = arcf_getpriv(ctx);
     if (cc == NULL)
     {
-        cc = ARC_CALLOC(1, sizeof(struct connctx));
+        conf = arcf_config_get();
+        if (conf == NULL)
+        {
+            if (dolog)
+            {
+                syslog(LOG_ERR, "%s arcf_config_get(): %s", host,
+                       strerror(ENOMEM));
+            }
+
+            return SMFIS_TEMPFAIL;
+        }
+
+        cc = arcf_newconn();
         if (cc == NULL)
         {
-            pthread_mutex_lock(&conf_lock);
+            int retval = conf->conf_ret_unable;
 
-            if (curconf->conf_dolog)
+            if (conf->conf_dolog)
             {
                 syslog(LOG_ERR, "%s malloc(): %s", host, strerror(errno));
             }
 
-            int retval = curconf->conf_ret_unable;
-            pthread_mutex_unlock(&conf_lock);
+            arcf_config_put(conf);
 
             return retval;
         }
 
-        pthread_mutex_lock(&conf_lock);
-
-        cc->cctx_config = curconf;
-        curconf->conf_refcnt++;
-
-        pthread_mutex_unlock(&conf_lock);
+        cc->cctx_config = conf;
 
         arcf_setpriv(ctx, cc);
     }
 
+    conf = cc->cctx_config;
+
     arc_lowercase(host);
 
     if (host != NULL)
@@ -2916,30 +2954,30 @@ mlfi_connect(SMFICTX *ctx, char *host, _SOCK_ADDR *ip)
 
     /* if the client is on the peer list, then ignore it */
     if (((host != NULL && host[0] != '[') &&
-         arcf_checkhost(&curconf->conf_peers, host)) ||
-        (ip != NULL && arcf_checkip(&curconf->conf_peers, ip)))
+         arcf_peerlist_checkhost(conf->conf_peers, host)) ||
+        (ip != NULL && arcf_peerlist_checkip(conf->conf_peers, ip)))
     {
-        if (curconf->conf_dolog)
+        if (conf->conf_dolog)
         {
             syslog(
                 LOG_INFO, "peer connection from %s, returning %s", host,
-                arc_code_to_name(arcf_responses, curconf->conf_ret_disabled));
+                arc_code_to_name(arcf_responses, conf->conf_ret_disabled));
         }
-        return curconf->conf_ret_disabled;
+        return conf->conf_ret_disabled;
     }
 
     /* infer operating mode if not explicitly set */
-    if (curconf->conf_mode != 0)
+    if (conf->conf_mode != 0)
     {
-        cc->cctx_mode = curconf->conf_mode;
+        cc->cctx_mode = conf->conf_mode;
     }
     else
     {
         char *modestr;
 
         if (((host != NULL && host[0] != '[') &&
-             arcf_checkhost(&curconf->conf_internal, host)) ||
-            (ip != NULL && arcf_checkip(&curconf->conf_internal, ip)))
+             arcf_peerlist_checkhost(conf->conf_internal, host)) ||
+            (ip != NULL && arcf_peerlist_checkip(conf->conf_internal, ip)))
         {
             /* internal host; assume outbound, so sign */
             cc->cctx_mode = ARC_MODE_SIGN;
@@ -2952,7 +2990,7 @@ mlfi_connect(SMFICTX *ctx, char *host, _SOCK_ADDR *ip)
             modestr = "verify";
         }
 
-        if (curconf->conf_dolog)
+        if (conf->conf_dolog)
         {
             syslog(LOG_INFO, "assuming %s mode for host %s", modestr,
                    cc->cctx_host);
@@ -3042,9 +3080,190 @@ mlfi_envfrom(SMFICTX *ctx, char **envfrom)
 }
 
 /*
-**  MLFI_HEADER -- handler for mail headers; stores the header in a vector
-**                 of headers for later perusal, removing RFC822 comment
-**                 substrings
+**  ARCF_MSGSTART -- get a libopenarc handle for the current message
+**
+**  Parameters:
+**  	cc -- connection context
+**  	afc -- message context
+**
+**  Return value:
+**  	false if no handle could be set up; this has been logged.
+*/
+
+static bool
+arcf_msgstart(connctx cc, msgctx afc)
+{
+    const char         *err = NULL;
+    struct arcf_config *conf;
+
+    conf = cc->cctx_config;
+
+    if (cc->cctx_arcmsg != NULL)
+    {
+        afc->mctx_arcmsg = cc->cctx_arcmsg;
+        cc->cctx_arcmsg = NULL;
+
+        if (arc_message_reset(afc->mctx_arcmsg, conf->conf_canonhdr,
+                              conf->conf_canonbody, conf->conf_signalg,
+                              cc->cctx_mode, &err) != ARC_STAT_OK)
+        {
+            arc_free(afc->mctx_arcmsg);
+            afc->mctx_arcmsg = NULL;
+        }
+    }
+    else
+    {
+        afc->mctx_arcmsg = arc_message(conf->conf_libopenarc,
+                                       conf->conf_canonhdr,
+                                       conf->conf_canonbody,
+                                       conf->conf_signalg, cc->cctx_mode,
+                                       &err);
+    }
+
+    if (afc->mctx_arcmsg == NULL)
+    {
+        if (conf->conf_dolog)
+        {
+            syslog(LOG_INFO, "%s: can't initialize ARC handle: %s",
+                   afc->mctx_jobid, err);
+        }
+
+        return false;
+    }
+
+    return true;
+}
+
+/*
+**  ARCF_FEEDHEADER -- hand one header field to libopenarc
+**
+**  Parameters:
+**  	cc -- connection context
+**  	afc -- message context, with a libopenarc handle
+**  	name -- field name
+**  	value -- field value, with milter-style bare LF line endings
+**
+**  Return value:
+**  	An ARC_STAT_* constant.
+**
+**  Notes:
+**  	The field is passed in pieces so it's copied only once: name,
+**  	separator, then the value split wherever a CR has to be added
+**  	before a bare LF.  Line breaks are found with memchr(), so the
+**  	usual single-line field is one piece.
+*/
+
+static ARC_STAT
+arcf_feedheader(connctx cc, msgctx afc, const char *name, const char *value)
+{
+    size_t        n;
+    size_t        len;
+    const char   *p;
+    const char   *q;
+    const char   *end;
+    struct iovec *iov;
+
+    len = strlen(value);
+    end = value + len;
+
+    n = 3;
+    for (p = memchr(value, '\n', len); p != NULL;
+         p = memchr(p + 1, '\n', end - p - 1))
+    {
+        n += 2;
+    }
+
+    if (n > cc->cctx_iovsz)
+    {
+        iov = ARC_REALLOC(cc->cctx_iov, n * sizeof *iov);
+        if (iov == NULL)
+        {
+            return ARC_STAT_NORESOURCE;
+        }
+        cc->cctx_iov = iov;
+        cc->cctx_iovsz = n;
+        afc->mctx_allocs++;
+    }
+
+    iov = cc->cctx_iov;
+    n = 0;
+
+    iov[n].iov_base = (void *) name;
+    iov[n++].iov_len = strlen(name);
+    iov[n].iov_base = ": ";
+    iov[n++].iov_len = cc->cctx_noleadspc ? 1 : 2;
+
+    q = value;
+    for (p = memchr(value, '\n', len); p != NULL;
+         p = memchr(p + 1, '\n', end - p - 1))
+    {
+        if (p == value || p[-1] != '\r')
+        {
+            iov[n].iov_base = (void *) q;
+            iov[n++].iov_len = p - q;
+            iov[n].iov_base = "\r";
+            iov[n++].iov_len = 1;
+            q = p;
+        }
+    }
+    iov[n].iov_base = (void *) q;
+    iov[n++].iov_len = end - q;
+
+    return arc_header_field_iov(afc->mctx_arcmsg, iov, n);
+}
+
+/*
+**  ARCF_KEEPHEADER -- decide whether a header field is needed after EOH
+**
+**  Parameters:
+**  	cc -- connection context
+**  	name -- field name
+**
+**  Return value:
+**  	true if the filter itself will look at fields with this name again.
+*/
+
+static bool
+arcf_keepheader(connctx cc, const char *name)
+{
+    struct arcf_config *conf;
+
+    conf = cc->cctx_config;
+
+    /* Authentication-Results, to be merged into the seal */
+    if (BITSET(ARC_MODE_SIGN, cc->cctx_mode) &&
+        strcasecmp(name, AUTHRESULTSHDR) == 0)
+    {
+        return true;
+    }
+
+    /* RFC5322 header requirements, which are only counted */
+    if (conf->conf_reqhdrs)
+    {
+        for (size_t n = 0; n < sizeof reqhdrs / sizeof reqhdrs[0]; n++)
+        {
+            if (strcasecmp(name, reqhdrs[n].rh_name) == 0)
+            {
+                return true;
+            }
+        }
+    }
+
+#ifdef USE_JANSSON
+    /* SealHeaderChecks targets */
+    if (conf->conf_sealheaderchecks != NULL &&
+        arcf_sealcheck_wants(conf->conf_sealheaderchecks, name))
+    {
+        return true;
+    }
+#endif /* USE_JANSSON */
+
+    return false;
+}
+
+/*
+**  MLFI_HEADER -- handler for mail headers; passes each field to libopenarc
+**                 as it arrives and keeps the ones the filter needs again
 **
 **  Parameters:
 **  	ctx -- milter context
@@ -3061,6 +3280,11 @@ mlfi_header(SMFICTX *ctx, char *headerf, char *headerv)
     msgctx              afc;
     connctx             cc;
     Header              newhdr;
+    char               *p;
+    char               *buf;
+    size_t              flen;
+    size_t              vlen;
+    ARC_STAT            status;
     struct arcf_config *conf;
 
     assert(ctx != NULL);
@@ -3102,43 +3326,7 @@ mlfi_header(SMFICTX *ctx, char *headerf, char *headerv)
         return SMFIS_CONTINUE;
     }
 
-    newhdr = ARC_CALLOC(1, sizeof(struct Header));
-    if (newhdr == NULL)
-    {
-        if (conf->conf_dolog)
-        {
-            syslog(LOG_ERR, "malloc(): %s", strerror(errno));
-        }
-
-        arcf_cleanup(ctx);
-        return conf->conf_ret_unable;
-    }
-
-    newhdr->hdr_hdr = ARC_STRDUP(headerf);
-
-    if (afc->mctx_tmpstr == NULL)
-    {
-        afc->mctx_tmpstr = arc_dstring_new(BUFRSZ, 0, NULL, NULL);
-        if (afc->mctx_tmpstr == NULL)
-        {
-            if (conf->conf_dolog)
-            {
-                syslog(LOG_ERR, "arc_dstring_new() failed");
-            }
-
-            ARC_FREE(newhdr->hdr_hdr);
-            ARC_FREE(newhdr);
-
-            arcf_cleanup(ctx);
-
-            return conf->conf_ret_unable;
-        }
-    }
-    else
-    {
-        arc_dstring_blank(afc->mctx_tmpstr);
-    }
-
+    p = headerv;
     if (!cc->cctx_noleadspc)
     {
         /*
@@ -3165,55 +3353,117 @@ mlfi_header(SMFICTX *ctx, char *headerf, char *headerv)
         **  it).
         */
 
-        char *p;
-
-        p = headerv;
         while (isascii(*p) && isspace(*p))
         {
             p++;
         }
-
-        arc_dstring_copy(afc->mctx_tmpstr, p);
     }
-    else
+
+    flen = strlen(headerf);
+    vlen = strlen(p);
+    afc->mctx_hdrbytes += flen + 1;
+    afc->mctx_hdrbytes += vlen + 1;
+
+    /*
+    **  Start the library's work on the first field.  Failures are held
+    **  until EOH, where the RFC5322 and SealHeaderChecks tests that come
+    **  first may still decide the message isn't ours to process.
+    */
+
+    if (afc->mctx_hdrstat == ARC_STAT_OK && afc->mctx_arcmsg == NULL)
     {
-        arc_dstring_copy(afc->mctx_tmpstr, headerv);
+        if (afc->mctx_jobid == NULL)
+        {
+            afc->mctx_jobid = (unsigned char *) arcf_getsymval(ctx, "i");
+            if (afc->mctx_jobid == NULL || afc->mctx_jobid[0] == '\0')
+            {
+                afc->mctx_jobid = (unsigned char *) JOBIDUNKNOWN;
+            }
+        }
+
+        if (!arcf_msgstart(cc, afc))
+        {
+            afc->mctx_hdrstat = ARC_STAT_INTERNAL;
+        }
     }
 
-    newhdr->hdr_val = ARC_STRDUP(arc_dstring_get(afc->mctx_tmpstr));
+    if (afc->mctx_hdrstat == ARC_STAT_OK)
+    {
+        status = arcf_feedheader(cc, afc, headerf, p);
+        if (status != ARC_STAT_OK)
+        {
+            if (conf->conf_dolog)
+            {
+                syslog(LOG_INFO, "%s: error processing header field \"%s\"",
+                       afc->mctx_jobid, headerf);
+            }
 
-    newhdr->hdr_next = NULL;
-    newhdr->hdr_prev = afc->mctx_hqtail;
+            afc->mctx_hdrstat = status;
+        }
+    }
 
-    if (newhdr->hdr_hdr == NULL || newhdr->hdr_val == NULL)
+    if (!arcf_keepheader(cc, headerf))
     {
-        if (conf->conf_dolog)
+        return SMFIS_CONTINUE;
+    }
+
+    /* name and value share one buffer, kept with the node for reuse */
+    newhdr = arcf_pool_get(&hdrpool);
+    if (newhdr != NULL)
+    {
+        afc->mctx_reused++;
+    }
+    else
+    {
+        newhdr = ARC_CALLOC(1, sizeof(struct Header));
+        if (newhdr == NULL)
         {
-            syslog(LOG_ERR, "malloc(): %s", strerror(errno));
+            if (conf->conf_dolog)
+            {
+                syslog(LOG_ERR, "malloc(): %s", strerror(errno));
+            }
+
+            arcf_cleanup(ctx);
+            return conf->conf_ret_unable;
         }
+        afc->mctx_allocs++;
+    }
 
-        ARC_FREE(newhdr->hdr_hdr);
-        ARC_FREE(newhdr->hdr_val);
-        ARC_FREE(newhdr);
-        arcf_cleanup(ctx);
-        return conf->conf_ret_unable;
+    if (newhdr->hdr_bufsz < flen + vlen + 2)
+    {
+        buf = ARC_REALLOC(newhdr->hdr_hdr, flen + vlen + 2);
+        if (buf == NULL)
+        {
+            if (conf->conf_dolog)
+            {
+                syslog(LOG_ERR, "malloc(): %s", strerror(errno));
+            }
+
+            arcf_freehdr(newhdr);
+            arcf_cleanup(ctx);
+            return conf->conf_ret_unable;
+        }
+        newhdr->hdr_hdr = buf;
+        newhdr->hdr_bufsz = flen + vlen + 2;
+        afc->mctx_allocs++;
     }
 
-    afc->mctx_hdrbytes += strlen(newhdr->hdr_hdr) + 1;
-    afc->mctx_hdrbytes += strlen(newhdr->hdr_val) + 1;
+    memcpy(newhdr->hdr_hdr, headerf, flen + 1);
+    newhdr->hdr_val = newhdr->hdr_hdr + flen + 1;
+    memcpy(newhdr->hdr_val, p, vlen + 1);
 
-    if (afc->mctx_hqhead == NULL)
+    if (!arcf_hdrq_add(&afc->mctx_hq, newhdr))
     {
-        afc->mctx_hqhead = newhdr;
-    }
+        if (conf->conf_dolog)
+        {
+            syslog(LOG_ERR, "malloc(): %s", strerror(errno));
+        }
 
-    if (afc->mctx_hqtail != NULL)
-    {
-        afc->mctx_hqtail->hdr_next = newhdr;
+        arcf_freehdr(newhdr);
+        arcf_cleanup(ctx);
+        return conf->conf_ret_unable;
     }
 
-    afc->mctx_hqtail = newhdr;
-
     return SMFIS_CONTINUE;
 }
 
@@ -3230,15 +3480,10 @@ mlfi_header(SMFICTX *ctx, char *headerf, char *headerv)
 sfsistat
 mlfi_eoh(SMFICTX *ctx)
 {
-    char                last;
-    unsigned int        mode;
     ARC_STAT            status;
     connctx             cc;
     msgctx              afc;
-    char               *p;
-    const char         *err = NULL;
     struct arcf_config *conf;
-    Header              hdr;
 
     assert(ctx != NULL);
 
@@ -3263,66 +3508,17 @@ mlfi_eoh(SMFICTX *ctx)
     {
         bool ok = true;
 
-        /* exactly one From: */
-        if (arcf_findheader(afc, "From", 0) == NULL ||
-            arcf_findheader(afc, "From", 1) != NULL)
-        {
-            ok = false;
-        }
-
-        /* exactly one Date: */
-        if (arcf_findheader(afc, "Date", 0) == NULL ||
-            arcf_findheader(afc, "Date", 1) != NULL)
-        {
-            ok = false;
-        }
-
-        /* no more than one Reply-To: */
-        if (arcf_findheader(afc, "Reply-To", 1) != NULL)
-        {
-            ok = false;
-        }
-
-        /* no more than one To: */
-        if (arcf_findheader(afc, "To", 1) != NULL)
-        {
-            ok = false;
-        }
-
-        /* no more than one Cc: */
-        if (arcf_findheader(afc, "Cc", 1) != NULL)
-        {
-            ok = false;
-        }
-
-        /* no more than one Bcc: */
-        if (arcf_findheader(afc, "Bcc", 1) != NULL)
+        for (size_t n = 0; n < sizeof reqhdrs / sizeof reqhdrs[0]; n++)
         {
-            ok = false;
-        }
-
-        /* no more than one Message-Id: */
-        if (arcf_findheader(afc, "Message-Id", 1) != NULL)
-        {
-            ok = false;
-        }
+            size_t count;
 
-        /* no more than one In-Reply-To: */
-        if (arcf_findheader(afc, "In-Reply-To", 1) != NULL)
-        {
-            ok = false;
-        }
-
-        /* no more than one References: */
-        if (arcf_findheader(afc, "References", 1) != NULL)
-        {
-            ok = false;
-        }
+            count = arcf_hdrq_count(&afc->mctx_hq, reqhdrs[n].rh_name);
 
-        /* no more than one Subject: */
-        if (arcf_findheader(afc, "Subject", 1) != NULL)
-        {
-            ok = false;
+            if (count < reqhdrs[n].rh_min || count > reqhdrs[n].rh_max)
+            {
+                ok = false;
+                break;
+            }
         }
 
         if (!ok)
@@ -3343,192 +3539,32 @@ mlfi_eoh(SMFICTX *ctx)
     **  see if this is one of those.
     */
 
-    if (!LIST_EMPTY(&conf->conf_sealheaderchecks))
+    if (conf->conf_sealheaderchecks != NULL &&
+        !arcf_sealcheck_match(conf->conf_sealheaderchecks, &afc->mctx_hq))
     {
-        bool                found = false;
-        int                 restatus;
-        struct configvalue *node;
-        char                buf[BUFRSZ];
-
-        LIST_FOREACH(node, &conf->conf_sealheaderchecks, entries)
+        if (conf->conf_dolog)
         {
-            int          hfnum = 0;
-            char        *hfname = NULL;
-            char        *hfmatch;
-            regex_t      re;
-            json_t      *json;
-            const char  *str;
-            json_error_t json_err;
-
-            strlcpy(buf, node->value, sizeof buf);
-            hfmatch = strchr(buf, ':');
-            if (hfmatch != NULL)
-            {
-                hfname = buf;
-                *hfmatch++ = '\0';
-            }
-
-            if (hfmatch != NULL)
-            {
-                restatus = regcomp(&re, hfmatch, 0);
-            }
-
-            if (hfname == NULL || hfmatch == NULL || restatus != 0)
-            {
-                if (conf->conf_dolog)
-                {
-                    syslog(LOG_ERR, "%s: invalid seal header check \"%s\"",
-                           afc->mctx_jobid, node->value);
-                }
-            }
-
-            for (hfnum = 0; !found; hfnum++)
-            {
-                hdr = arcf_findheader(afc, hfname, hfnum);
-                if (hdr == NULL)
-                {
-                    break;
-                }
-
-                json = json_loads(hdr->hdr_val, 0, &json_err);
-                if (json != NULL)
-                {
-                    if (json_is_string(json))
-                    {
-                        str = json_string_value(json);
-                        if (regexec(&re, str, 0, NULL, 0) == 0)
-                        {
-                            found = true;
-                            break;
-                        }
-                    }
-                    else if (json_is_array(json))
-                    {
-                        size_t  jn;
-                        json_t *entry;
-
-                        for (jn = 0; !found && jn < json_array_size(json); jn++)
-                        {
-                            entry = json_array_get(json, jn);
-
-                            if (json_is_string(entry))
-                            {
-                                str = json_string_value(entry);
-
-                                if (regexec(&re, str, 0, NULL, 0) == 0)
-                                {
-                                    found = true;
-                                    break;
-                                }
-                            }
-                        }
-                    }
-
-                    json_decref(json);
-                }
-                else if (regexec(&re, hdr->hdr_val, 0, NULL, 0) == 0)
-                {
-                    found = true;
-                    break;
-                }
-            }
-
-            regfree(&re);
+            syslog(LOG_INFO, "%s: no seal header check matched; continuing",
+                   afc->mctx_jobid);
         }
 
-        if (!found)
-        {
-            if (conf->conf_dolog)
-            {
-                syslog(LOG_INFO, "%s: no seal header check matched; continuing",
-                       afc->mctx_jobid);
-            }
-
-            return conf->conf_ret_disabled;
-        }
+        return conf->conf_ret_disabled;
     }
 #endif /* USE_JANSSON */
 
-    /* run the header fields */
-    mode = conf->conf_mode;
-    if (mode == 0)
+    /* report anything that went wrong while the fields were passed on */
+    if (afc->mctx_hdrstat == ARC_STAT_OK && afc->mctx_arcmsg == NULL &&
+        !arcf_msgstart(cc, afc))
     {
-        mode = cc->cctx_mode;
+        afc->mctx_hdrstat = ARC_STAT_INTERNAL;
     }
-    afc->mctx_arcmsg = arc_message(conf->conf_libopenarc, conf->conf_canonhdr,
-                                   conf->conf_canonbody, conf->conf_signalg,
-                                   mode, &err);
-    if (afc->mctx_arcmsg == NULL)
+    if (afc->mctx_hdrstat == ARC_STAT_SYNTAX)
     {
-        if (conf->conf_dolog)
-        {
-            syslog(LOG_INFO, "%s: can't initialize ARC handle: %s",
-                   afc->mctx_jobid, err);
-        }
-
-        return conf->conf_ret_unable;
+        return conf->conf_ret_unwilling;
     }
-
-    for (hdr = afc->mctx_hqhead; hdr != NULL; hdr = hdr->hdr_next)
+    if (afc->mctx_hdrstat != ARC_STAT_OK)
     {
-        if (afc->mctx_tmpstr == NULL)
-        {
-            afc->mctx_tmpstr = arc_dstring_new(BUFRSZ, 0, NULL, NULL);
-            if (afc->mctx_tmpstr == NULL)
-            {
-                if (conf->conf_dolog)
-                {
-                    syslog(LOG_ERR, "%s: arc_dstring_new() failed",
-                           afc->mctx_jobid);
-                }
-
-                return conf->conf_ret_unable;
-            }
-        }
-        else
-        {
-            arc_dstring_blank(afc->mctx_tmpstr);
-        }
-
-        arc_dstring_copy(afc->mctx_tmpstr, hdr->hdr_hdr);
-        arc_dstring_cat1(afc->mctx_tmpstr, ':');
-        if (!cc->cctx_noleadspc)
-        {
-            arc_dstring_cat1(afc->mctx_tmpstr, ' ');
-        }
-
-        last = '\0';
-
-        /* do milter-ized continuation conversion */
-        for (p = hdr->hdr_val; *p != '\0'; p++)
-        {
-            if (*p == '\n' && last != '\r')
-            {
-                arc_dstring_cat1(afc->mctx_tmpstr, '\r');
-            }
-
-            arc_dstring_cat1(afc->mctx_tmpstr, *p);
-
-            last = *p;
-        }
-
-        status = arc_header_field(afc->mctx_arcmsg,
-                                  arc_dstring_get(afc->mctx_tmpstr),
-                                  arc_dstring_len(afc->mctx_tmpstr));
-        if (status != ARC_STAT_OK)
-        {
-            if (conf->conf_dolog)
-            {
-                syslog(LOG_INFO, "%s: error processing header field \"%s\"",
-                       afc->mctx_jobid, hdr->hdr_hdr);
-            }
-
-            if (status == ARC_STAT_SYNTAX)
-            {
-                return conf->conf_ret_unwilling;
-            }
-            return conf->conf_ret_unable;
-        }
+        return conf->conf_ret_unable;
     }
 
     /* signal end of headers to libopenarc */
@@ -3592,6 +3628,12 @@ mlfi_body(SMFICTX *ctx, unsigned char *bodyp, size_t bodylen)
 
     if (afc->mctx_arcmsg != NULL)
     {
+        /* the MTA can stop sending the body once nothing depends on it */
+        if (cc->cctx_milterv2 && !arc_body_needed(afc->mctx_arcmsg))
+        {
+            return SMFIS_SKIP;
+        }
+
         status = arc_body(afc->mctx_arcmsg, bodyp, bodylen);
         if (status != ARC_STAT_OK)
         {
@@ -3681,6 +3723,33 @@ add_arc_authres(msgctx afc, struct arcf_config *conf, const char *ip)
     }
 }
 
+/*
+**  ARCF_EOM_WAIT -- have the event engine call mlfi_eom() again later
+**
+**  Parameters:
+**  	ctx -- milter context
+**  	afc -- message context, whose arc_eom() wants key replies
+**
+**  Return value:
+**  	ARCF_ENGINE_AGAIN.
+*/
+
+static sfsistat
+arcf_eom_wait(SMFICTX *ctx, msgctx afc)
+{
+    int   n;
+    void *qh[ARCF_ENGINE_MAXWAIT];
+
+    /* any beyond the engine's limit are checked on its next tick */
+    n = arc_pending_queries(afc->mctx_arcmsg, qh, ARCF_ENGINE_MAXWAIT);
+    for (int i = 0; i < n && i < ARCF_ENGINE_MAXWAIT; i++)
+    {
+        (void) arcf_engine_waitfd(ctx, arcf_dns_fd(qh[i]));
+    }
+
+    return ARCF_ENGINE_AGAIN;
+}
+
 /*
 **  MLFI_EOM -- handler called at the end of the message; we can now decide
 **              based on the configuration if and how to add the text
@@ -3690,7 +3759,7 @@ add_arc_authres(msgctx afc, struct arcf_config *conf, const char *ip)
 **  	ctx -- milter context
 **
 **  Return value:
-**  	An SMFIS_* constant.
+**  	An SMFIS_* constant, or ARCF_ENGINE_AGAIN under the event engine.
 */
 
 sfsistat
@@ -3736,9 +3805,30 @@ mlfi_eom(SMFICTX *ctx)
         }
     }
 
+    /*
+    **  Signal end-of-message to ARC.  Under the event engine this doesn't
+    **  wait for key lookups; the engine calls again once a reply is in.
+    */
+
+    status = arc_eom(afc->mctx_arcmsg);
+    if (status == ARC_STAT_AGAIN && eventmode)
+    {
+        return arcf_eom_wait(ctx, afc);
+    }
+    else if (status != ARC_STAT_OK)
+    {
+        if (conf->conf_dolog)
+        {
+            syslog(LOG_WARNING, "%s: error processing at end-of-message",
+                   afc->mctx_jobid);
+        }
+
+        return conf->conf_ret_unable;
+    }
+
     if (afc->mctx_tmpstr == NULL)
     {
-        afc->mctx_tmpstr = arc_dstring_new(BUFRSZ, 0, NULL, NULL);
+        afc->mctx_tmpstr = arc_dstring_new(BUFRSZ, 0, NULL, NULL, NULL);
         if (afc->mctx_tmpstr == NULL)
         {
             if (conf->conf_dolog)
@@ -3748,6 +3838,11 @@ mlfi_eom(SMFICTX *ctx)
 
             return conf->conf_ret_unable;
         }
+        afc->mctx_allocs++;
+    }
+    else
+    {
+        afc->mctx_reused++;
     }
 
     /* get hostname; used in the X header and in new MIME boundaries */
@@ -3769,20 +3864,10 @@ mlfi_eom(SMFICTX *ctx)
         memset(ipbuf, '\0', sizeof ipbuf);
     }
 
-    /*
-    **  Signal end-of-message to ARC.
-    */
-
-    status = arc_eom(afc->mctx_arcmsg);
-    if (status != ARC_STAT_OK)
+    if (conf->conf_dolog && arc_capture_path(afc->mctx_arcmsg) != NULL)
     {
-        if (conf->conf_dolog)
-        {
-            syslog(LOG_WARNING, "%s: error processing at end-of-message",
-                   afc->mctx_jobid);
-        }
-
-        return conf->conf_ret_unable;
+        syslog(LOG_INFO, "%s: canonicalizations captured in %s",
+               afc->mctx_jobid, arc_capture_path(afc->mctx_arcmsg));
     }
 
     if (BITSET(ARC_MODE_SIGN, cc->cctx_mode))
@@ -3792,13 +3877,9 @@ mlfi_eom(SMFICTX *ctx)
         arc_dstring_blank(afc->mctx_tmpstr);
 
         /* assemble authentication results */
-        for (int i = 0;; i++)
+        for (hdr = arcf_hdrq_find(&afc->mctx_hq, AUTHRESULTSHDR, 0);
+             hdr != NULL; hdr = hdr->hdr_nextname)
         {
-            hdr = arcf_findheader(afc, AUTHRESULTSHDR, i);
-            if (hdr == NULL)
-            {
-                break;
-            }
             status = ares_parse(hdr->hdr_val, &ar, conf->conf_authservid);
             if (status == -1)
             {
@@ -3812,9 +3893,11 @@ mlfi_eom(SMFICTX *ctx)
             }
         }
 
-        for (int i = 0; i < ar.ares_count; i++)
+        for (size_t i = 0; i < ar.ares_count; i++)
         {
-            if (ar.ares_result[i].result_method == ARES_METHOD_ARC)
+            struct result *r = &ar.ares_result[i];
+
+            if (r->result_method == ARES_METHOD_ARC)
             {
                 if (!conf->conf_overridecv)
                 {
@@ -3822,8 +3905,7 @@ mlfi_eom(SMFICTX *ctx)
                 }
 
                 arfound = true;
-                if (reconcile_arc_state(afc, &ar.ares_result[i]) &&
-                    conf->conf_dolog)
+                if (reconcile_arc_state(afc, r) && conf->conf_dolog)
                 {
                     syslog(
                         LOG_INFO,
@@ -3839,38 +3921,47 @@ mlfi_eom(SMFICTX *ctx)
             }
 
             arc_dstring_printf(afc->mctx_tmpstr, "%s=%s",
-                               ares_getmethod(ar.ares_result[i].result_method),
-                               ares_getresult(ar.ares_result[i].result_result));
+                               ares_getmethod(r->result_method),
+                               ares_getresult(r->result_result));
 
-            if (ar.ares_result[i].result_reason[0] != '\0')
+            if (r->result_reason.as_len > 0)
             {
-                arc_dstring_printf(afc->mctx_tmpstr, " reason=\"%s\"",
-                                   ar.ares_result[i].result_reason);
+                arc_dstring_printf(afc->mctx_tmpstr, " reason=\"%.*s\"",
+                                   (int) r->result_reason.as_len,
+                                   r->result_reason.as_str);
             }
 
-            for (int j = 0; j < ar.ares_result[i].result_props; j++)
+            for (size_t j = 0; j < r->result_props; j++)
             {
-                if (ar.ares_result[i].result_ptype[j] == ARES_PTYPE_COMMENT)
+                struct ares_prop *prop = &ar.ares_props[r->result_prop + j];
+
+                if (prop->prop_ptype == ARES_PTYPE_COMMENT)
                 {
                     if (conf->conf_authrescomments)
                     {
-                        arc_dstring_printf(afc->mctx_tmpstr, " %s",
-                                           ar.ares_result[i].result_value[j]);
+                        arc_dstring_printf(afc->mctx_tmpstr, " %.*s",
+                                           (int) prop->prop_value.as_len,
+                                           prop->prop_value.as_str);
                     }
                 }
                 else
                 {
-                    bool quote = !ares_istoken(
-                        ar.ares_result[i].result_value[j]);
-                    arc_dstring_printf(
-                        afc->mctx_tmpstr, " %s.%s=%s%s%s",
-                        ares_getptype(ar.ares_result[i].result_ptype[j]),
-                        ar.ares_result[i].result_property[j], quote ? "\"" : "",
-                        ar.ares_result[i].result_value[j], quote ? "\"" : "");
+                    bool quote = !ares_istokenn(prop->prop_value.as_str,
+                                                prop->prop_value.as_len);
+                    arc_dstring_printf(afc->mctx_tmpstr, " %s.%.*s=%s%.*s%s",
+                                       ares_getptype(prop->prop_ptype),
+                                       (int) prop->prop_property.as_len,
+                                       prop->prop_property.as_str,
+                                       quote ? "\"" : "",
+                                       (int) prop->prop_value.as_len,
+                                       prop->prop_value.as_str,
+                                       quote ? "\"" : "");
                 }
             }
         }
 
+        ares_free(&ar);
+
         if (!arfound)
         {
             if (arc_dstring_len(afc->mctx_tmpstr) > 0)
@@ -4054,18 +4145,12 @@ mlfi_close(SMFICTX *ctx)
     cc = (connctx) arcf_getpriv(ctx);
     if (cc != NULL)
     {
-        pthread_mutex_lock(&conf_lock);
-
-        cc->cctx_config->conf_refcnt--;
-
-        if (cc->cctx_config->conf_refcnt == 0 && cc->cctx_config != curconf)
-        {
-            arcf_config_free(cc->cctx_config);
-        }
+        /* must go before the library instance it belongs to */
+        arc_free(cc->cctx_arcmsg);
 
-        pthread_mutex_unlock(&conf_lock);
+        arcf_config_put(cc->cctx_config);
 
-        ARC_FREE(cc);
+        arcf_putconn(cc);
         arcf_setpriv(ctx, NULL);
     }
 
@@ -4157,6 +4242,7 @@ main(int argc, char **argv)
     int  maxrestartrate_n = 0;
     int  filemask = -1;
     int  mdebug = 0;
+    int  mworkers = 0;
 #ifdef HAVE_SMFI_VERSION
     unsigned int mvmajor;
     unsigned int mvminor;
@@ -4173,6 +4259,8 @@ main(int argc, char **argv)
     struct group  *gr = NULL;
     char          *become = NULL;
     char          *chrootdir = NULL;
+    char          *engine = NULL;
+    char          *nameservers = NULL;
     char          *p;
     char          *pidfile = NULL;
     char          *testfile = NULL;
@@ -4526,6 +4614,48 @@ main(int argc, char **argv)
 
         (void) config_get(cfg, "ChangeRootDirectory", &chrootdir,
                           sizeof chrootdir);
+
+        (void) config_get(cfg, "MilterEngine", &engine, sizeof engine);
+
+        (void) config_get(cfg, "MilterWorkers", &mworkers, sizeof mworkers);
+
+        (void) config_get(cfg, "Nameservers", &nameservers,
+                          sizeof nameservers);
+    }
+
+    if (nameservers != NULL)
+    {
+        if (arcf_dns_setservers(nameservers) != 0)
+        {
+            fprintf(stderr, "%s: can't use Nameservers \"%s\"\n", progname,
+                    nameservers);
+            return EX_CONFIG;
+        }
+
+        dnsservers = true;
+    }
+
+    if (engine != NULL && strcasecmp(engine, "event") == 0)
+    {
+        if (!arcf_engine_available())
+        {
+            fprintf(stderr, "%s: MilterEngine \"event\" is not available "
+                            "on this platform\n", progname);
+            return EX_CONFIG;
+        }
+
+        eventmode = !testmode;
+    }
+    else if (engine != NULL && strcasecmp(engine, "libmilter") != 0)
+    {
+        fprintf(stderr, "%s: unknown MilterEngine \"%s\"\n", progname, engine);
+        return EX_CONFIG;
+    }
+
+    if (mworkers < 0)
+    {
+        fprintf(stderr, "%s: MilterWorkers must not be negative\n", progname);
+        return EX_CONFIG;
     }
 
     if (!gotp && !testmode)
@@ -5146,9 +5276,27 @@ main(int argc, char **argv)
         return EX_UNAVAILABLE;
     }
 
+    if (eventmode)
+    {
+        /* the built-in engine listens for itself */
+        status = arcf_engine_open(sock, SOMAXCONN);
+        if (status != 0)
+        {
+            if (curconf->conf_dolog)
+            {
+                syslog(LOG_ERR, "can't open milter socket %s: %s", sock,
+                       strerror(status));
+            }
+
+            fprintf(stderr, "%s: can't open milter socket %s: %s\n", progname,
+                    sock, strerror(status));
+
+            return EX_UNAVAILABLE;
+        }
+    }
 #ifdef HAVE_SMFI_OPENSOCKET
     /* try to establish the milter socket */
-    if (!testmode && smfi_opensocket(false) == MI_FAILURE)
+    else if (!testmode && smfi_opensocket(false) == MI_FAILURE)
     {
         if (curconf->conf_dolog)
         {
@@ -5177,6 +5325,30 @@ main(int argc, char **argv)
     pthread_mutex_init(&conf_lock, NULL);
     pthread_mutex_init(&pwdb_lock, NULL);
 
+    status = arcf_rcu_init();
+    if (status != 0)
+    {
+        fprintf(stderr, "%s: arcf_rcu_init(): %s\n", progname,
+                strerror(status));
+        return EX_OSERR;
+    }
+
+    status = arcf_pool_init(&connpool, CONNPOOLMAX, arcf_freeconn);
+    if (status == 0)
+    {
+        status = arcf_pool_init(&msgpool, MSGPOOLMAX, arcf_freemsg);
+    }
+    if (status == 0)
+    {
+        status = arcf_pool_init(&hdrpool, HDRPOOLMAX, arcf_freehdr);
+    }
+    if (status != 0)
+    {
+        fprintf(stderr, "%s: arcf_pool_init(): %s\n", progname,
+                strerror(status));
+        return EX_OSERR;
+    }
+
     /* perform test mode */
     if (testfile != NULL)
     {
@@ -5228,12 +5400,25 @@ main(int argc, char **argv)
 
     /* call the milter mainline */
     errno = 0;
-    status = smfi_main();
+    if (eventmode)
+    {
+        status = arcf_engine_main(&smfilter, (unsigned int) mworkers);
+    }
+    else
+    {
+        status = smfi_main();
+    }
 
     if (curconf->conf_dolog)
     {
+        size_t hwm = 0;
+
         syslog(LOG_INFO, "%s v%s terminating with status %d, errno = %d",
                ARCF_PRODUCT, VERSION, status, errno);
+
+        (void) arc_options(curconf->conf_libopenarc, ARC_OP_GETOPT,
+                           ARC_OPTS_ARENAHWM, &hwm, sizeof hwm);
+        syslog(LOG_INFO, "largest message arena: %zu bytes", hwm);
     }
 
     /* tell the reloader thread to die */
@@ -5249,7 +5434,16 @@ main(int argc, char **argv)
     arcf_crypto_free();
 #endif /* OpenSSL < 1.1.0 */
 
+    /* the reload thread may still be busy */
+    pthread_mutex_lock(&conf_lock);
     arcf_config_free(curconf);
+    curconf = NULL;
+    pthread_mutex_unlock(&conf_lock);
+
+    arcf_pool_destroy(&hdrpool);
+    arcf_pool_destroy(&msgpool);
+    arcf_pool_destroy(&connpool);
+    arcf_rcu_shutdown();
 
     return status;
 }
@@ -52,10 +52,13 @@
 typedef struct Header *Header;
 struct Header
 {
-    char          *hdr_hdr;
-    char          *hdr_val;
+    char          *hdr_hdr;   /* start of an allocation holding both */
+    char          *hdr_val;   /* points into the hdr_hdr allocation */
+    size_t         hdr_bufsz; /* bytes allocated at hdr_hdr */
     struct Header *hdr_next;
     struct Header *hdr_prev;
+    struct Header *hdr_nextname; /* next field with the same name */
+    struct Header *hdr_prevname; /* previous field with the same name */
 };
 
 /* externs */
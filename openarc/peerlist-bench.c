@@ -0,0 +1,620 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#include "build-config.h"
+
+/* system includes */
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+
+/* libbsd if found */
+#ifdef USE_BSD_H
+#include <bsd/string.h>
+#endif /* USE_BSD_H */
+
+/* libstrl if needed */
+#ifdef USE_STRL_H
+#include <strl.h>
+#endif /* USE_STRL_H */
+
+/* openarc includes */
+#include "openarc-peerlist.h"
+#include "util.h"
+
+#define BENCH_ENTRIES 100000
+#define BENCH_LOOKUPS 1000000
+#define BENCH_REFCHK  4000
+#define BENCH_REFSIZE 2000
+#define BENCH_REFSLOW 20
+#define BENCH_MAXLEN  64
+#define BENCH_NAMES   100000
+
+/* struct bench_list -- entries as the old code kept them */
+struct bench_list
+{
+    size_t bl_n;
+    char **bl_entry;
+};
+
+/**
+ *  Generate a pseudo-random number.
+ *
+ *  Parameters:
+ *      state: generator state
+ *
+ *  Returns:
+ *      The next number.
+ */
+
+static uint64_t
+bench_rand(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/**
+ *  The old lookup: is this exact string, or its negation, on the list?
+ *
+ *  Parameters:
+ *      list: entries
+ *      neg: the string with a "!" in front
+ *      result: set to the answer if there was one
+ *
+ *  Returns:
+ *      true if the list had an answer.
+ */
+
+static bool
+bench_ref_try(struct bench_list *list, const char *neg, bool *result)
+{
+    for (size_t n = 0; n < list->bl_n; n++)
+    {
+        if (strcmp(neg, list->bl_entry[n]) == 0)
+        {
+            *result = false;
+            return true;
+        }
+    }
+    for (size_t n = 0; n < list->bl_n; n++)
+    {
+        if (strcmp(neg + 1, list->bl_entry[n]) == 0)
+        {
+            *result = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ *  The old arcf_checkip(), trying every prefix length as text.
+ *
+ *  Parameters:
+ *      list: entries
+ *      sa: address
+ *
+ *  Returns:
+ *      true if the address is on the list.
+ */
+
+static bool
+bench_ref_checkip(struct bench_list *list, struct sockaddr *sa)
+{
+    int           bits;
+    int           maxbits;
+    bool          result;
+    unsigned char addr[16];
+    char          text[INET6_ADDRSTRLEN + 1];
+    char          buf[BENCH_MAXLEN];
+
+    if (sa->sa_family == AF_INET6)
+    {
+        maxbits = 128;
+        memcpy(addr, &((struct sockaddr_in6 *) sa)->sin6_addr, 16);
+    }
+    else
+    {
+        maxbits = 32;
+        memcpy(addr, &((struct sockaddr_in *) sa)->sin_addr, 4);
+    }
+
+    for (bits = maxbits + 1; bits >= 0; bits--)
+    {
+        /* one past the address length stands for the bare address */
+        if (bits < maxbits)
+        {
+            addr[bits / 8] &= ~(0x80 >> (bits % 8));
+        }
+
+        if (maxbits == 32)
+        {
+            struct in_addr in;
+
+            memcpy(&in, addr, 4);
+            arcf_inet_ntoa(in, text, sizeof text);
+        }
+        else
+        {
+            inet_ntop(AF_INET6, addr, text, sizeof text);
+        }
+
+        if (bits > maxbits)
+        {
+            snprintf(buf, sizeof buf, "!%s", text);
+            if (bench_ref_try(list, buf, &result))
+            {
+                return result;
+            }
+            snprintf(buf, sizeof buf, "![%s]", text);
+            if (bench_ref_try(list, buf, &result))
+            {
+                return result;
+            }
+            continue;
+        }
+
+        snprintf(buf, sizeof buf, "!%s/%d", text, bits);
+        if (bench_ref_try(list, buf, &result))
+        {
+            return result;
+        }
+        snprintf(buf, sizeof buf, "![%s]/%d", text, bits);
+        if (bench_ref_try(list, buf, &result))
+        {
+            return result;
+        }
+    }
+
+    return false;
+}
+
+/**
+ *  The old arcf_checkhost(): the host, then each suffix from a later dot.
+ *
+ *  Parameters:
+ *      list: entries
+ *      host: host name
+ *
+ *  Returns:
+ *      true if the host is on the list.
+ */
+
+static bool
+bench_ref_checkhost(struct bench_list *list, const char *host)
+{
+    bool result;
+    char buf[BENCH_MAXLEN * 2];
+
+    if (host[0] == '\0')
+    {
+        return false;
+    }
+
+    for (const char *p = host; p != NULL; p = strchr(p + 1, '.'))
+    {
+        snprintf(buf, sizeof buf, "!%s", p);
+        if (bench_ref_try(list, buf, &result))
+        {
+            return result;
+        }
+    }
+
+    return false;
+}
+
+/**
+ *  Make up a list entry.
+ *
+ *  Parameters:
+ *      state: generator state
+ *      buf: where to put it
+ *      buflen: bytes at "buf"
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+static void
+bench_entry(uint64_t *state, char *buf, size_t buflen)
+{
+    int           kind = bench_rand(state) % 100;
+    int           plen;
+    int           maxbits;
+    uint64_t      r1 = bench_rand(state);
+    uint64_t      r2 = bench_rand(state);
+    const char   *neg = bench_rand(state) % 8 == 0 ? "!" : "";
+    bool          bracket = bench_rand(state) % 16 == 0;
+    unsigned char addr[16];
+    char          text[INET6_ADDRSTRLEN + 1];
+
+    if (kind < 7)
+    {
+        snprintf(buf, buflen, "%s%shost%u.example%u.com", neg,
+                 kind < 4 ? "." : "", (unsigned) (r1 % 100),
+                 (unsigned) (r2 % 1000));
+        return;
+    }
+    if (kind < 10)
+    {
+        snprintf(buf, buflen, "%s.example%u.com", neg, (unsigned) (r2 % 1000));
+        return;
+    }
+
+    memcpy(addr, &r1, 8);
+    memcpy(addr + 8, &r2, 8);
+
+    /* keep the addresses in a few blocks so that prefixes nest */
+    if (kind < 60)
+    {
+        maxbits = 32;
+        addr[0] = 10 + addr[0] % 4;
+        plen = kind < 20 ? 32 : 8 + bench_rand(state) % 25;
+    }
+    else
+    {
+        maxbits = 128;
+        addr[0] = 0x20;
+        addr[1] = 0x01;
+        addr[2] = 0x0d;
+        addr[3] = 0xb8 + addr[3] % 2;
+        plen = kind < 70 ? 128 : 32 + bench_rand(state) % 97;
+    }
+
+    for (int b = plen; b < maxbits; b++)
+    {
+        addr[b / 8] &= ~(0x80 >> (b % 8));
+    }
+
+    if (maxbits == 32)
+    {
+        struct in_addr in;
+
+        memcpy(&in, addr, 4);
+        arcf_inet_ntoa(in, text, sizeof text);
+    }
+    else
+    {
+        inet_ntop(AF_INET6, addr, text, sizeof text);
+    }
+
+    if (plen == maxbits && kind % 2 == 0)
+    {
+        snprintf(buf, buflen, bracket ? "%s[%s]" : "%s%s", neg, text);
+    }
+    else
+    {
+        snprintf(buf, buflen, bracket ? "%s[%s]/%d" : "%s%s/%d", neg, text,
+                 plen);
+    }
+}
+
+/**
+ *  Make up a client address, usually near some list entry.
+ *
+ *  Parameters:
+ *      state: generator state
+ *      ss: where to put it
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+static void
+bench_addr(uint64_t *state, struct sockaddr_storage *ss)
+{
+    uint64_t r1 = bench_rand(state);
+    uint64_t r2 = bench_rand(state);
+
+    memset(ss, '\0', sizeof *ss);
+
+    if (r1 % 2 == 0)
+    {
+        struct sockaddr_in *sin = (struct sockaddr_in *) ss;
+        unsigned char      *a = (unsigned char *) &sin->sin_addr;
+
+        sin->sin_family = AF_INET;
+        memcpy(a, &r2, 4);
+        a[0] = 10 + a[0] % 5;
+    }
+    else
+    {
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *) ss;
+        unsigned char       *a = sin6->sin6_addr.s6_addr;
+
+        sin6->sin6_family = AF_INET6;
+        memcpy(a, &r1, 8);
+        memcpy(a + 8, &r2, 8);
+        a[0] = 0x20;
+        a[1] = 0x01;
+        a[2] = 0x0d;
+        a[3] = 0xb8 + a[3] % 3;
+        /* sparse lists need dense addresses to hit anything */
+        if (r2 % 4 != 0)
+        {
+            memset(a + 6, '\0', 10);
+        }
+    }
+}
+
+/**
+ *  Make up a client host name, usually in some listed domain.
+ *
+ *  Parameters:
+ *      state: generator state
+ *      buf: where to put it
+ *      buflen: bytes at "buf"
+ *
+ *  Returns:
+ *      Nothing.
+ */
+
+static void
+bench_host(uint64_t *state, char *buf, size_t buflen)
+{
+    uint64_t r1 = bench_rand(state);
+    uint64_t r2 = bench_rand(state);
+
+    snprintf(buf, buflen, "%s%shost%u.example%u.com", r1 % 3 == 0 ? "mail." : "",
+             r1 % 5 == 0 ? "smtp." : "", (unsigned) ((r1 >> 8) % 100),
+             (unsigned) (r2 % 1000));
+}
+
+/**
+ *  Time something.
+ *
+ *  Parameters:
+ *      start: when it started
+ *
+ *  Returns:
+ *      Seconds since "start".
+ */
+
+static double
+bench_elapsed(const struct timespec *start)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int
+main(int argc, char **argv)
+{
+    bool                     mismatch = false;
+    int                      c;
+    int                      fd;
+    long                     nentries = BENCH_ENTRIES;
+    size_t                   refsize;
+    size_t                   hits = 0;
+    size_t                   n;
+    uint64_t                 state = 0x9e3779b97f4a7c15ULL;
+    double                   t;
+    char                    *p;
+    char                    *err = NULL;
+    char                    *progname;
+    FILE                    *f;
+    peerlist                 small;
+    peerlist                 big;
+    struct bench_list        list;
+    struct sockaddr_storage *addrs;
+    struct timespec          start;
+    char                     buf[BENCH_MAXLEN];
+    char                     path[] = "/tmp/peerlist-bench.XXXXXX";
+    char (*names)[BENCH_MAXLEN];
+
+    progname = (p = strrchr(argv[0], '/')) == NULL ? argv[0] : p + 1;
+
+    while ((c = getopt(argc, argv, "e:")) != -1)
+    {
+        switch (c)
+        {
+        case 'e':
+            nentries = strtol(optarg, &p, 10);
+            if (*p != '\0' || nentries < 1)
+            {
+                fprintf(stderr, "%s: invalid entry count \"%s\"\n", progname,
+                        optarg);
+                return EX_USAGE;
+            }
+            break;
+
+        default:
+            fprintf(stderr, "%s: usage: %s [-e entries]\n", progname,
+                    progname);
+            return EX_USAGE;
+        }
+    }
+
+    /* a short list is checked against the old code in full */
+    refsize = nentries < BENCH_REFSIZE ? nentries : BENCH_REFSIZE;
+
+    list.bl_n = nentries;
+    list.bl_entry = calloc(nentries, sizeof *list.bl_entry);
+    addrs = calloc(BENCH_LOOKUPS, sizeof *addrs);
+    names = calloc(BENCH_NAMES, sizeof *names);
+    small = arcf_peerlist_new();
+    big = arcf_peerlist_new();
+    if (list.bl_entry == NULL || addrs == NULL || names == NULL ||
+        small == NULL || big == NULL)
+    {
+        return EX_OSERR;
+    }
+
+    for (n = 0; n < list.bl_n; n++)
+    {
+        bench_entry(&state, buf, sizeof buf);
+        list.bl_entry[n] = strdup(buf);
+        if (list.bl_entry[n] == NULL)
+        {
+            return EX_OSERR;
+        }
+    }
+    for (n = 0; n < BENCH_LOOKUPS; n++)
+    {
+        bench_addr(&state, &addrs[n]);
+    }
+    for (n = 0; n < BENCH_NAMES; n++)
+    {
+        bench_host(&state, names[n], sizeof names[n]);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (n = 0; n < list.bl_n; n++)
+    {
+        if (!arcf_peerlist_add(big, list.bl_entry[n], &err))
+        {
+            fprintf(stderr, "%s: arcf_peerlist_add(): %s\n", progname, err);
+            return EX_OSERR;
+        }
+    }
+    t = bench_elapsed(&start);
+    printf("add %zu entries one at a time: %.1f ms\n", list.bl_n, t * 1e3);
+
+    fd = mkstemp(path);
+    f = fd == -1 ? NULL : fdopen(fd, "w");
+    if (f == NULL)
+    {
+        fprintf(stderr, "%s: %s: %s\n", progname, path, strerror(errno));
+        return EX_CANTCREAT;
+    }
+    for (n = 0; n < list.bl_n; n++)
+    {
+        fprintf(f, "%s\n", list.bl_entry[n]);
+    }
+    fclose(f);
+
+    arcf_peerlist_free(big);
+    big = arcf_peerlist_new();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (big == NULL || !arcf_peerlist_load(big, path, &err))
+    {
+        fprintf(stderr, "%s: arcf_peerlist_load(): %s\n", progname, err);
+        unlink(path);
+        return EX_OSERR;
+    }
+    t = bench_elapsed(&start);
+    unlink(path);
+    printf("load %zu entries from a file: %.1f ms\n", list.bl_n, t * 1e3);
+
+    /* check against the old code on a list it can get through */
+    for (n = 0; n < refsize; n++)
+    {
+        if (!arcf_peerlist_add(small, list.bl_entry[n], &err))
+        {
+            return EX_OSERR;
+        }
+    }
+    list.bl_n = refsize;
+    for (n = 0; n < BENCH_REFCHK; n++)
+    {
+        struct sockaddr *sa = (struct sockaddr *) &addrs[n];
+        bool             want = bench_ref_checkip(&list, sa);
+
+        hits += want;
+        if (arcf_peerlist_checkip(small, sa) != want)
+        {
+            if (!mismatch)
+            {
+                fprintf(stderr, "%s: lookup %zu differs from the old code\n",
+                        progname, n);
+            }
+            mismatch = true;
+        }
+    }
+    printf("check %d lookups on %zu entries: %zu hits, %s\n", BENCH_REFCHK,
+           refsize, hits, mismatch ? "MISMATCH" : "ok");
+
+    list.bl_n = nentries;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (n = 0; n < BENCH_REFSLOW; n++)
+    {
+        struct sockaddr *sa = (struct sockaddr *) &addrs[n];
+
+        if (arcf_peerlist_checkip(big, sa) != bench_ref_checkip(&list, sa))
+        {
+            mismatch = true;
+        }
+    }
+    t = bench_elapsed(&start);
+    printf("old code, %zu entries: %.0f us/lookup\n", list.bl_n,
+           t * 1e6 / BENCH_REFSLOW);
+
+    hits = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (n = 0; n < BENCH_LOOKUPS; n++)
+    {
+        hits += arcf_peerlist_checkip(big, (struct sockaddr *) &addrs[n]);
+    }
+    t = bench_elapsed(&start);
+    printf("trie, %zu entries: %.0f ns/lookup (%zu hits)\n", list.bl_n,
+           t * 1e9 / BENCH_LOOKUPS, hits);
+
+    /* host names are cheap enough to check against the whole list, and
+     * should match in any case */
+    hits = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (n = 0; n < BENCH_REFCHK; n++)
+    {
+        bool want = bench_ref_checkhost(&list, names[n]);
+
+        hits += want;
+        for (p = buf; (*p = toupper((unsigned char) names[n][p - buf])); p++)
+        {
+            continue;
+        }
+        if (arcf_peerlist_checkhost(big, names[n]) != want ||
+            arcf_peerlist_checkhost(big, buf) != want)
+        {
+            if (!mismatch)
+            {
+                fprintf(stderr, "%s: host %s differs from the old code\n",
+                        progname, names[n]);
+            }
+            mismatch = true;
+        }
+    }
+    t = bench_elapsed(&start);
+    printf("check %d hosts on %zu entries: %zu hits, %s\n", BENCH_REFCHK,
+           list.bl_n, hits, mismatch ? "MISMATCH" : "ok");
+    printf("old code, %zu entries: %.0f us/host\n", list.bl_n,
+           t * 1e6 / BENCH_REFCHK);
+
+    hits = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (n = 0; n < BENCH_LOOKUPS; n++)
+    {
+        hits += arcf_peerlist_checkhost(big, names[n % BENCH_NAMES]);
+    }
+    t = bench_elapsed(&start);
+    printf("hash, %zu entries: %.0f ns/host (%zu hits)\n", list.bl_n,
+           t * 1e9 / BENCH_LOOKUPS, hits);
+
+    arcf_peerlist_free(small);
+    arcf_peerlist_free(big);
+    for (n = 0; n < list.bl_n; n++)
+    {
+        free(list.bl_entry[n]);
+    }
+    free(list.bl_entry);
+    free(addrs);
+    free(names);
+
+    return mismatch ? EX_SOFTWARE : EX_OK;
+}
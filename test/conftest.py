@@ -4,14 +4,44 @@ import copy
 import json
 import pathlib
 import socket
+import struct
 import subprocess
 import sys
+import threading
 import time
 
 import miltertest
 import pytest
 
 
+def milter_send_body(sock, body, blksize=65535):
+    """Send a body in chunks like an MTA would, returning True if the milter
+    asked for the rest to be skipped
+    """
+    if isinstance(body, str):
+        body = body.encode()
+
+    for i in range(0, len(body), blksize):
+        chunk = body[i : i + blksize]
+        sock.sendall(struct.pack('>I', len(chunk) + 1) + miltertest.SMFIC_BODY.encode() + chunk)
+
+        reply = b''
+        while len(reply) < 5:
+            data = sock.recv(5 - len(reply))
+            if not data:
+                raise miltertest.MilterError('connection closed')
+            reply += data
+        if reply[:4] != struct.pack('>I', 1):
+            raise miltertest.MilterError(f'unexpected reply to body: {reply}')
+
+        if chr(reply[4]) == miltertest.SMFIR_SKIP:
+            return True
+        if chr(reply[4]) != miltertest.SMFIR_CONTINUE:
+            raise miltertest.MilterError(f'unexpected response: {chr(reply[4])}')
+
+    return False
+
+
 @pytest.fixture(scope='session')
 def private_key(tmp_path_factory, tool_path):
     basepath = tmp_path_factory.mktemp('keys')
@@ -107,21 +137,93 @@ def milter_config(request, tmp_path, private_key):
         if c['KeyFile']:
             c['KeyFile'] = private_key['basepath'].joinpath(c['KeyFile'])
 
-        for static_file in ['PeerList', 'InternalHosts']:
+        for static_file in ['PeerList', 'InternalHosts', 'SealHeaderChecks']:
             if c.get(static_file):
                 c[static_file] = base_path.joinpath(c[static_file])
 
+        # scratch space belongs to the test, not to the whole system
+        if c.get('TemporaryDirectory'):
+            c['TemporaryDirectory'] = tmp_path.joinpath(c['TemporaryDirectory'])
+            c['TemporaryDirectory'].mkdir(exist_ok=True)
+
         fname = tmp_path.joinpath(f'milter-{i}.conf')
         with open(fname, 'w') as f:
             for k, v in c.items():
                 if v is not None:
                     f.write(f'{k} {v}\n')
 
-        ret.append({'file': fname, 'sock': tmp_path.joinpath(f'milter-{i}.sock')})
+        ret.append(
+            {
+                'file': fname,
+                'sock': tmp_path.joinpath(f'milter-{i}.sock'),
+                'log': tmp_path.joinpath(f'milter-{i}.log'),
+            }
+        )
 
     return ret
 
 
+@pytest.fixture()
+def dns_server(milter_config, private_key):
+    """Answer key lookups from the test keys and point the milters' Nameservers
+    here; must come before the milter in a test's arguments. Set 'delay' to
+    hold replies back; 'queries' lists the names asked for.
+    """
+    records = {}
+    with open(private_key['public_keys'], 'r') as f:
+        for line in f:
+            name, _, txt = line.strip().partition(' ')
+            records[name.lower()] = txt.encode()
+
+    sock = socket.socket(family=socket.AF_INET, type=socket.SOCK_DGRAM)
+    sock.bind(('127.0.0.1', 0))
+    sock.settimeout(0.1)
+    server = {'delay': 0, 'queries': [], 'running': True}
+
+    def _reply(query, addr):
+        # header and question go back as asked, minus any OPT record
+        end = 12
+        labels = []
+        while query[end]:
+            labels.append(query[end + 1 : end + 1 + query[end]].decode())
+            end += query[end] + 1
+        end += 5
+        name = '.'.join(labels).lower()
+        server['queries'].append(name)
+
+        txt = records.get(name)
+        flags = 0x8180 if txt else 0x8183
+        resp = query[:2] + struct.pack('>HHHHH', flags, 1, 1 if txt else 0, 0, 0) + query[12:end]
+        if txt:
+            rdata = b''.join(bytes([len(txt[i : i + 255])]) + txt[i : i + 255] for i in range(0, len(txt), 255))
+            resp += struct.pack('>HHHIH', 0xC00C, 16, 1, 300, len(rdata)) + rdata
+
+        if server['delay']:
+            time.sleep(server['delay'])
+        sock.sendto(resp, addr)
+
+    def _serve():
+        while server['running']:
+            try:
+                query, addr = sock.recvfrom(4096)
+            except TimeoutError:
+                continue
+            threading.Thread(target=_reply, args=(query, addr), daemon=True).start()
+
+    thread = threading.Thread(target=_serve, daemon=True)
+    thread.start()
+
+    for conf in milter_config:
+        with open(conf['file'], 'a') as f:
+            f.write(f'Nameservers 127.0.0.1:{sock.getsockname()[1]}\n')
+
+    yield server
+
+    server['running'] = False
+    thread.join()
+    sock.close()
+
+
 @pytest.fixture()
 def milter_cmdline(tmp_path, tool_path):
     def _milter_cmdline(conf, extra_args=None):
@@ -146,7 +248,8 @@ def milter(milter_cmdline, milter_config):
     milter_procs = []
 
     for i in range(0, len(milter_config)):
-        proc = subprocess.Popen(milter_cmdline(milter_config[i]))
+        with open(milter_config[i]['log'], 'w') as log:
+            proc = subprocess.Popen(milter_cmdline(milter_config[i]), stderr=log)
         while not proc.poll() and not milter_config[i]['sock'].exists():
             time.sleep(0.1)
         milter_procs.append(proc)
@@ -155,6 +258,23 @@ def milter(milter_cmdline, milter_config):
 
     for proc in milter_procs:
         proc.terminate()
+        proc.wait()
+
+    # let pytest show the milters' output with any failure
+    for conf in milter_config:
+        sys.stderr.write(conf['log'].read_text())
+
+
+@pytest.fixture()
+def milter_log(milter, milter_config):
+    """Stop a milter and return its stderr, which has its log with SyslogStderr"""
+
+    def _milter_log(milter_instance=0):
+        milter[milter_instance].terminate()
+        milter[milter_instance].wait()
+        return milter_config[milter_instance]['log'].read_text()
+
+    return _milter_log
 
 
 @pytest.fixture
@@ -165,6 +285,7 @@ def run_miltertest(request, milter, milter_config):
         body='test body\r\n',
         protocol=miltertest.SMFI_V6_PROT,
         milter_instance=0,
+        messages=1,
     ):
         headers = copy.copy(headers) or []
         if standard_headers:
@@ -184,36 +305,39 @@ def run_miltertest(request, milter, milter_config):
         conn.send(miltertest.SMFIC_CONNECT, hostname='localhost', address='127.0.0.1', family=miltertest.SMFIA_INET, port=666)
         conn.send(miltertest.SMFIC_HELO, helo='mx.example.com')
 
-        # Envelope data
-        conn.send(miltertest.SMFIC_MAIL, args=['<sender@example.com>'])
-        conn.send(miltertest.SMFIC_RCPT, args=['<recipient@example.com>'])
-
-        # Send headers
-        conn.send(miltertest.SMFIC_DATA)
-        conn.send_headers(headers)
-        conn.send(miltertest.SMFIC_EOH)
-
-        # Send body
-        conn.send_body(body)
-        resp = conn.send_eom()
-        ins_headers = []
-        for msg in resp:
-            if msg[0] == miltertest.SMFIR_INSHEADER:
-                # Check for invalid characters
-                assert '\r' not in msg[1]['value']
-                # Check for proper wrapping
-                if msg[1]['name'] in ['ARC-Message-Signature', 'ARC-Seal']:
-                    assert not any(len(x) > 78 for x in msg[1]['value'].splitlines())
-                ins_headers.insert(msg[1]['index'], [msg[1]['name'], msg[1]['value']])
-            elif msg[0] in miltertest.DISPOSITION_REPLIES:
-                assert msg[0] == miltertest.SMFIR_ACCEPT
-            else:
-                pytest.fail(f'Unexpected EOM response {msg}')
+        # Send the same message "messages" times; the last one's results count
+        for _ in range(messages):
+            # Envelope data
+            conn.send(miltertest.SMFIC_MAIL, args=['<sender@example.com>'])
+            conn.send(miltertest.SMFIC_RCPT, args=['<recipient@example.com>'])
+
+            # Send headers
+            conn.send(miltertest.SMFIC_DATA)
+            conn.send_headers(headers)
+            conn.send(miltertest.SMFIC_EOH)
+
+            # Send body
+            body_skipped = milter_send_body(sock, body)
+            resp = conn.send_eom()
+            ins_headers = []
+            for msg in resp:
+                if msg[0] == miltertest.SMFIR_INSHEADER:
+                    # Check for invalid characters
+                    assert '\r' not in msg[1]['value']
+                    # Check for proper wrapping
+                    if msg[1]['name'] in ['ARC-Message-Signature', 'ARC-Seal']:
+                        assert not any(len(x) > 78 for x in msg[1]['value'].splitlines())
+                    ins_headers.insert(msg[1]['index'], [msg[1]['name'], msg[1]['value']])
+                elif msg[0] in miltertest.DISPOSITION_REPLIES:
+                    assert msg[0] == miltertest.SMFIR_ACCEPT
+                else:
+                    pytest.fail(f'Unexpected EOM response {msg}')
 
         return {
             'headers': ins_headers,
             'msg_headers': headers,
             'msg_body': body,
+            'body_skipped': body_skipped,
         }
 
     return _run_miltertest
@@ -62,6 +62,31 @@ def test_dkimpy_sign(run_miltertest, private_key, dkimpy):
     )
 
 
+def test_dkimpy_sign_relaxed_headers(run_miltertest, private_key, dkimpy):
+    # exercise relaxed header canonicalization against another implementation
+    hdrs = [
+        ['Subject', '  test \t message   with\t\t odd    whitespace' + ' padding' * 40 + '  \t '],
+        ['From', '\ttestsender@example.com   '],
+        ['To', ' testrcpt@example.com'],
+        ['Authentication-Results', ' dkimpy.example.com; none'],
+    ]
+
+    msg = b''
+    for h, v in hdrs:
+        msg += f'{h}:{v}\r\n'.encode()
+    msg += b'\r\ntest body\r\n'
+
+    res = ARC(msg).sign(b'dkimpy', b'example.com', private_key['basepath'].joinpath('dkimpy._domainkey.example.com.key').read_bytes(), b'dkimpy.example.com')
+
+    hdrs = [
+        *[h.decode().rstrip().split(':', 1) for h in res],
+        *hdrs,
+    ]
+    res = run_miltertest(hdrs, False)
+
+    assert res['headers'][0] == ['Authentication-Results', ' example.com; arc=pass header.oldest-pass=0 smtp.remote-ip=127.0.0.1']
+
+
 def test_dkimpy_verify(run_miltertest, private_key, dkimpy):
     # we don't test simple/simple because dkimpy uses the wrong default
     for i in range(0, 3):
@@ -1,11 +1,23 @@
 #!/usr/bin/env python3
 
+import concurrent.futures
+import copy
+import hashlib
+import pathlib
+import re
+import socket
+import struct
+import subprocess
+import time
+
 import miltertest
 import pytest
 
 from dirty_equals import IsStr
 from inline_snapshot import snapshot
 
+SMFIP_SKIP = 0x400
+
 
 def test_milter_basic(run_miltertest):
     """Basic signing"""
@@ -78,6 +90,87 @@ def test_milter_canon_simple(run_miltertest):
     )
 
 
+def test_milter_capturecanonicalization(run_miltertest, milter_log, tmp_path):
+    """One message in two has what it hashed captured, and the captures add up"""
+    res = run_miltertest()
+
+    headers = []
+    for i in range(2, 4):
+        headers = [*res['headers'], *headers]
+        res = run_miltertest(headers)
+
+        # capturing doesn't change the results
+        assert res['headers'][0] == ['Authentication-Results', ' example.com; arc=pass header.oldest-pass=0 smtp.remote-ip=127.0.0.1']
+        assert res['headers'][-1] == [
+            'ARC-Authentication-Results',
+            f' i={i}; example.com; arc=pass header.oldest-pass=0 smtp.remote-ip=127.0.0.1',
+        ]
+
+    # the first and third messages were sampled
+    logged = re.findall(r'canonicalizations captured in (\S+)', milter_log())
+    assert sorted(logged) == sorted(str(p) for p in tmp_path.joinpath('capture').iterdir())
+    assert len(logged) == 2
+
+    # the first message was only signed; the third also had a chain to check
+    for path, expected in zip(logged, [['ams', 'body', 'seal'], ['ams', 'body', 'header', 'seal']], strict=True):
+        data = pathlib.Path(path).read_bytes()
+        assert data.startswith(b'ARC-CAPTURE 1\n')
+
+        # the trailer points back at the index
+        index_off = data.rindex(b'\n#index\n') + 1
+        assert data.endswith(f'#end {index_off}\n'.encode())
+
+        # replay the writes, stream by stream
+        streams = {}
+        pos = len(b'ARC-CAPTURE 1\n')
+        while data[pos : pos + 1] == b'@':
+            eol = data.index(b'\n', pos)
+            stream, length = data[pos + 1 : eol].split()
+            streams.setdefault(int(stream), bytearray()).extend(data[eol + 1 : eol + 1 + int(length)])
+            pos = eol + 1 + int(length)
+        assert pos + 1 == index_off
+
+        types = []
+        for line in data[index_off:].decode().splitlines()[1:-1]:
+            stream, htype, _, halg, _, nbytes, digest = line.split()
+            types.append(htype)
+            assert halg == 'sha256'
+            assert int(nbytes) == len(streams[int(stream)])
+            assert digest == hashlib.sha256(streams[int(stream)]).hexdigest()
+        assert sorted(set(types)) == expected
+
+
+def test_milter_cryptothreads(run_miltertest, milter_log):
+    """RSA worker threads sign and verify a multi-hop chain and log their activity"""
+    res = run_miltertest()
+
+    headers = []
+    for i in range(2, 5):
+        headers = [*res['headers'], *headers]
+        res = run_miltertest(headers)
+
+        assert res['headers'][0] == ['Authentication-Results', ' example.com; arc=pass header.oldest-pass=0 smtp.remote-ip=127.0.0.1']
+        assert res['headers'][-1] == [
+            'ARC-Authentication-Results',
+            f' i={i}; example.com; arc=pass header.oldest-pass=0 smtp.remote-ip=127.0.0.1',
+        ]
+
+    # long enough for CryptoStatsInterval to come around
+    time.sleep(1.5)
+
+    stats = [(int(t), int(n)) for t, n in re.findall(r'RSA workers: (\d+) threads, (\d+) operations', milter_log())]
+
+    # at least one periodic report and the one made on exit
+    assert len(stats) >= 2
+    assert all(t == 2 for t, _ in stats)
+    assert [n for _, n in stats] == sorted(n for _, n in stats)
+
+    # two signatures made for each message, and two checked for each set
+    # on the three that had a chain
+    assert stats[-2][1] == 20
+    assert stats[-1][1] == 20
+
+
 def test_milter_resign(run_miltertest):
     """Extend the chain as much as possible"""
     res = run_miltertest()
@@ -254,7 +347,7 @@ def test_milter_mode_none_sign(run_miltertest):
 	arc=none smtp.remote-ip=127.0.0.1\
 """),
         ],
-        # Header with more results than we're willing to store
+        # Header with many results
         [
             [
                 (
@@ -297,9 +390,17 @@ def test_milter_mode_none_sign(run_miltertest):
 	dkim=policy header.i=@example.com header.s=bar;
 	dkim=policy header.i=@example.com header.s=baz;
 	dkim=policy header.i=@example.com header.s=qux;
+	dkim=policy header.i=@example.com header.s=quux;
+	dkim=policy header.i=@example.com header.s=quuux;
+	spf=pass;
 	arc=none smtp.remote-ip=127.0.0.1\
 """),
         ],
+        # Long property values
+        [
+            ['example.com; dkim=pass header.b="' + 'A' * 300 + '" (' + 'a comment ' * 30 + ')'],
+            (' i=1; example.com; dkim=pass header.b=' + 'A' * 300 + ' (' + 'a comment ' * 30 + ');\n\tarc=none smtp.remote-ip=127.0.0.1'),
+        ],
         # Non-matching authserv-id
         [
             [
@@ -315,6 +416,14 @@ def test_milter_mode_none_sign(run_miltertest):
             snapshot("""\
  i=1; example.com; spf=pass (good) smtp.mailfrom=foo@example.com;
 	arc=none smtp.remote-ip=127.0.0.1\
+"""),
+        ],
+        # nested comments
+        [
+            ['example.com; spf=pass (a (nested) comment) smtp.mailfrom=foo@example.com'],
+            snapshot("""\
+ i=1; example.com; spf=pass (a (nested) comment) smtp.mailfrom=foo@example.com;
+	arc=none smtp.remote-ip=127.0.0.1\
 """),
         ],
         # Unknown method
@@ -482,6 +591,37 @@ def test_milter_ar_override(run_miltertest):
     assert res['headers'] == snapshot([['Authentication-Results', ' example.com; arc=fail smtp.remote-ip=127.0.0.1']])
 
 
+def test_milter_ar_override_broken_ams(run_miltertest):
+    """A chain that came in failed is an ordinary failure if its newest signature is broken too"""
+    res = run_miltertest()
+
+    # override the result to "fail"
+    headers = res['headers']
+    headers[0][1] = 'example.com; arc=fail'
+    res = run_miltertest(headers)
+
+    # override the result to "pass", with a body the last signature doesn't match
+    headers = [*res['headers'], *headers]
+    headers[0][1] = 'example.com; arc=pass'
+    res = run_miltertest(headers, body='another body\r\n')
+
+    # so it gets a seal, and A-R can still change its state
+    assert res['headers'] == snapshot(
+        [
+            ['Authentication-Results', ' example.com; arc=pass smtp.remote-ip=127.0.0.1'],
+            [
+                'ARC-Seal',
+                IsStr(regex=r' i=3; d=example\.com; s=elpmaxe; a=rsa-sha256; cv=pass; t=1234567890;\s+(?s:.+)'),
+            ],
+            [
+                'ARC-Message-Signature',
+                IsStr(regex=r' i=3; d=example\.com; s=elpmaxe; a=rsa-sha256;\s+c=relaxed/simple; t=1234567890;\s+h=From:Date:Subject;\s+(?s:.+)'),
+            ],
+            ['ARC-Authentication-Results', ' i=3; example.com; arc=pass'],
+        ]
+    )
+
+
 def test_milter_ar_override_disabled(run_miltertest):
     """`PermitAuthenticationOverrides = no` preserves the actual state"""
     res = run_miltertest()
@@ -676,6 +816,106 @@ def test_milter_authresip(run_miltertest):
     )
 
 
+def test_milter_authresoldestpass(run_miltertest):
+    """AuthResOldestPass false drops header.oldest-pass once it costs anything"""
+    headers = []
+    for i in range(0, 3):
+        res = run_miltertest(headers)
+        headers = [*res['headers'], *headers]
+
+    assert res['headers'][0] == ['Authentication-Results', ' example.com; arc=pass smtp.remote-ip=127.0.0.1']
+    assert res['headers'][-1] == ['ARC-Authentication-Results', ' i=3; example.com; arc=pass smtp.remote-ip=127.0.0.1']
+
+
+def test_milter_backgroundverification(run_miltertest):
+    """BackgroundVerification gives the same results"""
+    headers = []
+    for i in range(0, 3):
+        res = run_miltertest(headers)
+        headers = [*res['headers'], *headers]
+
+    assert res['headers'][0] == ['Authentication-Results', ' example.com; arc=pass header.oldest-pass=0 smtp.remote-ip=127.0.0.1']
+    assert res['headers'][-1] == ['ARC-Authentication-Results', ' i=3; example.com; arc=pass header.oldest-pass=0 smtp.remote-ip=127.0.0.1']
+
+    # break the newest seal's signature, which only the background check
+    # can catch, and don't let A-R override the result
+    good = [x for x in headers if x[0] != 'Authentication-Results']
+    bad = copy.deepcopy(good)
+    assert bad[0][0] == 'ARC-Seal' and bad[0][1].startswith(' i=3;')
+    bad[0][1] = bad[0][1].replace('t=1234567890', 't=1234567891')
+    res = run_miltertest(bad)
+    assert res['headers'][0] == ['Authentication-Results', ' example.com; arc=fail smtp.remote-ip=127.0.0.1']
+
+    # more messages at once than there are background workers
+    with concurrent.futures.ThreadPoolExecutor(max_workers=16) as pool:
+        results = list(pool.map(lambda n: run_miltertest(bad if n % 3 == 0 else good), range(0, 64)))
+
+    for n, res in enumerate(results):
+        if n % 3 == 0:
+            assert res['headers'][0] == ['Authentication-Results', ' example.com; arc=fail smtp.remote-ip=127.0.0.1']
+        else:
+            assert res['headers'][0] == ['Authentication-Results', ' example.com; arc=pass header.oldest-pass=0 smtp.remote-ip=127.0.0.1']
+
+
+def test_milter_bodyhashthreads(run_miltertest):
+    """Hashing body canonicalizations on helper threads matches the serial path"""
+    body = ''.join(f'line {i} of a body  with\tsome   whitespace \r\n' for i in range(0, 2000))
+
+    res = run_miltertest(body=body)
+    headers = res['headers']
+    res = run_miltertest(headers, body=body, milter_instance=1)
+    headers = [*res['headers'], *headers]
+
+    threaded = run_miltertest(headers, body=body, milter_instance=2)
+    serial = run_miltertest(headers, body=body, milter_instance=3)
+
+    assert threaded['headers'][0] == ['Authentication-Results', ' example.com; arc=pass header.oldest-pass=0 smtp.remote-ip=127.0.0.1']
+    assert threaded['headers'] == serial['headers']
+
+    # a broken body hash must be caught on either path
+    body = body.replace('line 1999', 'line 2000')
+    threaded = run_miltertest(headers, body=body, milter_instance=2)
+    serial = run_miltertest(headers, body=body, milter_instance=3)
+
+    assert threaded['headers'][0] == ['Authentication-Results', ' example.com; arc=fail smtp.remote-ip=127.0.0.1']
+    assert threaded['headers'] == serial['headers']
+
+
+@pytest.mark.parametrize(
+    'chain,result,skipped',
+    [
+        ('none', 'arc=none', True),
+        ('pass', 'arc=pass header.oldest-pass=0', False),
+        ('cv_fail', 'arc=fail', True),
+        ('bad_seal', 'arc=fail', True),
+    ],
+)
+def test_milter_bodyskip(run_miltertest, chain, result, skipped):
+    """A verifier skips the body once the chain can't depend on it"""
+    body = 'test body\r\n' * 10000
+    headers = []
+    if chain != 'none':
+        for i in range(0, 3):
+            res = run_miltertest(headers, body=body)
+            headers = [*res['headers'], *headers]
+        headers = [x for x in headers if x[0] != 'Authentication-Results']
+
+    for h in headers:
+        if chain == 'cv_fail' and h[0] == 'ARC-Seal' and h[1].startswith(' i=2;'):
+            h[1] = h[1].replace('cv=pass', 'cv=fail')
+        if chain == 'bad_seal' and h[0] == 'ARC-Seal' and h[1].startswith(' i=3;'):
+            h[1] = h[1].replace('t=1234567890', 't=1234567891')
+
+    res = run_miltertest(headers, body=body, milter_instance=1)
+    assert res['body_skipped'] == skipped
+    assert res['headers'] == [['Authentication-Results', f' example.com; {result} smtp.remote-ip=127.0.0.1']]
+
+    # an MTA that can't skip sends the whole body and gets the same result
+    full = run_miltertest(headers, body=body, milter_instance=1, protocol=miltertest.SMFI_V6_PROT & ~SMFIP_SKIP)
+    assert not full['body_skipped']
+    assert full['headers'] == res['headers']
+
+
 def test_milter_finalreceiver(run_miltertest):
     """FinalReceiver adds arc.chain"""
     headers = []
@@ -698,12 +938,188 @@ def test_milter_finalreceiver(run_miltertest):
     )
 
 
+def test_milter_logallocations(run_miltertest, milter_log):
+    """A connection's later messages reuse what its first one allocated"""
+    res = run_miltertest(messages=3)
+    assert res['headers'][-1] == ['ARC-Authentication-Results', ' i=1; example.com; arc=none smtp.remote-ip=127.0.0.1']
+
+    headers = []
+    for i in range(2, 5):
+        headers = [*res['headers'], *headers]
+        res = run_miltertest(headers, messages=3)
+
+        assert res['headers'][-1] == [
+            'ARC-Authentication-Results',
+            f' i={i}; example.com; arc=pass header.oldest-pass=0 smtp.remote-ip=127.0.0.1',
+        ]
+
+    counts = [(int(a), int(r)) for a, r in re.findall(r': (\d+) allocations, (\d+) objects reused', milter_log())]
+    assert len(counts) == 12
+
+    # nothing to reuse at first
+    assert counts[0][0] > 0
+    assert counts[0][1] == 0
+
+    # a connection's second message may still allocate while the pools fill,
+    # but by the third everything comes from them
+    for conn in range(0, 12, 3):
+        assert counts[conn + 1][1] > 0
+        assert counts[conn + 2][0] == 0
+        assert counts[conn + 2][1] > 0
+
+
 def test_milter_maximumheaders(run_miltertest):
     """Oversized headers result in message rejection"""
     with pytest.raises(miltertest.MilterError, match="Unexpected reply to L: \\('r'"):
         run_miltertest()
 
 
+def test_milter_messagearenasize(run_miltertest, milter_log):
+    """Messages that outgrow a tiny arena still work, and the largest is logged"""
+    headers = []
+    for i in range(0, 4):
+        res = run_miltertest(headers)
+        headers = [*res['headers'], *headers]
+
+    assert res['headers'][0] == ['Authentication-Results', ' example.com; arc=pass header.oldest-pass=0 smtp.remote-ip=127.0.0.1']
+
+    hwm = re.search(r'largest message arena: ([0-9]+) bytes', milter_log())
+    assert hwm
+    assert int(hwm[1]) > 1024
+
+
+def test_milter_milterengine(run_miltertest):
+    """The built-in milter engine handles a multi-hop chain"""
+    res = run_miltertest()
+    assert res['headers'][-1] == ['ARC-Authentication-Results', ' i=1; example.com; arc=none smtp.remote-ip=127.0.0.1']
+
+    headers = []
+    for i in range(2, 5):
+        headers = [*res['headers'], *headers]
+        res = run_miltertest(headers)
+
+        assert res['headers'][-1] == [
+            'ARC-Authentication-Results',
+            f' i={i}; example.com; arc=pass header.oldest-pass=0 smtp.remote-ip=127.0.0.1',
+        ]
+
+
+def test_milter_milterengine_concurrent(run_miltertest):
+    """Connections served at the same time by a few workers get the same results as one alone"""
+    expected = run_miltertest(messages=2)['headers']
+
+    with concurrent.futures.ThreadPoolExecutor(max_workers=16) as pool:
+        results = list(pool.map(lambda n: run_miltertest(messages=3), range(0, 48)))
+
+    for res in results:
+        assert res['headers'] == expected
+
+
+def _milterengine_connect(milter_config):
+    sock = socket.socket(family=socket.AF_UNIX)
+    sock.connect(bytes(milter_config[0]['sock']))
+    conn = miltertest.MilterConnection(sock)
+    conn.optneg_mta()
+    conn.send(miltertest.SMFIC_CONNECT, hostname='localhost', address='127.0.0.1', family=miltertest.SMFIA_INET, port=666)
+    conn.send(miltertest.SMFIC_HELO, helo='mx.example.com')
+    return sock, conn
+
+
+def _milterengine_start(conn, subject):
+    conn.send(miltertest.SMFIC_MAIL, args=['<sender@example.com>'])
+    conn.send(miltertest.SMFIC_RCPT, args=['<recipient@example.com>'])
+    conn.send(miltertest.SMFIC_DATA)
+    conn.send_headers(
+        [
+            ['From', ' user@example.com'],
+            ['Date', ' Fri, 04 Oct 2024 10:11:12 -0400'],
+            ['Subject', subject],
+        ]
+    )
+    conn.send(miltertest.SMFIC_EOH)
+
+
+def test_milter_milterengine_abort(run_miltertest, milter_config):
+    """A message aborted halfway leaves the connection ready for the next one"""
+    expected = run_miltertest()['headers']
+
+    sock, conn = _milterengine_connect(milter_config)
+    _milterengine_start(conn, 'test_milter_milterengine_abort')
+    assert conn.send_body('a body that never ends\r\n') is None
+    conn.send(miltertest.SMFIC_ABORT)
+
+    _milterengine_start(conn, 'test_milter_milterengine_abort')
+    assert conn.send_body('test body\r\n') is None
+    resp = conn.send_eom()
+    sock.close()
+
+    headers = []
+    for r in resp[:-1]:
+        assert r[0] == miltertest.SMFIR_INSHEADER
+        headers.insert(r[1]['index'], [r[1]['name'], r[1]['value']])
+    assert headers == expected
+    assert resp[-1][0] == miltertest.SMFIR_ACCEPT
+
+
+def test_milter_milterengine_macros(milter, milter_config):
+    """Connection macros outlast a message; the message's own don't"""
+    sock, conn = _milterengine_connect(milter_config)
+    conn.send(miltertest.SMFIC_MACRO, cmdcode=miltertest.SMFIC_CONNECT, nameval={'j': 'mta.example.com'})
+
+    software = []
+    for n in range(0, 2):
+        if n == 0:
+            conn.send(miltertest.SMFIC_MACRO, cmdcode=miltertest.SMFIC_MAIL, nameval={'i': 'ABC123'})
+        _milterengine_start(conn, 'test_milter_milterengine_macros')
+        assert conn.send_body('test body\r\n') is None
+        for r in conn.send_eom():
+            if r[0] == miltertest.SMFIR_INSHEADER and r[1]['name'] == 'ARC-Filter':
+                software.append(r[1]['value'])
+    sock.close()
+
+    assert software == [
+        IsStr(regex=r' OpenARC Filter v[0-9a-z\.]+ mta\.example\.com ABC123'),
+        IsStr(regex=r' OpenARC Filter v[0-9a-z\.]+ mta\.example\.com \(unknown-jobid\)'),
+    ]
+
+
+def test_milter_milterengine_teardown(run_miltertest, milter, milter_config):
+    """Many connections going away in the same moment, some mid-message, don't upset the engine"""
+    conns = []
+    for n in range(0, 32):
+        sock, conn = _milterengine_connect(milter_config)
+        if n % 2:
+            _milterengine_start(conn, 'test_milter_milterengine_teardown')
+        conns.append(sock)
+
+    # reset rather than close, so they all land in one batch of events
+    for sock in conns:
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_LINGER, struct.pack('ii', 1, 0))
+        sock.close()
+
+    res = run_miltertest()
+    assert res['headers'][-1] == ['ARC-Authentication-Results', ' i=1; example.com; arc=none smtp.remote-ip=127.0.0.1']
+    assert milter[0].poll() is None
+
+
+def test_milter_milterengine_dns(dns_server, run_miltertest):
+    """A message waiting on a key lookup doesn't hold the only worker"""
+    signed = run_miltertest()['headers']
+
+    dns_server['delay'] = 1
+    with concurrent.futures.ThreadPoolExecutor(max_workers=2) as pool:
+        waiting = pool.submit(run_miltertest, signed)
+        while not dns_server['queries']:
+            time.sleep(0.01)
+        unsigned = run_miltertest()
+        assert not waiting.done()
+        res = waiting.result()
+
+    assert dns_server['queries'] == ['elpmaxe._domainkey.example.com']
+    assert unsigned['headers'][-1] == ['ARC-Authentication-Results', ' i=1; example.com; arc=none smtp.remote-ip=127.0.0.1']
+    assert res['headers'][-1] == ['ARC-Authentication-Results', ' i=2; example.com; arc=pass header.oldest-pass=0 smtp.remote-ip=127.0.0.1']
+
+
 def test_milter_minimum_key_bits(run_miltertest):
     """A 2048-bit key passes when that is the minimum"""
     res = run_miltertest()
@@ -742,12 +1158,42 @@ def test_milter_minimum_key_bits_fail(run_miltertest):
     )
 
 
+def test_milter_minimum_key_bits_cryptothreads(run_miltertest, milter_log):
+    """A key below the minimum is refused before it reaches the RSA workers"""
+    res = run_miltertest()
+    res = run_miltertest(res['headers'])
+    assert res['headers'][-1] == ['ARC-Authentication-Results', ' i=2; example.com; arc=fail smtp.remote-ip=127.0.0.1']
+
+    # only the signatures made for the two messages
+    stats = re.findall(r'RSA workers: \d+ threads, (\d+) operations', milter_log())
+    assert stats == ['4']
+
+
 def test_milter_peerlist(run_miltertest):
     """Connections from peers just get `accept` back immediately"""
     with pytest.raises(miltertest.MilterError, match='unexpected response: a'):
         run_miltertest()
 
 
+def test_milter_peerlist_hostcase(run_miltertest):
+    """PeerList host names match in any case"""
+    with pytest.raises(miltertest.MilterError, match='unexpected response: a'):
+        run_miltertest()
+
+
+def test_milter_peerlist_prefix(run_miltertest):
+    """PeerList entries can be network prefixes"""
+    with pytest.raises(miltertest.MilterError, match='unexpected response: a'):
+        run_miltertest()
+
+
+def test_milter_peerlist_matcher(tool_path):
+    """PeerList and InternalHosts lookups agree with the old matcher on a random list"""
+    res = subprocess.run([tool_path('openarc/peerlist-bench'), '-e', '200'], capture_output=True, timeout=60)
+    assert res.returncode == 0, res.stderr.decode()
+    assert res.stdout.decode().count(', ok\n') == 2
+
+
 def test_milter_responsedisabled(run_miltertest):
     """Configured to reject messages from peers"""
     with pytest.raises(miltertest.MilterError, match='unexpected response: r'):
@@ -760,6 +1206,21 @@ def test_milter_responseunwilling(run_miltertest):
         run_miltertest()
 
 
+def test_milter_sealheaderchecks(run_miltertest):
+    """Only messages matching a SealHeaderChecks rule are processed"""
+    with pytest.raises(miltertest.MilterError, match='unexpected response: a'):
+        run_miltertest()
+
+    with pytest.raises(miltertest.MilterError, match='unexpected response: a'):
+        run_miltertest([['X-Seal-Tenant', ' ["tenant-1", "tenant-2"]']])
+
+    res = run_miltertest([['X-Seal-Tenant', ' ["tenant-1", "tenant-7"]']])
+    assert res['headers'][0] == ['Authentication-Results', ' example.com; arc=none smtp.remote-ip=127.0.0.1']
+
+    res = run_miltertest([['X-Seal-Tenant', ' tenant-7']])
+    assert res['headers'][0] == ['Authentication-Results', ' example.com; arc=none smtp.remote-ip=127.0.0.1']
+
+
 def test_milter_signaturettl(run_miltertest):
     """Setting a TTL tags AMS with x="""
     ttl_res = run_miltertest()
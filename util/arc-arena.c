@@ -0,0 +1,349 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#include "build-config.h"
+
+/* system includes */
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "arc-arena.h"
+#include "arc-malloc.h"
+
+/* enough for any object the library stores */
+#define ARC_ARENA_ALIGN    ((size_t) 16)
+#define ARC_ARENA_MASK     (ARC_ARENA_ALIGN - 1)
+#define ARC_ARENA_ROUND(x) (((x) + ARC_ARENA_MASK) & ~ARC_ARENA_MASK)
+
+/* don't let chunk sizes double forever */
+#define ARC_ARENA_MAXCHUNK (1024 * 1024)
+
+/* struct arc_arena_chunk -- one block of arena memory */
+struct arc_arena_chunk
+{
+    struct arc_arena_chunk *ac_next;
+    size_t                  ac_size;
+    size_t                  ac_used;
+    bool                    ac_dedicated;
+};
+
+#define ARC_ARENA_CHUNKHDR ARC_ARENA_ROUND(sizeof(struct arc_arena_chunk))
+
+/* chunks are kept in allocation order, starting with the one embedded in
+ * the arena; arc_arena_reset() rewinds "aa_cur" to the start */
+struct arc_arena
+{
+    size_t                  aa_used;
+    size_t                  aa_nextsize;
+    struct arc_allocator   *aa_alloc;
+    struct arc_arena_chunk *aa_cur;
+    struct arc_arena_chunk *aa_first;
+};
+
+#define ARC_ARENA_HDR ARC_ARENA_ROUND(sizeof(struct arc_arena))
+
+/**
+ *  Create an arena.
+ *
+ *  Parameters:
+ *      size: size of the first chunk, which shares an allocation with the
+ *            arena itself (minimum 1024)
+ *      al: where the arena's memory comes from, or NULL for libc
+ *
+ *  Returns:
+ *      A new arena, or NULL on allocation failure.
+ */
+struct arc_arena *
+arc_arena_new(size_t size, struct arc_allocator *al)
+{
+    unsigned char    *block;
+    struct arc_arena *arena;
+
+    if (size < 1024)
+    {
+        size = 1024;
+    }
+
+    size = ARC_ARENA_ROUND(size);
+    if (size > SIZE_MAX - ARC_ARENA_HDR - ARC_ARENA_CHUNKHDR)
+    {
+        return NULL;
+    }
+
+    block = ARC_LMALLOC(al, ARC_ARENA_HDR + ARC_ARENA_CHUNKHDR + size);
+    if (block == NULL)
+    {
+        return NULL;
+    }
+
+    arena = (struct arc_arena *) block;
+    arena->aa_used = 0;
+    arena->aa_nextsize = size;
+    arena->aa_alloc = al;
+    arena->aa_first = (struct arc_arena_chunk *) (block + ARC_ARENA_HDR);
+    arena->aa_first->ac_next = NULL;
+    arena->aa_first->ac_size = size;
+    arena->aa_first->ac_used = 0;
+    arena->aa_first->ac_dedicated = false;
+    arena->aa_cur = arena->aa_first;
+
+    return arena;
+}
+
+/**
+ *  Allocate memory from an arena.
+ *
+ *  Parameters:
+ *      arena: arena to allocate from
+ *      size: number of bytes wanted
+ *
+ *  Returns:
+ *      A pointer to the memory, or NULL on allocation failure. The memory
+ *      is released by arc_arena_free(), never on its own.
+ */
+void *
+arc_arena_malloc(struct arc_arena *arena, size_t size)
+{
+    bool                    dedicated;
+    size_t                  chunksize;
+    struct arc_arena_chunk *chunk;
+
+    assert(arena != NULL);
+
+    if (size == 0)
+    {
+        size = 1;
+    }
+    if (size > SIZE_MAX - ARC_ARENA_CHUNKHDR - ARC_ARENA_ALIGN)
+    {
+        return NULL;
+    }
+    size = ARC_ARENA_ROUND(size);
+
+    chunk = arena->aa_cur;
+    if (chunk->ac_size - chunk->ac_used < size)
+    {
+        /* chunks kept by arc_arena_reset() are reused before adding more */
+        for (chunk = chunk->ac_next; chunk != NULL; chunk = chunk->ac_next)
+        {
+            if (chunk->ac_size - chunk->ac_used >= size)
+            {
+                arena->aa_cur = chunk;
+                break;
+            }
+        }
+    }
+
+    if (chunk == NULL)
+    {
+        chunksize = arena->aa_nextsize;
+        if (chunksize < ARC_ARENA_MAXCHUNK)
+        {
+            chunksize *= 2;
+        }
+
+        /* something too big to share gets its own chunk, and the current
+         * one stays current since it may still have room for smaller
+         * requests */
+        dedicated = size > chunksize / 2;
+        if (dedicated)
+        {
+            chunk = ARC_LMALLOC(arena->aa_alloc, ARC_ARENA_CHUNKHDR + size);
+            if (chunk == NULL)
+            {
+                return NULL;
+            }
+            chunk->ac_size = size;
+        }
+        else
+        {
+            chunk = ARC_LMALLOC(arena->aa_alloc,
+                                ARC_ARENA_CHUNKHDR + chunksize);
+            if (chunk == NULL)
+            {
+                return NULL;
+            }
+            chunk->ac_size = chunksize;
+            arena->aa_nextsize = chunksize;
+        }
+
+        chunk->ac_used = 0;
+        chunk->ac_dedicated = dedicated;
+        chunk->ac_next = arena->aa_cur->ac_next;
+        arena->aa_cur->ac_next = chunk;
+        if (!dedicated)
+        {
+            arena->aa_cur = chunk;
+        }
+    }
+
+    chunk->ac_used += size;
+    arena->aa_used += size;
+
+    return (unsigned char *) chunk + ARC_ARENA_CHUNKHDR + chunk->ac_used - size;
+}
+
+/**
+ *  Allocate zeroed memory for an array from an arena.
+ *
+ *  Parameters:
+ *      arena: arena to allocate from
+ *      nmemb: number of elements
+ *      size: size of each element
+ *
+ *  Returns:
+ *      A pointer to the memory, or NULL on allocation failure.
+ */
+void *
+arc_arena_calloc(struct arc_arena *arena, size_t nmemb, size_t size)
+{
+    void *p;
+
+    if (size != 0 && nmemb > SIZE_MAX / size)
+    {
+        return NULL;
+    }
+
+    p = arc_arena_malloc(arena, nmemb * size);
+    if (p != NULL)
+    {
+        memset(p, '\0', nmemb * size);
+    }
+
+    return p;
+}
+
+/**
+ *  Copy a string into an arena.
+ *
+ *  Parameters:
+ *      arena: arena to allocate from
+ *      str: string to copy
+ *      len: maximum number of bytes to copy from "str"
+ *
+ *  Returns:
+ *      A NUL-terminated copy, or NULL on allocation failure.
+ */
+char *
+arc_arena_strndup(struct arc_arena *arena, const char *str, size_t len)
+{
+    char       *p;
+    const char *nul;
+
+    nul = memchr(str, '\0', len);
+    if (nul != NULL)
+    {
+        len = nul - str;
+    }
+
+    p = arc_arena_malloc(arena, len + 1);
+    if (p != NULL)
+    {
+        memcpy(p, str, len);
+        p[len] = '\0';
+    }
+
+    return p;
+}
+
+/**
+ *  Report how much of an arena has been handed out.
+ *
+ *  Parameters:
+ *      arena: arena to inspect
+ *
+ *  Returns:
+ *      Bytes allocated from the arena so far, including alignment padding.
+ */
+size_t
+arc_arena_used(struct arc_arena *arena)
+{
+    assert(arena != NULL);
+
+    return arena->aa_used;
+}
+
+/**
+ *  Discard everything allocated from an arena but keep its memory, except
+ *  for chunks made for one oversized request or grown past the usual limit.
+ *
+ *  Parameters:
+ *      arena: arena to rewind
+ *      keep: number of bytes at the start of the first chunk to preserve;
+ *            must be a value arc_arena_used() returned while all allocations
+ *            still fit in the first chunk
+ *
+ *  Returns:
+ *      Nothing.
+ */
+void
+arc_arena_reset(struct arc_arena *arena, size_t keep)
+{
+    struct arc_arena_chunk *chunk;
+    struct arc_arena_chunk *next;
+    struct arc_arena_chunk *prev;
+
+    assert(arena != NULL);
+    assert(keep <= arena->aa_first->ac_size);
+
+    /* a handle lives as long as its connection, so don't let one large
+     * message pin its big chunks there; growth restarts from what's left */
+    arena->aa_nextsize = arena->aa_first->ac_size;
+    prev = arena->aa_first;
+    for (chunk = prev->ac_next; chunk != NULL; chunk = next)
+    {
+        next = chunk->ac_next;
+        if (chunk->ac_dedicated || chunk->ac_size > ARC_ARENA_MAXCHUNK)
+        {
+            prev->ac_next = next;
+            ARC_LFREE(arena->aa_alloc, chunk);
+            continue;
+        }
+
+        chunk->ac_used = 0;
+        if (chunk->ac_size > arena->aa_nextsize)
+        {
+            arena->aa_nextsize = chunk->ac_size;
+        }
+        prev = chunk;
+    }
+
+    arena->aa_first->ac_used = keep;
+    arena->aa_cur = arena->aa_first;
+    arena->aa_used = keep;
+}
+
+/**
+ *  Release an arena and everything allocated from it.
+ *
+ *  Parameters:
+ *      arena: arena to destroy
+ *
+ *  Returns:
+ *      Nothing.
+ */
+void
+arc_arena_free(struct arc_arena *arena)
+{
+    struct arc_arena_chunk *chunk;
+    struct arc_arena_chunk *next;
+
+    if (arena == NULL)
+    {
+        return;
+    }
+
+    /* the first chunk is part of the arena's own allocation */
+    for (chunk = arena->aa_first->ac_next; chunk != NULL; chunk = next)
+    {
+        next = chunk->ac_next;
+        ARC_LFREE(arena->aa_alloc, chunk);
+    }
+
+    ARC_LFREE(arena->aa_alloc, arena);
+}
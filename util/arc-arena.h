@@ -0,0 +1,28 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#ifndef ARC_ARENA_H
+#define ARC_ARENA_H
+
+#include "build-config.h"
+
+/* system includes */
+#include <sys/types.h>
+
+#include "arc-malloc.h"
+
+/* struct arc_arena -- bump allocator for objects sharing one lifetime */
+struct arc_arena;
+
+extern struct arc_arena *arc_arena_new(size_t, struct arc_allocator *);
+extern void             *arc_arena_malloc(struct arc_arena *, size_t);
+extern void             *arc_arena_calloc(struct arc_arena *, size_t, size_t);
+extern char             *arc_arena_strndup(struct arc_arena *,
+                                           const char *,
+                                           size_t);
+extern size_t            arc_arena_used(struct arc_arena *);
+extern void              arc_arena_reset(struct arc_arena *, size_t);
+extern void              arc_arena_free(struct arc_arena *);
+
+#endif /* ARC_ARENA_H */
@@ -43,7 +43,7 @@
 static bool
 arc_dstring_resize(struct arc_dstring *dstr, int len)
 {
-    int newsz;
+    int   newsz;
     char *new;
 
     assert(dstr != NULL);
@@ -54,8 +54,15 @@ arc_dstring_resize(struct arc_dstring *dstr, int len)
         return true;
     }
 
+    /* leaving the inline buffer goes straight to the size hint */
+    newsz = dstr->ds_alloc * 2;
+    if (dstr->ds_buf == dstr->ds_small && newsz < dstr->ds_hint)
+    {
+        newsz = dstr->ds_hint;
+    }
+
     /* must resize */
-    for (newsz = dstr->ds_alloc * 2; newsz < len; newsz *= 2)
+    for (; newsz < len; newsz *= 2)
     {
         /* impose ds_max limit, if specified */
         if (dstr->ds_max > 0 && newsz > dstr->ds_max)
@@ -86,7 +93,26 @@ arc_dstring_resize(struct arc_dstring *dstr, int len)
         }
     }
 
-    new = ARC_MALLOC(newsz);
+    /* never allocate more than the string could use */
+    if (dstr->ds_max > 0 && newsz > dstr->ds_max && len <= dstr->ds_max)
+    {
+        newsz = dstr->ds_max;
+    }
+
+    /* only a heap buffer can be grown in place */
+    if (dstr->ds_arena != NULL)
+    {
+        new = ARC_AMALLOC(dstr->ds_arena, newsz);
+    }
+    else if (dstr->ds_buf == dstr->ds_small)
+    {
+        new = ARC_LMALLOC(dstr->ds_al, newsz);
+    }
+    else
+    {
+        new = ARC_LREALLOC(dstr->ds_al, dstr->ds_buf, newsz);
+    }
+
     if (new == NULL)
     {
         if (dstr->ds_cb)
@@ -96,21 +122,61 @@ arc_dstring_resize(struct arc_dstring *dstr, int len)
         return false;
     }
 
-    memcpy(new, dstr->ds_buf, dstr->ds_alloc);
-    ARC_FREE(dstr->ds_buf);
+    if (dstr->ds_arena != NULL || dstr->ds_buf == dstr->ds_small)
+    {
+        memcpy(new, dstr->ds_buf, dstr->ds_len + 1);
+    }
     dstr->ds_alloc = newsz;
     dstr->ds_buf = new;
 
     return true;
 }
 
+/*
+**  ARC_DSTRING_INIT -- set up a freshly allocated dstring
+**
+**  Parameters:
+**  	dstr -- ARC_DSTRING handle
+**  	len -- expected size
+**  	maxlen -- maximum allowed length, including the NULL byte
+**  	ctx -- context for "callback"
+**  	callback -- error reporting function (or NULL)
+**
+**  Return value:
+**  	None.
+*/
+
+static void
+arc_dstring_init(struct arc_dstring *dstr,
+                 int                 len,
+                 int                 maxlen,
+                 void               *ctx,
+                 void (*callback)(void *, const char *, ...))
+{
+    dstr->ds_ctx = ctx;
+    dstr->ds_cb = callback;
+    dstr->ds_al = NULL;
+    dstr->ds_arena = NULL;
+    dstr->ds_buf = dstr->ds_small;
+    dstr->ds_buf[0] = '\0';
+    dstr->ds_alloc = sizeof dstr->ds_small;
+    dstr->ds_len = 0;
+    dstr->ds_max = maxlen;
+    dstr->ds_hint = len < 1024 ? 1024 : len;
+}
+
 /*
 **  ARC_DSTRING_NEW -- make a new dstring
 **
 **  Parameters:
-**  	len -- initial number of bytes
+**  	len -- expected size; nothing beyond the handle itself is allocated
+**  	       until the string outgrows ARC_DSTRING_SMALL, and then at
+**  	       least this much is
 **  	maxlen -- maximum allowed length, including the NULL byte
 **  	          (0 == unbounded)
+**  	ctx -- context for "callback"
+**  	callback -- error reporting function (or NULL)
+**  	al -- allocator to use (or NULL for libc)
 **
 **  Return value:
 **  	A ARC_DSTRING handle, or NULL on failure.
@@ -120,7 +186,8 @@ struct arc_dstring *
 arc_dstring_new(int   len,
                 int   maxlen,
                 void *ctx,
-                void (*callback)(void *, const char *, ...))
+                void (*callback)(void *, const char *, ...),
+                struct arc_allocator *al)
 {
     struct arc_dstring *new;
 
@@ -130,12 +197,7 @@ arc_dstring_new(int   len,
         return NULL;
     }
 
-    if (len < 1024)
-    {
-        len = 1024;
-    }
-
-    new = ARC_MALLOC(sizeof *new);
+    new = ARC_LMALLOC(al, sizeof *new);
     if (new == NULL)
     {
         if (callback)
@@ -145,23 +207,61 @@ arc_dstring_new(int   len,
         return NULL;
     }
 
-    new->ds_ctx = ctx;
-    new->ds_cb = callback;
-    new->ds_buf = ARC_MALLOC(len);
-    if (new->ds_buf == NULL)
+    arc_dstring_init(new, len, maxlen, ctx, callback);
+    new->ds_al = al;
+
+    return new;
+}
+
+/*
+**  ARC_DSTRING_NEW_ARENA -- make a new dstring that lives in an arena
+**
+**  Parameters:
+**  	arena -- arena to allocate from
+**  	len -- expected size
+**  	maxlen -- maximum allowed length, including the NULL byte
+**  	          (0 == unbounded)
+**  	ctx -- context for "callback"
+**  	callback -- error reporting function (or NULL)
+**
+**  Return value:
+**  	A ARC_DSTRING handle, or NULL on failure.
+**
+**  Notes:
+**  	The string and every buffer it grows into are released with the
+**  	arena; arc_dstring_free() does nothing to it. Arenas are not
+**  	thread-safe, so neither is appending to such a string.
+*/
+
+struct arc_dstring *
+arc_dstring_new_arena(struct arc_arena *arena,
+                      int               len,
+                      int               maxlen,
+                      void             *ctx,
+                      void (*callback)(void *, const char *, ...))
+{
+    struct arc_dstring *new;
+
+    assert(arena != NULL);
+
+    /* fail on invalid parameters */
+    if ((maxlen > 0 && len > maxlen) || len < 0)
+    {
+        return NULL;
+    }
+
+    new = ARC_AMALLOC(arena, sizeof *new);
+    if (new == NULL)
     {
         if (callback)
         {
-            callback(ctx, "unable to allocate %d bytes", sizeof len);
+            callback(ctx, "unable to allocate %d bytes", sizeof *new);
         }
-        ARC_FREE(new);
         return NULL;
     }
 
-    memset(new->ds_buf, '\0', len);
-    new->ds_alloc = len;
-    new->ds_len = 0;
-    new->ds_max = maxlen;
+    arc_dstring_init(new, len, maxlen, ctx, callback);
+    new->ds_arena = arena;
 
     return new;
 }
@@ -179,13 +279,71 @@ arc_dstring_new(int   len,
 void
 arc_dstring_free(struct arc_dstring *dstr)
 {
-    if (dstr == NULL)
+    if (dstr == NULL || dstr->ds_arena != NULL)
     {
         return;
     }
 
-    ARC_FREE(dstr->ds_buf);
-    ARC_FREE(dstr);
+    if (dstr->ds_buf != dstr->ds_small)
+    {
+        ARC_LFREE(dstr->ds_al, dstr->ds_buf);
+    }
+    ARC_LFREE(dstr->ds_al, dstr);
+}
+
+/*
+**  ARC_DSTRING_RESERVE -- make room to append to a dstring
+**
+**  Parameters:
+**  	dstr -- ARC_DSTRING handle to update
+**  	nbytes -- number of bytes the caller is about to append
+**
+**  Return value:
+**  	true iff that many bytes can now be appended without reallocating.
+**
+**  Notes:
+**  	Callers about to build a string out of many small appends can use
+**  	this to allocate once; others write into the space directly and
+**  	then call arc_dstring_commit().
+*/
+
+bool
+arc_dstring_reserve(struct arc_dstring *dstr, size_t nbytes)
+{
+    size_t needed;
+
+    assert(dstr != NULL);
+
+    needed = dstr->ds_len + nbytes + 1;
+
+    if ((dstr->ds_max > 0 && needed > dstr->ds_max) || needed > INT_MAX)
+    {
+        return false;
+    }
+
+    return arc_dstring_resize(dstr, needed);
+}
+
+/*
+**  ARC_DSTRING_COMMIT -- account for bytes written directly into a dstring
+**
+**  Parameters:
+**  	dstr -- ARC_DSTRING handle to update
+**  	nbytes -- number of bytes written just past the current end, which
+**  	          arc_dstring_reserve() must have made room for
+**
+**  Return value:
+**  	None.
+*/
+
+void
+arc_dstring_commit(struct arc_dstring *dstr, size_t nbytes)
+{
+    assert(dstr != NULL);
+    assert(dstr->ds_len + nbytes < dstr->ds_alloc);
+
+    dstr->ds_len += nbytes;
+    dstr->ds_buf[dstr->ds_len] = '\0';
 }
 
 /*
@@ -307,6 +465,15 @@ arc_dstring_cat1(struct arc_dstring *dstr, int c)
 
     len = dstr->ds_len + 1;
 
+    /* fast path: room already, which is nearly always */
+    if (len < dstr->ds_alloc && (dstr->ds_max == 0 || len < dstr->ds_max))
+    {
+        dstr->ds_buf[dstr->ds_len] = c;
+        dstr->ds_buf[len] = '\0';
+        dstr->ds_len = len;
+        return true;
+    }
+
     /* too big? */
     if (dstr->ds_max > 0 && len >= dstr->ds_max)
     {
@@ -563,7 +730,7 @@ arc_dstring_printf(struct arc_dstring *dstr, char *fmt, ...)
     len = vsnprintf((char *) dstr->ds_buf + dstr->ds_len, rem, fmt, ap);
     va_end(ap);
 
-    if (len > rem)
+    if (len >= rem)
     {
         if (!arc_dstring_resize(dstr, dstr->ds_len + len + 1))
         {
@@ -12,18 +12,29 @@
 #include <sys/param.h>
 #include <sys/types.h>
 
+#include "arc-arena.h"
+#include "arc-malloc.h"
+
+/* strings up to this size (including the NUL) never leave the handle */
+#define ARC_DSTRING_SMALL 64
+
 /* struct arc_dstring -- a dynamically-sized string */
 struct arc_dstring
 {
-    int   ds_alloc;
-    int   ds_max;
-    int   ds_len;
-    char *ds_buf;
-    void *ds_ctx;
+    int                   ds_alloc;
+    int                   ds_max;
+    int                   ds_len;
+    int                   ds_hint;
+    char                 *ds_buf;
+    void                 *ds_ctx;
+    struct arc_allocator *ds_al;
+    struct arc_arena     *ds_arena;
     void (*ds_cb)(void *, const char *, ...);
+    char ds_small[ARC_DSTRING_SMALL];
 };
 
 extern void  arc_dstring_blank(struct arc_dstring *);
+extern void  arc_dstring_commit(struct arc_dstring *, size_t);
 extern bool  arc_dstring_cat(struct arc_dstring *, const char *);
 extern bool  arc_dstring_cat1(struct arc_dstring *, int);
 extern bool  arc_dstring_catn(struct arc_dstring *, const char *, size_t);
@@ -39,7 +50,11 @@ extern int   arc_dstring_len(struct arc_dstring *);
 extern struct arc_dstring *arc_dstring_new(int,
                                            int,
                                            void *,
-                                           void (*)(void *, const char *, ...));
+                                           void (*)(void *, const char *, ...),
+                                           struct arc_allocator *);
+extern struct arc_dstring *arc_dstring_new_arena(
+    struct arc_arena *, int, int, void *, void (*)(void *, const char *, ...));
+extern bool   arc_dstring_reserve(struct arc_dstring *, size_t);
 extern size_t arc_dstring_printf(struct arc_dstring *dstr, char *fmt, ...);
 extern void   arc_clobber_array(char **);
 extern void   arc_collapse(char *);
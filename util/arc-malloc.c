@@ -0,0 +1,341 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#include "build-config.h"
+
+/* system includes */
+#include <assert.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "arc-malloc.h"
+
+/* each block starts with its size, so frees can be accounted for; the
+ * union keeps what follows suitably aligned for anything */
+union arc_allochdr
+{
+    size_t      ah_size;
+    max_align_t ah_align;
+};
+
+/**
+ *  Adjust an allocator's live byte count and its peak.
+ *
+ *  Parameters:
+ *      al: allocator
+ *      add: bytes newly allocated
+ *      sub: bytes newly released
+ *
+ *  Returns:
+ *      Nothing.
+ */
+static void
+arc_allocator_account(struct arc_allocator *al, size_t add, size_t sub)
+{
+    size_t live;
+    size_t peak;
+
+    if (add < sub)
+    {
+        atomic_fetch_sub(&al->al_live, sub - add);
+        return;
+    }
+
+    live = atomic_fetch_add(&al->al_live, add - sub) + add - sub;
+    peak = atomic_load(&al->al_peak);
+    while (live > peak &&
+           !atomic_compare_exchange_weak(&al->al_peak, &peak, live))
+    {
+        continue;
+    }
+}
+
+/**
+ *  Set up an allocator that uses libc.
+ *
+ *  Parameters:
+ *      al: allocator to initialize
+ *
+ *  Returns:
+ *      Nothing.
+ */
+void
+arc_allocator_init(struct arc_allocator *al)
+{
+    assert(al != NULL);
+
+    memset(al, '\0', sizeof *al);
+    atomic_init(&al->al_live, 0);
+    atomic_init(&al->al_peak, 0);
+}
+
+/**
+ *  Tear down an allocator.
+ *
+ *  Parameters:
+ *      al: allocator, with nothing still allocated from it
+ *
+ *  Returns:
+ *      Nothing.
+ */
+void
+arc_allocator_destroy(struct arc_allocator *al)
+{
+    assert(al != NULL);
+
+    /* nothing to release; the counts are plain atomics */
+}
+
+/**
+ *  Report how much memory an allocator has handed out.
+ *
+ *  Parameters:
+ *      al: allocator
+ *      live: bytes currently allocated (returned, may be NULL)
+ *      peak: most bytes ever allocated at once (returned, may be NULL)
+ *
+ *  Returns:
+ *      Nothing.  Counts are of the sizes asked for, not including any
+ *      overhead.
+ */
+void
+arc_allocator_stats(struct arc_allocator *al, size_t *live, size_t *peak)
+{
+    assert(al != NULL);
+
+    if (live != NULL)
+    {
+        *live = atomic_load(&al->al_live);
+    }
+    if (peak != NULL)
+    {
+        *peak = atomic_load(&al->al_peak);
+    }
+}
+
+/**
+ *  Restart peak tracking.
+ *
+ *  Parameters:
+ *      al: allocator
+ *      peak: new peak; raised to the live byte count if it's lower
+ *
+ *  Returns:
+ *      Nothing.
+ */
+void
+arc_allocator_setpeak(struct arc_allocator *al, size_t peak)
+{
+    size_t live;
+
+    assert(al != NULL);
+
+    live = atomic_load(&al->al_live);
+    atomic_store(&al->al_peak, peak > live ? peak : live);
+}
+
+/**
+ *  Allocate memory.
+ *
+ *  Parameters:
+ *      al: allocator, or NULL for libc
+ *      size: number of bytes wanted
+ *
+ *  Returns:
+ *      A pointer to the memory, or NULL on allocation failure.  It must be
+ *      released with arc_allocator_free() on the same allocator.
+ */
+void *
+arc_allocator_malloc(struct arc_allocator *al, size_t size)
+{
+    union arc_allochdr *hdr;
+
+    if (al == NULL)
+    {
+        return malloc(size);
+    }
+
+    if (size > SIZE_MAX - sizeof *hdr)
+    {
+        return NULL;
+    }
+
+    if (al->al_malloc != NULL)
+    {
+        hdr = al->al_malloc(al->al_ctx, sizeof *hdr + size);
+    }
+    else
+    {
+        hdr = malloc(sizeof *hdr + size);
+    }
+    if (hdr == NULL)
+    {
+        return NULL;
+    }
+
+    hdr->ah_size = size;
+    arc_allocator_account(al, size, 0);
+
+    return hdr + 1;
+}
+
+/**
+ *  Allocate zeroed memory for an array.
+ *
+ *  Parameters:
+ *      al: allocator, or NULL for libc
+ *      nmemb: number of elements
+ *      size: size of each element
+ *
+ *  Returns:
+ *      A pointer to the memory, or NULL on allocation failure.
+ */
+void *
+arc_allocator_calloc(struct arc_allocator *al, size_t nmemb, size_t size)
+{
+    void *p;
+
+    if (al == NULL)
+    {
+        return calloc(nmemb, size);
+    }
+
+    if (size != 0 && nmemb > SIZE_MAX / size)
+    {
+        return NULL;
+    }
+
+    p = arc_allocator_malloc(al, nmemb * size);
+    if (p != NULL)
+    {
+        memset(p, '\0', nmemb * size);
+    }
+
+    return p;
+}
+
+/**
+ *  Resize memory.
+ *
+ *  Parameters:
+ *      al: allocator, or NULL for libc
+ *      p: memory from the same allocator, or NULL
+ *      size: number of bytes wanted
+ *
+ *  Returns:
+ *      A pointer to the memory, or NULL on allocation failure, in which
+ *      case "p" is untouched.
+ */
+void *
+arc_allocator_realloc(struct arc_allocator *al, void *p, size_t size)
+{
+    size_t              old;
+    union arc_allochdr *hdr;
+
+    if (al == NULL)
+    {
+        return realloc(p, size);
+    }
+
+    if (p == NULL)
+    {
+        return arc_allocator_malloc(al, size);
+    }
+
+    if (size > SIZE_MAX - sizeof *hdr)
+    {
+        return NULL;
+    }
+
+    hdr = (union arc_allochdr *) p - 1;
+    old = hdr->ah_size;
+
+    if (al->al_realloc != NULL)
+    {
+        hdr = al->al_realloc(al->al_ctx, hdr, sizeof *hdr + size);
+    }
+    else
+    {
+        hdr = realloc(hdr, sizeof *hdr + size);
+    }
+    if (hdr == NULL)
+    {
+        return NULL;
+    }
+
+    hdr->ah_size = size;
+    arc_allocator_account(al, size, old);
+
+    return hdr + 1;
+}
+
+/**
+ *  Copy a string.
+ *
+ *  Parameters:
+ *      al: allocator, or NULL for libc
+ *      str: string to copy
+ *
+ *  Returns:
+ *      A copy of "str", or NULL on allocation failure.
+ */
+char *
+arc_allocator_strdup(struct arc_allocator *al, const char *str)
+{
+    size_t len;
+    char  *p;
+
+    len = strlen(str) + 1;
+
+    p = arc_allocator_malloc(al, len);
+    if (p != NULL)
+    {
+        memcpy(p, str, len);
+    }
+
+    return p;
+}
+
+/**
+ *  Release memory.
+ *
+ *  Parameters:
+ *      al: allocator, or NULL for libc
+ *      p: memory from the same allocator, or NULL
+ *
+ *  Returns:
+ *      Nothing.
+ */
+void
+arc_allocator_free(struct arc_allocator *al, void *p)
+{
+    union arc_allochdr *hdr;
+
+    if (p == NULL)
+    {
+        return;
+    }
+
+    if (al == NULL)
+    {
+        free(p);
+        return;
+    }
+
+    hdr = (union arc_allochdr *) p - 1;
+    arc_allocator_account(al, 0, hdr->ah_size);
+
+    if (al->al_free != NULL)
+    {
+        al->al_free(al->al_ctx, hdr);
+    }
+    else
+    {
+        free(hdr);
+    }
+}
@@ -7,10 +7,47 @@
 #ifndef ARC_MALLOC_H
 #define ARC_MALLOC_H
 
-#define ARC_FREE    free
-#define ARC_MALLOC  malloc
-#define ARC_CALLOC  calloc
-#define ARC_REALLOC realloc
-#define ARC_STRDUP  strdup
+/* system includes */
+#include <stdatomic.h>
+#include <sys/types.h>
+
+#define ARC_FREE     free
+#define ARC_MALLOC   malloc
+#define ARC_CALLOC   calloc
+#define ARC_REALLOC  realloc
+#define ARC_STRDUP   strdup
+
+/* objects that live exactly as long as an arena; see arc-arena.h */
+#define ARC_AMALLOC  arc_arena_malloc
+#define ARC_ACALLOC  arc_arena_calloc
+#define ARC_ASTRNDUP arc_arena_strndup
+
+/* objects charged to an allocator; a NULL allocator means plain libc */
+#define ARC_LFREE    arc_allocator_free
+#define ARC_LMALLOC  arc_allocator_malloc
+#define ARC_LCALLOC  arc_allocator_calloc
+#define ARC_LREALLOC arc_allocator_realloc
+#define ARC_LSTRDUP  arc_allocator_strdup
+
+/* struct arc_allocator -- memory functions, and what they've handed out */
+struct arc_allocator
+{
+    void *(*al_malloc)(void *, size_t);
+    void *(*al_realloc)(void *, void *, size_t);
+    void (*al_free)(void *, void *);
+    void         *al_ctx;
+    atomic_size_t al_live;
+    atomic_size_t al_peak;
+};
+
+extern void  arc_allocator_init(struct arc_allocator *);
+extern void  arc_allocator_destroy(struct arc_allocator *);
+extern void  arc_allocator_stats(struct arc_allocator *, size_t *, size_t *);
+extern void  arc_allocator_setpeak(struct arc_allocator *, size_t);
+extern void *arc_allocator_malloc(struct arc_allocator *, size_t);
+extern void *arc_allocator_calloc(struct arc_allocator *, size_t, size_t);
+extern void *arc_allocator_realloc(struct arc_allocator *, void *, size_t);
+extern char *arc_allocator_strdup(struct arc_allocator *, const char *);
+extern void  arc_allocator_free(struct arc_allocator *, void *);
 
 #endif /* ARC_MALLOC_H */
@@ -0,0 +1,308 @@
+/* Copyright 2025 OpenARC contributors.
+ * See LICENSE.
+ */
+
+#include "build-config.h"
+
+/* system includes */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <time.h>
+
+#include "arc-arena.h"
+#include "arc-dstring.h"
+
+#define BENCH_BYTES (64 * 1024 * 1024)
+
+/* a body line of the sort relaxed canonicalization sees most of */
+static const char bench_line[] =
+    "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do\r\n";
+
+/**
+ *  Report elapsed time.
+ *
+ *  Parameters:
+ *      start: when the timed section began
+ *
+ *  Returns:
+ *      Seconds since "start".
+ */
+
+static double
+bench_elapsed(const struct timespec *start)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+ *  Split "total" bytes of body text into words, appending each word to a
+ *  dstring and emptying it at whitespace the way relaxed body
+ *  canonicalization uses "canon_buf".
+ *
+ *  Parameters:
+ *      buf: input data
+ *      buflen: bytes at "buf"
+ *      total: number of bytes to process
+ *      bulk: append each word with one arc_dstring_catn() instead of one
+ *            arc_dstring_cat1() per byte
+ *      sum: checksum of what was appended (returned)
+ *
+ *  Returns:
+ *      Elapsed time in seconds.
+ */
+
+static double
+bench_words(const char *buf,
+            size_t      buflen,
+            size_t      total,
+            bool        bulk,
+            size_t     *sum)
+{
+    size_t              done;
+    const char         *p;
+    const char         *q;
+    const char         *eob;
+    struct arc_dstring *dstr;
+    struct timespec     start;
+
+    dstr = arc_dstring_new(2048, 0, NULL, NULL, NULL);
+    *sum = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (done = 0; done < total; done += buflen)
+    {
+        eob = buf + buflen;
+        for (p = buf; p < eob; p++)
+        {
+            if (*p == ' ' || *p == '\r' || *p == '\n')
+            {
+                *sum += arc_dstring_len(dstr);
+                arc_dstring_blank(dstr);
+            }
+            else if (bulk)
+            {
+                for (q = p + 1; q < eob && *q != ' ' && *q != '\r'; q++)
+                {
+                    continue;
+                }
+                arc_dstring_catn(dstr, p, q - p);
+                p = q - 1;
+            }
+            else
+            {
+                arc_dstring_cat1(dstr, *p);
+            }
+        }
+    }
+    *sum += arc_dstring_len(dstr);
+    arc_dstring_free(dstr);
+
+    return bench_elapsed(&start);
+}
+
+/**
+ *  Copy "total" bytes of body text into a reused scratch dstring chunk by
+ *  chunk, as CRLF repair does.
+ *
+ *  Parameters:
+ *      buf: input data
+ *      buflen: bytes at "buf"
+ *      total: number of bytes to process
+ *      bulk: copy runs between line endings and reserve room up front
+ *            instead of appending one byte at a time
+ *      sum: checksum of what was appended (returned)
+ *
+ *  Returns:
+ *      Elapsed time in seconds.
+ */
+
+static double
+bench_copy(const char *buf,
+           size_t      buflen,
+           size_t      total,
+           bool        bulk,
+           size_t     *sum)
+{
+    size_t              done;
+    const char         *p;
+    const char         *q;
+    const char         *eob;
+    struct arc_dstring *dstr;
+    struct timespec     start;
+
+    dstr = arc_dstring_new(buflen, 0, NULL, NULL, NULL);
+    *sum = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (done = 0; done < total; done += buflen)
+    {
+        arc_dstring_blank(dstr);
+        eob = buf + buflen;
+        if (bulk)
+        {
+            arc_dstring_reserve(dstr, buflen);
+        }
+        for (p = buf; p < eob; p++)
+        {
+            if (!bulk || *p == '\r' || *p == '\n')
+            {
+                arc_dstring_cat1(dstr, *p);
+                continue;
+            }
+
+            for (q = p + 1; q < eob && *q != '\r' && *q != '\n'; q++)
+            {
+                continue;
+            }
+            arc_dstring_catn(dstr, p, q - p);
+            p = q - 1;
+        }
+        *sum += arc_dstring_len(dstr);
+    }
+    arc_dstring_free(dstr);
+
+    return bench_elapsed(&start);
+}
+
+/**
+ *  Create, fill and discard "count" short-lived strings, as the signing
+ *  code does for each header field it generates.
+ *
+ *  Parameters:
+ *      count: number of strings
+ *      arena: arena to allocate them from, or NULL for the heap
+ *      sum: checksum of the strings built (returned)
+ *
+ *  Returns:
+ *      Elapsed time in seconds.
+ */
+
+static double
+bench_temp(size_t count, struct arc_arena *arena, size_t *sum)
+{
+    size_t              c;
+    struct arc_dstring *dstr;
+    struct timespec     start;
+
+    *sum = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (c = 0; c < count; c++)
+    {
+        if (arena != NULL)
+        {
+            dstr = arc_dstring_new_arena(arena, 1024, 0, NULL, NULL);
+        }
+        else
+        {
+            dstr = arc_dstring_new(1024, 0, NULL, NULL, NULL);
+        }
+
+        /* a typical seal is a few hundred bytes */
+        arc_dstring_cat(dstr, "i=1; a=rsa-sha256; d=example.com; s=sel;");
+        arc_dstring_printf(dstr, " t=%zu; cv=none; b=", c);
+        while (arc_dstring_len(dstr) < 400)
+        {
+            arc_dstring_catn(dstr, bench_line, 32);
+        }
+        *sum += arc_dstring_len(dstr);
+
+        arc_dstring_free(dstr);
+
+        /* the arena is emptied with each message */
+        if (arena != NULL && c % 16 == 15)
+        {
+            arc_arena_reset(arena, 0);
+        }
+    }
+
+    return bench_elapsed(&start);
+}
+
+int
+main(int argc, char **argv)
+{
+    bool              mismatch = false;
+    size_t            c;
+    size_t            n;
+    size_t            total = BENCH_BYTES;
+    size_t            sum1;
+    size_t            sum2;
+    double            mb;
+    double            t1;
+    double            t2;
+    char             *p;
+    char             *progname;
+    char              buf[65536];
+    struct arc_arena *arena;
+    /* roughly: small milter body chunks, and the usual large ones */
+    static const size_t chunks[] = {1024, 65536};
+
+    progname = (p = strrchr(argv[0], '/')) == NULL ? argv[0] : p + 1;
+
+    if (argc > 2)
+    {
+        fprintf(stderr, "%s: usage: %s [megabytes]\n", progname, progname);
+        return EX_USAGE;
+    }
+    else if (argc == 2)
+    {
+        total = strtoul(argv[1], NULL, 10) * 1024 * 1024;
+        if (total == 0)
+        {
+            fprintf(stderr, "%s: invalid size \"%s\"\n", progname, argv[1]);
+            return EX_USAGE;
+        }
+    }
+
+    for (c = 0; c < sizeof buf; c++)
+    {
+        buf[c] = bench_line[c % (sizeof bench_line - 1)];
+    }
+
+    printf("%-14s %8s %12s %12s\n", "pattern", "chunk", "bytewise", "bulk");
+
+    for (c = 0; c < sizeof chunks / sizeof chunks[0]; c++)
+    {
+        n = total - (total % chunks[c]);
+        mb = (double) n / (1024 * 1024);
+
+        t1 = bench_words(buf, chunks[c], n, false, &sum1);
+        t2 = bench_words(buf, chunks[c], n, true, &sum2);
+        mismatch |= sum1 != sum2;
+        printf("%-14s %8zu %9.1f MB/s %7.1f MB/s\n", "relaxed words",
+               chunks[c], mb / t1, mb / t2);
+
+        t1 = bench_copy(buf, chunks[c], n, false, &sum1);
+        t2 = bench_copy(buf, chunks[c], n, true, &sum2);
+        mismatch |= sum1 != sum2;
+        printf("%-14s %8zu %9.1f MB/s %7.1f MB/s\n", "CRLF copy", chunks[c],
+               mb / t1, mb / t2);
+    }
+
+    n = total / 1024;
+    arena = arc_arena_new(16384, NULL);
+    t1 = bench_temp(n, NULL, &sum1);
+    t2 = bench_temp(n, arena, &sum2);
+    mismatch |= sum1 != sum2;
+    arc_arena_free(arena);
+
+    printf("\n%-14s %8s %12s %12s\n", "pattern", "count", "heap", "arena");
+    printf("%-14s %8zu %9.0f ns %10.0f ns\n", "temp string", n, t1 * 1e9 / n,
+           t2 * 1e9 / n);
+
+    if (mismatch)
+    {
+        fprintf(stderr, "%s: output mismatch\n", progname);
+        return EX_SOFTWARE;
+    }
+
+    return EX_OK;
+}